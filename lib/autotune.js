@@ -0,0 +1,166 @@
+var fs = require('fs')
+  , path = require('path')
+  , async = require('async')
+  , spawn = require('child_process').spawn;
+
+/**
+ * likelihood used to tune each implementation: the ode one is the
+ * likelihood maximized by simplex (one particle is enough, the
+ * integration is deterministic), the ekf one is the likelihood of
+ * kalman, ksimplex and kmcmc.
+ */
+var targets = {
+  ode: {exec: 'smc', args: ['ode', '--n_parts', '1'], steppers: ['rkf45', 'rkck', 'rk8pd', 'rk4imp', 'bsimp', 'msbdf', 'auto']},
+  ekf: {exec: 'kalman', args: ['sde'], steppers: ['rkf45', 'rkck', 'rk8pd']} //no jacobian for the covariance system: explicit steppers only
+};
+
+/**
+ * tight tolerances used to compute the reference likelihood
+ */
+var reference = {stepper: 'rk8pd', eps_abs_integ: 1e-10, eps_rel_integ: 1e-10};
+
+/**
+ * candidate tolerances (from the loosest to the tightest)
+ */
+var tolerances = [
+  {eps_abs_integ: 1e-4, eps_rel_integ: 1e-2},
+  {eps_abs_integ: 1e-5, eps_rel_integ: 1e-3},
+  {eps_abs_integ: 1e-6, eps_rel_integ: 1e-4},
+  {eps_abs_integ: 1e-7, eps_rel_integ: 1e-5},
+  {eps_abs_integ: 1e-8, eps_rel_integ: 1e-6}
+];
+
+
+/**
+ * run the likelihood once with the integration settings conf and
+ * callback(err, log_likelihood, wall time in ms)
+ */
+function run(pathModel, dpkg, target, conf, callback){
+
+  var args = target.args.concat([
+    '--stepper', conf.stepper,
+    '--eps_abs_integ', String(conf.eps_abs_integ),
+    '--eps_rel_integ', String(conf.eps_rel_integ)
+  ]);
+
+  var start = process.hrtime();
+  var prog = spawn(path.join(pathModel, target.exec), args, {cwd: pathModel});
+
+  var out = '';
+  prog.stdout.setEncoding('utf8');
+  prog.stdout.on('data', function(data){ out += data; });
+
+  prog.on('error', function(err){
+    prog.removeAllListeners('exit');
+    callback(err);
+  });
+
+  prog.on('exit', function(code){
+    var elapsed = process.hrtime(start);
+    if(code !== 0){
+      return callback(new Error(target.exec + ' exited with code ' + code));
+    }
+
+    try {
+      var summary = JSON.parse(out).resources.filter(function(x){return x.name === 'summary'})[0];
+    } catch(e){
+      return callback(e);
+    }
+
+    var logLike = summary && summary.data.log_likelihood;
+    if(typeof logLike !== 'number' || !isFinite(logLike)){
+      return callback(new Error('no finite log likelihood'));
+    }
+
+    callback(null, logLike, elapsed[0]*1e3 + elapsed[1]/1e6);
+  });
+
+  prog.stdin.end(JSON.stringify(dpkg));
+};
+
+
+/**
+ * For each implementation, time the likelihood over the matrix of
+ * steppers x tolerances and keep the fastest settings whose log
+ * likelihood is within opts.tolerance of the reference one. The
+ * result is written in pathModel/.autotune.json where the compiled
+ * programs read their default integration settings from.
+ */
+module.exports = function(pathModel, dpkg, opts, emitter, callback){
+
+  var pathTune = path.join(pathModel, '.autotune.json');
+  var tuned = {};
+
+  async.eachSeries(Object.keys(targets), function(impl, cb){
+    var target = targets[impl];
+
+    run(pathModel, dpkg, target, reference, function(err, refLogLike){
+      if(err){
+        emitter.emit('log', impl + ': reference likelihood could not be computed, skipping (' + err.message + ')');
+        return cb(null);
+      }
+
+      var confs = [];
+      target.steppers.forEach(function(stepper){
+        tolerances.forEach(function(tol){
+          confs.push({stepper: stepper, eps_abs_integ: tol.eps_abs_integ, eps_rel_integ: tol.eps_rel_integ});
+        });
+      });
+
+      var best = null;
+      async.eachSeries(confs, function(conf, cb2){
+
+        var times = [];
+        var logLike;
+        var repeats = [];
+        for(var i=0; i<opts.repeat; i++) repeats.push(i);
+
+        async.eachSeries(repeats, function(i, cb3){
+          run(pathModel, dpkg, target, conf, function(err, ll, time){
+            if(err) return cb3(err);
+            logLike = ll;
+            times.push(time);
+            cb3(null);
+          });
+        }, function(err){
+          if(err){
+            emitter.emit('log', impl + ': ' + JSON.stringify(conf) + ' failed (' + err.message + ')');
+            return cb2(null);
+          }
+
+          var time = Math.min.apply(Math, times);
+          var error = Math.abs(logLike - refLogLike);
+          emitter.emit('log', impl + ': ' + JSON.stringify(conf) + ' ' + time.toFixed(1) + ' ms, |error| ' + error.toPrecision(3));
+
+          if(error <= opts.tolerance && (!best || time < best.time)){
+            best = {conf: conf, time: time};
+          }
+          cb2(null);
+        });
+
+      }, function(err){
+        if(best){
+          tuned[impl] = best.conf;
+          emitter.emit('log', impl + ': selected ' + JSON.stringify(best.conf));
+        } else {
+          emitter.emit('log', impl + ': no setting met the accuracy target, keeping the defaults');
+        }
+        cb(null);
+      });
+
+    });
+
+  }, function(err){
+    if(err) return callback(err);
+
+    if(!Object.keys(tuned).length){
+      return callback(new Error('the model could not be tuned'));
+    }
+
+    fs.writeFile(pathTune, JSON.stringify(tuned, null, 2), function(err){
+      if(err) return callback(err);
+      callback(null, tuned);
+    });
+  });
+
+};
@@ -83,7 +83,8 @@ class Builder(Data, Ccoder):
         step_ode_sde = self.step_ode_sde()
         jac = self.jac(step_ode_sde['sf'])
 
-        self.render('ode_sde', {'is_diff': is_diff, 'step':step_ode_sde, 'orders': orders})
+        is_cov = True if len(self.par_forced) > 0 else False
+        self.render('ode_sde', {'is_diff': is_diff, 'is_cov': is_cov, 'step':step_ode_sde, 'batch': self.step_ode_batch(step_ode_sde), 'batch_sde': self.step_sde_batch(step_ode_sde), 'sde': self.sde_diffusion(step_ode_sde), 'orders': orders})
 
         parameters = self.parameters()
         parameters['orders'] = orders
@@ -97,26 +98,37 @@ class Builder(Data, Ccoder):
 
         self.render('iterator', {'iterators':self.iterators()})
 
+        step_psr = self.step_psr()
+        step_psr_inc = self.step_psr_inc()
         psr = {
             'orders': orders,
             'alloc': self.alloc_psr(),
             'is_diff': is_diff,
+            'is_cov': is_cov,
             'white_noise': self.white_noise,
-            'step': self.step_psr(),
-            'step_inc': self.step_psr_inc(),
+            'step': step_psr,
+            'step_inc': step_psr_inc,
+            'batch': self.step_psr_batch(step_psr, step_psr_inc),
             'psr_multinomial': self.step_psr_multinomial()
         }
         self.render('psr', psr)
 
-        self.render('diff', {'diff': self.compute_diff(), 'orders': orders})
+        gillespie = self.gillespie()
+        gillespie['orders'] = orders
+        gillespie['is_diff'] = is_diff
+        self.render('gillespie', gillespie)
 
-        self.render('Q', {'Q': self.eval_Q(), 'is_diff': is_diff, 'orders': orders})
+        diff = self.compute_diff()
+        self.render('diff', {'diff': diff, 'batch': self.compute_diff_batch(diff), 'orders': orders})
+
+        Q = self.eval_Q()
+        self.render('Q', {'Q': Q, 'is_diff': is_diff, 'orders': orders})
 
         self.render('Ht', {'Ht': self.Ht(), 'is_diff': is_diff, 'orders': orders})
 
         self.render('jac', {'jac': jac, 'is_diff': is_diff, 'orders': orders})
 
-        self.render('step_ekf', {'is_diff': is_diff, 'step': step_ode_sde, 'orders': orders})
+        self.render('step_ekf', {'is_diff': is_diff, 'step': step_ode_sde, 'sparsity': self.ekf_sparsity(jac, Q), 'orders': orders})
 
         self.render('check_ic', parameters)
 
@@ -0,0 +1,765 @@
+/**************************************************************************
+ *    This file is part of ssm.
+ *
+ *    ssm is free software: you can redistribute it and/or modify it
+ *    under the terms of the GNU General Public License as published
+ *    by the Free Software Foundation, either version 3 of the
+ *    License, or (at your option) any later version.
+ *
+ *    ssm is distributed in the hope that it will be useful, but
+ *    WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public
+ *    License along with ssm.  If not, see
+ *    <http://www.gnu.org/licenses/>.
+ *************************************************************************/
+
+#include "ssm.h"
+
+/**
+ * The broker owns a pool of workers and dispatches to it the
+ * particles of several servers (smc, pmcmc, mif, simul run with
+ * --broker). Protocol:
+ *
+ * control (ROUTER, servers use a REQ socket):
+ *   JOB <hash> <manifest> <parameters> <data> <wopts> -> OK
+ *   BYE -> OK
+ *
+ * frontend (ROUTER, servers use a DEALER socket with the same identity):
+ *   <particle> from the servers, <results> to the servers (frames
+ *   as in the tcp mode of ssm_workers_start())
+ *
+ * backend (ROUTER, workers use a DEALER socket):
+ *   from the workers: READY | HEARTBEAT | LOADED <hash> | MISMATCH [<hash>] | DONE <server> <results>
+ *   to the workers:   JOB <manifest> <parameters> <data> <wopts> | WORK <server> <particle> | KILL
+ *
+ * Fair share: an available worker is given a particle of the server
+ * having the fewest particles in flight. A worker only switches job
+ * (and receives the data of another server) once it is idle. The
+ * jobs a worker refused (MISMATCH: compiled for another model) are
+ * not offered to it again, a worker that refused all the registered
+ * jobs is removed from the pool.
+ *
+ * Idle workers send a HEARTBEAT every SSM_BROKER_HEARTBEAT ms. A
+ * worker silent for SSM_BROKER_LIVENESS heartbeats is lost: the
+ * particles it holds (the broker keeps a copy of them) are put back
+ * at the head of the queues of their servers. A lost worker rejoins
+ * the pool as soon as it sends anything (it was only slow: the
+ * results of the particles that have been resent are dropped) or
+ * READY (restart).
+ */
+
+static ssm_broker_msg_t *_ssm_broker_msg_recv(void *socket)
+{
+    int i, length = 0;
+    zmq_msg_t parts[SSM_BROKER_MAX_PARTS];
+
+    do {
+        if(length == SSM_BROKER_MAX_PARTS){
+            ssm_print_err("too many parts in the message received by the broker");
+            exit(EXIT_FAILURE);
+        }
+        zmq_msg_init(&parts[length]);
+        zmq_msg_recv(&parts[length], socket, 0);
+        length++;
+    } while (zmq_msg_more(&parts[length-1]));
+
+    ssm_broker_msg_t *msg = malloc(sizeof (ssm_broker_msg_t));
+    if(msg == NULL){
+        ssm_print_err("allocation impossible for ssm_broker_msg_t");
+        exit(EXIT_FAILURE);
+    }
+
+    msg->length = length;
+    msg->master = NULL;
+    msg->next = NULL;
+    msg->parts = malloc(length * sizeof (zmq_msg_t));
+    if(msg->parts == NULL){
+        ssm_print_err("allocation impossible for zmq_msg_t");
+        exit(EXIT_FAILURE);
+    }
+
+    for(i=0; i<length; i++){
+        zmq_msg_init(&msg->parts[i]);
+        zmq_msg_move(&msg->parts[i], &parts[i]);
+        zmq_msg_close(&parts[i]);
+    }
+
+    return msg;
+}
+
+/**
+ * send (and free) the message
+ */
+static void _ssm_broker_msg_send(void *socket, ssm_broker_msg_t *msg)
+{
+    int i;
+    for(i=0; i<msg->length; i++){
+        zmq_msg_send(&msg->parts[i], socket, (i < msg->length-1) ? ZMQ_SNDMORE: 0);
+        zmq_msg_close(&msg->parts[i]);
+    }
+
+    free(msg->parts);
+    free(msg->master);
+    free(msg);
+}
+
+static void _ssm_broker_msg_free(ssm_broker_msg_t *msg)
+{
+    int i;
+    for(i=0; i<msg->length; i++){
+        zmq_msg_close(&msg->parts[i]);
+    }
+
+    free(msg->parts);
+    free(msg->master);
+    free(msg);
+}
+
+/**
+ * copy of a particle sent to a worker (the parts share their content)
+ */
+static ssm_broker_msg_t *_ssm_broker_msg_copy(ssm_broker_msg_t *msg, const char *master)
+{
+    int i;
+
+    ssm_broker_msg_t *copy = malloc(sizeof (ssm_broker_msg_t));
+    if(copy == NULL){
+        ssm_print_err("allocation impossible for ssm_broker_msg_t");
+        exit(EXIT_FAILURE);
+    }
+
+    copy->length = msg->length;
+    copy->next = NULL;
+    copy->master = strdup(master);
+    copy->parts = malloc(msg->length * sizeof (zmq_msg_t));
+    if(copy->parts == NULL){
+        ssm_print_err("allocation impossible for zmq_msg_t");
+        exit(EXIT_FAILURE);
+    }
+
+    for(i=0; i<msg->length; i++){
+        zmq_msg_init(&copy->parts[i]);
+        zmq_msg_copy(&copy->parts[i], &msg->parts[i]);
+    }
+
+    return copy;
+}
+
+/**
+ * monotonic time in ms
+ */
+static int64_t _ssm_broker_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (int64_t) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static void _ssm_broker_log(ssm_broker_t *broker, char *msg)
+{
+    if(broker->flag_log){
+        ssm_print_log(msg);
+    }
+}
+
+static void _ssm_send_identity(void *socket, const char *identity)
+{
+    zmq_send(socket, identity, strlen(identity), ZMQ_SNDMORE);
+}
+
+
+static void _ssm_broker_master_free(ssm_broker_master_t *master)
+{
+    while(master->head){
+        ssm_broker_msg_t *next = master->head->next;
+        _ssm_broker_msg_free(master->head);
+        master->head = next;
+    }
+
+    free(master->identity);
+    free(master->str_manifest);
+    free(master->str_parameters);
+    free(master->str_data);
+    free(master);
+}
+
+static void _ssm_broker_worker_free(ssm_broker_worker_t *worker)
+{
+    while(worker->head){
+        ssm_broker_msg_t *next = worker->head->next;
+        _ssm_broker_msg_free(worker->head);
+        worker->head = next;
+    }
+
+    free(worker->refused);
+    free(worker->identity);
+    free(worker);
+}
+
+static int _ssm_broker_refused(ssm_broker_worker_t *worker, const char *hash)
+{
+    int i;
+    for(i=0; i<worker->refused_length; i++){
+        if(strcmp(worker->refused[i], hash) == 0){
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+static int _ssm_broker_master_index(ssm_broker_t *broker, const char *identity)
+{
+    int i;
+    for(i=0; i<broker->masters_length; i++){
+        if(strcmp(broker->masters[i]->identity, identity) == 0){
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+static ssm_broker_worker_t *_ssm_broker_worker_get(ssm_broker_t *broker, char *identity)
+{
+    int i;
+    char str[SSM_STR_BUFFSIZE];
+
+    for(i=0; i<broker->workers_length; i++){
+        if(strcmp(broker->workers[i]->identity, identity) == 0){
+            free(identity);
+            return broker->workers[i];
+        }
+    }
+
+    ssm_broker_worker_t *worker = malloc(sizeof (ssm_broker_worker_t));
+    if(worker == NULL){
+        ssm_print_err("allocation impossible for ssm_broker_worker_t");
+        exit(EXIT_FAILURE);
+    }
+    worker->identity = identity;
+    strncpy(worker->hash, "", SSM_HASH_BUFFSIZE);
+    worker->credit = 0;
+    worker->in_flight = 0;
+    worker->flag_loading = 0;
+    worker->refused_length = 0;
+    worker->refused = NULL;
+    worker->flag_lost = 0;
+    worker->orphans = 0;
+    worker->expiry = 0;
+    worker->head = NULL;
+    worker->tail = NULL;
+
+    broker->workers = realloc(broker->workers, (broker->workers_length+1) * sizeof (ssm_broker_worker_t *));
+    if(broker->workers == NULL){
+        ssm_print_err("allocation impossible for ssm_broker_worker_t *");
+        exit(EXIT_FAILURE);
+    }
+    broker->workers[broker->workers_length++] = worker;
+
+    snprintf(str, SSM_STR_BUFFSIZE, "worker %s joined the pool (%d workers)", worker->identity, broker->workers_length);
+    _ssm_broker_log(broker, str);
+
+    return worker;
+}
+
+
+ssm_broker_t *ssm_broker_new(ssm_options_t *opts)
+{
+    char str[SSM_STR_BUFFSIZE];
+
+    ssm_broker_t *broker = malloc(sizeof (ssm_broker_t));
+    if(broker == NULL){
+        ssm_print_err("allocation impossible for ssm_broker_t");
+        exit(EXIT_FAILURE);
+    }
+
+    broker->context = zmq_ctx_new();
+
+    broker->frontend = zmq_socket(broker->context, ZMQ_ROUTER);
+    snprintf(str, SSM_STR_BUFFSIZE, "tcp://*:%d", SSM_BROKER_PORT_FRONTEND);
+    zmq_bind(broker->frontend, str);
+
+    broker->control = zmq_socket(broker->context, ZMQ_ROUTER);
+    snprintf(str, SSM_STR_BUFFSIZE, "tcp://*:%d", SSM_BROKER_PORT_CONTROL);
+    zmq_bind(broker->control, str);
+
+    broker->backend = zmq_socket(broker->context, ZMQ_ROUTER);
+    snprintf(str, SSM_STR_BUFFSIZE, "tcp://*:%d", SSM_BROKER_PORT_BACKEND);
+    zmq_bind(broker->backend, str);
+
+    broker->masters_length = 0;
+    broker->masters = NULL;
+    broker->workers_length = 0;
+    broker->workers = NULL;
+
+    broker->flag_log = (opts->print & SSM_PRINT_LOG);
+
+    return broker;
+}
+
+
+void ssm_broker_free(ssm_broker_t *broker)
+{
+    int i;
+
+    for(i=0; i<broker->workers_length; i++){
+        _ssm_send_identity(broker->backend, broker->workers[i]->identity);
+        ssm_zmq_send_str(broker->backend, "KILL", 0);
+        _ssm_broker_worker_free(broker->workers[i]);
+    }
+    free(broker->workers);
+
+    for(i=0; i<broker->masters_length; i++){
+        _ssm_broker_master_free(broker->masters[i]);
+    }
+    free(broker->masters);
+
+    zmq_close(broker->frontend);
+    zmq_close(broker->control);
+    zmq_close(broker->backend);
+    zmq_ctx_destroy(broker->context);
+
+    free(broker);
+}
+
+
+/**
+ * remove an idle worker from the pool
+ */
+static void _ssm_broker_worker_remove(ssm_broker_t *broker, ssm_broker_worker_t *worker)
+{
+    int i, j;
+    for(i=0; i<broker->workers_length; i++){
+        if(broker->workers[i] == worker){
+            _ssm_broker_worker_free(worker);
+            for(j=i; j<broker->workers_length-1; j++){
+                broker->workers[j] = broker->workers[j+1];
+            }
+            broker->workers_length--;
+            return;
+        }
+    }
+}
+
+
+/**
+ * registration (JOB) and unregistration (BYE) of the servers
+ */
+static void _ssm_broker_control(ssm_broker_t *broker)
+{
+    int index;
+    char str[SSM_STR_BUFFSIZE];
+
+    char *identity = ssm_zmq_recv_str(broker->control);
+    char *empty = ssm_zmq_recv_str(broker->control);
+    char *cmd = ssm_zmq_recv_str(broker->control);
+    free(empty);
+
+    if(!identity || !cmd){ //context terminated
+        free(identity);
+        free(cmd);
+        return;
+    }
+
+    index = _ssm_broker_master_index(broker, identity);
+
+    if(strcmp(cmd, "JOB") == 0) {
+        ssm_broker_master_t *master = malloc(sizeof (ssm_broker_master_t));
+        if(master == NULL){
+            ssm_print_err("allocation impossible for ssm_broker_master_t");
+            exit(EXIT_FAILURE);
+        }
+
+        char *hash = ssm_zmq_recv_str(broker->control);
+        master->identity = strdup(identity);
+        master->str_manifest = ssm_zmq_recv_str(broker->control);
+        master->str_parameters = ssm_zmq_recv_str(broker->control);
+        master->str_data = ssm_zmq_recv_str(broker->control);
+        zmq_recv(broker->control, &master->wopts, sizeof (int), 0);
+
+        master->head = NULL;
+        master->tail = NULL;
+
+        if(!hash || !master->str_manifest || !master->str_parameters || !master->str_data){
+            ssm_print_warning("invalid job sent by a server: rejected");
+            free(hash);
+            _ssm_broker_master_free(master);
+            _ssm_send_identity(broker->control, identity);
+            zmq_send(broker->control, "", 0, ZMQ_SNDMORE);
+            ssm_zmq_send_str(broker->control, "ERR", 0);
+            free(identity);
+            free(cmd);
+            return;
+        }
+
+        strncpy(master->hash, hash, SSM_HASH_BUFFSIZE);
+        master->hash[SSM_HASH_BUFFSIZE-1] = '\0';
+        free(hash);
+
+        master->queued = 0;
+        master->in_flight = 0;
+
+        if(index == -1){
+            broker->masters = realloc(broker->masters, (broker->masters_length+1) * sizeof (ssm_broker_master_t *));
+            if(broker->masters == NULL){
+                ssm_print_err("allocation impossible for ssm_broker_master_t *");
+                exit(EXIT_FAILURE);
+            }
+            broker->masters[broker->masters_length++] = master;
+        } else {
+            _ssm_broker_master_free(broker->masters[index]);
+            broker->masters[index] = master;
+        }
+
+        snprintf(str, SSM_STR_BUFFSIZE, "server %s registered job %s (%d servers)", master->identity, master->hash, broker->masters_length);
+        _ssm_broker_log(broker, str);
+
+    } else if(strcmp(cmd, "BYE") == 0) {
+        if(index != -1){
+            int i;
+            _ssm_broker_master_free(broker->masters[index]);
+            for(i=index; i<broker->masters_length-1; i++){
+                broker->masters[i] = broker->masters[i+1];
+            }
+            broker->masters_length--;
+        }
+
+        snprintf(str, SSM_STR_BUFFSIZE, "server %s left (%d servers)", identity, broker->masters_length);
+        _ssm_broker_log(broker, str);
+    }
+
+    _ssm_send_identity(broker->control, identity);
+    zmq_send(broker->control, "", 0, ZMQ_SNDMORE);
+    ssm_zmq_send_str(broker->control, "OK", 0);
+
+    free(identity);
+    free(cmd);
+}
+
+
+/**
+ * queue the particles sent by the servers
+ */
+static void _ssm_broker_frontend(ssm_broker_t *broker)
+{
+    char *identity = ssm_zmq_recv_str(broker->frontend);
+    if(!identity){ //context terminated
+        return;
+    }
+    ssm_broker_msg_t *msg = _ssm_broker_msg_recv(broker->frontend);
+
+    int index = _ssm_broker_master_index(broker, identity);
+    if(index == -1){
+        if(broker->flag_log){
+            ssm_print_warning("particle received from an unregistered server");
+        }
+        _ssm_broker_msg_free(msg);
+    } else {
+        ssm_broker_master_t *master = broker->masters[index];
+        if(master->tail){
+            master->tail->next = msg;
+        } else {
+            master->head = msg;
+        }
+        master->tail = msg;
+        master->queued++;
+    }
+
+    free(identity);
+}
+
+
+/**
+ * messages from the workers of the pool
+ */
+static void _ssm_broker_backend(ssm_broker_t *broker)
+{
+    char str[SSM_STR_BUFFSIZE];
+    char *identity = ssm_zmq_recv_str(broker->backend);
+    char *cmd = ssm_zmq_recv_str(broker->backend);
+    if(!identity || !cmd){ //context terminated
+        free(identity);
+        free(cmd);
+        return;
+    }
+    ssm_broker_worker_t *worker = _ssm_broker_worker_get(broker, identity);
+
+    worker->expiry = _ssm_broker_now() + SSM_BROKER_HEARTBEAT * SSM_BROKER_LIVENESS;
+
+    if(worker->flag_lost && strcmp(cmd, "READY") != 0){ //only slow (e.g. a long integration): its job is still loaded
+        worker->flag_lost = 0;
+        snprintf(str, SSM_STR_BUFFSIZE, "worker %s is back in the pool", worker->identity);
+        _ssm_broker_log(broker, str);
+    }
+
+    if(strcmp(cmd, "READY") == 0) {
+        if(worker->flag_lost){ //restarted: nothing loaded, nothing held
+            worker->flag_lost = 0;
+            worker->credit = 0;
+            worker->orphans = 0;
+            worker->flag_loading = 0;
+            strncpy(worker->hash, "", SSM_HASH_BUFFSIZE);
+            snprintf(str, SSM_STR_BUFFSIZE, "worker %s rejoined the pool", worker->identity);
+            _ssm_broker_log(broker, str);
+        }
+        worker->credit++;
+
+    } else if(strcmp(cmd, "HEARTBEAT") == 0) {
+        //only refreshes the expiry
+
+    } else if(strncmp(cmd, "LOADED ", 7) == 0) {
+        strncpy(worker->hash, cmd + 7, SSM_HASH_BUFFSIZE);
+        worker->hash[SSM_HASH_BUFFSIZE-1] = '\0';
+        worker->flag_loading = 0;
+
+    } else if(strncmp(cmd, "MISMATCH", 8) == 0) { //the hash is the one of the job sent (the worker may not have been able to read it)
+        int i;
+        char hash[SSM_HASH_BUFFSIZE];
+        strncpy(hash, worker->hash, SSM_HASH_BUFFSIZE);
+        worker->flag_loading = 0;
+        strncpy(worker->hash, "", SSM_HASH_BUFFSIZE); //the previous job has been freed
+
+        if(!_ssm_broker_refused(worker, hash)){
+            worker->refused = realloc(worker->refused, (worker->refused_length+1) * sizeof (char [SSM_HASH_BUFFSIZE]));
+            if(worker->refused == NULL){
+                ssm_print_err("allocation impossible for the refused jobs of a worker");
+                exit(EXIT_FAILURE);
+            }
+            strncpy(worker->refused[worker->refused_length], hash, SSM_HASH_BUFFSIZE);
+            worker->refused[worker->refused_length][SSM_HASH_BUFFSIZE-1] = '\0';
+            worker->refused_length++;
+        }
+
+        for(i=0; i<broker->masters_length && _ssm_broker_refused(worker, broker->masters[i]->hash); i++);
+        if(broker->masters_length && i == broker->masters_length){ //can't run any of the registered jobs
+            snprintf(str, SSM_STR_BUFFSIZE, "worker %s could not load any of the registered jobs and has been removed from the pool", worker->identity);
+            ssm_print_warning(str);
+            _ssm_send_identity(broker->backend, worker->identity);
+            ssm_zmq_send_str(broker->backend, "KILL", 0);
+            _ssm_broker_worker_remove(broker, worker);
+        } else {
+            snprintf(str, SSM_STR_BUFFSIZE, "worker %s could not load job %s, it will only be offered the other jobs", worker->identity, hash);
+            _ssm_broker_log(broker, str);
+        }
+
+    } else if(strcmp(cmd, "DONE") == 0) {
+        char *identity = ssm_zmq_recv_str(broker->backend);
+        if(!identity){ //context terminated
+            free(cmd);
+            return;
+        }
+        ssm_broker_msg_t *msg = _ssm_broker_msg_recv(broker->backend);
+
+        int index = _ssm_broker_master_index(broker, identity);
+
+        if(worker->orphans){ //the particle has already been sent to another worker (the workers integrate their particles in order)
+            worker->orphans--;
+            worker->credit++;
+            _ssm_broker_msg_free(msg);
+            free(identity);
+            free(cmd);
+            return;
+        }
+
+        ssm_broker_msg_t *held = worker->head; //the workers integrate their particles in order
+        worker->head = held->next;
+        if(!worker->head){
+            worker->tail = NULL;
+        }
+        _ssm_broker_msg_free(held);
+
+        worker->credit++;
+        worker->in_flight--;
+
+        if(index == -1){ //the server left
+            _ssm_broker_msg_free(msg);
+        } else {
+            broker->masters[index]->in_flight--;
+            _ssm_send_identity(broker->frontend, identity);
+            _ssm_broker_msg_send(broker->frontend, msg);
+        }
+        free(identity);
+    }
+
+    free(cmd);
+}
+
+
+/**
+ * server the particles of which should be given to worker (NULL if
+ * none): the one with the fewest particles in flight. An idle worker
+ * can switch job (except to the jobs it refused), a busy one only
+ * serves its current job.
+ */
+static ssm_broker_master_t *_ssm_broker_next_master(ssm_broker_t *broker, ssm_broker_worker_t *worker)
+{
+    int i, same, best_same = 0;
+    ssm_broker_master_t *best = NULL;
+
+    for(i=0; i<broker->masters_length; i++){
+        ssm_broker_master_t *master = broker->masters[i];
+        if(!master->queued){
+            continue;
+        }
+
+        same = (strcmp(master->hash, worker->hash) == 0);
+        if(!same && (worker->in_flight || _ssm_broker_refused(worker, master->hash))){
+            continue;
+        }
+
+        if(!best || (master->in_flight < best->in_flight) || (master->in_flight == best->in_flight && same && !best_same)){
+            best = master;
+            best_same = same;
+        }
+    }
+
+    return best;
+}
+
+static void _ssm_broker_schedule(ssm_broker_t *broker)
+{
+    int i, dispatched;
+
+    do {
+        dispatched = 0;
+
+        for(i=0; i<broker->workers_length; i++){
+            ssm_broker_worker_t *worker = broker->workers[i];
+            if(worker->flag_lost || worker->flag_loading || !worker->credit){
+                continue;
+            }
+
+            ssm_broker_master_t *master = _ssm_broker_next_master(broker, worker);
+            if(!master){
+                continue;
+            }
+
+            if(strcmp(master->hash, worker->hash) != 0){
+                _ssm_send_identity(broker->backend, worker->identity);
+                ssm_zmq_send_str(broker->backend, "JOB", ZMQ_SNDMORE);
+                ssm_zmq_send_str(broker->backend, master->str_manifest, ZMQ_SNDMORE);
+                ssm_zmq_send_str(broker->backend, master->str_parameters, ZMQ_SNDMORE);
+                ssm_zmq_send_str(broker->backend, master->str_data, ZMQ_SNDMORE);
+                zmq_send(broker->backend, &master->wopts, sizeof (int), 0);
+                strncpy(worker->hash, master->hash, SSM_HASH_BUFFSIZE); //confirmed by LOADED
+                worker->flag_loading = 1;
+                continue;
+            }
+
+            ssm_broker_msg_t *msg = master->head;
+            master->head = msg->next;
+            if(!master->head){
+                master->tail = NULL;
+            }
+            master->queued--;
+            master->in_flight++;
+            worker->credit--;
+            worker->in_flight++;
+
+            ssm_broker_msg_t *held = _ssm_broker_msg_copy(msg, master->identity);
+            if(worker->tail){
+                worker->tail->next = held;
+            } else {
+                worker->head = held;
+            }
+            worker->tail = held;
+
+            _ssm_send_identity(broker->backend, worker->identity);
+            ssm_zmq_send_str(broker->backend, "WORK", ZMQ_SNDMORE);
+            ssm_zmq_send_str(broker->backend, master->identity, ZMQ_SNDMORE);
+            _ssm_broker_msg_send(broker->backend, msg);
+
+            dispatched = 1;
+        }
+    } while (dispatched);
+}
+
+
+/**
+ * put the particles held by the workers silent for too long back at
+ * the head of the queues of their servers
+ */
+static void _ssm_broker_purge(ssm_broker_t *broker)
+{
+    int i;
+    char str[SSM_STR_BUFFSIZE];
+    int64_t now = _ssm_broker_now();
+
+    for(i=0; i<broker->workers_length; i++){
+        ssm_broker_worker_t *worker = broker->workers[i];
+        if(worker->flag_lost || now < worker->expiry){
+            continue;
+        }
+
+        snprintf(str, SSM_STR_BUFFSIZE, "worker %s is lost, %d particle(s) resent", worker->identity, worker->in_flight);
+        if(worker->in_flight){
+            ssm_print_warning(str);
+        } else {
+            _ssm_broker_log(broker, str);
+        }
+
+        while(worker->head){
+            ssm_broker_msg_t *msg = worker->head;
+            worker->head = msg->next;
+
+            int index = _ssm_broker_master_index(broker, msg->master);
+            if(index == -1){ //the server left
+                _ssm_broker_msg_free(msg);
+                continue;
+            }
+
+            ssm_broker_master_t *master = broker->masters[index];
+            free(msg->master);
+            msg->master = NULL;
+            msg->next = master->head;
+            master->head = msg;
+            if(!master->tail){
+                master->tail = msg;
+            }
+            master->queued++;
+            master->in_flight--;
+        }
+
+        worker->tail = NULL;
+        worker->orphans += worker->in_flight;
+        worker->in_flight = 0;
+        worker->flag_lost = 1;
+    }
+}
+
+
+/**
+ * serve until interrupted
+ */
+void ssm_broker_run(ssm_broker_t *broker)
+{
+    zmq_pollitem_t items [] = {
+        { broker->control, 0, ZMQ_POLLIN, 0 },
+        { broker->frontend, 0, ZMQ_POLLIN, 0 },
+        { broker->backend, 0, ZMQ_POLLIN, 0 }
+    };
+
+    while (1) {
+        if(zmq_poll (items, 3, SSM_BROKER_HEARTBEAT) == -1){
+            break; //interrupted
+        }
+
+        if (items [0].revents & ZMQ_POLLIN) {
+            _ssm_broker_control(broker);
+        }
+        if (items [1].revents & ZMQ_POLLIN) {
+            _ssm_broker_frontend(broker);
+        }
+        if (items [2].revents & ZMQ_POLLIN) {
+            _ssm_broker_backend(broker);
+        }
+
+        _ssm_broker_purge(broker);
+        _ssm_broker_schedule(broker);
+    }
+}
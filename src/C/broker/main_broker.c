@@ -0,0 +1,33 @@
+/**************************************************************************
+ *    This file is part of ssm.
+ *
+ *    ssm is free software: you can redistribute it and/or modify it
+ *    under the terms of the GNU General Public License as published
+ *    by the Free Software Foundation, either version 3 of the
+ *    License, or (at your option) any later version.
+ *
+ *    ssm is distributed in the hope that it will be useful, but
+ *    WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public
+ *    License along with ssm.  If not, see
+ *    <http://www.gnu.org/licenses/>.
+ *************************************************************************/
+
+#include "ssm.h"
+
+int main(int argc, char *argv[])
+{
+    ssm_options_t *opts = ssm_options_new();
+    ssm_options_load(opts, SSM_BROKER, argc, argv);
+
+    ssm_broker_t *broker = ssm_broker_new(opts);
+    ssm_broker_run(broker);
+    ssm_broker_free(broker);
+
+    ssm_options_free(opts);
+
+    return 0;
+}
@@ -0,0 +1,61 @@
+/**************************************************************************
+ *    This file is part of ssm.
+ *
+ *    ssm is free software: you can redistribute it and/or modify it
+ *    under the terms of the GNU General Public License as published
+ *    by the Free Software Foundation, either version 3 of the
+ *    License, or (at your option) any later version.
+ *
+ *    ssm is distributed in the hope that it will be useful, but
+ *    WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public
+ *    License along with ssm.  If not, see
+ *    <http://www.gnu.org/licenses/>.
+ *************************************************************************/
+
+#include "ssm.h"
+
+/**
+ * Allocate a zeroed block holding size_ptr bytes of row pointers
+ * followed by size_data bytes of values. The values start on a
+ * SSM_ALLOC_ALIGN boundary (*data). Blocks larger than
+ * SSM_ALLOC_HUGE are aligned on a huge page and, where the kernel
+ * supports it, backed by transparent huge pages (less TLB misses when
+ * iterating over long time series).
+ *
+ * The whole block is freed with ssm_arena_free().
+ */
+void *ssm_arena_new(size_t size_ptr, size_t size_data, void **data)
+{
+    void *block;
+    size_t offset = (size_ptr + SSM_ALLOC_ALIGN - 1) & ~((size_t) SSM_ALLOC_ALIGN - 1);
+    size_t size = offset + size_data;
+    size_t align = (size >= SSM_ALLOC_HUGE) ? SSM_ALLOC_HUGE : SSM_ALLOC_ALIGN;
+
+    if(posix_memalign(&block, align, (size) ? size : 1) != 0){
+        char str[SSM_STR_BUFFSIZE];
+        sprintf(str, "Allocation impossible in file :%s line : %d",__FILE__,__LINE__);
+        ssm_print_err(str);
+        exit(EXIT_FAILURE);
+    }
+
+#ifdef MADV_HUGEPAGE
+    if(align == SSM_ALLOC_HUGE){
+        madvise(block, size, MADV_HUGEPAGE); //only an advice: failure is harmless
+    }
+#endif
+
+    memset(block, 0, size);
+    *data = (char *) block + offset;
+
+    return block;
+}
+
+
+void ssm_arena_free(void *block)
+{
+    free(block);
+}
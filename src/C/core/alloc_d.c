@@ -18,6 +18,12 @@
 
 #include "ssm.h"
 
+/**
+ * The multi-dimensional arrays are allocated in a single block (see
+ * alloc.c): the row pointers are views on contiguous values. The
+ * size of the dimensions passed to the _free functions are only kept
+ * for source compatibility.
+ */
 
 double *ssm_d1_new(int n)
 {
@@ -41,118 +47,83 @@ double *ssm_d1_new(int n)
 double **ssm_d2_new(int n, int p)
 {
     int i;
-    double **tab = malloc(n* sizeof (double *));
-
-    if(tab==NULL)
-    {
-        char str[SSM_STR_BUFFSIZE];
-        sprintf(str, "Allocation impossible in file :%s line : %d",__FILE__,__LINE__);
-        ssm_print_err(str);
-        exit(EXIT_FAILURE);
-    }
+    double *data;
+    double **tab = ssm_arena_new(n * sizeof (double *), (size_t) n * p * sizeof (double), (void **) &data);
 
     for(i=0;i<n;i++)
-        tab[i] = ssm_d1_new(p);
+        tab[i] = data + (size_t) i*p;
 
     return tab;
 }
 
 void ssm_d2_free(double **tab, int n)
 {
-    int i;
-    for(i=0; i<n; i++)
-        free(tab[i]);
-
-    free(tab);
+    ssm_arena_free(tab);
 }
 
 
 double ***ssm_d3_new(int n, int p1, int p2)
 {
-    int i;
-    double ***tab = malloc(n* sizeof (double **));
+    int i, j;
+    double *data;
+    double ***tab = ssm_arena_new(n * sizeof (double **) + (size_t) n * p1 * sizeof (double *), (size_t) n * p1 * p2 * sizeof (double), (void **) &data);
+    double **rows = (double **) (tab + n);
 
-    if(tab==NULL)
-    {
-        char str[SSM_STR_BUFFSIZE];
-        sprintf(str, "Allocation impossible in file :%s line : %d",__FILE__,__LINE__);
-        ssm_print_err(str);
-        exit(EXIT_FAILURE);
+    for(i=0;i<n;i++) {
+        tab[i] = rows + (size_t) i*p1;
+        for(j=0;j<p1;j++)
+            tab[i][j] = data + ((size_t) i*p1 + j)*p2;
     }
 
-    for(i=0;i<n;i++)
-        tab[i] = ssm_d2_new(p1, p2);
-
     return tab;
 }
 
 
 void ssm_d3_free(double ***tab, int n, int p1)
 {
-    int i, j;
-
-    for(i=0; i<n; i++)
-        for(j=0; j<p1; j++)
-            free(tab[i][j]);
-
-    for(i=0; i<n; i++)
-        free(tab[i]);
-    free(tab);
+    ssm_arena_free(tab);
 }
 
 double ****ssm_d4_new(int n, int p1, int p2, int p3)
 {
-    int i;
-    double ****tab = malloc(n* sizeof (double ***));
-
-    if(tab==NULL)
-    {
-        char str[SSM_STR_BUFFSIZE];
-        sprintf(str, "Allocation impossible in file :%s line : %d",__FILE__,__LINE__);
-        ssm_print_err(str);
-        exit(EXIT_FAILURE);
+    int i, j, k;
+    double *data;
+    double ****tab = ssm_arena_new(n * sizeof (double ***) + (size_t) n * p1 * sizeof (double **) + (size_t) n * p1 * p2 * sizeof (double *), (size_t) n * p1 * p2 * p3 * sizeof (double), (void **) &data);
+    double ***rows1 = (double ***) (tab + n);
+    double **rows2 = (double **) (rows1 + (size_t) n*p1);
+
+    for(i=0;i<n;i++) {
+        tab[i] = rows1 + (size_t) i*p1;
+        for(j=0;j<p1;j++) {
+            tab[i][j] = rows2 + ((size_t) i*p1 + j)*p2;
+            for(k=0;k<p2;k++)
+                tab[i][j][k] = data + (((size_t) i*p1 + j)*p2 + k)*p3;
+        }
     }
 
-    for(i=0;i<n;i++)
-        tab[i] = ssm_d3_new(p1, p2, p3);
-
     return tab;
 }
 
 void ssm_d4_free(double ****tab, int n, int p1, int p2)
 {
-    int i, j, k;
-
-    for(i=0; i<n; i++)
-        for(j=0; j<p1; j++)
-            for(k=0; k<p2; k++)
-                free(tab[i][j][k]);
-
-    for(i=0; i<n; i++)
-        for(j=0; j<p1; j++)
-            free(tab[i][j]);
-
-    for(i=0; i<n; i++)
-        free(tab[i]);
-
-    free(tab);
+    ssm_arena_free(tab);
 }
 
 double **ssm_d2_var_new(int n, unsigned int *p)
 {
     int i;
-
-    double **tab=malloc(n* sizeof (double *));
-    if(tab==NULL)
-    {
-        char str[SSM_STR_BUFFSIZE];
-        sprintf(str, "Allocation impossible in file :%s line : %d",__FILE__,__LINE__);
-        ssm_print_err(str);
-        exit(EXIT_FAILURE);
-    }
+    size_t size = 0;
+    double *data;
 
     for(i=0;i<n;i++)
-        tab[i] = ssm_d1_new(p[i]);
+        size += p[i];
+
+    double **tab = ssm_arena_new(n * sizeof (double *), size * sizeof (double), (void **) &data);
+
+    for(i=0;i<n;i++) {
+        tab[i] = data;
+        data += p[i];
+    }
 
     return tab;
 }
@@ -160,19 +131,27 @@ double **ssm_d2_var_new(int n, unsigned int *p)
 
 double ***ssm_d3_var_new(int n, unsigned int *p1, unsigned int **p2)
 {
-    int i;
+    int i, j;
+    size_t size_rows = 0, size = 0;
+    double *data;
 
-    double ***tab = malloc(n* sizeof (double **));
-    if(tab==NULL)
-    {
-        char str[SSM_STR_BUFFSIZE];
-        sprintf(str, "Allocation impossible in file :%s line : %d",__FILE__,__LINE__);
-        ssm_print_err(str);
-        exit(EXIT_FAILURE);
+    for(i=0;i<n;i++) {
+        size_rows += p1[i];
+        for(j=0;j<p1[i];j++)
+            size += p2[i][j];
     }
 
-    for(i=0;i<n;i++)
-        tab[i]= ssm_d2_var_new(p1[i], p2[i]);
+    double ***tab = ssm_arena_new(n * sizeof (double **) + size_rows * sizeof (double *), size * sizeof (double), (void **) &data);
+    double **rows = (double **) (tab + n);
+
+    for(i=0;i<n;i++) {
+        tab[i] = rows;
+        rows += p1[i];
+        for(j=0;j<p1[i];j++) {
+            tab[i][j] = data;
+            data += p2[i][j];
+        }
+    }
 
     return tab;
 }
@@ -180,80 +159,54 @@ double ***ssm_d3_var_new(int n, unsigned int *p1, unsigned int **p2)
 
 void ssm_d3_var_free(double ***tab, int n, unsigned int *p1)
 {
-    int i, j;
-
-    for(i=0; i<n; i++)
-        for(j=0; j<p1[i]; j++)
-            free(tab[i][j]);
-
-    for(i=0; i<n; i++)
-        free(tab[i]);
-
-    free(tab);
+    ssm_arena_free(tab);
 }
 
 
 double ***ssm_d3_varp1_new(int n, unsigned int *p1, int p2)
 {
-    int i,j;
-
-    double ***tab = malloc(n* sizeof (double **));
-    if(tab==NULL)
-    {
-        char str[SSM_STR_BUFFSIZE];
-        sprintf(str, "Allocation impossible in file :%s line : %d",__FILE__,__LINE__);
-        ssm_print_err(str);
-        exit(EXIT_FAILURE);
-    }
+    int i, j;
+    size_t size_rows = 0;
+    double *data;
 
     for(i=0;i<n;i++)
-    {
-        tab[i]= malloc(p1[i]* sizeof (double *));
-        if(tab[i]==NULL)
-        {
-            char str[SSM_STR_BUFFSIZE];
-            sprintf(str, "Allocation impossible in file :%s line : %d",__FILE__,__LINE__);
-            ssm_print_err(str);
-            exit(EXIT_FAILURE);
+        size_rows += p1[i];
+
+    double ***tab = ssm_arena_new(n * sizeof (double **) + size_rows * sizeof (double *), size_rows * p2 * sizeof (double), (void **) &data);
+    double **rows = (double **) (tab + n);
+
+    for(i=0;i<n;i++) {
+        tab[i] = rows;
+        rows += p1[i];
+        for(j=0;j<p1[i];j++) {
+            tab[i][j] = data;
+            data += p2;
         }
     }
 
-    for(i=0;i<n;i++)
-        for(j=0;j<p1[i];j++)
-            tab[i][j]= ssm_d1_new(p2);
-
     return tab;
 }
 
 
 double ***ssm_d3_varp2_new(int n, unsigned int p1, unsigned int *p2)
 {
-    int i,j;
-
-    double ***tab = malloc(n* sizeof (double **));
-    if(tab==NULL)
-    {
-        char str[SSM_STR_BUFFSIZE];
-        sprintf(str, "Allocation impossible in file :%s line : %d",__FILE__,__LINE__);
-        ssm_print_err(str);
-        exit(EXIT_FAILURE);
-    }
+    int i, j;
+    size_t size = 0;
+    double *data;
 
     for(i=0;i<n;i++)
-    {
-        tab[i] = malloc(p1* sizeof (double *));
-        if(tab[i]==NULL)
-        {
-            char str[SSM_STR_BUFFSIZE];
-            sprintf(str, "Allocation impossible in file :%s line : %d",__FILE__,__LINE__);
-            ssm_print_err(str);
-            exit(EXIT_FAILURE);
+        size += (size_t) p1 * p2[i];
+
+    double ***tab = ssm_arena_new(n * sizeof (double **) + (size_t) n * p1 * sizeof (double *), size * sizeof (double), (void **) &data);
+    double **rows = (double **) (tab + n);
+
+    for(i=0;i<n;i++) {
+        tab[i] = rows + (size_t) i*p1;
+        for(j=0;j<p1;j++) {
+            tab[i][j] = data;
+            data += p2[i];
         }
     }
 
-    for(i=0;i<n;i++)
-        for(j=0;j<p1;j++)
-            tab[i][j]= ssm_d1_new(p2[i]);
-
     return tab;
 }
@@ -18,6 +18,13 @@
 
 #include "ssm.h"
 
+/**
+ * The multi-dimensional arrays are allocated in a single block (see
+ * alloc.c): the row pointers are views on contiguous values. The
+ * size of the dimensions passed to the _free functions are only kept
+ * for source compatibility.
+ */
+
 unsigned int *ssm_u1_new(int n)
 {
     int i;
@@ -40,116 +47,83 @@ unsigned int *ssm_u1_new(int n)
 unsigned int **ssm_u2_new(int n, int p)
 {
     int i;
-    unsigned int **tab = malloc(n* sizeof (unsigned int *));
-
-    if(tab==NULL)
-    {
-        char str[SSM_STR_BUFFSIZE];
-        sprintf(str, "Allocation impossible in file :%s line : %d",__FILE__,__LINE__);
-        ssm_print_err(str);
-        exit(EXIT_FAILURE);
-    }
+    unsigned int *data;
+    unsigned int **tab = ssm_arena_new(n * sizeof (unsigned int *), (size_t) n * p * sizeof (unsigned int), (void **) &data);
 
     for(i=0;i<n;i++)
-        tab[i] = ssm_u1_new(p);
+        tab[i] = data + (size_t) i*p;
 
     return tab;
 }
 
 void ssm_u2_free(unsigned int **tab, int n)
 {
-    int i;
-    for(i=0; i<n; i++)
-        free(tab[i]);
-
-    free(tab);
+    ssm_arena_free(tab);
 }
 
+
 unsigned int ***ssm_u3_new(int n, int p1, int p2)
 {
-    int i;
-    unsigned int ***tab = malloc(n* sizeof (unsigned int **));
+    int i, j;
+    unsigned int *data;
+    unsigned int ***tab = ssm_arena_new(n * sizeof (unsigned int **) + (size_t) n * p1 * sizeof (unsigned int *), (size_t) n * p1 * p2 * sizeof (unsigned int), (void **) &data);
+    unsigned int **rows = (unsigned int **) (tab + n);
 
-    if(tab==NULL)
-    {
-        char str[SSM_STR_BUFFSIZE];
-        sprintf(str, "Allocation impossible in file :%s line : %d",__FILE__,__LINE__);
-        ssm_print_err(str);
-        exit(EXIT_FAILURE);
+    for(i=0;i<n;i++) {
+        tab[i] = rows + (size_t) i*p1;
+        for(j=0;j<p1;j++)
+            tab[i][j] = data + ((size_t) i*p1 + j)*p2;
     }
 
-    for(i=0;i<n;i++)
-        tab[i] = ssm_u2_new(p1, p2);
-
     return tab;
 }
 
+
 void ssm_u3_free(unsigned int ***tab, int n, int p1)
 {
-    int i, j;
-
-    for(i=0; i<n; i++)
-        for(j=0; j<p1; j++)
-            free(tab[i][j]);
-
-    for(i=0; i<n; i++)
-        free(tab[i]);
-    free(tab);
+    ssm_arena_free(tab);
 }
 
 unsigned int ****ssm_u4_new(int n, int p1, int p2, int p3)
 {
-    int i;
-    unsigned int ****tab = malloc(n* sizeof (unsigned int ***));
-
-    if(tab==NULL)
-    {
-        char str[SSM_STR_BUFFSIZE];
-        sprintf(str, "Allocation impossible in file :%s line : %d",__FILE__,__LINE__);
-        ssm_print_err(str);
-        exit(EXIT_FAILURE);
+    int i, j, k;
+    unsigned int *data;
+    unsigned int ****tab = ssm_arena_new(n * sizeof (unsigned int ***) + (size_t) n * p1 * sizeof (unsigned int **) + (size_t) n * p1 * p2 * sizeof (unsigned int *), (size_t) n * p1 * p2 * p3 * sizeof (unsigned int), (void **) &data);
+    unsigned int ***rows1 = (unsigned int ***) (tab + n);
+    unsigned int **rows2 = (unsigned int **) (rows1 + (size_t) n*p1);
+
+    for(i=0;i<n;i++) {
+        tab[i] = rows1 + (size_t) i*p1;
+        for(j=0;j<p1;j++) {
+            tab[i][j] = rows2 + ((size_t) i*p1 + j)*p2;
+            for(k=0;k<p2;k++)
+                tab[i][j][k] = data + (((size_t) i*p1 + j)*p2 + k)*p3;
+        }
     }
 
-    for(i=0;i<n;i++)
-        tab[i] = ssm_u3_new(p1, p2, p3);
-
     return tab;
 }
 
 void ssm_u4_free(unsigned int ****tab, int n, int p1, int p2)
 {
-    int i, j, k;
-
-    for(i=0; i<n; i++)
-        for(j=0; j<p1; j++)
-            for(k=0; k<p2; k++)
-                free(tab[i][j][k]);
-
-    for(i=0; i<n; i++)
-        for(j=0; j<p1; j++)
-            free(tab[i][j]);
-
-    for(i=0; i<n; i++)
-        free(tab[i]);
-
-    free(tab);
+    ssm_arena_free(tab);
 }
 
 unsigned int **ssm_u2_var_new(int n, unsigned int *p)
 {
     int i;
-
-    unsigned int **tab=malloc(n* sizeof (unsigned int *));
-    if(tab==NULL)
-    {
-        char str[SSM_STR_BUFFSIZE];
-        sprintf(str, "Allocation impossible in file :%s line : %d",__FILE__,__LINE__);
-        ssm_print_err(str);
-        exit(EXIT_FAILURE);
-    }
+    size_t size = 0;
+    unsigned int *data;
 
     for(i=0;i<n;i++)
-        tab[i] = ssm_u1_new(p[i]);
+        size += p[i];
+
+    unsigned int **tab = ssm_arena_new(n * sizeof (unsigned int *), size * sizeof (unsigned int), (void **) &data);
+
+    for(i=0;i<n;i++) {
+        tab[i] = data;
+        data += p[i];
+    }
 
     return tab;
 }
@@ -157,19 +131,27 @@ unsigned int **ssm_u2_var_new(int n, unsigned int *p)
 
 unsigned int ***ssm_u3_var_new(int n, unsigned int *p1, unsigned int **p2)
 {
-    int i;
+    int i, j;
+    size_t size_rows = 0, size = 0;
+    unsigned int *data;
 
-    unsigned int ***tab = malloc(n* sizeof (unsigned int **));
-    if(tab==NULL)
-    {
-        char str[SSM_STR_BUFFSIZE];
-        sprintf(str, "Allocation impossible in file :%s line : %d",__FILE__,__LINE__);
-        ssm_print_err(str);
-        exit(EXIT_FAILURE);
+    for(i=0;i<n;i++) {
+        size_rows += p1[i];
+        for(j=0;j<p1[i];j++)
+            size += p2[i][j];
     }
 
-    for(i=0;i<n;i++)
-        tab[i]= ssm_u2_var_new(p1[i], p2[i]);
+    unsigned int ***tab = ssm_arena_new(n * sizeof (unsigned int **) + size_rows * sizeof (unsigned int *), size * sizeof (unsigned int), (void **) &data);
+    unsigned int **rows = (unsigned int **) (tab + n);
+
+    for(i=0;i<n;i++) {
+        tab[i] = rows;
+        rows += p1[i];
+        for(j=0;j<p1[i];j++) {
+            tab[i][j] = data;
+            data += p2[i][j];
+        }
+    }
 
     return tab;
 }
@@ -177,80 +159,54 @@ unsigned int ***ssm_u3_var_new(int n, unsigned int *p1, unsigned int **p2)
 
 void ssm_u3_var_free(unsigned int ***tab, int n, unsigned int *p1)
 {
-    int i, j;
-
-    for(i=0; i<n; i++)
-        for(j=0; j<p1[i]; j++)
-            free(tab[i][j]);
-
-    for(i=0; i<n; i++)
-        free(tab[i]);
-
-    free(tab);
+    ssm_arena_free(tab);
 }
 
 
 unsigned int ***ssm_u3_varp1_new(int n, unsigned int *p1, int p2)
 {
-    int i,j;
-
-    unsigned int ***tab = malloc(n* sizeof (unsigned int **));
-    if(tab==NULL)
-    {
-        char str[SSM_STR_BUFFSIZE];
-        sprintf(str, "Allocation impossible in file :%s line : %d",__FILE__,__LINE__);
-        ssm_print_err(str);
-        exit(EXIT_FAILURE);
-    }
+    int i, j;
+    size_t size_rows = 0;
+    unsigned int *data;
 
     for(i=0;i<n;i++)
-    {
-        tab[i]= malloc(p1[i]* sizeof (unsigned int *));
-        if(tab[i]==NULL)
-        {
-            char str[SSM_STR_BUFFSIZE];
-            sprintf(str, "Allocation impossible in file :%s line : %d",__FILE__,__LINE__);
-            ssm_print_err(str);
-            exit(EXIT_FAILURE);
+        size_rows += p1[i];
+
+    unsigned int ***tab = ssm_arena_new(n * sizeof (unsigned int **) + size_rows * sizeof (unsigned int *), size_rows * p2 * sizeof (unsigned int), (void **) &data);
+    unsigned int **rows = (unsigned int **) (tab + n);
+
+    for(i=0;i<n;i++) {
+        tab[i] = rows;
+        rows += p1[i];
+        for(j=0;j<p1[i];j++) {
+            tab[i][j] = data;
+            data += p2;
         }
     }
 
-    for(i=0;i<n;i++)
-        for(j=0;j<p1[i];j++)
-            tab[i][j]= ssm_u1_new(p2);
-
     return tab;
 }
 
 
 unsigned int ***ssm_u3_varp2_new(int n, unsigned int p1, unsigned int *p2)
 {
-    int i,j;
-
-    unsigned int ***tab = malloc(n* sizeof (unsigned int **));
-    if(tab==NULL)
-    {
-        char str[SSM_STR_BUFFSIZE];
-        sprintf(str, "Allocation impossible in file :%s line : %d",__FILE__,__LINE__);
-        ssm_print_err(str);
-        exit(EXIT_FAILURE);
-    }
+    int i, j;
+    size_t size = 0;
+    unsigned int *data;
 
     for(i=0;i<n;i++)
-    {
-        tab[i] = malloc(p1* sizeof (unsigned int *));
-        if(tab[i]==NULL)
-        {
-            char str[SSM_STR_BUFFSIZE];
-            sprintf(str, "Allocation impossible in file :%s line : %d",__FILE__,__LINE__);
-            ssm_print_err(str);
-            exit(EXIT_FAILURE);
+        size += (size_t) p1 * p2[i];
+
+    unsigned int ***tab = ssm_arena_new(n * sizeof (unsigned int **) + (size_t) n * p1 * sizeof (unsigned int *), size * sizeof (unsigned int), (void **) &data);
+    unsigned int **rows = (unsigned int **) (tab + n);
+
+    for(i=0;i<n;i++) {
+        tab[i] = rows + (size_t) i*p1;
+        for(j=0;j<p1;j++) {
+            tab[i][j] = data;
+            data += p2[i];
         }
     }
 
-    for(i=0;i<n;i++)
-        for(j=0;j<p1;j++)
-            tab[i][j]= ssm_u1_new(p2[i]);
-
     return tab;
 }
@@ -19,18 +19,22 @@
 #include "ssm.h"
 
 /**
- * compute the log of the prob of the proposal
+ * compute the log of the prob of the proposal. proposal is NULL for
+ * iid gaussians. For a symmetric multivariate normal proposal the
+ * gaussian density is omitted (it cancels out in the Metropolis
+ * Hastings ratio): only the change of variable terms are computed.
  */
-ssm_err_code_t ssm_log_prob_proposal(double *log_proposal, ssm_theta_t *proposed, ssm_theta_t *theta, ssm_var_t *var, double sd_fac, ssm_nav_t *nav, int is_mvn)
+ssm_err_code_t ssm_log_prob_proposal(double *log_proposal, ssm_theta_t *proposed, ssm_theta_t *theta, ssm_var_t *var, double sd_fac, ssm_nav_t *nav, ssm_proposal_t *proposal)
 {
 
     int i;
     ssm_parameter_t *p;
     double p_tmp =0.0;
     double lp = 0.0;
+    int is_mvn = (proposal != NULL);
 
     if (is_mvn) {
-        p_tmp = ssm_dmvnorm(proposed->size, proposed, theta, var, sd_fac);
+        p_tmp = (proposal->flag_symmetric) ? 1.0 : exp(ssm_proposal_log_dmvnorm(proposal, proposed, theta, sd_fac));
     }
 
     for(i=0; i<nav->theta_all->length; i++) {
@@ -129,13 +133,13 @@ ssm_err_code_t ssm_log_prob_prior(double *log_prior, ssm_theta_t *theta, ssm_nav
  * return accepted (SSM_SUCCESS) or rejected (SSM_MH_REJECTED) or
  * combination of prob errors and assign fitness->log_prior
  */
-ssm_err_code_t ssm_metropolis_hastings(ssm_fitness_t *fitness, double *alpha, ssm_theta_t *proposed, ssm_theta_t *theta, gsl_matrix *var, double sd_fac , ssm_nav_t *nav, ssm_calc_t *calc, int is_mvn)
+ssm_err_code_t ssm_metropolis_hastings(ssm_fitness_t *fitness, double *alpha, ssm_theta_t *proposed, ssm_theta_t *theta, gsl_matrix *var, double sd_fac , ssm_nav_t *nav, ssm_calc_t *calc, ssm_proposal_t *proposal)
 {
     double ran;
     ssm_err_code_t success = SSM_SUCCESS;
     double lproposal, lproposal_prev, lprior_prev;
-    success |= ssm_log_prob_proposal(&lproposal,          proposed, theta,    var, sd_fac, nav,  is_mvn); /* q{ theta* | theta(i-1) }*/
-    success |= ssm_log_prob_proposal(&lproposal_prev,     theta,    proposed, var, sd_fac, nav, is_mvn);  /* q{ theta(i-1) | theta* }*/
+    success |= ssm_log_prob_proposal(&lproposal,          proposed, theta,    var, sd_fac, nav, proposal); /* q{ theta* | theta(i-1) }*/
+    success |= ssm_log_prob_proposal(&lproposal_prev,     theta,    proposed, var, sd_fac, nav, proposal); /* q{ theta(i-1) | theta* }*/
     success |= ssm_log_prob_prior   (&fitness->log_prior, proposed,                        nav, fitness); /* p{theta*} */
     success |= ssm_log_prob_prior   (&lprior_prev,        theta,                           nav, fitness); /* p{theta(i-1)} */
 
@@ -178,7 +182,10 @@ ssm_var_t *ssm_adapt_eps_var_sd_fac(double *sd_fac, ssm_adapt_t *a, ssm_var_t *v
     // evaluate tuning factor sd_fac = epsilon * 2.38/sqrt(n_to_be_estimated)
     *sd_fac = a->eps * 2.38/sqrt(nav->theta_all->length);
 
-    return ((m * a->ar) >= a->m_switch) ? a->var_sampling: var;
+    ssm_var_t *var_used = ((m * a->ar) >= a->m_switch) ? a->var_sampling: var;
+    ssm_proposal_set(a->proposal, var_used); //no factorization if var_used is unchanged
+
+    return var_used;
 }
 
 
@@ -196,12 +203,16 @@ void ssm_adapt_ar(ssm_adapt_t *a, int is_accepted, int m)
 
 
 
-void ssm_theta_ran(ssm_theta_t *proposed, ssm_theta_t *theta, ssm_var_t *var, double sd_fac, ssm_calc_t *calc, ssm_nav_t *nav, int is_mvn)
+/**
+ * proposal is NULL for iid gaussians, otherwise it must have been set
+ * to var (see ssm_adapt_eps_var_sd_fac())
+ */
+void ssm_theta_ran(ssm_theta_t *proposed, ssm_theta_t *theta, ssm_var_t *var, double sd_fac, ssm_calc_t *calc, ssm_nav_t *nav, ssm_proposal_t *proposal)
 {
     int i;
 
-    if(is_mvn){
-        ssm_rmvnorm(calc->randgsl, nav->theta_all->length, theta, var, sd_fac, proposed);
+    if(proposal){
+        ssm_proposal_rmvnorm(calc->randgsl, proposal, theta, sd_fac, proposed);
     } else { //iid gaussians
         for (i=0; i< nav->theta_all->length ; i++) {
             gsl_vector_set(proposed, i, gsl_vector_get(theta, i) + gsl_ran_gaussian(calc->randgsl, sd_fac*sqrt(gsl_matrix_get(var, i, i))));
@@ -30,6 +30,13 @@ ssm_par_t *ssm_par_new(ssm_input_t *input, ssm_calc_t *calc, ssm_nav_t *nav)
 {
     ssm_it_parameters_t *it = nav->par_all;
     ssm_par_t *par = gsl_vector_calloc(it->length);
+
+    //with --shm the values are read by the forked workers: point to shared memory (the block is still freed by gsl_vector_free)
+    if(ssm_shm_active()){
+        par->data = ssm_shm_malloc(it->length * sizeof (double));
+        gsl_vector_set_zero(par);
+    }
+
     ssm_input2par(par, input, calc, nav);
 
     return par;
@@ -177,6 +184,8 @@ ssm_nav_t *ssm_nav_new(json_t *jparameters, ssm_options_t *opts)
     nav->implementation = opts->implementation;
     nav->noises_off = opts->noises_off;
     nav->print = opts->print;
+    nav->adapt_dt = opts->adapt_dt;
+    nav->scheme = opts->scheme;
 
     nav->parameters = _ssm_parameters_new(&nav->parameters_length);
     nav->states = _ssm_states_new(&nav->states_length, nav->parameters);
@@ -764,19 +773,79 @@ ssm_calc_t *ssm_calc_new(json_t *jdata, ssm_nav_t *nav, ssm_data_t *data, ssm_fi
     /* implementations */
     /*******************/
     int dim = _ssm_dim_X(nav);
+    calc->_batch = NULL;
+    calc->gillespie = NULL;
+    calc->_dw = NULL;
+    calc->_dw_zero = NULL;
+    calc->_X_adapt = NULL;
+    calc->_sde_ws = NULL;
+
+    if (nav->implementation == SSM_ODE || nav->implementation == SSM_EKF || nav->implementation == SSM_UKF){
+
+        //the UKF only integrates the states (of each sigma point), not the covariance
+        int dim_sys = (nav->implementation == SSM_UKF) ? nav->states_sv_inc->length + nav->states_diff->length : dim;
 
-    if (nav->implementation == SSM_ODE || nav->implementation == SSM_EKF){
+        int is_implicit;
+        calc->T = ssm_str_to_stepper_type(opts->stepper, &is_implicit);
 
-        calc->T = gsl_odeiv2_step_rkf45;
-        calc->control = gsl_odeiv2_control_y_new(opts->eps_abs, opts->eps_rel);
-        calc->step = gsl_odeiv2_step_alloc(calc->T, dim);
-        calc->evolve = gsl_odeiv2_evolve_alloc(dim);
-        (calc->sys).function =  (nav->implementation == SSM_ODE) ? &ssm_step_ode: &ssm_step_ekf;
-        (calc->sys).jacobian = NULL;
-        (calc->sys).dimension= dim;
+        //the jacobian is only generated for the states
+        if(is_implicit && nav->implementation != SSM_ODE){
+            if(nav->print & SSM_PRINT_WARNING){
+                ssm_print_warning("implicit steppers can only be used with the ode implementation. rkf45 will be used instead.");
+            }
+            calc->T = gsl_odeiv2_step_rkf45;
+        }
+
+        if(nav->implementation == SSM_ODE){
+            (calc->sys).function = &ssm_step_ode;
+            (calc->sys).jacobian = &ssm_jac_ode;
+        } else if(nav->implementation == SSM_EKF){
+            (calc->sys).function = &ssm_step_ekf;
+            (calc->sys).jacobian = NULL;
+        } else {
+            (calc->sys).function = &ssm_step_ukf;
+            (calc->sys).jacobian = NULL;
+        }
+        (calc->sys).dimension= dim_sys;
         (calc->sys).params= calc;
 
         if(nav->implementation == SSM_EKF){
+            //the covariance terms are often the badly scaled part of the system: their absolute error is scaled by opts->eps_cov so that they don't drive the step-size control
+            int i;
+            int m = nav->states_sv_inc->length + nav->states_diff->length;
+            double scale_abs[dim_sys];
+            for(i=0; i<dim_sys; i++){
+                scale_abs[i] = (i < m) ? 1.0 : opts->eps_cov;
+            }
+            calc->_driver = gsl_odeiv2_driver_alloc_scaled_new(&(calc->sys), calc->T, opts->dt, opts->eps_abs, opts->eps_rel, 1.0, 0.0, scale_abs);
+        } else {
+            calc->_driver = gsl_odeiv2_driver_alloc_y_new(&(calc->sys), calc->T, opts->dt, opts->eps_abs, opts->eps_rel);
+        }
+        calc->step = calc->_driver->s;
+        calc->evolve = calc->_driver->e;
+        calc->control = calc->_driver->c;
+
+        calc->_ode_proj = NULL;
+        calc->_ode_t = 0.0;
+        calc->_ode_step = NULL;
+        calc->_ode_y = ssm_d1_new(dim_sys);
+
+        calc->is_stiff = 0;
+        calc->_driver_stiff = NULL;
+        calc->_jac = NULL;
+        if(nav->implementation == SSM_ODE && strcmp(opts->stepper, "auto") == 0){
+            calc->_driver_stiff = gsl_odeiv2_driver_alloc_y_new(&(calc->sys), gsl_odeiv2_step_msbdf, opts->dt, opts->eps_abs, opts->eps_rel);
+            calc->_jac = ssm_d1_new(dim_sys*dim_sys);
+        }
+
+        //with rkf45, the particles of an ode are integrated SSM_ODE_BATCH at a time in lock-step (see ssm_f_prediction_ode_batch())
+        if(nav->implementation == SSM_ODE && calc->T == gsl_odeiv2_step_rkf45 && !calc->_driver_stiff){
+            calc->_batch = ssm_d1_new((9*dim_sys + nav->par_all->length)*SSM_ODE_BATCH);
+        }
+        calc->eps_abs = opts->eps_abs;
+        calc->eps_rel = opts->eps_rel;
+
+        if(nav->implementation == SSM_EKF || nav->implementation == SSM_UKF){
 
             int can_run;
 
@@ -806,9 +875,8 @@ ssm_calc_t *ssm_calc_new(json_t *jdata, ssm_nav_t *nav, ssm_data_t *data, ssm_fi
             int n_s = nav->states_sv_inc->length + nav->states_diff->length;
             int n_o = nav->observed_length;
             calc->_pred_error = gsl_vector_calloc(n_o);
-            calc->_zero = gsl_vector_calloc(n_o);
+            calc->_std_error = gsl_vector_calloc(n_o);
             calc->_St = gsl_matrix_calloc(n_o, n_o);
-            calc->_Stm1 = gsl_matrix_calloc(n_o, n_o);
             calc->_Rt = gsl_matrix_calloc(n_o, n_o);
             calc->_Ht = gsl_matrix_calloc(n_s, n_o);
             calc->_Kt = gsl_matrix_calloc(n_s, n_o);
@@ -817,15 +885,59 @@ ssm_calc_t *ssm_calc_new(json_t *jdata, ssm_nav_t *nav, ssm_data_t *data, ssm_fi
             calc->_Q = gsl_matrix_calloc(n_s, n_s);
             calc->_FtCt = gsl_matrix_calloc(n_s, n_s);
             calc->_Ft = gsl_matrix_calloc(n_s, n_s);
+            calc->_Ct = gsl_matrix_calloc(n_s, n_s);
             calc->_eval = gsl_vector_calloc(n_s);
             calc->_evec = gsl_matrix_calloc(n_s, n_s);
             calc->_w_eigen_vv = gsl_eigen_symmv_alloc(n_s);
+
+            calc->flag_sqrt = opts->flag_sqrt;
+            if(calc->flag_sqrt){
+                calc->_sqrt_pre = gsl_matrix_calloc(n_o + n_s, n_o + n_s);
+                calc->_sqrt_tau = gsl_vector_calloc(n_o + n_s);
+            }
+
+            if(nav->implementation == SSM_UKF){
+                calc->_ukf_sigma = gsl_matrix_calloc(2*n_s+1, n_s);
+                calc->_ukf_obs = gsl_matrix_calloc(2*n_s+1, n_o);
+                calc->_ukf_proj = calloc(dim, sizeof (double));
+                if(calc->_ukf_proj == NULL){
+                    ssm_print_err("Allocation impossible for calc->_ukf_proj");
+                    exit(EXIT_FAILURE);
+                }
+            }
         }
 
     } else if (nav->implementation == SSM_SDE){
         calc->y_pred = ssm_d1_new(dim);
-    } else if (nav->implementation == SSM_PSR){
+    } else if (nav->implementation == SSM_PSR || nav->implementation == SSM_HYBRID){
         ssm_psr_new(calc);
+        calc->ran_multinomial = (nav->implementation == SSM_HYBRID) ? &ssm_ran_multinomial_hybrid : &ssm_ran_multinomial;
+        calc->ran_poisson = (nav->implementation == SSM_HYBRID) ? &ssm_ran_poisson_hybrid : &gsl_ran_poisson;
+    }
+
+    //the particles of an sde or a psr are stepped SSM_STO_BATCH at a time (see ssm_f_prediction_sto_batch())
+    if (nav->implementation == SSM_SDE || nav->implementation == SSM_PSR || nav->implementation == SSM_HYBRID){
+        calc->_batch = ssm_d1_new((dim + nav->par_all->length)*SSM_STO_BATCH);
+    }
+
+    //step doubling on the noise-free system (see ssm_f_prediction_sde_adapt())
+    if (nav->implementation == SSM_SDE && nav->adapt_dt > 0.0){
+        calc->_dw_zero = ssm_d1_new(GSL_MAX(ssm_sde_dw_length(), 1)); //zeroed
+        calc->_X_adapt = ssm_d1_new(2*dim);
+    }
+
+    //drift, diffusion matrix and stages of ssm_f_prediction_sde_milstein() and ssm_f_prediction_sde_srk15()
+    if (nav->implementation == SSM_SDE && nav->scheme != SSM_EULER){
+        int j, n_on = 0;
+        int n_dw = ssm_sde_dw_length();
+        for(j=0; j<n_dw; j++){
+            n_on += ssm_sde_dw_on(j, nav);
+        }
+        if(nav->scheme == SSM_SRK15 && n_on > 1){
+            ssm_print_err("--scheme srk15 requires a single noise (see --no_dem_sto and --no_white_noise or use --scheme milstein)");
+            exit(EXIT_FAILURE);
+        }
+        calc->_sde_ws = ssm_d1_new((8 + 5*n_dw)*dim + n_dw*(n_dw + 1));
     }
 
     /**************************/
@@ -965,6 +1077,49 @@ ssm_calc_t *ssm_calc_new(json_t *jdata, ssm_nav_t *nav, ssm_data_t *data, ssm_fi
             free(y);
         }
     }
+
+    /*************/
+    /* gillespie */
+    /*************/
+
+    //after the covariates (frozen in calc->gillespie)
+    if (nav->implementation == SSM_GILLESPIE){
+        ssm_gillespie_new(calc, nav);
+    }
+
+    /******************************/
+    /* steady-state Kalman filter */
+    /******************************/
+
+    calc->steady_tol = (nav->implementation == SSM_EKF) ? opts->steady_tol : 0.0;
+
+    if(calc->steady_tol > 0.0 && (calc->flag_sqrt || (calc->covariates_length && !strcmp(opts->freeze_forcing, "")) || (nav->states_diff->length && !(nav->noises_off & SSM_NO_DIFF)))){
+        if(nav->print & SSM_PRINT_WARNING){
+            ssm_print_warning("--steady is ignored: it requires a time invariant model (no diffusions, frozen covariates) and cannot be used with --sqrt");
+        }
+        calc->steady_tol = 0.0;
+    }
+
+    if(calc->steady_tol > 0.0){
+        int n_s = nav->states_sv_inc->length + nav->states_diff->length;
+        int n_o = nav->observed_length;
+
+        calc->_steady_Kt = gsl_matrix_calloc(n_s, n_o);
+        calc->_steady_G = gsl_matrix_calloc(n_o, n_o);
+        calc->_steady_st = gsl_vector_calloc(n_o);
+        calc->_steady_Ct_pred = ssm_d1_new((n_s*(n_s+1))/2);
+        calc->_steady_Ct = ssm_d1_new((n_s*(n_s+1))/2);
+
+        calc->_steady_step = gsl_odeiv2_step_alloc(calc->T, n_s);
+        calc->_steady_evolve = gsl_odeiv2_evolve_alloc(n_s);
+        (calc->_steady_sys).function = &ssm_step_ode;
+        (calc->_steady_sys).jacobian = NULL;
+        (calc->_steady_sys).dimension = n_s;
+        (calc->_steady_sys).params = calc;
+    }
+
+    ssm_kalman_steady_reset(calc);
+
     return calc;
 }
 
@@ -973,16 +1128,22 @@ void ssm_calc_free(ssm_calc_t *calc, ssm_nav_t *nav)
 {
     gsl_rng_free(calc->randgsl);
 
-    if (nav->implementation == SSM_ODE  || nav->implementation == SSM_EKF){
+    if (nav->implementation == SSM_ODE  || nav->implementation == SSM_EKF || nav->implementation == SSM_UKF){
 
-        gsl_odeiv2_step_free(calc->step);
-        gsl_odeiv2_evolve_free(calc->evolve);
-        gsl_odeiv2_control_free(calc->control);
+        gsl_odeiv2_driver_free(calc->_driver);
+        free(calc->_ode_y);
+        if(calc->_driver_stiff){
+            gsl_odeiv2_driver_free(calc->_driver_stiff);
+            free(calc->_jac);
+        }
+        if(calc->_batch){
+            free(calc->_batch);
+        }
 
-        if(nav->implementation == SSM_EKF){
+        if(nav->implementation == SSM_EKF || nav->implementation == SSM_UKF){
             gsl_vector_free(calc->_pred_error);
+            gsl_vector_free(calc->_std_error);
             gsl_matrix_free(calc->_St);
-            gsl_matrix_free(calc->_Stm1);
             gsl_matrix_free(calc->_Rt);
             gsl_matrix_free(calc->_Ht);
             gsl_matrix_free(calc->_Kt);
@@ -991,15 +1152,48 @@ void ssm_calc_free(ssm_calc_t *calc, ssm_nav_t *nav)
             gsl_matrix_free(calc->_Q);
             gsl_matrix_free(calc->_FtCt);
             gsl_matrix_free(calc->_Ft);
+            gsl_matrix_free(calc->_Ct);
             gsl_vector_free(calc->_eval);
             gsl_matrix_free(calc->_evec);
             gsl_eigen_symmv_free(calc->_w_eigen_vv);
+
+            if(calc->flag_sqrt){
+                gsl_matrix_free(calc->_sqrt_pre);
+                gsl_vector_free(calc->_sqrt_tau);
+            }
+
+            if(calc->steady_tol > 0.0){
+                gsl_matrix_free(calc->_steady_Kt);
+                gsl_matrix_free(calc->_steady_G);
+                gsl_vector_free(calc->_steady_st);
+                free(calc->_steady_Ct_pred);
+                free(calc->_steady_Ct);
+                gsl_odeiv2_step_free(calc->_steady_step);
+                gsl_odeiv2_evolve_free(calc->_steady_evolve);
+            }
+
+            if(nav->implementation == SSM_UKF){
+                gsl_matrix_free(calc->_ukf_sigma);
+                gsl_matrix_free(calc->_ukf_obs);
+                free(calc->_ukf_proj);
+            }
         }
 
     } else if (nav->implementation == SSM_SDE){
         free(calc->y_pred);
-    } else if (nav->implementation == SSM_PSR){
+        free(calc->_batch);
+        if(calc->_dw_zero){
+            free(calc->_dw_zero);
+            free(calc->_X_adapt);
+        }
+        if(calc->_sde_ws){
+            free(calc->_sde_ws);
+        }
+    } else if (nav->implementation == SSM_PSR || nav->implementation == SSM_HYBRID){
         ssm_psr_free(calc);
+        free(calc->_batch);
+    } else if (nav->implementation == SSM_GILLESPIE){
+        ssm_gillespie_free(calc);
     }
 
     free(calc->to_be_sorted);
@@ -1070,9 +1264,11 @@ ssm_options_t *ssm_options_new(void)
     opts->root = ssm_c1_new(SSM_STR_BUFFSIZE);
     opts->next = ssm_c1_new(SSM_STR_BUFFSIZE);
     opts->interpolator = ssm_c1_new(SSM_STR_BUFFSIZE);
+    opts->stepper = ssm_c1_new(SSM_STR_BUFFSIZE);
     opts->start = ssm_c1_new(SSM_STR_BUFFSIZE);
     opts->end = ssm_c1_new(SSM_STR_BUFFSIZE);
     opts->server = ssm_c1_new(SSM_STR_BUFFSIZE);
+    opts->broker = ssm_c1_new(SSM_STR_BUFFSIZE);
 
     //fill default
     opts->worker_algo = 0;
@@ -1087,6 +1283,9 @@ ssm_options_t *ssm_options_new(void)
     opts->dt = 0.25;
     opts->eps_abs = 1e-6;
     opts->eps_rel = 1e-3;
+    opts->eps_cov = 1e3;
+    opts->adapt_dt = 0.0;
+    opts->scheme = SSM_EULER;
     strncpy(opts->freeze_forcing, "", SSM_STR_BUFFSIZE);
     strncpy(opts->root, ".", SSM_STR_BUFFSIZE);
     strncpy(opts->next, "", SSM_STR_BUFFSIZE);
@@ -1095,6 +1294,7 @@ ssm_options_t *ssm_options_new(void)
     opts->J = 1;
     opts->n_obs = -1;
     strncpy(opts->interpolator, "linear", SSM_STR_BUFFSIZE);
+    strncpy(opts->stepper, "rkf45", SSM_STR_BUFFSIZE);
     opts->n_obs = -1;
     opts->n_iter = 10;
     opts->a = 0.98;
@@ -1114,7 +1314,13 @@ ssm_options_t *ssm_options_new(void)
     strncpy(opts->start, "", SSM_STR_BUFFSIZE);
     strncpy(opts->end, "", SSM_STR_BUFFSIZE);
     strncpy(opts->server, "127.0.0.1", SSM_STR_BUFFSIZE);
+    strncpy(opts->broker, "", SSM_STR_BUFFSIZE);
     opts->flag_no_filter = 0;
+    opts->flag_shm = 0;
+    opts->flag_chain = 0;
+    opts->prefetch = 0;
+    opts->flag_sqrt = 0;
+    opts->steady_tol = 0.0;
 
     return opts;
 }
@@ -1126,9 +1332,11 @@ void ssm_options_free(ssm_options_t *opts)
     free(opts->root);
     free(opts->next);
     free(opts->interpolator);
+    free(opts->stepper);
     free(opts->start);
     free(opts->end);
     free(opts->server);
+    free(opts->broker);
 
     free(opts);
 }
@@ -1153,14 +1361,11 @@ ssm_fitness_t *ssm_fitness_new(ssm_data_t *data, ssm_options_t *opts)
     fitness->log_like_n = 0.0;
     fitness->log_like = 0.0;
 
-    fitness->weights = ssm_d1_new(fitness->J);
+    fitness->weights = ssm_shm_malloc(fitness->J * sizeof (double));
+    memset(fitness->weights, 0, fitness->J * sizeof (double));
     fitness->select = ssm_u2_new(fitness->data_length, fitness->J);
 
-    fitness->cum_status = malloc(fitness->J * sizeof (ssm_err_code_t));
-    if(fitness->cum_status == NULL) {
-        ssm_print_err("Allocation impossible for fitness->cum_status");
-        exit(EXIT_FAILURE);
-    }
+    fitness->cum_status = ssm_shm_malloc(fitness->J * sizeof (ssm_err_code_t));
     for(i=0; i<fitness->J; i++){
         fitness->cum_status[i] = SSM_SUCCESS;
     }
@@ -1194,10 +1399,10 @@ ssm_fitness_t *ssm_fitness_new(ssm_data_t *data, ssm_options_t *opts)
 
 void ssm_fitness_free(ssm_fitness_t *fitness)
 {
-    free(fitness->weights);
+    ssm_shm_free(fitness->weights);
     ssm_u2_free(fitness->select, fitness->data_length);
 
-    free(fitness->cum_status);
+    ssm_shm_free(fitness->cum_status);
 
     free(fitness);
 }
@@ -1206,34 +1411,31 @@ void ssm_fitness_free(ssm_fitness_t *fitness)
 int _ssm_dim_X(ssm_nav_t *nav)
 {
     int dim = nav->states_sv_inc->length + nav->states_diff->length;
-    if(nav->implementation == SSM_EKF){
-        dim += pow(dim, 2);
+    if(nav->implementation == SSM_EKF || nav->implementation == SSM_UKF){
+        dim += (dim*(dim+1))/2; //Ct is symmetric: only its upper triangle is stored
     }
     return dim;
 }
 
 ssm_X_t *ssm_X_new(ssm_nav_t *nav, ssm_options_t *opts)
 {
-    ssm_X_t *X = malloc(sizeof (ssm_X_t));
-    if (X==NULL) {
-        ssm_print_err("Allocation impossible for ssm_X_t");
-        exit(EXIT_FAILURE);
-    }
+    ssm_X_t *X = ssm_shm_malloc(sizeof (ssm_X_t)); //shared with the forked workers (--shm)
 
     X->length = _ssm_dim_X(nav);
 
     X->dt = 1.0/ ((double) round(1.0/opts->dt)); //IMPORTANT: for non adaptive time step methods, we ensure an integer multiple of dt in between 2 data points
     X->dt0 = X->dt;
 
-    X->proj = ssm_d1_new(X->length);
+    X->proj = ssm_shm_malloc(X->length * sizeof (double));
+    memset(X->proj, 0, X->length * sizeof (double));
 
     return X;
 }
 
 void ssm_X_free(ssm_X_t *X)
 {
-    free(X->proj);
-    free(X);
+    ssm_shm_free(X->proj);
+    ssm_shm_free(X);
 }
 
 
@@ -1295,6 +1497,42 @@ void ssm_D_X_free(ssm_X_t **X, ssm_data_t *data)
 
 
 
+ssm_dense_t *ssm_dense_new(ssm_nav_t *nav)
+{
+    int n = nav->states_sv_inc->length + nav->states_diff->length;
+
+    ssm_dense_t *dense = malloc(sizeof (ssm_dense_t));
+    if (dense==NULL) {
+        ssm_print_err("Allocation impossible for ssm_dense_t *");
+        exit(EXIT_FAILURE);
+    }
+
+    dense->is_started = 0;
+    dense->h = 0.0;
+    dense->t_prev = 0.0;
+    dense->t = 0.0;
+    dense->y_prev = ssm_d1_new(n);
+    dense->f_prev = ssm_d1_new(n);
+    dense->y = ssm_d1_new(n);
+    dense->f = ssm_d1_new(n);
+    dense->y_out = ssm_d1_new(n);
+    dense->base = ssm_d1_new(n);
+
+    return dense;
+}
+
+void ssm_dense_free(ssm_dense_t *dense)
+{
+    free(dense->y_prev);
+    free(dense->f_prev);
+    free(dense->y);
+    free(dense->f);
+    free(dense->y_out);
+    free(dense->base);
+    free(dense);
+}
+
+
 ssm_X_t ***ssm_D_J_X_new(ssm_data_t *data, ssm_fitness_t *fitness, ssm_nav_t *nav, ssm_options_t *opts)
 {
     int i;
@@ -1424,6 +1662,7 @@ ssm_adapt_t *ssm_adapt_new(ssm_nav_t *nav, ssm_options_t * opts)
 
     a->mean_sampling = ssm_d1_new(nav->theta_all->length);
     a->var_sampling = gsl_matrix_calloc(nav->theta_all->length, nav->theta_all->length);
+    a->proposal = ssm_proposal_new(nav->theta_all->length);
 
     return a;
 }
@@ -1432,6 +1671,7 @@ void ssm_adapt_free(ssm_adapt_t *adapt)
 {
     free(adapt->mean_sampling);
     gsl_matrix_free(adapt->var_sampling);
+    ssm_proposal_free(adapt->proposal);
 
     free(adapt);
 }
@@ -0,0 +1,181 @@
+/**************************************************************************
+ *    This file is part of ssm.
+ *
+ *    ssm is free software: you can redistribute it and/or modify it
+ *    under the terms of the GNU General Public License as published
+ *    by the Free Software Foundation, either version 3 of the
+ *    License, or (at your option) any later version.
+ *
+ *    ssm is distributed in the hope that it will be useful, but
+ *    WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public
+ *    License along with ssm.  If not, see
+ *    <http://www.gnu.org/licenses/>.
+ *************************************************************************/
+
+#include "ssm.h"
+
+/**
+ * Exact stochastic simulation of the reactions of the model with the
+ * next reaction method of Gibson and Bruck (2000): every reaction
+ * keeps the (absolute) putative time of its next firing in an indexed
+ * priority queue. After a firing, only the reactions depending on the
+ * states it changed (dependency graph generated by Ccoder) have their
+ * propensity recomputed and their putative time rescaled, so that
+ * each event costs O(log(n_reactions)) and one random number.
+ *
+ * The covariates, the diffusions and the white noises are frozen over
+ * each time step dt (see ssm_gillespie_freeze()): the propensities
+ * are piecewise constant in time and the putative times are rescaled
+ * at the start of each time step.
+ */
+
+
+static void _ssm_ipq_swap(ssm_gillespie_t *gil, int i, int j)
+{
+    int r = gil->heap[i];
+    gil->heap[i] = gil->heap[j];
+    gil->heap[j] = r;
+
+    gil->node[gil->heap[i]] = i;
+    gil->node[gil->heap[j]] = j;
+}
+
+static void _ssm_ipq_down(ssm_gillespie_t *gil, int i)
+{
+    const double *tau = gil->tau;
+    const int *heap = gil->heap;
+    int n = gil->n_reactions;
+
+    for(;;){
+        int l = 2*i + 1;
+        int m = i;
+
+        if (l < n && tau[heap[l]] < tau[heap[m]]) {
+            m = l;
+        }
+        if (l + 1 < n && tau[heap[l+1]] < tau[heap[m]]) {
+            m = l + 1;
+        }
+        if (m == i) {
+            return;
+        }
+
+        _ssm_ipq_swap(gil, i, m);
+        i = m;
+    }
+}
+
+/**
+ * Restore the order of the queue after a change of the putative time
+ * of the reaction at node i
+ */
+static void _ssm_ipq_update(ssm_gillespie_t *gil, int i)
+{
+    const double *tau = gil->tau;
+    const int *heap = gil->heap;
+
+    while (i > 0 && tau[heap[(i-1)/2]] > tau[heap[i]]) {
+        _ssm_ipq_swap(gil, i, (i-1)/2);
+        i = (i-1)/2;
+    }
+
+    _ssm_ipq_down(gil, i);
+}
+
+static void _ssm_ipq_build(ssm_gillespie_t *gil)
+{
+    int i;
+
+    for(i=0; i<gil->n_reactions; i++){
+        gil->heap[i] = i;
+        gil->node[i] = i;
+    }
+
+    for(i=gil->n_reactions/2 - 1; i>=0; i--){
+        _ssm_ipq_down(gil, i);
+    }
+}
+
+
+static double _ssm_gillespie_propensity(int r, const double *X, ssm_par_t *par, ssm_nav_t *nav, ssm_calc_t *calc)
+{
+    double a = ssm_gillespie_propensity(r, X, par, nav, calc);
+    return (a > 0.0) ? a : 0.0;
+}
+
+/**
+ * Putative time of the next firing of a reaction whose propensity
+ * changes from a_old to a at time t: the time left is rescaled by
+ * a_old/a if the reaction was possible, drawn otherwise (both are
+ * exact as the waiting times are exponential).
+ */
+static double _ssm_gillespie_tau(double a_old, double a, double tau, double t, ssm_calc_t *calc)
+{
+    if (a <= 0.0) {
+        return GSL_POSINF;
+    } else if (a_old > 0.0 && tau < GSL_POSINF) {
+        return t + (a_old / a) * (tau - t);
+    }
+
+    return t + gsl_ran_exponential(calc->randgsl, 1.0 / a);
+}
+
+
+static ssm_err_code_t _ssm_f_prediction_gillespie(ssm_X_t *p_X, double t0, double t1, ssm_par_t *par, int is_diff, ssm_nav_t *nav, ssm_calc_t *calc)
+{
+    int i, k;
+    ssm_gillespie_t *gil = calc->gillespie;
+    double *X = p_X->proj;
+    double t = t0;
+    int is_started = 0; //the putative times of a previous call are not the ones of p_X: they are drawn again
+
+    while (t < t1) {
+        double t_end = GSL_MIN(t + p_X->dt, t1); //no reaction after t1 is counted in the incidences of the row
+
+        ssm_gillespie_freeze(p_X, t, par, nav, calc);
+        for(i=0; i<gil->n_reactions; i++){
+            double a = _ssm_gillespie_propensity(i, X, par, nav, calc);
+            gil->tau[i] = _ssm_gillespie_tau((is_started) ? gil->a[i] : 0.0, a, gil->tau[i], t, calc);
+            gil->a[i] = a;
+        }
+        _ssm_ipq_build(gil);
+        is_started = 1;
+
+        while (gil->tau[gil->heap[0]] < t_end) {
+            int r = gil->heap[0];
+            double t_r = gil->tau[r];
+
+            ssm_gillespie_fire(r, X, nav);
+
+            for(k=0; k<gil->dep_length[r]; k++){
+                int j = gil->dep[r][k];
+                double a = _ssm_gillespie_propensity(j, X, par, nav, calc);
+                gil->tau[j] = _ssm_gillespie_tau((j == r) ? 0.0 : gil->a[j], a, gil->tau[j], t_r, calc);
+                gil->a[j] = a;
+                _ssm_ipq_update(gil, gil->node[j]);
+            }
+        }
+
+        if(is_diff){
+            ssm_compute_diff(p_X, par, nav, calc);
+        }
+        t = t_end;
+    }
+
+    return ssm_check_no_neg_sv_or_remainder(p_X, par, nav, calc, t1);
+}
+
+
+ssm_err_code_t ssm_f_prediction_gillespie(ssm_X_t *p_X, double t0, double t1, ssm_par_t *par, ssm_nav_t *nav, ssm_calc_t *calc)
+{
+    return _ssm_f_prediction_gillespie(p_X, t0, t1, par, 1, nav, calc);
+}
+
+ssm_err_code_t ssm_f_prediction_gillespie_no_diff(ssm_X_t *p_X, double t0, double t1, ssm_par_t *par, ssm_nav_t *nav, ssm_calc_t *calc)
+{
+    return _ssm_f_prediction_gillespie(p_X, t0, t1, par, 0, nav, calc);
+}
@@ -86,19 +86,19 @@ void ssm_hat_eval(ssm_hat_t *hat, ssm_X_t **J_X, ssm_par_t **J_par, ssm_nav_t *n
     ssm_implementations_t implementation = nav->implementation;
 
 
-    if (implementation == SSM_EKF) {
+    if (implementation == SSM_EKF || implementation == SSM_UKF) {
         int m = nav->states_sv->length + nav->states_inc->length + nav->states_diff->length;
         ssm_X_t *X = *J_X;
         ssm_par_t *par = *J_par;
-        gsl_matrix_const_view Ct   = gsl_matrix_const_view_array(&X->proj[m], m, m);
+        const double *Ct = &X->proj[m];
         double rem, obs, var, grad, grad2;
 
         //sv and incidences
         for(i=0; i< nav->states_sv_inc->length; i++) {
             offset = nav->states_sv_inc->p[i]->offset;
 	    hat->states[offset] = X->proj[offset];
-            hat->states_95[offset][0] = X->proj[offset] - 1.96*sqrt(gsl_matrix_get(&Ct.matrix,offset,offset));
-	    hat->states_95[offset][1] = X->proj[offset] + 1.96*sqrt(gsl_matrix_get(&Ct.matrix,offset,offset));
+            hat->states_95[offset][0] = X->proj[offset] - 1.96*sqrt(ssm_kalman_Ct_get(Ct, m, offset, offset));
+	    hat->states_95[offset][1] = X->proj[offset] + 1.96*sqrt(ssm_kalman_Ct_get(Ct, m, offset, offset));
         }
 
         //remainders
@@ -119,7 +119,7 @@ void ssm_hat_eval(ssm_hat_t *hat, ssm_X_t **J_X, ssm_par_t **J_par, ssm_nav_t *n
             offset = state->offset;
             grad = state->f_der_inv(X->proj[offset]);
             grad2 = state->f_der2_inv(X->proj[offset]);
-            var = pow(grad,2.0) * gsl_matrix_get(&Ct.matrix,offset,offset) + pow(grad2,2.0)/4.0*pow(gsl_matrix_get(&Ct.matrix,offset,offset),2.0);
+            var = pow(grad,2.0) * ssm_kalman_Ct_get(Ct, m, offset, offset) + pow(grad2,2.0)/4.0*pow(ssm_kalman_Ct_get(Ct, m, offset, offset),2.0);
 	    hat->states[offset] = state->f_inv(X->proj[offset]);
             hat->states_95[offset][0] = state->f_inv(X->proj[offset]) - 1.96*sqrt(var);
             hat->states_95[offset][1] = state->f_inv(X->proj[offset]) + 1.96*sqrt(var);
@@ -89,7 +89,7 @@ void ssm_par2X(ssm_X_t *X, ssm_par_t *par, ssm_calc_t *calc, ssm_nav_t *nav)
 
     for(i=0; i<sv->length; i++){
 	X->proj[ sv->p[i]->offset ] = sv->p[i]->f(gsl_vector_get(par, sv->p[i]->ic->offset));
-	if(nav->implementation == SSM_PSR){
+	if(nav->implementation == SSM_PSR || nav->implementation == SSM_HYBRID || nav->implementation == SSM_GILLESPIE){
 	    X->proj[ sv->p[i]->offset ] = round(X->proj[ sv->p[i]->offset ]);
 	} 
     }
@@ -148,7 +148,7 @@ void ssm_mcmc_results2X(ssm_X_t *X, json_t *jprediction_j, ssm_calc_t *calc, ssm
 	    ssm_print_err(str);
 	    exit(EXIT_FAILURE);
 	}
-	if(nav->implementation == SSM_PSR){
+	if(nav->implementation == SSM_PSR || nav->implementation == SSM_HYBRID || nav->implementation == SSM_GILLESPIE){
 	    X->proj[ sv->p[i]->offset ] = round(X->proj[ sv->p[i]->offset ]);
 	}
     }
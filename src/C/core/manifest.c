@@ -0,0 +1,275 @@
+/**************************************************************************
+ *    This file is part of ssm.
+ *
+ *    ssm is free software: you can redistribute it and/or modify it
+ *    under the terms of the GNU General Public License as published
+ *    by the Free Software Foundation, either version 3 of the
+ *    License, or (at your option) any later version.
+ *
+ *    ssm is distributed in the hope that it will be useful, but
+ *    WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public
+ *    License along with ssm.  If not, see
+ *    <http://www.gnu.org/licenses/>.
+ *************************************************************************/
+
+#include "ssm.h"
+
+/**
+ * 64 bits FNV-1a hash, h is the hash of the previous chunks (use
+ * SSM_FNV1A_INIT for the first one)
+ */
+static uint64_t _ssm_fnv1a(uint64_t h, const void *buf, size_t n)
+{
+    size_t i;
+    const unsigned char *c = (const unsigned char *) buf;
+
+    for(i=0; i<n; i++){
+        h ^= (uint64_t) c[i];
+        h *= UINT64_C(1099511628211);
+    }
+
+    return h;
+}
+
+static uint64_t _ssm_fnv1a_str(uint64_t h, const char *str)
+{
+    //hash the terminating '\0' so that ["ab", "c"] != ["a", "bc"]
+    return _ssm_fnv1a(h, str, strlen(str) + 1);
+}
+
+static void _ssm_hash2str(char *dest, uint64_t h)
+{
+    snprintf(dest, SSM_HASH_BUFFSIZE, "%016" PRIx64, h);
+}
+
+
+/**
+ * Hash of the layout of the compiled model: everything that par and X
+ * exchanged between a server and its workers depend on.
+ */
+void ssm_hash_model(char *dest, ssm_nav_t *nav)
+{
+    int i;
+    int length[6];
+    uint64_t h = SSM_FNV1A_INIT;
+
+    length[0] = nav->parameters_length;
+    length[1] = nav->states_length;
+    length[2] = nav->observed_length;
+    length[3] = nav->states_sv_inc->length;
+    length[4] = nav->states_diff->length;
+    length[5] = nav->theta_all->length;
+    h = _ssm_fnv1a(h, length, sizeof (length));
+
+    for(i=0; i<nav->parameters_length; i++){
+        h = _ssm_fnv1a_str(h, nav->parameters[i]->name);
+    }
+    for(i=0; i<nav->states_length; i++){
+        h = _ssm_fnv1a_str(h, nav->states[i]->name);
+    }
+    for(i=0; i<nav->observed_length; i++){
+        h = _ssm_fnv1a_str(h, nav->observed[i]->name);
+    }
+
+    _ssm_hash2str(dest, h);
+}
+
+
+/**
+ * Hash of the data and covariates (content of .data.json). Keys are
+ * sorted so that the hash does not depend on how the file was written.
+ */
+void ssm_hash_data(char *dest, json_t *jdata)
+{
+    char *str = json_dumps(jdata, JSON_COMPACT | JSON_SORT_KEYS);
+    if(str == NULL){
+        ssm_print_err("could not serialize the data");
+        exit(EXIT_FAILURE);
+    }
+
+    _ssm_hash2str(dest, _ssm_fnv1a_str(SSM_FNV1A_INIT, str));
+    free(str);
+}
+
+
+/**
+ * Hash of the options affecting the integration of the particles.
+ * Numbers are hashed through their text representation to remain
+ * valid across architectures.
+ */
+void ssm_hash_options(char *dest, ssm_options_t *opts)
+{
+    char str[SSM_STR_BUFFSIZE];
+
+    snprintf(str, SSM_STR_BUFFSIZE, "%d:%d:%.17g:%.17g:%.17g:%.17g:%d:%s:%s", (int) opts->implementation, (int) opts->noises_off, opts->dt, opts->eps_abs, opts->eps_rel, opts->adapt_dt, (int) opts->scheme, opts->interpolator, opts->stepper);
+    _ssm_hash2str(dest, _ssm_fnv1a_str(SSM_FNV1A_INIT, str));
+}
+
+
+ssm_manifest_t *ssm_manifest_new(json_t *jdata, ssm_nav_t *nav, ssm_options_t *opts)
+{
+    char str[3*SSM_HASH_BUFFSIZE];
+
+    ssm_manifest_t *manifest = malloc(sizeof (ssm_manifest_t));
+    if (manifest == NULL) {
+        ssm_print_err("Allocation impossible for ssm_manifest_t *");
+        exit(EXIT_FAILURE);
+    }
+
+    ssm_hash_model(manifest->model, nav);
+    ssm_hash_data(manifest->data, jdata);
+    ssm_hash_options(manifest->options, opts);
+
+    snprintf(str, 3*SSM_HASH_BUFFSIZE, "%s%s%s", manifest->model, manifest->data, manifest->options);
+    _ssm_hash2str(manifest->hash, _ssm_fnv1a_str(SSM_FNV1A_INIT, str));
+
+    manifest->implementation = opts->implementation;
+    manifest->noises_off = opts->noises_off;
+    manifest->dt = opts->dt;
+    manifest->eps_abs = opts->eps_abs;
+    manifest->eps_rel = opts->eps_rel;
+    manifest->adapt_dt = opts->adapt_dt;
+    manifest->scheme = opts->scheme;
+    strncpy(manifest->interpolator, opts->interpolator, SSM_STR_BUFFSIZE);
+    manifest->interpolator[SSM_STR_BUFFSIZE-1] = '\0';
+    strncpy(manifest->stepper, opts->stepper, SSM_STR_BUFFSIZE);
+    manifest->stepper[SSM_STR_BUFFSIZE-1] = '\0';
+
+    return manifest;
+}
+
+
+void ssm_manifest_free(ssm_manifest_t *manifest)
+{
+    free(manifest);
+}
+
+
+/**
+ * serialize the manifest into a json string (to be freed by the caller)
+ */
+char *ssm_manifest_dumps(ssm_manifest_t *manifest)
+{
+    json_t *jmanifest = json_pack("{s:s,s:s,s:s,s:s,s:{s:i,s:i,s:f,s:f,s:f,s:f,s:i,s:s,s:s}}",
+                                  "model", manifest->model,
+                                  "data", manifest->data,
+                                  "options", manifest->options,
+                                  "hash", manifest->hash,
+                                  "values",
+                                  "implementation", (int) manifest->implementation,
+                                  "noises_off", (int) manifest->noises_off,
+                                  "dt", manifest->dt,
+                                  "eps_abs", manifest->eps_abs,
+                                  "eps_rel", manifest->eps_rel,
+                                  "adapt_dt", manifest->adapt_dt,
+                                  "scheme", (int) manifest->scheme,
+                                  "interpolator", manifest->interpolator,
+                                  "stepper", manifest->stepper);
+
+    if(jmanifest == NULL){
+        ssm_print_err("could not build the manifest");
+        exit(EXIT_FAILURE);
+    }
+
+    char *str = json_dumps(jmanifest, JSON_COMPACT);
+    json_decref(jmanifest);
+
+    return str;
+}
+
+
+/**
+ * parse a manifest serialized with ssm_manifest_dumps. Returns NULL
+ * if str is NULL or is not a valid manifest (it comes from the
+ * network: the caller rejects the message).
+ */
+ssm_manifest_t *ssm_manifest_loads(const char *str)
+{
+    json_error_t error;
+    int implementation, noises_off, scheme;
+    const char *model, *data, *options, *hash, *interpolator, *stepper;
+
+    if(str == NULL){
+        ssm_print_warning("no manifest received");
+        return NULL;
+    }
+
+    json_t *jmanifest = json_loads(str, 0, &error);
+    if(!jmanifest) {
+        ssm_print_warning(error.text);
+        return NULL;
+    }
+
+    ssm_manifest_t *manifest = malloc(sizeof (ssm_manifest_t));
+    if (manifest == NULL) {
+        ssm_print_err("Allocation impossible for ssm_manifest_t *");
+        exit(EXIT_FAILURE);
+    }
+
+    if(json_unpack(jmanifest, "{s:s,s:s,s:s,s:s,s:{s:i,s:i,s:F,s:F,s:F,s:F,s:i,s:s,s:s}}",
+                   "model", &model,
+                   "data", &data,
+                   "options", &options,
+                   "hash", &hash,
+                   "values",
+                   "implementation", &implementation,
+                   "noises_off", &noises_off,
+                   "dt", &manifest->dt,
+                   "eps_abs", &manifest->eps_abs,
+                   "eps_rel", &manifest->eps_rel,
+                   "adapt_dt", &manifest->adapt_dt,
+                   "scheme", &scheme,
+                   "interpolator", &interpolator,
+                   "stepper", &stepper) != 0){
+        ssm_print_warning("invalid manifest");
+        free(manifest);
+        json_decref(jmanifest);
+        return NULL;
+    }
+
+    strncpy(manifest->model, model, SSM_HASH_BUFFSIZE);
+    strncpy(manifest->data, data, SSM_HASH_BUFFSIZE);
+    strncpy(manifest->options, options, SSM_HASH_BUFFSIZE);
+    strncpy(manifest->hash, hash, SSM_HASH_BUFFSIZE);
+    strncpy(manifest->interpolator, interpolator, SSM_STR_BUFFSIZE);
+    strncpy(manifest->stepper, stepper, SSM_STR_BUFFSIZE);
+    manifest->model[SSM_HASH_BUFFSIZE-1] = '\0';
+    manifest->data[SSM_HASH_BUFFSIZE-1] = '\0';
+    manifest->options[SSM_HASH_BUFFSIZE-1] = '\0';
+    manifest->hash[SSM_HASH_BUFFSIZE-1] = '\0';
+    manifest->interpolator[SSM_STR_BUFFSIZE-1] = '\0';
+    manifest->stepper[SSM_STR_BUFFSIZE-1] = '\0';
+
+    manifest->implementation = (ssm_implementations_t) implementation;
+    manifest->noises_off = (ssm_noises_off_t) noises_off;
+    manifest->scheme = (ssm_schemes_t) scheme;
+
+    json_decref(jmanifest);
+
+    return manifest;
+}
+
+
+/**
+ * set the options of a worker to the one of the server
+ */
+void ssm_manifest2options(ssm_options_t *opts, ssm_manifest_t *manifest)
+{
+    if(opts->implementation != manifest->implementation){
+        ssm_print_err("the worker and the server do not use the same implementation");
+        exit(EXIT_FAILURE);
+    }
+
+    opts->noises_off = manifest->noises_off;
+    opts->dt = manifest->dt;
+    opts->eps_abs = manifest->eps_abs;
+    opts->eps_rel = manifest->eps_rel;
+    opts->adapt_dt = manifest->adapt_dt;
+    opts->scheme = manifest->scheme;
+    strncpy(opts->interpolator, manifest->interpolator, SSM_STR_BUFFSIZE);
+    strncpy(opts->stepper, manifest->stepper, SSM_STR_BUFFSIZE);
+}
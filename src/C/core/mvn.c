@@ -100,6 +100,95 @@ double ssm_dmvnorm(const int n, const gsl_vector *x, const gsl_vector *mean, con
 
 
 
+ssm_proposal_t *ssm_proposal_new(int n)
+{
+    ssm_proposal_t *proposal = malloc(sizeof (ssm_proposal_t));
+    if(proposal == NULL) {
+        ssm_print_err("allocation impossible for ssm_proposal_t");
+        exit(EXIT_FAILURE);
+    }
+
+    proposal->n = n;
+    proposal->var = NULL;
+    proposal->is_dirty = 1;
+    proposal->chol = gsl_matrix_calloc(n, n);
+    proposal->log_det = 0.0;
+    proposal->work = gsl_vector_calloc(n);
+    proposal->flag_symmetric = 1; //gaussian random walk
+
+    return proposal;
+}
+
+void ssm_proposal_free(ssm_proposal_t *proposal)
+{
+    gsl_matrix_free(proposal->chol);
+    gsl_vector_free(proposal->work);
+    free(proposal);
+}
+
+
+/**
+ * use the covariance var: (re)compute its Cholesky factor only if
+ * var is not the one already factorized or if it has been modified
+ * since (is_dirty). The tuning factor sd_fac is applied when sampling
+ * and evaluating the density so that changing it doesn't require a
+ * factorization.
+ */
+void ssm_proposal_set(ssm_proposal_t *proposal, const gsl_matrix *var)
+{
+    int i;
+
+    if(var == proposal->var && !proposal->is_dirty){
+        return;
+    }
+
+    gsl_matrix_memcpy(proposal->chol, var);
+    gsl_linalg_cholesky_decomp(proposal->chol);
+
+    proposal->log_det = 0.0;
+    for(i=0; i<proposal->n; i++){
+        proposal->log_det += 2.0*log(gsl_matrix_get(proposal->chol, i, i));
+    }
+
+    proposal->var = var;
+    proposal->is_dirty = 0;
+}
+
+
+/**
+ * draw result from N(mean, sd_fac^2 var) (without allocation)
+ */
+void ssm_proposal_rmvnorm(const gsl_rng *r, ssm_proposal_t *proposal, const gsl_vector *mean, double sd_fac, gsl_vector *result)
+{
+    int k;
+
+    for(k=0; k<proposal->n; k++)
+        gsl_vector_set( result, k, gsl_ran_ugaussian(r) );
+
+    gsl_blas_dtrmv(CblasLower, CblasNoTrans, CblasNonUnit, proposal->chol, result);
+    gsl_vector_scale(result, sd_fac);
+    gsl_vector_add(result, mean);
+}
+
+
+/**
+ * log density of N(mean, sd_fac^2 var) at x (without allocation)
+ */
+double ssm_proposal_log_dmvnorm(ssm_proposal_t *proposal, const gsl_vector *x, const gsl_vector *mean, double sd_fac)
+{
+    double d2;
+    int n = proposal->n;
+
+    // solve L y = (x-mean) so that (x-mean)' var^-1 (x-mean) = y'y
+    gsl_vector_memcpy(proposal->work, x);
+    gsl_vector_sub(proposal->work, mean);
+    gsl_blas_dtrsv(CblasLower, CblasNoTrans, CblasNonUnit, proposal->chol, proposal->work);
+    gsl_blas_ddot(proposal->work, proposal->work, &d2);
+
+    return -0.5*d2/(sd_fac*sd_fac) - n*log(sd_fac) - 0.5*proposal->log_det - 0.5*n*log(2*M_PI);
+}
+
+
 /**
  * evaluate the empirical covariance matrix using a stable one-pass
  * algorithm: see
@@ -140,6 +229,11 @@ void ssm_adapt_var(ssm_adapt_t *adapt, ssm_theta_t *x, int m)
         }
     }
 
+    //the proposal has to be refactorized if it uses the sampling covariance
+    if(adapt->proposal->var == adapt->var_sampling){
+        adapt->proposal->is_dirty = 1;
+    }
+
     /* update x_bar */
     for (i=0; i < x->size; i++) {
         x_bar[i] += (gsl_vector_get(x, i) - x_bar[i]) / dm;
@@ -29,6 +29,59 @@ struct opts_part{
 };
 
 
+/**
+ * Integration settings selected by ssm autotune for the model
+ * (.autotune.json, one object per implementation keyed by the long
+ * name of the options). They replace the built-in defaults only:
+ * options given on the command line (@given) take precedence.
+ */
+static void _ssm_options_load_autotune(ssm_options_t *opts, const char *given)
+{
+    const char *key;
+
+    if(opts->implementation == SSM_ODE){
+        key = "ode";
+    } else if(opts->implementation == SSM_EKF){
+        key = "ekf";
+    } else {
+        return;
+    }
+
+    if(access(".autotune.json", R_OK) != 0){
+        return;
+    }
+
+    json_t *jtune = ssm_load_json_file(".autotune.json");
+    json_t *jimpl = json_object_get(jtune, key);
+
+    if(json_is_object(jimpl)){
+        json_t *el;
+
+        el = json_object_get(jimpl, "eps_abs_integ");
+        if(json_is_number(el) && !strchr(given, 'Y')){
+            opts->eps_abs = json_number_value(el);
+        }
+
+        el = json_object_get(jimpl, "eps_rel_integ");
+        if(json_is_number(el) && !strchr(given, 'Z')){
+            opts->eps_rel = json_number_value(el);
+        }
+
+        el = json_object_get(jimpl, "eps_cov_integ");
+        if(json_is_number(el) && !strchr(given, 'i')){
+            opts->eps_cov = json_number_value(el);
+        }
+
+        el = json_object_get(jimpl, "stepper");
+        if(json_is_string(el) && !strchr(given, 'u')){
+            strncpy(opts->stepper, json_string_value(el), SSM_STR_BUFFSIZE);
+        }
+    }
+
+    json_decref(jtune);
+}
+
+
 void ssm_options_load(ssm_options_t *opts, ssm_algo_t algo, int argc, char *argv[])
 {
     opts->algo = algo;
@@ -38,7 +91,7 @@ void ssm_options_load(ssm_options_t *opts, ssm_algo_t algo, int argc, char *argv
         {"I", 'I', "id",             "general id (unique integer identifier that will be appended to the output)", required_argument,  SSM_WORKER | SSM_SMC | SSM_KALMAN | SSM_KMCMC | SSM_PMCMC | SSM_KSIMPLEX | SSM_SIMPLEX | SSM_MIF | SSM_SIMUL },
         {"P", 'P', "root",           "root path for output files (if any) (no trailing slash)", required_argument,  SSM_SMC | SSM_KALMAN | SSM_KMCMC | SSM_PMCMC | SSM_KSIMPLEX | SSM_SIMPLEX | SSM_MIF | SSM_SIMUL },
         {"X", 'X', "next",           "write the outputed parameters in a file prefixed by the argument", required_argument,  SSM_WORKER | SSM_SMC | SSM_KALMAN | SSM_KMCMC | SSM_PMCMC | SSM_KSIMPLEX | SSM_SIMPLEX | SSM_MIF | SSM_SIMUL },
-        {"N", 'N', "n_thread",       "number of threads to be used", required_argument,  SSM_SMC | SSM_PMCMC | SSM_MIF | SSM_SIMUL },
+        {"N", 'N', "n_thread",       "number of threads to be used", required_argument,  SSM_WORKER | SSM_SMC | SSM_PMCMC | SSM_MIF | SSM_SIMUL },
         {"J", 'J', "n_parts",        "number of particles", required_argument,  SSM_SMC | SSM_PMCMC | SSM_MIF | SSM_SIMUL },
         {"O", 'O', "n_obs",          "number of observations to be fitted (for tempering)", required_argument,  SSM_SMC | SSM_KALMAN | SSM_KMCMC | SSM_PMCMC | SSM_KSIMPLEX | SSM_SIMPLEX | SSM_MIF },
         {"A", 'A', "cooling",        "cooling factor (for sampling covariance live tuning or MIF cooling)", required_argument, SSM_KMCMC | SSM_PMCMC | SSM_MIF },
@@ -50,6 +103,10 @@ void ssm_options_load(ssm_options_t *opts, ssm_algo_t algo, int argc, char *argv
         {"E", 'E', "end",            "ISO 8601 date when simulation end", required_argument,  SSM_SIMUL },
         {"Y", 'Y', "eps_abs_integ",  "absolute error for adaptive step-size control", required_argument,  SSM_WORKER | SSM_SMC | SSM_KALMAN | SSM_KMCMC | SSM_PMCMC | SSM_KSIMPLEX | SSM_SIMPLEX | SSM_MIF | SSM_SIMUL },
         {"Z", 'Z', "eps_rel_integ",  "relative error for adaptive step-size control", required_argument,  SSM_WORKER | SSM_SMC | SSM_KALMAN | SSM_KMCMC | SSM_PMCMC | SSM_KSIMPLEX | SSM_SIMPLEX | SSM_MIF | SSM_SIMUL },
+        {"1", '1', "adapt_dt",       "adaptive time steps (sde: step doubling, psr and hybrid: tau-leaping) keeping the relative change (sde: error) of the states per step below <eps> (dt is then the largest time step)", required_argument,  SSM_WORKER | SSM_SMC | SSM_PMCMC | SSM_MIF | SSM_SIMUL },
+        {"2", '2', "scheme",         "integration scheme of the sde implementation: euler (Euler Maruyama), milstein or srk15 (strong order 1.5 stochastic Runge Kutta, models with a single noise only)", required_argument,  SSM_WORKER | SSM_SMC | SSM_PMCMC | SSM_MIF | SSM_SIMUL },
+        {"i", 'i', "eps_cov_integ",  "scaling of the absolute error of the covariance terms (relative to the one of the states) for adaptive step-size control (EKF)", required_argument,  SSM_KALMAN | SSM_KMCMC | SSM_KSIMPLEX },
+        {"u", 'u', "stepper",        "gsl_odeiv2 stepper: rkf45, rkck, rk8pd, rk4imp, bsimp, msbdf (the implicit ones use the jacobian) or auto (switch between rkf45 and msbdf depending on the stiffness)", required_argument,  SSM_WORKER | SSM_SMC | SSM_KALMAN | SSM_KMCMC | SSM_PMCMC | SSM_KSIMPLEX | SSM_SIMPLEX | SSM_MIF | SSM_SIMUL },
         {"G", 'G', "freeze_forcing", "freeze covariates to their value at specified ISO 8601 date", required_argument, SSM_WORKER |  SSM_SMC | SSM_KALMAN | SSM_KMCMC | SSM_PMCMC | SSM_KSIMPLEX | SSM_SIMPLEX | SSM_MIF | SSM_SIMUL },
         {"K", 'K', "like_min",       "if applicable, particles with likelihood smaller than like_min are considered lost. Otherwise, lower bound on likelihood", required_argument,  SSM_WORKER | SSM_SMC | SSM_KALMAN | SSM_KMCMC | SSM_PMCMC | SSM_KSIMPLEX | SSM_SIMPLEX | SSM_MIF },
         {"U", 'U', "eps_max",        "maximum value allowed for epislon", required_argument,  SSM_KMCMC | SSM_PMCMC },
@@ -60,10 +117,11 @@ void ssm_options_load(ssm_options_t *opts, ssm_algo_t algo, int argc, char *argv
         {"V", 'V', "size",           "simplex size used as stopping criteria", required_argument,  SSM_KSIMPLEX | SSM_SIMPLEX },
         {"Q", 'Q', "interpolator",   "gsl interpolator for covariates", required_argument,  SSM_WORKER | SSM_SMC | SSM_KALMAN | SSM_KMCMC | SSM_PMCMC | SSM_KSIMPLEX | SSM_SIMPLEX | SSM_MIF | SSM_SIMUL },
         {"R", 'R', "server",         "domain name or IP address of the particule server (e.g 127.0.0.1)", required_argument,  SSM_WORKER },
+        {"k", 'k', "broker",         "domain name or IP address of a broker sharing its pool of workers (implies --tcp)", required_argument,  SSM_WORKER | SSM_SIMUL | SSM_SMC | SSM_PMCMC | SSM_MIF },
 
-        {"h", 'h', "help",           "print the usage on stdout", no_argument,  SSM_WORKER | SSM_SMC | SSM_KALMAN | SSM_KMCMC | SSM_PMCMC | SSM_KSIMPLEX | SSM_SIMPLEX | SSM_MIF | SSM_SIMUL },
-        {"v", 'v', "verbose",        "print logs (verbose)", no_argument,  SSM_WORKER | SSM_SMC | SSM_KALMAN | SSM_KMCMC | SSM_PMCMC | SSM_KSIMPLEX | SSM_SIMPLEX | SSM_MIF | SSM_SIMUL },
-        {"n", 'n', "warning",        "print warnings", no_argument,  SSM_WORKER | SSM_SMC | SSM_KALMAN | SSM_KMCMC | SSM_PMCMC | SSM_KSIMPLEX | SSM_SIMPLEX | SSM_MIF | SSM_SIMUL },
+        {"h", 'h', "help",           "print the usage on stdout", no_argument,  SSM_WORKER | SSM_SMC | SSM_KALMAN | SSM_KMCMC | SSM_PMCMC | SSM_KSIMPLEX | SSM_SIMPLEX | SSM_MIF | SSM_SIMUL | SSM_BROKER },
+        {"v", 'v', "verbose",        "print logs (verbose)", no_argument,  SSM_WORKER | SSM_SMC | SSM_KALMAN | SSM_KMCMC | SSM_PMCMC | SSM_KSIMPLEX | SSM_SIMPLEX | SSM_MIF | SSM_SIMUL | SSM_BROKER },
+        {"n", 'n', "warning",        "print warnings", no_argument,  SSM_WORKER | SSM_SMC | SSM_KALMAN | SSM_KMCMC | SSM_PMCMC | SSM_KSIMPLEX | SSM_SIMPLEX | SSM_MIF | SSM_SIMUL | SSM_BROKER },
         {"d", 'd', "no_dem_sto",     "turn off demographic stochasticity  (if any)", no_argument,  SSM_WORKER | SSM_SMC | SSM_KALMAN | SSM_KMCMC | SSM_PMCMC | SSM_KSIMPLEX | SSM_SIMPLEX | SSM_MIF | SSM_SIMUL },
         {"w", 'w', "no_white_noise", "turn off white noises (if any)", no_argument,  SSM_WORKER | SSM_SMC | SSM_KALMAN | SSM_KMCMC | SSM_PMCMC | SSM_KSIMPLEX | SSM_SIMPLEX | SSM_MIF | SSM_SIMUL },
         {"f", 'f', "no_diff",        "turn off diffusions (if any)", no_argument,  SSM_WORKER | SSM_SMC | SSM_KALMAN | SSM_KMCMC | SSM_PMCMC | SSM_KSIMPLEX | SSM_SIMPLEX | SSM_MIF | SSM_SIMUL },
@@ -76,6 +134,11 @@ void ssm_options_load(ssm_options_t *opts, ssm_algo_t algo, int argc, char *argv
         {"s", 's', "smooth",         "tune epsilon with the value of the acceptance rate obtained with exponential smoothing", no_argument,  SSM_KMCMC | SSM_PMCMC },
         {"a", 'a', "acc",            "print the acceptance rate", no_argument,  SSM_KMCMC | SSM_PMCMC },
         {"z", 'z', "tcp",            "dispatch particles across machines", no_argument,  SSM_SIMUL | SSM_SMC | SSM_PMCMC | SSM_MIF },
+        {"o", 'o', "chain",          "dispatch whole likelihood evaluations (instead of particles) across machines (implies --tcp)", no_argument,  SSM_PMCMC },
+        {"q", 'q', "prefetch",       "speculatively evaluate the likelihoods of the next <integer> proposals of the accept/reject tree (implies --chain)", required_argument,  SSM_PMCMC },
+        {"m", 'm', "shm",            "use n_thread processes sharing the particles memory instead of threads", no_argument,  SSM_SIMUL | SSM_SMC | SSM_PMCMC | SSM_MIF },
+        {"j", 'j', "sqrt",           "square-root update: the propagated covariance is factorized and updated in square-root form (positive by construction after the update)", no_argument,  SSM_KALMAN | SSM_KMCMC | SSM_KSIMPLEX },
+        {"y", 'y', "steady",         "freeze the Kalman gain and covariance once their relative change is smaller than <tol> (time invariant models only): only the mean is then propagated", required_argument,  SSM_KALMAN | SSM_KMCMC | SSM_KSIMPLEX },
         {"b", 'b', "ic_only",        "only fit the initial condition using fixed lag smoothing", no_argument,  SSM_MIF },
         {"l", 'l', "least_squares",  "minimize the sum of squared errors instead of maximizing the likelihood", no_argument,  SSM_SIMPLEX },
         {"g", 'g', "seed_time",      "seed the random number generator with the current time", no_argument,  SSM_WORKER | SSM_SMC | SSM_KALMAN | SSM_KMCMC | SSM_PMCMC | SSM_KSIMPLEX | SSM_SIMPLEX | SSM_MIF | SSM_SIMUL }
@@ -116,6 +179,7 @@ void ssm_options_load(ssm_options_t *opts, ssm_algo_t algo, int argc, char *argv
     long_options[n_opts].val = 0;
 
     int c;
+    char given[SSM_STR_BUFFSIZE] = ""; //short options given on the command line
 
     while (1) {
         /* getopt_long stores the option index here. */
@@ -125,6 +189,12 @@ void ssm_options_load(ssm_options_t *opts, ssm_algo_t algo, int argc, char *argv
 
         /* Detect the end of the options. */
         if (c == -1) break;
+        size_t n_given = strlen(given);
+        if (c > 0 && n_given < SSM_STR_BUFFSIZE - 1) {
+            given[n_given] = (char) c;
+            given[n_given+1] = '\0';
+        }
+
         switch (c) {
         case 0:
             /* If this option set a flag, do nothing else now. */
@@ -202,6 +272,35 @@ void ssm_options_load(ssm_options_t *opts, ssm_algo_t algo, int argc, char *argv
             opts->eps_rel = atof(optarg);
             break;
 
+        case '1': //adapt_dt
+            opts->adapt_dt = atof(optarg);
+            if(opts->adapt_dt < 0.0){
+                ssm_print_err("--adapt_dt must be positive");
+                exit(EXIT_FAILURE);
+            }
+            break;
+
+        case '2': //scheme
+            if (strcmp(optarg, "euler") == 0) {
+                opts->scheme = SSM_EULER;
+            } else if (strcmp(optarg, "milstein") == 0) {
+                opts->scheme = SSM_MILSTEIN;
+            } else if (strcmp(optarg, "srk15") == 0) {
+                opts->scheme = SSM_SRK15;
+            } else {
+                ssm_print_err("--scheme must be euler, milstein or srk15");
+                exit(EXIT_FAILURE);
+            }
+            break;
+
+        case 'i': //eps_cov_integ
+            opts->eps_cov = atof(optarg);
+            break;
+
+        case 'u': //stepper
+            strncpy(opts->stepper, optarg, SSM_STR_BUFFSIZE);
+            break;
+
         case 'G': //freeze_forcing
             strncpy(opts->freeze_forcing, optarg, SSM_STR_BUFFSIZE);
             break;
@@ -242,6 +341,11 @@ void ssm_options_load(ssm_options_t *opts, ssm_algo_t algo, int argc, char *argv
             strncpy(opts->server, optarg, SSM_STR_BUFFSIZE);
             break;
 
+        case 'k': //broker
+            strncpy(opts->broker, optarg, SSM_STR_BUFFSIZE);
+            opts->flag_tcp = 1;
+            break;
+
         case 'n': //warning
             opts->print |= SSM_PRINT_WARNING;
             break;
@@ -298,6 +402,29 @@ void ssm_options_load(ssm_options_t *opts, ssm_algo_t algo, int argc, char *argv
             opts->flag_tcp = 1;
             break;
 
+        case 'o': //chain
+            opts->flag_chain = 1;
+            opts->flag_tcp = 1;
+            break;
+
+        case 'q': //prefetch
+            opts->prefetch = atoi(optarg);
+            opts->flag_chain = 1;
+            opts->flag_tcp = 1;
+            break;
+
+        case 'm': //shm
+            opts->flag_shm = 1;
+            break;
+
+        case 'j': //sqrt
+            opts->flag_sqrt = 1;
+            break;
+
+        case 'y': //steady
+            opts->steady_tol = atof(optarg);
+            break;
+
         case 'b': //ic_only
             opts->flag_ic_only = 1;
             break;
@@ -322,10 +449,25 @@ void ssm_options_load(ssm_options_t *opts, ssm_algo_t algo, int argc, char *argv
     argv += optind;
 
     ssm_options_set_implementation(opts, algo, argc, argv);    
+    _ssm_options_load_autotune(opts, given);
+
+    if(opts->scheme != SSM_EULER && opts->adapt_dt > 0.0){
+        ssm_print_err("--scheme milstein and srk15 use a fixed time step (they can't be combined with --adapt_dt)");
+        exit(EXIT_FAILURE);
+    }
+
+    //has to be mapped before the particles are allocated
+    if(opts->flag_shm && !opts->flag_tcp){
+        ssm_shm_init(opts);
+    }
 }
 
 void ssm_options_set_implementation(ssm_options_t *opts, ssm_algo_t algo, int argc, char *argv[])
 {
+    if(algo & SSM_BROKER){ //the broker is model agnostic
+	return;
+    }
+
     if(algo & SSM_WORKER){
 	if(argc != 2){
 	    ssm_print_err("invalid usage, correct usage is: worker <implementation> <algorithm> [options]");
@@ -352,6 +494,8 @@ void ssm_options_set_implementation(ssm_options_t *opts, ssm_algo_t algo, int ar
 
 	if(argc == 0 || !strcmp(argv[0], "sde")){
 	    opts->implementation = SSM_EKF;
+	} else if(!strcmp(argv[0], "ukf")){
+	    opts->implementation = SSM_UKF;
 	} else {
             ssm_print_err("invalid implementation");
             exit(EXIT_FAILURE);	    
@@ -379,6 +523,10 @@ void ssm_options_set_implementation(ssm_options_t *opts, ssm_algo_t algo, int ar
 		opts->implementation = SSM_SDE;
 	    } else if (!strcmp(argv[0], "psr")) {
 		opts->implementation = SSM_PSR;
+	    } else if (!strcmp(argv[0], "gillespie")) {
+		opts->implementation = SSM_GILLESPIE;
+	    } else if (!strcmp(argv[0], "hybrid")) {
+		opts->implementation = SSM_HYBRID;
 	    } else {
 		ssm_print_err("invalid implementation");
 		exit(EXIT_FAILURE);
@@ -33,35 +33,133 @@ void ssm_X_reset_inc(ssm_X_t *X, ssm_row_t *row, ssm_nav_t *nav)
         X->proj[ row->states_reset[i]->offset ] = 0.0;
     }
 
-    //reset cov (if EKF)
-    if (nav->implementation == SSM_EKF){
+    //reset cov (if EKF or UKF)
+    if (nav->implementation == SSM_EKF || nav->implementation == SSM_UKF){
         int m = nav->states_sv_inc->length + nav->states_diff->length;
-        gsl_matrix_view Ct =  gsl_matrix_view_array(&X->proj[m], m, m);
+        double *Ct = &X->proj[m];
         for(i=0; i<row->states_reset_length; i++){
             X->proj[ row->states_reset[i]->offset ] = 0.0;
             for(j=0; j<m; j++){
-                gsl_matrix_set(&Ct.matrix, row->states_reset[i]->offset, j, 0);
-                gsl_matrix_set(&Ct.matrix, j, row->states_reset[i]->offset, 0);
+                Ct[ssm_kalman_Ct_index(m, row->states_reset[i]->offset, j)] = 0.0;
             }
         }
     }
 }
 
 /**
- * Modified version of gsl_ran_multinomial to avoid a loop. We avoid
- * to recompute the total sum of p (called norm in GSL) as it will
- * always be 1.0 with ssm (no rounding error by construction)
+ * Index of the last row of the integration span starting at the
+ * time of row n-1 (0 for n = 0). The next rows are merged into the
+ * span as long as nothing happens at the end of its current last row
+ * (no data, no output) and no incidence is reset at the start of the
+ * next one, so that a run of rows with missing data is integrated at
+ * once. The steady-state Kalman filter compares the
+ * prediction/update cycles row by row: nothing is merged with
+ * --steady.
  */
-void ssm_ran_multinomial (const gsl_rng * r, const size_t K, unsigned int N, const double p[], unsigned int n[])
+int ssm_row_span_end(ssm_data_t *data, int n, ssm_nav_t *nav, ssm_calc_t *calc)
+{
+    if((nav->print & (SSM_PRINT_X | SSM_PRINT_HAT | SSM_PRINT_DIAG)) || calc->steady_tol > 0.0){
+        return n;
+    }
+
+    while(n+1 < data->n_obs && !data->rows[n]->ts_nonan_length && !data->rows[n+1]->states_reset_length){
+        n++;
+    }
+
+    return n;
+}
+
+
+/**
+ * Binomial draw of n trials with probability p. The small mean (n
+ * min(p, 1-p) < SSM_BINOMIAL_SMALL_MEAN) draws of the Euler
+ * multinomial transitions (few individuals leaving a compartment
+ * during dt) are made by inversion (a single uniform and a
+ * sequential search from 0 with the recurrence of the binomial
+ * probabilities), the other ones by gsl_ran_binomial() (BTPE). p
+ * outside of ]0, 1[ (possible after rounding) is clamped.
+ */
+unsigned int ssm_ran_binomial(const gsl_rng *r, double p, unsigned int n)
+{
+    if (n == 0 || p <= 0.0) {
+        return 0;
+    } else if (p >= 1.0) {
+        return n;
+    } else if (p > 0.5) {
+        return n - ssm_ran_binomial(r, 1.0 - p, n);
+    } else if (n * p >= SSM_BINOMIAL_SMALL_MEAN) {
+        return gsl_ran_binomial(r, p, n);
+    }
+
+    double s = p / (1.0 - p);
+    double a = (n + 1) * s;
+    double f0 = exp(n * log1p(-p)); //P(X=0)
+
+    for(;;){
+        double u = gsl_rng_uniform(r);
+        double f = f0;
+        unsigned int x = 0;
+
+        while (u > f) {
+            u -= f;
+            x++;
+            if (x > SSM_BINOMIAL_INV_MAX) {
+                break;
+            }
+            f *= (a / x - s);
+        }
+
+        //with a mean smaller than SSM_BINOMIAL_SMALL_MEAN, going past SSM_BINOMIAL_INV_MAX can only come from round-off errors: draw again
+        if (x <= SSM_BINOMIAL_INV_MAX) {
+            return x;
+        }
+    }
+}
+
+
+/**
+ * Normal (diffusion) approximation of a count of mean mu and variance
+ * var, rounded to the nearest integer within [0, n_max]
+ */
+static unsigned int _ssm_ran_normal_count(const gsl_rng *r, double mu, double var, double n_max)
+{
+    double x = floor(mu + gsl_ran_gaussian(r, sqrt(var)) + 0.5);
+    return (unsigned int) GSL_MAX(0.0, GSL_MIN(x, n_max));
+}
+
+
+/**
+ * Poisson draw of the hybrid implementation: normal approximation
+ * when the variance (mu) is larger than SSM_HYBRID_VAR, exact draw
+ * otherwise
+ */
+unsigned int ssm_ran_poisson_hybrid(const gsl_rng *r, double mu)
+{
+    if (mu >= SSM_HYBRID_VAR) {
+        return _ssm_ran_normal_count(r, mu, mu, GSL_POSINF);
+    }
+
+    return gsl_ran_poisson(r, mu);
+}
+
+
+static void _ssm_ran_multinomial(const gsl_rng *r, const size_t K, unsigned int N, const double p[], unsigned int n[], int is_hybrid)
 {
     size_t k;
     double sum_p = 0.0;
 
     unsigned int sum_n = 0;
 
-    for (k = 0; k < K; k++) {
+    for (k = 0; k < K-1 && sum_n < N; k++) {
         if (p[k] > 0.0) {
-            n[k] = gsl_ran_binomial (r, p[k] / (1.0 - sum_p), N - sum_n);
+            double q = p[k] / (1.0 - sum_p);
+            unsigned int m = N - sum_n;
+
+            if (is_hybrid && m*q*(1.0-q) >= SSM_HYBRID_VAR) {
+                n[k] = _ssm_ran_normal_count(r, m*q, m*q*(1.0-q), m);
+            } else {
+                n[k] = ssm_ran_binomial (r, q, m);
+            }
         }
         else {
             n[k] = 0;
@@ -70,6 +168,39 @@ void ssm_ran_multinomial (const gsl_rng * r, const size_t K, unsigned int N, con
         sum_p += p[k];
         sum_n += n[k];
     }
+
+    for (; k < K-1; k++) {
+        n[k] = 0;
+    }
+
+    n[K-1] = N - sum_n;
+}
+
+/**
+ * Modified version of gsl_ran_multinomial to avoid a loop. We avoid
+ * to recompute the total sum of p (called norm in GSL) as it will
+ * always be 1.0 with ssm (no rounding error by construction). As p
+ * sums to 1.0, the last category (staying in the compartment) gets
+ * what the other ones left without a draw, and the draws stop as
+ * soon as the N individuals are allocated (in particular for empty
+ * compartments).
+ */
+void ssm_ran_multinomial (const gsl_rng * r, const size_t K, unsigned int N, const double p[], unsigned int n[])
+{
+    _ssm_ran_multinomial(r, K, N, p, n, 0);
+}
+
+/**
+ * ssm_ran_multinomial() of the hybrid implementation: the binomial
+ * draws (one per exit of the compartment) whose variance is larger
+ * than SSM_HYBRID_VAR are replaced by their normal approximation.
+ * The partition between discrete and continuous exits is thus
+ * re-evaluated at every step from the population of the compartment
+ * and the probability of each exit.
+ */
+void ssm_ran_multinomial_hybrid (const gsl_rng * r, const size_t K, unsigned int N, const double p[], unsigned int n[])
+{
+    _ssm_ran_multinomial(r, K, N, p, n, 1);
 }
 
 /**
@@ -122,15 +253,28 @@ ssm_f_pred_t ssm_get_f_pred(ssm_nav_t *nav)
     ssm_implementations_t implementation = nav->implementation;
     ssm_noises_off_t noises_off= nav->noises_off;
 
-    if (implementation == SSM_ODE || implementation == SSM_EKF) {
+    if (implementation == SSM_ODE) {
         return &ssm_f_prediction_ode;
 
+    } else if (implementation == SSM_EKF){
+        return &ssm_f_prediction_ekf;
+
+    } else if (implementation == SSM_UKF){
+        return &ssm_f_prediction_ukf;
+
     } else if (implementation == SSM_SDE){
 
         if (noises_off == (SSM_NO_DEM_STO | SSM_NO_WHITE_NOISE | SSM_NO_DIFF) ) {
             return &ssm_f_prediction_ode;
+        } else if (nav->adapt_dt > 0.0) {
+            return &ssm_f_prediction_sde_adapt;
         } else if (noises_off == (SSM_NO_DEM_STO | SSM_NO_WHITE_NOISE) ) {
             return &ssm_f_prediction_sde_no_dem_sto_no_white_noise;
+        } else if (nav->scheme == SSM_MILSTEIN) {
+            //without Brownian increments, the schemes reduce to Euler (above)
+            return &ssm_f_prediction_sde_milstein;
+        } else if (nav->scheme == SSM_SRK15) {
+            return &ssm_f_prediction_sde_srk15;
         } else if (noises_off == (SSM_NO_DEM_STO | SSM_NO_DIFF) ) {
             return &ssm_f_prediction_sde_no_dem_sto_no_diff;
         } else if (noises_off == (SSM_NO_WHITE_NOISE | SSM_NO_DIFF) ) {
@@ -145,42 +289,552 @@ ssm_f_pred_t ssm_get_f_pred(ssm_nav_t *nav)
             return &ssm_f_prediction_sde_full;
         }
 
-    } else if (implementation == SSM_PSR){
-        //no_white_noise is handled within the step funciton
-        if(noises_off & SSM_NO_DIFF){
+    } else if (implementation == SSM_PSR || implementation == SSM_HYBRID){
+        //no_white_noise is handled within the step funciton (the hybrid implementation only differs by the samplers of calc)
+        if(nav->adapt_dt > 0.0){
+            return &ssm_f_prediction_psr_adapt;
+        } else if(noises_off & SSM_NO_DIFF){
             return &ssm_f_prediction_psr_no_diff;
         } else {
             return &ssm_f_prediction_psr;
         }
+
+    } else if (implementation == SSM_GILLESPIE){
+        //no_white_noise is handled within ssm_gillespie_freeze()
+        if(noises_off & SSM_NO_DIFF){
+            return &ssm_f_prediction_gillespie_no_diff;
+        } else {
+            return &ssm_f_prediction_gillespie;
+        }
     }
 
     return NULL;
 }
 
 
+/**
+ * --stepper auto: the step size h of an explicit stepper integrating
+ * a stiff system is limited by its stability (h |lambda| within the
+ * stability region of rkf45 for the eigen values lambda of the
+ * jacobian J) instead of its accuracy. ||J||_inf bounds the spectral
+ * radius of J.
+ *
+ * The step allowed by the accuracy is estimated independently of the
+ * stepper in use (the steps of msbdf grow with the stiffness): with
+ * tau = min_i (|y_i| + eps_abs/eps_rel) / |f_i| the time scale of the
+ * solution, rkf45 keeps a relative error eps_rel with steps of about
+ * h_acc = tau eps_rel^(1/5), and no step is longer than t1 - t0. The
+ * system is taken as stiff when h_acc ||J||_inf > SSM_ODE_STIFF_RATIO
+ * and integrated with msbdf until h_acc ||J||_inf <
+ * SSM_ODE_STIFF_RATIO/2 (hysteresis).
+ */
+static void _ssm_select_stepper(ssm_X_t *p_X, double t0, double t1, ssm_calc_t *calc)
+{
+    int i, j;
+    double row, norm = 0.0;
+    double h_acc = t1 - t0;
+    double acc = pow(calc->eps_rel, 0.2);
+    int m = calc->sys.dimension;
+    double dfdt[m];
+    double f[m];
+
+    ssm_jac_ode(t0, p_X->proj, calc->_jac, dfdt, calc);
+    for(i=0; i<m; i++){
+        row = 0.0;
+        for(j=0; j<m; j++){
+            row += fabs(calc->_jac[i*m+j]);
+        }
+        norm = GSL_MAX(norm, row);
+    }
+
+    (calc->sys).function(t0, p_X->proj, f, calc);
+    for(i=0; i<m; i++){
+        if(f[i] != 0.0){
+            h_acc = GSL_MIN(h_acc, acc * (fabs(p_X->proj[i]) + calc->eps_abs/calc->eps_rel) / fabs(f[i]));
+        }
+    }
+
+    if(!calc->is_stiff && h_acc * norm > SSM_ODE_STIFF_RATIO){
+        calc->is_stiff = 1;
+    } else if(calc->is_stiff && h_acc * norm < SSM_ODE_STIFF_RATIO/2.0){
+        calc->is_stiff = 0;
+    }
+
+    gsl_odeiv2_driver *driver = (calc->is_stiff) ? calc->_driver_stiff : calc->_driver;
+    calc->step = driver->s;
+    calc->evolve = driver->e;
+    calc->control = driver->c;
+}
+
+
 ssm_err_code_t ssm_f_prediction_ode(ssm_X_t *p_X, double t0, double t1, ssm_par_t *par, ssm_nav_t *nav, ssm_calc_t *calc)
 {
     double t=t0;
     double *h = &p_X->dt; //h is the integration step size (we propagate it from data point to data points)
     calc->_par = par; //pass the ref to par so that it is available wihtin the function to integrate
 
+    if(calc->_driver_stiff){
+        _ssm_select_stepper(p_X, t0, t1, calc);
+    }
+
     double *y = p_X->proj;
-    gsl_odeiv2_evolve_reset (calc->evolve);
-    gsl_odeiv2_step_reset (calc->step);
+    int is_msbdf = (calc->step->type == gsl_odeiv2_step_msbdf);
+
+    //the integrator is kept warm when this integration continues the previous one (same trajectory, same stepper, starting where it stopped). The history of msbdf is also invalidated by a change of the states (e.g. reset of the incidences)
+    int is_warm = (y == calc->_ode_proj && t0 == calc->_ode_t && calc->step == calc->_ode_step);
+    if(is_warm && is_msbdf){
+        is_warm = (memcmp(y, calc->_ode_y, calc->sys.dimension * sizeof (double)) == 0);
+    }
+
+    if(!is_warm){
+        gsl_odeiv2_evolve_reset (calc->evolve);
+        gsl_odeiv2_step_reset (calc->step);
+    }
 
     while (t < t1) {
         int status = gsl_odeiv2_evolve_apply (calc->evolve, calc->control, calc->step, &(calc->sys), &t, t1, h, y);
         if (status != GSL_SUCCESS) {
+            calc->_ode_proj = NULL;
             if (nav->print & SSM_PRINT_WARNING) {
                 ssm_print_warning("gsl_odeiv2 error");
             }
             return SSM_ERR_PRED;
         }
     }
+
+    calc->_ode_proj = y;
+    calc->_ode_t = t1;
+    calc->_ode_step = calc->step;
+    if(is_msbdf){
+        memcpy(calc->_ode_y, y, calc->sys.dimension * sizeof (double));
+    }
+
     return ssm_check_no_neg_sv_or_remainder(p_X, par, nav, calc, t1);
 }
 
 
+/**
+ * simul: integrate the ode of a particle across the rows without
+ * restarting the integrator at each of them. The steps are only
+ * limited by t_end (the end of the simulation) and the states at t1
+ * are obtained by cubic Hermite interpolation of the step containing
+ * t1 (dense output). The incidences are never reset in the
+ * integrated states: the ones reset by row (at t0) are reported
+ * relative to their cumulated value at t0.
+ *
+ * Explicit steppers only: calc->evolve and calc->step are shared by
+ * all the particles.
+ */
+ssm_err_code_t ssm_f_prediction_ode_dense(ssm_X_t *p_X, ssm_dense_t *dense, double t0, double t1, double t_end, ssm_row_t *row, ssm_par_t *par, ssm_nav_t *nav, ssm_calc_t *calc)
+{
+    int i;
+    int n = nav->states_sv_inc->length + nav->states_diff->length;
+    calc->_par = par;
+
+    if(!dense->is_started){
+        memcpy(dense->y, p_X->proj, n * sizeof (double));
+        memcpy(dense->y_out, p_X->proj, n * sizeof (double));
+        memset(dense->base, 0, n * sizeof (double));
+        dense->t = t0;
+        dense->h = p_X->dt;
+        ssm_step_ode(t0, dense->y, dense->f, calc);
+        dense->is_started = 1;
+    }
+
+    for(i=0; i<row->states_reset_length; i++){
+        int offset = row->states_reset[i]->offset;
+        dense->base[offset] = dense->y_out[offset];
+    }
+
+    gsl_odeiv2_evolve_reset (calc->evolve);
+    gsl_odeiv2_step_reset (calc->step);
+
+    while (dense->t < t1) {
+        memcpy(dense->y_prev, dense->y, n * sizeof (double));
+        memcpy(dense->f_prev, dense->f, n * sizeof (double));
+        dense->t_prev = dense->t;
+
+        int status = gsl_odeiv2_evolve_apply (calc->evolve, calc->control, calc->step, &(calc->sys), &(dense->t), t_end, &(dense->h), dense->y);
+        if (status != GSL_SUCCESS) {
+            if (nav->print & SSM_PRINT_WARNING) {
+                ssm_print_warning("gsl_odeiv2 error");
+            }
+            return SSM_ERR_PRED;
+        }
+        ssm_step_ode(dense->t, dense->y, dense->f, calc);
+    }
+
+    if(t1 == dense->t){
+        memcpy(dense->y_out, dense->y, n * sizeof (double));
+    } else {
+        double dt = dense->t - dense->t_prev;
+        double s = (t1 - dense->t_prev) / dt;
+        double h00 = (1.0 + 2.0*s) * (1.0 - s) * (1.0 - s);
+        double h10 = s * (1.0 - s) * (1.0 - s);
+        double h01 = s * s * (3.0 - 2.0*s);
+        double h11 = s * s * (s - 1.0);
+
+        for(i=0; i<n; i++){
+            dense->y_out[i] = h00*dense->y_prev[i] + h10*dt*dense->f_prev[i] + h01*dense->y[i] + h11*dt*dense->f[i];
+        }
+    }
+
+    for(i=0; i<n; i++){
+        p_X->proj[i] = dense->y_out[i] - dense->base[i];
+    }
+    p_X->dt = dense->h;
+
+    return ssm_check_no_neg_sv_or_remainder(p_X, par, nav, calc, t1);
+}
+
+/**
+ * Lock-step integration of the ode of the B (<= SSM_ODE_BATCH)
+ * particles J_X[b] (parameters J_par[b]) from t0 to t1.
+ *
+ * Instead of one gsl_odeiv2 evolve per particle, the B particles are
+ * advanced together by the Runge-Kutta-Fehlberg (4, 5) scheme of
+ * gsl_odeiv2_step_rkf45 with a shared step size, controlled as with
+ * gsl_odeiv2_control_y_new() but on the largest error across the
+ * lanes. The states and the parameters are stored lane-wise ([n][B])
+ * so that the right hand side (ssm_step_ode_batch()) and every stage
+ * of the scheme are loops over the B lanes that the compiler can
+ * vectorize.
+ *
+ * A lane with a non finite error is masked: it no longer takes part
+ * in the step-size control and gets SSM_ERR_PRED in status[b]. The
+ * status of the other lanes is OR-ed with the one of
+ * ssm_check_no_neg_sv_or_remainder().
+ */
+void ssm_f_prediction_ode_batch(ssm_X_t **J_X, ssm_par_t **J_par, int B, double t0, double t1, ssm_nav_t *nav, ssm_calc_t *calc, ssm_err_code_t *status)
+{
+    static const double a21 = 1.0/4.0;
+    static const double a31 = 3.0/32.0, a32 = 9.0/32.0;
+    static const double a41 = 1932.0/2197.0, a42 = -7200.0/2197.0, a43 = 7296.0/2197.0;
+    static const double a51 = 439.0/216.0, a52 = -8.0, a53 = 3680.0/513.0, a54 = -845.0/4104.0;
+    static const double a61 = -8.0/27.0, a62 = 2.0, a63 = -3544.0/2565.0, a64 = 1859.0/4104.0, a65 = -11.0/40.0;
+    static const double c1 = 16.0/135.0, c3 = 6656.0/12825.0, c4 = 28561.0/56430.0, c5 = -9.0/50.0, c6 = 2.0/55.0; //5th order solution
+    static const double ec1 = 1.0/360.0, ec3 = -128.0/4275.0, ec4 = -2197.0/75240.0, ec5 = 1.0/50.0, ec6 = 2.0/55.0; //5th - 4th order
+
+    int i, b;
+    int n = calc->sys.dimension;
+    int nB = n*B;
+    int n_par = J_par[0]->size;
+
+    //lane-wise ([n][B]) workspace
+    double *y = calc->_batch;
+    double *k1 = y + nB;
+    double *k2 = k1 + nB;
+    double *k3 = k2 + nB;
+    double *k4 = k3 + nB;
+    double *k5 = k4 + nB;
+    double *k6 = k5 + nB;
+    double *y_tmp = k6 + nB;
+    double *y_err = y_tmp + nB;
+    double *P = y_err + nB; //[n_par][B]
+
+    int active[B];
+    int n_active = B;
+    double h = J_X[0]->dt; //shared step size (the smallest one of the lanes)
+
+    for(b=0; b<B; b++){
+        active[b] = 1;
+        h = GSL_MIN(h, J_X[b]->dt);
+        for(i=0; i<n; i++){
+            y[i*B+b] = J_X[b]->proj[i];
+        }
+        for(i=0; i<n_par; i++){
+            P[i*B+b] = gsl_vector_get(J_par[b], i);
+        }
+    }
+
+    double t = t0;
+    int is_k1 = 0; //is k1 the derivative at (t, y) (kept after a rejected step)?
+
+    while (t < t1 && n_active) {
+        double h0 = h;
+        int final_step = 0;
+        if(h0 >= t1 - t){
+            h0 = t1 - t;
+            final_step = 1;
+        }
+
+        if(!is_k1){
+            ssm_step_ode_batch(t, y, k1, B, P, nav, calc);
+            is_k1 = 1;
+        }
+
+        for(i=0; i<nB; i++){
+            y_tmp[i] = y[i] + h0*a21*k1[i];
+        }
+        ssm_step_ode_batch(t + h0/4.0, y_tmp, k2, B, P, nav, calc);
+
+        for(i=0; i<nB; i++){
+            y_tmp[i] = y[i] + h0*(a31*k1[i] + a32*k2[i]);
+        }
+        ssm_step_ode_batch(t + 3.0*h0/8.0, y_tmp, k3, B, P, nav, calc);
+
+        for(i=0; i<nB; i++){
+            y_tmp[i] = y[i] + h0*(a41*k1[i] + a42*k2[i] + a43*k3[i]);
+        }
+        ssm_step_ode_batch(t + 12.0*h0/13.0, y_tmp, k4, B, P, nav, calc);
+
+        for(i=0; i<nB; i++){
+            y_tmp[i] = y[i] + h0*(a51*k1[i] + a52*k2[i] + a53*k3[i] + a54*k4[i]);
+        }
+        ssm_step_ode_batch(t + h0, y_tmp, k5, B, P, nav, calc);
+
+        for(i=0; i<nB; i++){
+            y_tmp[i] = y[i] + h0*(a61*k1[i] + a62*k2[i] + a63*k3[i] + a64*k4[i] + a65*k5[i]);
+        }
+        ssm_step_ode_batch(t + h0/2.0, y_tmp, k6, B, P, nav, calc);
+
+        for(i=0; i<nB; i++){
+            y_tmp[i] = y[i] + h0*(c1*k1[i] + c3*k3[i] + c4*k4[i] + c5*k5[i] + c6*k6[i]);
+            y_err[i] = h0*(ec1*k1[i] + ec3*k3[i] + ec4*k4[i] + ec5*k5[i] + ec6*k6[i]);
+        }
+
+        //largest error (relative to eps_abs + eps_rel |y|) of the active lanes
+        double rmax = 0.0;
+        for(b=0; b<B; b++){
+            if(active[b]){
+                int is_finite = 1;
+                double r = 0.0;
+                for(i=0; i<n; i++){
+                    double e = fabs(y_err[i*B+b]) / (calc->eps_abs + calc->eps_rel * fabs(y_tmp[i*B+b]));
+                    is_finite = is_finite && gsl_finite(e);
+                    r = GSL_MAX(r, e);
+                }
+
+                if(is_finite){
+                    rmax = GSL_MAX(rmax, r);
+                } else {
+                    active[b] = 0;
+                    n_active--;
+                    status[b] |= SSM_ERR_PRED;
+                    if (nav->print & SSM_PRINT_WARNING) {
+                        ssm_print_warning("non finite error in the lock-step ode integration");
+                    }
+                }
+            }
+        }
+
+        if(rmax > 1.1){ //rejected: decrease the step size (as gsl_odeiv2_control_y_new() does for an order 5 stepper)
+            h = h0 * GSL_MAX(0.9*pow(rmax, -1.0/5.0), 0.2);
+            if(t + h == t){
+                for(b=0; b<B; b++){
+                    if(active[b]){
+                        active[b] = 0;
+                        status[b] |= SSM_ERR_PRED;
+                    }
+                }
+                if (nav->print & SSM_PRINT_WARNING) {
+                    ssm_print_warning("step size underflow in the lock-step ode integration");
+                }
+                return;
+            }
+            continue;
+        }
+
+        memcpy(y, y_tmp, nB * sizeof (double));
+        t = (final_step) ? t1 : t + h0;
+        is_k1 = 0;
+
+        //as gsl_odeiv2_evolve_apply(), the final step (shortened to land on t1) doesn't change the step size proposed for the next integration
+        if(!final_step){
+            h = h0;
+            if(rmax < 0.5){
+                h *= GSL_MAX(1.0, GSL_MIN(0.9*pow(rmax, -1.0/6.0), 5.0));
+            }
+        }
+    }
+
+    for(b=0; b<B; b++){
+        if(active[b]){
+            for(i=0; i<n; i++){
+                J_X[b]->proj[i] = y[i*B+b];
+            }
+            J_X[b]->dt = h;
+            status[b] |= ssm_check_no_neg_sv_or_remainder(J_X[b], J_par[b], nav, calc, t1);
+        }
+    }
+}
+
+
+/**
+ * Lane-wise stepping function of the sde or psr prediction function
+ * f_pred (NULL if there is none) and whether it is followed by
+ * ssm_compute_diff_batch() (is_diff)
+ */
+static ssm_step_batch_t _ssm_get_step_batch(ssm_f_pred_t f_pred, int *is_diff)
+{
+    *is_diff = (f_pred == &ssm_f_prediction_sde_no_dem_sto_no_white_noise ||
+                f_pred == &ssm_f_prediction_sde_no_dem_sto ||
+                f_pred == &ssm_f_prediction_sde_no_white_noise ||
+                f_pred == &ssm_f_prediction_sde_full ||
+                f_pred == &ssm_f_prediction_psr);
+
+    if (f_pred == &ssm_f_prediction_sde_no_dem_sto_no_white_noise) {
+        return &ssm_step_sde_batch_no_dem_sto_no_white_noise;
+    } else if (f_pred == &ssm_f_prediction_sde_no_dem_sto_no_diff || f_pred == &ssm_f_prediction_sde_no_dem_sto) {
+        return &ssm_step_sde_batch_no_dem_sto;
+    } else if (f_pred == &ssm_f_prediction_sde_no_white_noise_no_diff || f_pred == &ssm_f_prediction_sde_no_white_noise) {
+        return &ssm_step_sde_batch_no_white_noise;
+    } else if (f_pred == &ssm_f_prediction_sde_no_diff || f_pred == &ssm_f_prediction_sde_full) {
+        return &ssm_step_sde_batch_full;
+    } else if (f_pred == &ssm_f_prediction_psr_no_diff || f_pred == &ssm_f_prediction_psr) {
+        return &ssm_step_psr_batch;
+    }
+
+    return NULL;
+}
+
+
+/**
+ * Step the B particles J_X[b] (parameters J_par[b]) of an sde or a
+ * psr from t0 to t1 together: the states and the parameters are
+ * stored lane-wise ([n][B]) in calc->_batch so that the caches, the
+ * Euler updates and the diffusions of step_batch (and of
+ * ssm_compute_diff_batch() if is_diff) are loops over the B lanes
+ * that the compiler can vectorize. The particles must share the same
+ * time step. The status of each particle is OR-ed in status[b].
+ *
+ * The noises are drawn lane after lane from calc->randgsl: the
+ * trajectories have the same distribution as with the one particle
+ * at a time prediction functions but are not the same realisations.
+ */
+void ssm_f_prediction_sto_batch(ssm_X_t **J_X, ssm_par_t **J_par, int B, double t0, double t1, ssm_step_batch_t step_batch, int is_diff, ssm_nav_t *nav, ssm_calc_t *calc, ssm_err_code_t *status)
+{
+    int i, b;
+    int n = J_X[0]->length;
+    int n_par = J_par[0]->size;
+    double dt = J_X[0]->dt;
+
+    double *Y = calc->_batch; //[n][B]
+    double *P = Y + n*B;      //[n_par][B]
+
+    for(b=0; b<B; b++){
+        for(i=0; i<n; i++){
+            Y[i*B+b] = J_X[b]->proj[i];
+        }
+        for(i=0; i<n_par; i++){
+            P[i*B+b] = gsl_vector_get(J_par[b], i);
+        }
+    }
+
+    double t = t0;
+    while (t < t1) {
+        (*step_batch)(Y, t, dt, B, P, nav, calc);
+        if(is_diff){
+            ssm_compute_diff_batch(Y, dt, B, P, nav, calc);
+        }
+        t += dt;
+    }
+
+    for(b=0; b<B; b++){
+        for(i=0; i<n; i++){
+            J_X[b]->proj[i] = Y[i*B+b];
+        }
+        status[b] |= ssm_check_no_neg_sv_or_remainder(J_X[b], J_par[b], nav, calc, t1);
+    }
+}
+
+
+/**
+ * Reset the incidences of the particles J_X[j] (J_start <= j <
+ * J_end) and integrate them from t0 to t1, OR-ing their status in
+ * cum_status[j]. The parameters of particle j are J_par[j] if
+ * flag_J_par and J_par[0] otherwise.
+ *
+ * Particles of an ode are integrated SSM_ODE_BATCH at a time by
+ * ssm_f_prediction_ode_batch() when calc has its workspace, particles
+ * of an sde or a psr SSM_STO_BATCH at a time by
+ * ssm_f_prediction_sto_batch() (when they share the same fixed time step),
+ * other particles one by one by f_pred.
+ */
+void ssm_f_prediction_J(ssm_X_t **J_X, int J_start, int J_end, ssm_par_t **J_par, int flag_J_par, ssm_row_t *row, double t0, double t1, ssm_f_pred_t f_pred, ssm_nav_t *nav, ssm_calc_t *calc, ssm_err_code_t *cum_status)
+{
+    int j, b, B;
+    int is_diff;
+    ssm_step_batch_t step_batch = _ssm_get_step_batch(f_pred, &is_diff);
+
+    for(j=J_start; j<J_end; j++){
+        ssm_X_reset_inc(J_X[j], row, nav);
+    }
+
+    if(calc->_batch && nav->implementation == SSM_ODE && f_pred == &ssm_f_prediction_ode){
+        ssm_par_t *B_par[SSM_ODE_BATCH];
+
+        for(j=J_start; j<J_end; j+=B){
+            B = GSL_MIN(SSM_ODE_BATCH, J_end - j);
+            for(b=0; b<B; b++){
+                B_par[b] = (flag_J_par) ? J_par[j+b] : J_par[0];
+            }
+            ssm_f_prediction_ode_batch(&J_X[j], B_par, B, t0, t1, nav, calc, &cum_status[j]);
+        }
+    } else if(calc->_batch && step_batch){
+        ssm_par_t *B_par[SSM_STO_BATCH];
+
+        for(j=J_start; j<J_end; j+=B){
+            B = GSL_MIN(SSM_STO_BATCH, J_end - j);
+
+            int is_same_dt = 1;
+            for(b=0; b<B; b++){
+                B_par[b] = (flag_J_par) ? J_par[j+b] : J_par[0];
+                is_same_dt = is_same_dt && (J_X[j+b]->dt == J_X[j]->dt);
+            }
+
+            if(is_same_dt){
+                ssm_f_prediction_sto_batch(&J_X[j], B_par, B, t0, t1, step_batch, is_diff, nav, calc, &cum_status[j]);
+            } else {
+                for(b=0; b<B; b++){
+                    cum_status[j+b] |= (*f_pred)(J_X[j+b], t0, t1, B_par[b], nav, calc);
+                }
+            }
+        }
+    } else {
+        for(j=J_start; j<J_end; j++){
+            cum_status[j] |= (*f_pred)(J_X[j], t0, t1, (flag_J_par) ? J_par[j] : J_par[0], nav, calc);
+        }
+    }
+}
+
+
+
+/**
+ * Once the Kalman gain and covariance are frozen (see
+ * ssm_kalman_steady_check()), only the states are integrated and Ct
+ * is set to its (frozen) predicted value.
+ */
+ssm_err_code_t ssm_f_prediction_ekf(ssm_X_t *p_X, double t0, double t1, ssm_par_t *par, ssm_nav_t *nav, ssm_calc_t *calc)
+{
+    if(!calc->is_steady){
+        return ssm_f_prediction_ode(p_X, t0, t1, par, nav, calc);
+    }
+
+    double t=t0;
+    double *h = &p_X->dt;
+    int m = nav->states_sv_inc->length + nav->states_diff->length;
+    calc->_par = par;
+
+    double *y = p_X->proj;
+    gsl_odeiv2_evolve_reset (calc->_steady_evolve);
+    gsl_odeiv2_step_reset (calc->_steady_step);
+
+    while (t < t1) {
+        int status = gsl_odeiv2_evolve_apply (calc->_steady_evolve, calc->control, calc->_steady_step, &(calc->_steady_sys), &t, t1, h, y);
+        if (status != GSL_SUCCESS) {
+            if (nav->print & SSM_PRINT_WARNING) {
+                ssm_print_warning("gsl_odeiv2 error");
+            }
+            return SSM_ERR_PRED;
+        }
+    }
+
+    memcpy(&p_X->proj[m], calc->_steady_Ct_pred, (m*(m+1))/2 * sizeof (double));
+
+    return ssm_check_no_neg_sv_or_remainder(p_X, par, nav, calc, t1);
+}
+
 
 ssm_err_code_t ssm_f_prediction_sde_no_dem_sto_no_white_noise(ssm_X_t *p_X, double t0, double t1, ssm_par_t *par, ssm_nav_t *nav, ssm_calc_t *calc)
 {
@@ -293,3 +947,306 @@ ssm_err_code_t ssm_f_prediction_psr_no_diff(ssm_X_t *p_X, double t0, double t1,
     }
     return ssm_check_no_neg_sv_or_remainder(p_X, par, nav, calc, t1);
 }
+
+
+typedef void (*_ssm_step_sde_t) (ssm_X_t *, double, ssm_par_t *, ssm_nav_t *, ssm_calc_t *);
+
+static _ssm_step_sde_t _ssm_get_step_sde(ssm_noises_off_t noises_off, int *is_diff)
+{
+    *is_diff = !(noises_off & SSM_NO_DIFF);
+
+    if ((noises_off & SSM_NO_DEM_STO) && (noises_off & SSM_NO_WHITE_NOISE)) {
+        return &ssm_step_sde_no_dem_sto_no_white_noise;
+    } else if (noises_off & SSM_NO_DEM_STO) {
+        return &ssm_step_sde_no_dem_sto;
+    } else if (noises_off & SSM_NO_WHITE_NOISE) {
+        return &ssm_step_sde_no_white_noise;
+    }
+
+    return &ssm_step_sde_full;
+}
+
+
+/**
+ * Euler Maruyama with an adaptive time step (--adapt_dt): the length
+ * h of each step is chosen by step doubling on the noise-free system
+ * (one step of length h against 2 steps of length h/2, with the
+ * Brownian increments of calc->_dw set to 0). h is halved until they
+ * differ by less than adapt_dt*max(|x|, 1) for every state variable
+ * and incidence x, the step is then taken with its noises and the
+ * next one is lengthened.
+ *
+ * h only depends on the states at the start of the step (and not on
+ * the noises of the step): controlling the error of the noisy steps
+ * would select the Brownian paths and bias the noises.
+ *
+ * The step size is carried from one call to the next in p_X->dt and
+ * stays between p_X->dt0/2^SSM_ADAPT_DT_DEPTH and p_X->dt0.
+ */
+ssm_err_code_t ssm_f_prediction_sde_adapt(ssm_X_t *p_X, double t0, double t1, ssm_par_t *par, ssm_nav_t *nav, ssm_calc_t *calc)
+{
+    int i, is_diff;
+    _ssm_step_sde_t step = _ssm_get_step_sde(nav->noises_off, &is_diff);
+    ssm_it_states_t *states_sv_inc = nav->states_sv_inc;
+
+    double *X = p_X->proj;
+    double *X0 = calc->_X_adapt;
+    double *X_full = calc->_X_adapt + p_X->length;
+    size_t size_X = p_X->length * sizeof (double);
+
+    double eps = nav->adapt_dt;
+    double h_min = p_X->dt0 / (double) (1 << SSM_ADAPT_DT_DEPTH);
+    double h = GSL_MIN(p_X->dt, p_X->dt0);
+    double t = t0;
+
+    while (t < t1) {
+        int is_last = (h >= t1 - t); //the step ends at t1
+        int is_shortened = (h > t1 - t); //and is shorter than h
+        double h_step = (is_last) ? t1 - t : h;
+        double err;
+
+        memcpy(X0, X, size_X);
+        calc->_dw = calc->_dw_zero;
+
+        for(;;){
+            p_X->dt = h_step;
+            step(p_X, t, par, nav, calc);
+            memcpy(X_full, X, size_X);
+            memcpy(X, X0, size_X);
+
+            p_X->dt = 0.5*h_step;
+            step(p_X, t, par, nav, calc);
+            step(p_X, t + 0.5*h_step, par, nav, calc);
+
+            err = 0.0;
+            for(i=0; i<states_sv_inc->length; i++){
+                int o = states_sv_inc->p[i]->offset;
+                err = GSL_MAX(err, fabs(X[o] - X_full[o]) / (eps * GSL_MAX(fabs(X[o]), 1.0)));
+            }
+            memcpy(X, X0, size_X);
+
+            if (err <= 1.0 || 0.5*h_step < h_min) {
+                break;
+            }
+            h_step *= 0.5;
+            is_last = 0;
+            is_shortened = 0;
+        }
+
+        calc->_dw = NULL;
+        p_X->dt = h_step;
+        step(p_X, t, par, nav, calc);
+        if (is_diff) {
+            ssm_compute_diff(p_X, par, nav, calc);
+        }
+
+        t = (is_last) ? t1 : t + h_step;
+
+        //the error of Euler on the noise-free system is O(h^2): the next step is grown (or shrunk) from the accepted one. A step that was only shortened to end at t1 says nothing about h, which is kept
+        if (!is_shortened) {
+            h = h_step * ((err > 0.2025) ? 0.9/sqrt(err) : 2.0);
+            h = GSL_MIN(p_X->dt0, GSL_MAX(h_min, h));
+        }
+    }
+
+    p_X->dt = h;
+
+    return ssm_check_no_neg_sv_or_remainder(p_X, par, nav, calc, t1);
+}
+
+
+/**
+ * Milstein scheme (--scheme milstein): the Euler Maruyama step plus
+ * the correction of ssm_sde_milstein() (derivatives of the diffusion
+ * matrix generated from the model). The Levy areas are neglected: the
+ * scheme is of strong order 1 when the noises commute (a single
+ * noise, or noises acting on distinct states) and of strong order 0.5
+ * (as Euler Maruyama) otherwise.
+ */
+ssm_err_code_t ssm_f_prediction_sde_milstein(ssm_X_t *p_X, double t0, double t1, ssm_par_t *par, ssm_nav_t *nav, ssm_calc_t *calc)
+{
+    int i, j, l;
+    int is_diff = !(nav->noises_off & SSM_NO_DIFF);
+    int n_X = p_X->length;
+    int n_dw = ssm_sde_dw_length();
+    ssm_it_states_t *states_sv_inc = nav->states_sv_inc;
+
+    double *X = p_X->proj;
+    double *a = calc->_sde_ws;
+    double *m = a + n_X;
+    double *dw = m + n_X;
+    double *dd = dw + n_dw;
+    double *g = dd + n_dw*n_dw;
+
+    double dt = p_X->dt;
+    double sqrt_dt = sqrt(dt);
+    double t = t0;
+
+    while (t < t1) {
+        for(j=0; j<n_dw; j++){
+            dw[j] = (ssm_sde_dw_on(j, nav)) ? sqrt_dt*gsl_ran_ugaussian(calc->randgsl) : 0.0;
+        }
+
+        for(j=0; j<n_dw; j++){
+            for(l=0; l<n_dw; l++){
+                dd[j*n_dw + l] = dw[j]*dw[l];
+            }
+            if (ssm_sde_dw_on(j, nav)) {
+                dd[j*n_dw + j] -= dt;
+            }
+        }
+
+        ssm_sde_drift_diffusion(X, t, a, g, par, nav, calc);
+        ssm_sde_milstein(X, t, dd, m, par, nav, calc);
+
+        for(i=0; i<states_sv_inc->length; i++){
+            int o = states_sv_inc->p[i]->offset;
+            double x = X[o] + a[o]*dt + m[o];
+            for(j=0; j<n_dw; j++){
+                x += g[o*n_dw + j]*dw[j];
+            }
+            X[o] = (x < 0.0) ? 0.0 : x;
+        }
+
+        if (is_diff) {
+            ssm_compute_diff(p_X, par, nav, calc);
+        }
+
+        t += dt;
+    }
+
+    return ssm_check_no_neg_sv_or_remainder(p_X, par, nav, calc, t1);
+}
+
+
+/**
+ * Y + a*dt + b*h for the state variables and the incidences
+ * (truncated at 0 as the steps), the diffusions are copied from Y
+ */
+static void _ssm_sde_stage(double *dest, const double *Y, const double *a, double dt, const double *b, double h, int n_dw, ssm_X_t *p_X, ssm_nav_t *nav)
+{
+    int i;
+    ssm_it_states_t *states_sv_inc = nav->states_sv_inc;
+
+    memcpy(dest, Y, p_X->length * sizeof (double));
+
+    for(i=0; i<states_sv_inc->length; i++){
+        int o = states_sv_inc->p[i]->offset;
+        double x = Y[o] + ((a) ? a[o]*dt : 0.0) + b[o*n_dw]*h;
+        dest[o] = (x < 0.0) ? 0.0 : x;
+    }
+}
+
+
+/**
+ * Explicit strong order 1.5 stochastic Runge Kutta scheme (--scheme
+ * srk15) of Kloeden and Platen (1992, eq. 11.2.1). It is derivative
+ * free but requires a single Brownian motion (checked when calc is
+ * built): only one of the columns of the diffusion matrix (see
+ * ssm_sde_drift_diffusion()) can be switched on. The covariates are
+ * evaluated at the start of each step.
+ */
+ssm_err_code_t ssm_f_prediction_sde_srk15(ssm_X_t *p_X, double t0, double t1, ssm_par_t *par, ssm_nav_t *nav, ssm_calc_t *calc)
+{
+    int i, k;
+    int is_diff = !(nav->noises_off & SSM_NO_DIFF);
+    int n_X = p_X->length;
+    int n_dw = ssm_sde_dw_length();
+    ssm_it_states_t *states_sv_inc = nav->states_sv_inc;
+
+    double *X = p_X->proj;
+    double *Y_p = calc->_sde_ws; //Upsilon+, Upsilon-, Phi+, Phi-
+    double *Y_m = Y_p + n_X;
+    double *P_p = Y_m + n_X;
+    double *P_m = P_p + n_X;
+    double *a = P_m + n_X;
+    double *a_p = a + n_X;
+    double *a_m = a_p + n_X;
+    double *a_tmp = a_m + n_X;
+    double *g = a_tmp + n_X;
+    double *g_p = g + n_X*n_dw;
+    double *g_m = g_p + n_X*n_dw;
+    double *g_Pp = g_m + n_X*n_dw;
+    double *g_Pm = g_Pp + n_X*n_dw;
+
+    double dt = p_X->dt;
+    double sqrt_dt = sqrt(dt);
+    double t = t0;
+
+    //the single noise switched on
+    for(k=0; k<n_dw && !ssm_sde_dw_on(k, nav); k++);
+
+    while (t < t1) {
+        double dW = sqrt_dt*gsl_ran_ugaussian(calc->randgsl);
+        double dZ = 0.5*dt*(dW + sqrt_dt*gsl_ran_ugaussian(calc->randgsl)/M_SQRT3); //int_t^{t+dt} (W_s - W_t) ds
+
+        ssm_sde_drift_diffusion(X, t, a, g, par, nav, calc);
+
+        _ssm_sde_stage(Y_p, X, a, dt, g + k, sqrt_dt, n_dw, p_X, nav);
+        _ssm_sde_stage(Y_m, X, a, dt, g + k, -sqrt_dt, n_dw, p_X, nav);
+        ssm_sde_drift_diffusion(Y_p, t, a_p, g_p, par, nav, calc);
+        ssm_sde_drift_diffusion(Y_m, t, a_m, g_m, par, nav, calc);
+
+        _ssm_sde_stage(P_p, Y_p, NULL, dt, g_p + k, sqrt_dt, n_dw, p_X, nav);
+        _ssm_sde_stage(P_m, Y_p, NULL, dt, g_p + k, -sqrt_dt, n_dw, p_X, nav);
+        ssm_sde_drift_diffusion(P_p, t, a_tmp, g_Pp, par, nav, calc);
+        ssm_sde_drift_diffusion(P_m, t, a_tmp, g_Pm, par, nav, calc);
+
+        for(i=0; i<states_sv_inc->length; i++){
+            int o = states_sv_inc->p[i]->offset;
+            int ok = o*n_dw + k;
+            double b = g[ok];
+
+            double x = X[o] + b*dW
+                + (a_p[o] - a_m[o])*dZ/(2.0*sqrt_dt)
+                + 0.25*(a_p[o] + 2.0*a[o] + a_m[o])*dt
+                + (g_p[ok] - g_m[ok])*(dW*dW - dt)/(4.0*sqrt_dt)
+                + (g_p[ok] - 2.0*b + g_m[ok])*(dW*dt - dZ)/(2.0*dt)
+                + (g_Pp[ok] - g_Pm[ok] - g_p[ok] + g_m[ok])*(dW*dW/3.0 - dt)*dW/(4.0*dt);
+
+            X[o] = (x < 0.0) ? 0.0 : x;
+        }
+
+        if (is_diff) {
+            ssm_compute_diff(p_X, par, nav, calc);
+        }
+
+        t += dt;
+    }
+
+    return ssm_check_no_neg_sv_or_remainder(p_X, par, nav, calc, t1);
+}
+
+/**
+ * Poisson with stochastic rate with an adaptive time step
+ * (--adapt_dt): tau-leaping where each step is the largest one
+ * satisfying the leap condition of Cao, Gillespie and Petzold (2006)
+ * with eps = adapt_dt (see ssm_psr_leap()), between
+ * p_X->dt0/2^SSM_ADAPT_DT_DEPTH and p_X->dt0.
+ */
+ssm_err_code_t ssm_f_prediction_psr_adapt(ssm_X_t *p_X, double t0, double t1, ssm_par_t *par, ssm_nav_t *nav, ssm_calc_t *calc)
+{
+    int is_diff = !(nav->noises_off & SSM_NO_DIFF);
+    double h_min = p_X->dt0 / (double) (1 << SSM_ADAPT_DT_DEPTH);
+    double t = t0;
+
+    while (t < t1) {
+        double h = GSL_MIN(p_X->dt0, ssm_psr_leap(p_X, t, nav->adapt_dt, par, nav, calc));
+        int is_last;
+
+        h = GSL_MAX(h, h_min);
+        is_last = (h >= t1 - t);
+        p_X->dt = (is_last) ? t1 - t : h;
+
+        ssm_step_psr(p_X, t, par, nav, calc);
+        if (is_diff) {
+            ssm_compute_diff(p_X, par, nav, calc);
+        }
+
+        t = (is_last) ? t1 : t + h;
+    }
+
+    p_X->dt = p_X->dt0;
+
+    return ssm_check_no_neg_sv_or_remainder(p_X, par, nav, calc, t1);
+}
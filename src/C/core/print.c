@@ -388,7 +388,7 @@ void ssm_print_pred_res(FILE *stream, ssm_X_t **J_X, ssm_par_t *par, ssm_nav_t *
         observed = row->observed[ts];
         y = row->values[ts];
 
-        if (implementation == SSM_EKF) {
+        if (implementation == SSM_EKF || implementation == SSM_UKF) {
             var_obs = observed->f_obs_var(X, par, calc, t);
             pred = observed->f_obs_mean(X, par, calc, t);
             var_state = observed->f_var_pred(X, par, calc, nav, t);
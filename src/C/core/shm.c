@@ -0,0 +1,139 @@
+/**************************************************************************
+ *    This file is part of ssm.
+ *
+ *    ssm is free software: you can redistribute it and/or modify it
+ *    under the terms of the GNU General Public License as published
+ *    by the Free Software Foundation, either version 3 of the
+ *    License, or (at your option) any later version.
+ *
+ *    ssm is distributed in the hope that it will be useful, but
+ *    WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public
+ *    License along with ssm.  If not, see
+ *    <http://www.gnu.org/licenses/>.
+ *************************************************************************/
+
+#include "ssm.h"
+
+/**
+ * With --shm, the particle cloud (ssm_X_t), the parameters (ssm_par_t)
+ * and the weights and status of ssm_fitness_t are allocated in a
+ * POSIX shared memory segment. It is mapped before the workers are
+ * forked (see ssm_workers_start()) so that it lives at the same
+ * address in every process: the workers integrate the particles in
+ * place and only the chunk to integrate goes through the (ipc://)
+ * sockets.
+ *
+ * There is one segment per process, hence the static variable.
+ */
+static ssm_shm_t *_ssm_shm = NULL;
+
+
+void ssm_shm_init(ssm_options_t *opts)
+{
+    char name[SSM_STR_BUFFSIZE];
+
+    if(_ssm_shm){
+        return;
+    }
+
+    _ssm_shm = malloc(sizeof (ssm_shm_t));
+    if(_ssm_shm == NULL){
+        ssm_print_err("Allocation impossible for ssm_shm_t *");
+        exit(EXIT_FAILURE);
+    }
+
+    snprintf(name, SSM_STR_BUFFSIZE, "/ssm_%d_%d", (int) getpid(), opts->id);
+    int fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, S_IRUSR | S_IWUSR);
+    if(fd == -1){
+        ssm_print_err("could not create the shared memory segment");
+        exit(EXIT_FAILURE);
+    }
+
+    //pages are only allocated when they are used
+    if(ftruncate(fd, SSM_SHM_SIZE) == -1){
+        ssm_print_err("could not size the shared memory segment");
+        exit(EXIT_FAILURE);
+    }
+
+    _ssm_shm->base = mmap(NULL, SSM_SHM_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if(_ssm_shm->base == MAP_FAILED){
+        ssm_print_err("could not map the shared memory segment");
+        exit(EXIT_FAILURE);
+    }
+    close(fd);
+
+    //the workers inherit the mapping: the name is not needed anymore (and nothing is left behind if we crash)
+    shm_unlink(name);
+
+    _ssm_shm->size = SSM_SHM_SIZE;
+    _ssm_shm->used = 0;
+    _ssm_shm->flag_forked = 0;
+}
+
+
+/**
+ * to be called in a forked worker: the segment can still be read and
+ * written but further allocations have to be private.
+ */
+void ssm_shm_forked(void)
+{
+    if(_ssm_shm){
+        _ssm_shm->flag_forked = 1;
+    }
+}
+
+
+/**
+ * are the allocations made in the shared memory segment?
+ */
+int ssm_shm_active(void)
+{
+    return (_ssm_shm && !_ssm_shm->flag_forked);
+}
+
+
+/**
+ * allocate in the shared memory segment if any (malloc otherwise)
+ */
+void *ssm_shm_malloc(size_t size)
+{
+    void *ptr;
+
+    if(ssm_shm_active()){
+        size_t aligned = (size + SSM_SHM_ALIGN - 1) & ~((size_t) SSM_SHM_ALIGN - 1);
+        if(_ssm_shm->used + aligned > _ssm_shm->size){
+            ssm_print_err("shared memory segment exhausted (try without --shm)");
+            exit(EXIT_FAILURE);
+        }
+
+        ptr = (char *) _ssm_shm->base + _ssm_shm->used;
+        _ssm_shm->used += aligned;
+    } else {
+        ptr = malloc(size);
+    }
+
+    if(ptr == NULL){
+        ssm_print_err("Allocation impossible in ssm_shm_malloc");
+        exit(EXIT_FAILURE);
+    }
+
+    return ptr;
+}
+
+
+/**
+ * free memory obtained with ssm_shm_malloc(). Memory of the segment
+ * is released with the segment when the process exits.
+ */
+void ssm_shm_free(void *ptr)
+{
+    if(_ssm_shm && (char *) ptr >= (char *) _ssm_shm->base && (char *) ptr < (char *) _ssm_shm->base + _ssm_shm->size){
+        return;
+    }
+
+    free(ptr);
+}
@@ -131,3 +131,76 @@ void ssm_swap_X(ssm_X_t ***X, ssm_X_t ***tmp_X)
     *tmp_X=*X;
     *X=tmp;
 }
+
+
+/**
+ * Run a particle filter with the parameters par (the initial
+ * conditions are in D_J_X[0]) and compute fitness->log_like.
+ * workers dispatch the particles (tcp or inproc) if any.
+ */
+ssm_err_code_t ssm_run_smc(ssm_f_pred_t f_pred, ssm_X_t ***D_J_X, ssm_X_t ***D_J_X_tmp, ssm_par_t *par, ssm_calc_t **calc, ssm_data_t *data, ssm_fitness_t *fitness, ssm_nav_t *nav, ssm_workers_t *workers)
+{
+    int j, n, np1, the_j;
+    double t0, t1;
+
+    fitness->log_like = 0.0;
+    fitness->log_prior = 0.0;
+    fitness->n_all_fail = 0;
+
+    for(j=0; j<fitness->J; j++){
+	fitness->cum_status[j] = SSM_SUCCESS;
+    }
+
+    for(n=0; n<data->n_obs; n++) {
+        np1 = n+1;
+        t0 = (n) ? data->rows[n-1]->time: 0;
+        t1 = data->rows[n]->time;
+
+	if(!workers->flag_tcp){
+	    for(j=0; j<fitness->J; j++){
+		ssm_X_copy(D_J_X[np1][j], D_J_X[n][j]);
+	    }
+	}
+
+	if(workers->flag_tcp){
+	    //send work
+	    for (j=0;j<fitness->J;j++) {
+		zmq_send(workers->sender, &n, sizeof (int), ZMQ_SNDMORE);
+		ssm_zmq_send_par(workers->sender, par, ZMQ_SNDMORE);
+
+		zmq_send(workers->sender, &j, sizeof (int), ZMQ_SNDMORE);                   	       	       
+		ssm_zmq_send_X(workers->sender, D_J_X[n][j], ZMQ_SNDMORE);
+		zmq_send(workers->sender, &(fitness->cum_status[j]), sizeof (ssm_err_code_t), 0);
+	    }
+
+	    //get results from the workers
+	    for (j=0; j<fitness->J; j++) {
+		zmq_recv(workers->receiver, &the_j, sizeof (int), 0);
+		ssm_zmq_recv_X(D_J_X[ np1 ][ the_j ], workers->receiver);
+		zmq_recv(workers->receiver, &(fitness->weights[the_j]), sizeof (double), 0);
+		zmq_recv(workers->receiver, &(fitness->cum_status[the_j]), sizeof (ssm_err_code_t), 0);
+	    }
+
+	} else if(calc[0]->threads_length > 1){
+	    ssm_workers_integrate(workers, n);
+
+        } else {
+
+	    ssm_f_prediction_J(D_J_X[np1], 0, fitness->J, &par, 0, data->rows[n], t0, t1, f_pred, nav, calc[0], fitness->cum_status);
+	    for(j=0;j<fitness->J;j++) {
+		if(data->rows[n]->ts_nonan_length) {
+		    fitness->weights[j] = (fitness->cum_status[j] == SSM_SUCCESS) ?  exp(ssm_log_likelihood(data->rows[n], D_J_X[np1][j], par, calc[0], nav, fitness)) : 0.0;
+		    fitness->cum_status[j] = SSM_SUCCESS;
+		}
+	    }
+	}
+	
+        if(data->rows[n]->ts_nonan_length) {
+            if(ssm_weight(fitness, data->rows[n], nav, n)) {
+                ssm_systematic_sampling(fitness, calc[0], n);
+            }
+            ssm_resample_X(fitness, &D_J_X[np1], &D_J_X_tmp[np1], n);
+        }
+    }
+    return ( (data->n_obs != 0) && (fitness->n_all_fail == data->n_obs) ) ? SSM_ERR_PRED: SSM_SUCCESS;
+}
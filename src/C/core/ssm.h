@@ -31,6 +31,10 @@
 
 #include <getopt.h>
 #include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
 
 #include <gsl/gsl_math.h>
 #include <gsl/gsl_rng.h>
@@ -56,18 +60,35 @@
 #include <zmq.h>
 #include <pthread.h>
 
-typedef enum {SSM_SMC = 1 << 0, SSM_MIF = 1 << 1, SSM_PMCMC = 1 << 2, SSM_KMCMC = 1 << 3, SSM_KALMAN = 1 << 4, SSM_KSIMPLEX = 1 << 5, SSM_SIMUL = 1 << 6, SSM_SIMPLEX = 1 << 7, SSM_WORKER = 1 << 8 } ssm_algo_t;
-typedef enum {SSM_ODE, SSM_SDE, SSM_PSR, SSM_EKF} ssm_implementations_t;
+typedef enum {SSM_SMC = 1 << 0, SSM_MIF = 1 << 1, SSM_PMCMC = 1 << 2, SSM_KMCMC = 1 << 3, SSM_KALMAN = 1 << 4, SSM_KSIMPLEX = 1 << 5, SSM_SIMUL = 1 << 6, SSM_SIMPLEX = 1 << 7, SSM_WORKER = 1 << 8, SSM_BROKER = 1 << 9 } ssm_algo_t;
+typedef enum {SSM_ODE, SSM_SDE, SSM_PSR, SSM_EKF, SSM_UKF, SSM_GILLESPIE, SSM_HYBRID} ssm_implementations_t;
+typedef enum {SSM_EULER, SSM_MILSTEIN, SSM_SRK15} ssm_schemes_t; //integration schemes of the sde implementation
 typedef enum {SSM_NO_DEM_STO = 1 << 0, SSM_NO_WHITE_NOISE = 1 << 1, SSM_NO_DIFF = 1 << 2 } ssm_noises_off_t; //several noises can be turned off
 
 typedef enum {SSM_PRINT_TRACE = 1 << 0, SSM_PRINT_X = 1 << 1, SSM_PRINT_HAT = 1 << 2, SSM_PRINT_DIAG = 1 << 3, SSM_PRINT_LOG = 1 << 4, SSM_PRINT_WARNING = 1 << 5 } ssm_print_t;
 
 typedef enum {SSM_SUCCESS = 1 << 0 , SSM_ERR_LIKE= 1 << 1, SSM_ERR_REM_SV = 1 << 2, SSM_ERR_PRED = 1 << 3, SSM_ERR_KAL = 1 << 4, SSM_ERR_IC = 1 << 5, SSM_MH_REJECT = 1 << 6, SSM_ERR_PROPOSAL = 1 << 7, SSM_ERR_PRIOR = 1 << 8} ssm_err_code_t;
 
-typedef enum {SSM_WORKER_J_PAR = 1 << 0, SSM_WORKER_D_X = 1 << 1, SSM_WORKER_FITNESS = 1 << 2 } ssm_worker_opt_t;
+typedef enum {SSM_WORKER_J_PAR = 1 << 0, SSM_WORKER_D_X = 1 << 1, SSM_WORKER_FITNESS = 1 << 2, SSM_WORKER_CHAIN = 1 << 3 } ssm_worker_opt_t;
 
 #define SSM_BUFFER_SIZE (10 * 1024)  /**< 1000 KB buffer size */
 #define SSM_STR_BUFFSIZE 255 /**< buffer for log and error strings */
+#define SSM_HASH_BUFFSIZE 17 /**< buffer for the hexadecimal representation of a 64 bits hash (see manifest.c) */
+#define SSM_FNV1A_INIT UINT64_C(14695981039346656037) /**< FNV-1a offset basis */
+
+#define SSM_BROKER_PORT_FRONTEND 5561 /**< broker: particles sent by the servers */
+#define SSM_BROKER_PORT_CONTROL 5562  /**< broker: registration of the servers jobs */
+#define SSM_BROKER_PORT_BACKEND 5563  /**< broker: pool of workers */
+#define SSM_BROKER_PREFETCH 2         /**< broker: number of particles a worker can hold at once */
+#define SSM_BROKER_MAX_PARTS 16       /**< broker: maximum number of parts of a particle message */
+#define SSM_BROKER_HEARTBEAT 1000     /**< broker: interval (ms) between the heartbeats of the idle workers */
+#define SSM_BROKER_LIVENESS 60        /**< broker: a worker silent for SSM_BROKER_LIVENESS heartbeats is lost and its particles are sent to other workers */
+
+#define SSM_SHM_SIZE ((size_t) 1 << 30) /**< size of the shared memory segment (--shm), pages are only allocated when used */
+#define SSM_SHM_ALIGN 64                /**< alignment of the allocations in the shared memory segment (cache line) */
+
+#define SSM_ALLOC_ALIGN 64                 /**< alignment of the values of the multi-dimensional arrays (cache line) */
+#define SSM_ALLOC_HUGE ((size_t) 1 << 21)  /**< multi-dimensional arrays larger than that are aligned on (and advised to use) huge pages */
 
 
 #define SSM_WEB_APP 0 /**< webApp */
@@ -75,6 +96,19 @@ typedef enum {SSM_WORKER_J_PAR = 1 << 0, SSM_WORKER_D_X = 1 << 1, SSM_WORKER_FIT
 #define SSM_ZERO_LOG 1e-17 /**< smallest value that can be log transformed without being replaced by @c ZERO_LOG */
 #define SSM_ONE_LOGIT 0.999999999 /**< largest value that can be logit transformed without being replaced by @c ONE_LOGIT */
 
+#define SSM_ODE_STIFF_RATIO 3.0 /**< --stepper auto: stability bound of rkf45 on the negative real axis, the system is considered as stiff when h ||J||_inf is larger than that for the step h allowed by the accuracy (the step size of the explicit stepper is then limited by its stability) */
+
+#define SSM_ODE_BATCH 8 /**< number of particles integrated in lock-step by ssm_f_prediction_ode_batch() (a multiple of the SIMD width) */
+#define SSM_STO_BATCH 8 /**< number of particles stepped together by ssm_f_prediction_sto_batch() (a multiple of the SIMD width) */
+
+#define SSM_ADAPT_DT_DEPTH 10 /**< --adapt_dt: the time steps are never smaller than dt/2^SSM_ADAPT_DT_DEPTH */
+
+#define SSM_BINOMIAL_SMALL_MEAN 14.0 /**< binomial draws with a mean smaller than that are made by inversion (see ssm_ran_binomial()) */
+#define SSM_BINOMIAL_INV_MAX 110 /**< largest value reached by the inversion of ssm_ran_binomial() before drawing again */
+#define SSM_HYBRID_VAR 25.0 /**< hybrid implementation: the binomial and Poisson draws whose variance is larger than that are replaced by their normal approximation */
+
+#define SSM_KALMAN_STEADY_N 5 /**< number of consecutive updates with converged Kt and Ct before they are frozen (--steady) */
+
 
 /**
  * vector parameters in the user scale (all of them (infered or not))
@@ -101,6 +135,27 @@ typedef gsl_matrix ssm_var_t;
 
 typedef struct _nav ssm_nav_t;
 
+/**
+ * Workspace of the next reaction method (Gibson and Bruck, 2000) of
+ * the gillespie implementation
+ */
+typedef struct
+{
+    int n_reactions;
+
+    unsigned int *dep_length; /**< [n_reactions] number of reactions depending on each reaction */
+    unsigned int **dep;       /**< [n_reactions][dep_length] reactions whose propensity changes when a reaction fires (including itself) */
+
+    double *a;   /**< [n_reactions] propensities */
+    double *tau; /**< [n_reactions] (absolute) putative times of the next firing of each reaction */
+    int *heap;   /**< [n_reactions] indexed priority queue: binary heap of the reactions ordered by tau */
+    int *node;   /**< [n_reactions] position of each reaction in heap */
+
+    double *diffed; /**< [states_diff->length] diffusions (frozen over a time step) or NULL */
+    double *noise;  /**< [number of white noises] white noises (frozen over a time step) or NULL */
+    double *cov;    /**< [covariates_length] covariates (frozen over a time step) or NULL */
+} ssm_gillespie_t;
+
 /**
  * Everything needed to perform computations (possibly in parallel)
  * and store transiant states in a thread-safe way
@@ -120,28 +175,44 @@ typedef struct ssm_calc_t /*[N_THREADS] : for parallel computing we need N_THREA
     /* Euler multinomial */
     double **prob;      /**< [N_PAR_SV][number of output from the compartment]*/
     unsigned int **inc; /**< [N_PAR_SV][number of destinations] increments vector */
+    void (*ran_multinomial) (const gsl_rng *, const size_t, unsigned int, const double [], unsigned int []); /**< ssm_ran_multinomial() (psr) or ssm_ran_multinomial_hybrid() (hybrid) */
+    unsigned int (*ran_poisson) (const gsl_rng *, double); /**< gsl_ran_poisson() (psr) or ssm_ran_poisson_hybrid() (hybrid) */
 
     /* Gillespie */
-    //  double **reaction; /*reaction matrix*/
+    ssm_gillespie_t *gillespie; /**< workspace of the next reaction method */
 
     /* ODE*/
     const gsl_odeiv2_step_type *T;
-    gsl_odeiv2_control *control;
-    gsl_odeiv2_step *step;
-    gsl_odeiv2_evolve *evolve;
+    gsl_odeiv2_control *control;     /**< owned by _driver (or _driver_stiff) */
+    gsl_odeiv2_step *step;           /**< owned by _driver (or _driver_stiff) */
+    gsl_odeiv2_evolve *evolve;       /**< owned by _driver (or _driver_stiff) */
     gsl_odeiv2_system sys;
+    gsl_odeiv2_driver *_driver;        /**< stepper selected by --stepper (some steppers need a driver) */
+    gsl_odeiv2_driver *_driver_stiff;  /**< --stepper auto only: implicit stepper used while the system is stiff (NULL otherwise) */
+    int is_stiff;                      /**< --stepper auto only: are step, evolve and control the ones of _driver_stiff? */
+    double *_jac;                      /**< --stepper auto only: [n_s*n_s] jacobian matrix (row major) used to detect stiffness */
+    double *_batch;                    /**< ode implementation with rkf45: [(9*n_s + n_par)*SSM_ODE_BATCH] workspace of ssm_f_prediction_ode_batch(), sde and psr implementations: [(n_X + n_par)*SSM_STO_BATCH] workspace of ssm_f_prediction_sto_batch() (NULL otherwise) */
+    double eps_abs;                    /**< absolute error of the step-size control of ssm_f_prediction_ode_batch() and of the stiffness test of --stepper auto (opts->eps_abs) */
+    double eps_rel;                    /**< relative error of the step-size control of ssm_f_prediction_ode_batch() and of the stiffness test of --stepper auto (opts->eps_rel) */
+    const double *_ode_proj;           /**< proj of the last ssm_X_t integrated by ssm_f_prediction_ode() (NULL if it failed) */
+    double _ode_t;                     /**< time at which this integration stopped */
+    gsl_odeiv2_step *_ode_step;        /**< stepper used for it */
+    double *_ode_y;                    /**< [n_s] states at which it stopped (msbdf only: its history is only valid for these states) */
     double *yerr;
 
     /* SDE */
     double *y_pred; /**< used to store y predicted for Euler Maruyama */
+    double *_dw;       /**< Brownian increments used by the sde steps instead of drawing their noises (NULL: drawn) */
+    double *_dw_zero;  /**< --adapt_dt only: [n_dw] null Brownian increments (noise-free steps of ssm_f_prediction_sde_adapt()) */
+    double *_X_adapt;  /**< --adapt_dt only: [2*n_X] states at the start of a step and after the full step */
+    double *_sde_ws;   /**< --scheme milstein or srk15 only: [(8 + 5*n_dw)*n_X + n_dw*(n_dw + 1)] workspace of ssm_f_prediction_sde_milstein() and ssm_f_prediction_sde_srk15() */
 
     /* Kalman */
     void (*eval_Q)(const double X[], double t, ssm_par_t *par, ssm_nav_t *nav, struct ssm_calc_t *calc);
 
     gsl_vector *_pred_error;    /**< [nav->observed_length] */
-    gsl_vector *_zero;          /**< [nav->observed_length] */
-    gsl_matrix *_St;            /**< [nav->observed_length][nav->observed_length] */
-    gsl_matrix *_Stm1;          /**< [nav->observed_length][nav->observed_length] */
+    gsl_vector *_std_error;     /**< [nav->observed_length] prediction error standardized by the Cholesky factor of St */
+    gsl_matrix *_St;            /**< [nav->observed_length][nav->observed_length] (lower triangle holds its Cholesky factor in ssm_ukf_update()) */
     gsl_matrix *_Rt;            /**< [nav->observed_length][nav->observed_length] */
     gsl_matrix *_Ht;            /**< [nav->states_sv_inc->length + nav->states_diff->length][nav->observed_length] */
     gsl_matrix *_Kt;            /**< [nav->states_sv_inc->length + nav->states_diff->length][nav->observed_length] */
@@ -150,10 +221,36 @@ typedef struct ssm_calc_t /*[N_THREADS] : for parallel computing we need N_THREA
     gsl_matrix *_Q;             /**< [nav->states_sv_inc->length + nav->states_diff->length][nav->states_sv_inc->length + nav->states_diff->length] */
     gsl_matrix *_FtCt;          /**< [nav->states_sv_inc->length + nav->states_diff->length][nav->states_sv_inc->length + nav->states_diff->length] */
     gsl_matrix *_Ft;            /**< [nav->states_sv_inc->length + nav->states_diff->length][nav->states_sv_inc->length + nav->states_diff->length] */
+    gsl_matrix *_Ct;            /**< [nav->states_sv_inc->length + nav->states_diff->length][nav->states_sv_inc->length + nav->states_diff->length] Ct unpacked (it is packed in ssm_X_t) */
     gsl_vector *_eval;      /**< [nav->states_sv_inc->length + nav->states_diff->length] */
     gsl_matrix *_evec;      /**< [nav->states_sv_inc->length + nav->states_diff->length][nav->states_sv_inc->length + nav->states_diff->length] */
     gsl_eigen_symmv_workspace *_w_eigen_vv;  /**< workspace to compute eigen values and eigen vector for symmetric matrix */
 
+    /* square-root Kalman filter */
+    int flag_sqrt;          /**< update a square root of Ct (opts->flag_sqrt) */
+    gsl_matrix *_sqrt_pre;  /**< [nav->observed_length + nav->states_sv_inc->length + nav->states_diff->length]^2 pre-array of the update */
+    gsl_vector *_sqrt_tau;  /**< [nav->observed_length + nav->states_sv_inc->length + nav->states_diff->length] householder coefficients */
+
+    /* steady-state Kalman filter (see ssm_kalman_steady_check()) */
+    double steady_tol;             /**< tolerance on the relative change of Kt and Ct (0.0: they are never frozen) (opts->steady_tol) */
+    int steady_count;              /**< number of consecutive updates for which Kt and Ct changed by less than steady_tol (-1: nothing to compare with) */
+    int is_steady;                 /**< are Kt and Ct frozen? */
+    struct ssm_row_t *steady_row;  /**< row of the current prediction/update cycle */
+    double steady_dt;              /**< time step of the current prediction/update cycle */
+    gsl_matrix *_steady_Kt;        /**< [nav->states_sv_inc->length + nav->states_diff->length][nav->observed_length] gain of the last update */
+    gsl_matrix *_steady_G;         /**< [nav->observed_length][nav->observed_length] ht_j' kt_i (j > i) of the last sequential update */
+    gsl_vector *_steady_st;        /**< [nav->observed_length] variances of the scalar innovations of the last update */
+    double *_steady_Ct_pred;       /**< [(n_s*(n_s+1))/2] predicted Ct (packed) of the last update */
+    double *_steady_Ct;            /**< [(n_s*(n_s+1))/2] updated Ct (packed) of the last update */
+    gsl_odeiv2_step *_steady_step;     /**< integration of the states only */
+    gsl_odeiv2_evolve *_steady_evolve; /**< integration of the states only */
+    gsl_odeiv2_system _steady_sys;     /**< the states only (ssm_step_ode) */
+
+    /* unscented Kalman filter */
+    gsl_matrix *_ukf_sigma; /**< [2*(nav->states_sv_inc->length + nav->states_diff->length)+1][nav->states_sv_inc->length + nav->states_diff->length] sigma points */
+    gsl_matrix *_ukf_obs;   /**< [2*(nav->states_sv_inc->length + nav->states_diff->length)+1][nav->observed_length] observations of the sigma points */
+    double *_ukf_proj;      /**< [length of ssm_X_t.proj] a sigma point as the proj of a ssm_X_t */
+
     //multi-threaded sorting
     int J;                 /**< ssm_fitness_t->J */
     double *to_be_sorted;  /**< [this->J] array of the J particle to be sorted*/
@@ -181,7 +278,8 @@ typedef struct ssm_calc_t /*[N_THREADS] : for parallel computing we need N_THREA
 
 /**
  * the state variables (including including observed variables and
- * diffusions) and potientaly for kalman the covariance terms
+ * diffusions) and potientaly for kalman the covariance terms (upper
+ * triangle only, see ssm_kalman_Ct_index())
  */
 typedef struct  /* optionaly [N_DATA+1][J] for MIF and pMCMC "+1" is for initial condition (one time step before first data)  */
 {
@@ -194,6 +292,27 @@ typedef struct  /* optionaly [N_DATA+1][J] for MIF and pMCMC "+1" is for initial
 } ssm_X_t;
 
 
+/**
+ * State of the continuous integration of a particle across the rows
+ * of simul (see ssm_f_prediction_ode_dense()). The states are
+ * integrated without any reset of the incidences: the incidence of a
+ * row is the difference of the cumulated incidences at its boundaries.
+ */
+typedef struct
+{
+    int is_started; /**< has the integration started? */
+    double h;       /**< integration step size */
+    double t_prev;  /**< start of the last step */
+    double t;       /**< end of the last step */
+    double *y_prev; /**< [n_s] states at t_prev */
+    double *f_prev; /**< [n_s] derivatives at t_prev */
+    double *y;      /**< [n_s] states at t */
+    double *f;      /**< [n_s] derivatives at t */
+    double *y_out;  /**< [n_s] states (incidences cumulated) at the last output */
+    double *base;   /**< [n_s] cumulated incidences at their last reset (0.0 for the other states) */
+} ssm_dense_t;
+
+
 /**
  * The best estimates of the states variables (including observed
  * variables and diffusions and remainders) (weighted average of projected values,
@@ -311,6 +430,8 @@ struct _nav
     ssm_implementations_t implementation;
     ssm_noises_off_t noises_off;
     ssm_print_t print;
+    double adapt_dt; /**< tolerance of the adaptive time steps of the sde and psr implementations (0.0: fixed time step) */
+    ssm_schemes_t scheme; /**< integration scheme of the sde implementation */
 
 
     FILE *X;
@@ -392,7 +513,7 @@ typedef struct
 /**
  * A row of data
  */
-typedef struct { /* [n_data] */
+typedef struct ssm_row_t { /* [n_data] */
     char *date;
     unsigned int time;          /**< times in days since the smallest dates_t0 when the data were collected */
 
@@ -430,6 +551,12 @@ typedef struct
  */
 typedef ssm_err_code_t (*ssm_f_pred_t) (ssm_X_t *, double, double, ssm_par_t *, ssm_nav_t *, ssm_calc_t *);
 
+/**
+ * lane-wise stepping function of the sde and psr implementations
+ * (see ssm_f_prediction_sto_batch())
+ */
+typedef void (*ssm_step_batch_t) (double *, double, double, int, const double *, ssm_nav_t *, ssm_calc_t *);
+
 
 /**
  * options
@@ -449,6 +576,9 @@ typedef struct
     double dt;               /**< integration time step in days */
     double eps_abs;          /**< absolute error for adaptive step-size control */
     double eps_rel;          /**< relative error for adaptive step-size control */
+    double eps_cov;          /**< scaling of eps_abs for the covariance terms of the EKF */
+    double adapt_dt;         /**< tolerance of the adaptive time steps of the sde and psr implementations (0.0: fixed time step dt) */
+    ssm_schemes_t scheme;    /**< integration scheme of the sde implementation (euler, milstein or srk15) */
     char *freeze_forcing;    /**< freeze the metadata to their value at the specified ISO8601 date */
     char *root;              /**< root path where the outputs will be stored */
     char *next;              /**< write the outputed parameters in a file prefixed by the argument */
@@ -457,6 +587,7 @@ typedef struct
     int J;                   /**< number of particles */
     int n_obs;               /**< number of observations to be fitted (for tempering) */
     char *interpolator;      /**< gsl interpolator for metadata */
+    char *stepper;           /**< gsl_odeiv2 stepper (or "auto" to switch between rkf45 and msbdf depending on the stiffness) */
     int n_iter;              /**< number of iterations */
     double a;                /**< cooling factor (scales standard deviation) */
     double b;                /**< re-heating (inflation) (scales standard deviation of the proposal) */
@@ -475,10 +606,45 @@ typedef struct
     char *start;             /**< ISO 8601 date when the simulation starts*/
     char *end;               /**< ISO 8601 date when the simulation ends*/
     char *server;            /**< domain name or IP address of the particule server (e.g 127.0.0.1) */
+    char *broker;            /**< domain name or IP address of a broker sharing a pool of workers between servers ("" if none) */
     int flag_no_filter;      /**< do not filter */
+    int flag_shm;            /**< integrate the particles in forked processes sharing the particles memory instead of threads */
+    int flag_chain;          /**< dispatch whole likelihood evaluations across machines (implies flag_tcp) */
+    int prefetch;            /**< number of speculative likelihood evaluations of pmcmc (implies flag_chain) */
+    int flag_sqrt;           /**< square-root Kalman filter */
+    double steady_tol;       /**< tolerance on the relative change of the Kalman gain and covariance to freeze them (0.0: never) */
 } ssm_options_t;
 
 
+/**
+ * shared memory segment (see shm.c)
+ */
+typedef struct
+{
+    void *base;
+    size_t size;
+    size_t used;      /**< bump allocator offset */
+    int flag_forked;  /**< we are in a forked worker: allocations are private */
+} ssm_shm_t;
+
+
+
+
+/**
+ * Multivariate normal proposal (see mvn.c): the Cholesky factor and
+ * the log determinant of the covariance are cached and only
+ * recomputed when the covariance changes.
+ */
+typedef struct
+{
+    int n;
+    const gsl_matrix *var;  /**< covariance the factor was computed for (not owned) */
+    int is_dirty;           /**< var was modified since the factorization */
+    gsl_matrix *chol;       /**< [n][n] lower Cholesky factor of var */
+    double log_det;         /**< log determinant of var */
+    gsl_vector *work;       /**< [n] */
+    int flag_symmetric;     /**< q(x|y) = q(y|x): the density is not needed by the Metropolis Hastings ratio */
+} ssm_proposal_t;
 
 
 /**
@@ -508,19 +674,52 @@ typedef struct
     double *mean_sampling;         /**< [ssm_nav_t->theta_all->length] Em(X) 1st order mean needed to compute the sampling covariance */
     gsl_matrix *var_sampling;      /**< [ssm_nav_t->theta_all->length][ssm_nav_t->theta_all->length] Sampling covariance */
 
+    ssm_proposal_t *proposal;      /**< proposal using the covariance returned by ssm_adapt_eps_var_sd_fac() */
 } ssm_adapt_t;
 
 
+/**
+ * Tree of the next proposals of pmcmc (--prefetch): the likelihoods of
+ * the nodes the most likely to be reached given the acceptance rate
+ * are evaluated at once (see pmcmc/pmcmc_util.c). Node 0 is proposed
+ * from the current theta, the children of a node are proposed after
+ * its rejection [0] or its acceptance [1].
+ */
+typedef struct
+{
+    int length;               /**< maximum number of nodes (--prefetch) */
+    int n_nodes;              /**< number of nodes of the current tree */
+
+    int *parent;              /**< [this.length] parent node (-1 for the root) */
+    int **child;              /**< [this.length][2] child node after rejection [0] or acceptance [1] (-1 if not in the tree) */
+    double *prob;             /**< [this.length] probability that the node is reached */
+    ssm_theta_t **base;       /**< [this.length] theta the node is proposed from (not owned) */
+    ssm_theta_t **proposed;   /**< [this.length] */
+    ssm_par_t **par;          /**< [this.length] */
+    ssm_err_code_t *status;   /**< [this.length] */
+    double *log_like;         /**< [this.length] */
+    ssm_X_t ***D_X;           /**< [this.length][data->n_obs+1] sampled trajectories (NULL if not printed) */
+
+    int *index;               /**< [this.length] nodes sent to the workers */
+    ssm_par_t **N_par;        /**< [this.length] */
+    ssm_X_t ***N_D_X;         /**< [this.length] */
+    double *N_log_like;       /**< [this.length] */
+    ssm_err_code_t *N_status; /**< [this.length] */
+} ssm_prefetch_t;
+
+
 
 typedef struct
 {
     int id;
+    int index;          /**< index of the worker */
+    int flag_process;   /**< forked process (--shm) instead of a thread */
+    char *endpoint;     /**< prefix of the zmq endpoints (inproc:// or ipc://) */
     void *context; /**< zmq context */
     ssm_worker_opt_t wopts;
     int J_chunk;
     ssm_data_t *data;
     ssm_par_t **J_par;
-    ssm_X_t ***D_J_X;
     ssm_calc_t **calc;
     ssm_nav_t *nav;
     ssm_fitness_t *fitness;
@@ -528,11 +727,40 @@ typedef struct
 } ssm_params_worker_inproc_t;
 
 
+/**
+ * What a tcp worker has to agree on with the server before being
+ * sent any particle (see ssm_workers_handshake())
+ */
+typedef struct
+{
+    char model[SSM_HASH_BUFFSIZE];   /**< hash of the layout of the compiled model */
+    char data[SSM_HASH_BUFFSIZE];    /**< hash of the data and covariates */
+    char options[SSM_HASH_BUFFSIZE]; /**< hash of the options used for the integration */
+    char hash[SSM_HASH_BUFFSIZE];    /**< hash of the 3 hashes above */
+
+    ssm_implementations_t implementation;
+    ssm_noises_off_t noises_off;
+    double dt;
+    double eps_abs;
+    double eps_rel;
+    double adapt_dt;
+    ssm_schemes_t scheme;
+    char interpolator[SSM_STR_BUFFSIZE];
+    char stepper[SSM_STR_BUFFSIZE];
+} ssm_manifest_t;
+
+
 typedef struct 
 {
     int flag_tcp;
     int inproc_length; /**< number of inproc worker */
     ssm_worker_opt_t wopts;
+    int J;             /**< tcp only: number of particles of the likelihood evaluations of the workers (SSM_WORKER_CHAIN) */
+
+    int flag_broker;   /**< tcp through a broker (sender and receiver are then the same socket) */
+    int flag_shm;      /**< the inproc workers are forked processes sharing memory (--shm) */
+    char endpoint[SSM_STR_BUFFSIZE]; /**< prefix of the zmq endpoints of the inproc workers */
+    ssm_X_t ***D_J_X;  /**< particles integrated by the inproc workers */
 
     void *context;
     void *sender;
@@ -541,13 +769,135 @@ typedef struct
     ssm_params_worker_inproc_t *params;
 
     pthread_t *workers;
+    pid_t *pids;       /**< --shm only: forked workers */
+
+    ssm_manifest_t *manifest;  /**< tcp only: manifest sent to the workers */
+    char *str_manifest;        /**< tcp only: serialized manifest */
+    char *str_parameters;      /**< tcp only: serialized parameters */
+    char *str_data;            /**< tcp only: serialized data and covariates */
+    pthread_t handshake;       /**< tcp only: thread answering the workers handshake */
 } ssm_workers_t;
 
 
+/**
+ * everything a tcp worker needs to integrate the particles of a
+ * server (see worker/main_worker.c)
+ */
+typedef struct
+{
+    ssm_worker_opt_t wopts;   /**< only SSM_WORKER_FITNESS is relevant: send back the weights */
+    json_t *jparameters;
+    ssm_nav_t *nav;
+    ssm_data_t *data;
+    ssm_fitness_t *fitness;
+    ssm_calc_t *calc;
+    ssm_X_t *X;
+    ssm_input_t *input;
+    ssm_par_t *par;
+    ssm_f_pred_t f_pred;
+    ssm_manifest_t *manifest; /**< manifest computed on the worker side */
+} ssm_job_t;
+
+
+/**
+ * everything a tcp worker needs to run whole particle filters for a
+ * server (SSM_WORKER_CHAIN, see worker/main_worker.c)
+ */
+typedef struct
+{
+    json_t *jparameters;
+    ssm_nav_t *nav;
+    ssm_data_t *data;
+    ssm_fitness_t *fitness;
+    ssm_calc_t **calc;
+    ssm_X_t ***D_J_X;
+    ssm_X_t ***D_J_X_tmp;
+    ssm_X_t **D_X;            /**< sampled trajectory */
+    ssm_input_t *input;
+    ssm_par_t *par;
+    ssm_f_pred_t f_pred;
+    ssm_workers_t *workers;   /**< inproc workers of the worker (--n_thread) */
+    ssm_manifest_t *manifest; /**< manifest computed on the worker side */
+} ssm_chain_job_t;
+
+
+/**
+ * multipart zmq message waiting in a queue of the broker
+ */
+typedef struct ssm_broker_msg_s
+{
+    int length;
+    zmq_msg_t *parts;              /**< [this.length] */
+    char *master;                  /**< identity of the server of a particle held by a worker (NULL in the queues of the servers) */
+    struct ssm_broker_msg_s *next;
+} ssm_broker_msg_t;
+
+
+/**
+ * a server (smc, pmcmc, mif or simul run with --broker) registered
+ * to the broker
+ */
+typedef struct
+{
+    char *identity;
+    char hash[SSM_HASH_BUFFSIZE]; /**< hash of the manifest of the job */
+    char *str_manifest;
+    char *str_parameters;
+    char *str_data;
+    int wopts;
+
+    ssm_broker_msg_t *head;       /**< particles waiting to be dispatched */
+    ssm_broker_msg_t *tail;
+    int queued;                   /**< length of the queue */
+    int in_flight;                /**< number of particles being integrated by the pool */
+} ssm_broker_master_t;
+
+
+/**
+ * a worker of the pool
+ */
+typedef struct
+{
+    char *identity;
+    char hash[SSM_HASH_BUFFSIZE]; /**< hash of the job currently loaded or being loaded ("" if none) */
+    int credit;                   /**< number of particles that can still be sent */
+    int in_flight;                /**< number of particles being integrated */
+    int flag_loading;             /**< a job has been sent and not yet acknowledged */
+    int refused_length;
+    char (*refused)[SSM_HASH_BUFFSIZE]; /**< hashes of the jobs the worker could not load (other model): never offered again */
+    int flag_lost;                /**< silent for too long: not used until it sends a message again */
+    int orphans;                  /**< particles it was still integrating when it was lost (resent to other workers): their results are dropped */
+    int64_t expiry;               /**< time (ms, monotonic clock) after which the worker is lost if it stays silent */
+    ssm_broker_msg_t *head;       /**< copies of the particles being integrated, oldest first (resent if the worker is lost) */
+    ssm_broker_msg_t *tail;
+} ssm_broker_worker_t;
+
+
+typedef struct
+{
+    void *context;
+    void *frontend;  /**< ROUTER: particles from the servers */
+    void *control;   /**< ROUTER: registration of the servers */
+    void *backend;   /**< ROUTER: pool of workers */
+
+    int masters_length;
+    ssm_broker_master_t **masters;
+
+    int workers_length;
+    ssm_broker_worker_t **workers;
+
+    int flag_log;
+} ssm_broker_t;
+
+
 /****************************/
 /* core function signatures */
 /****************************/
 
+/* alloc.c */
+void *ssm_arena_new(size_t size_ptr, size_t size_data, void **data);
+void ssm_arena_free(void *block);
+
 /* alloc_c.c */
 char *ssm_c1_new(int n);
 char **ssm_c2_new(int n, int p);
@@ -625,6 +975,8 @@ ssm_X_t **ssm_J_X_new(ssm_fitness_t *fitness, ssm_nav_t *nav, ssm_options_t *opt
 void ssm_J_X_free(ssm_X_t **X, ssm_fitness_t *fitness);
 ssm_X_t **ssm_D_X_new(ssm_data_t *data, ssm_nav_t *nav, ssm_options_t *opts);
 void ssm_D_X_free(ssm_X_t **X, ssm_data_t *data);
+ssm_dense_t *ssm_dense_new(ssm_nav_t *nav);
+void ssm_dense_free(ssm_dense_t *dense);
 ssm_X_t ***ssm_D_J_X_new(ssm_data_t *data, ssm_fitness_t *fitness, ssm_nav_t *nav, ssm_options_t *opts);
 void ssm_D_J_X_free(ssm_X_t ***X, ssm_data_t *data, ssm_fitness_t *fitness);
 ssm_hat_t *ssm_hat_new(ssm_nav_t *nav);
@@ -663,14 +1015,24 @@ void ssm_dic_end(ssm_fitness_t *fitness, ssm_nav_t *nav, int m);
 int ssm_rmvnorm(const gsl_rng *r, const int n, const gsl_vector *mean, const gsl_matrix *var, double sd_fac, gsl_vector *result);
 double ssm_dmvnorm(const int n, const gsl_vector *x, const gsl_vector *mean, const gsl_matrix *var, double sd_fac);
 void ssm_adapt_var(ssm_adapt_t *adapt, ssm_theta_t *x, int m);
+ssm_proposal_t *ssm_proposal_new(int n);
+void ssm_proposal_free(ssm_proposal_t *proposal);
+void ssm_proposal_set(ssm_proposal_t *proposal, const gsl_matrix *var);
+void ssm_proposal_rmvnorm(const gsl_rng *r, ssm_proposal_t *proposal, const gsl_vector *mean, double sd_fac, gsl_vector *result);
+double ssm_proposal_log_dmvnorm(ssm_proposal_t *proposal, const gsl_vector *x, const gsl_vector *mean, double sd_fac);
 
 /* prediction_util.c */
 void ssm_X_copy(ssm_X_t *dest, ssm_X_t *src);
 void ssm_X_reset_inc(ssm_X_t *X, ssm_row_t *row, ssm_nav_t *nav);
+int ssm_row_span_end(ssm_data_t *data, int n, ssm_nav_t *nav, ssm_calc_t *calc);
+unsigned int ssm_ran_binomial(const gsl_rng *r, double p, unsigned int n);
 void ssm_ran_multinomial (const gsl_rng * r, const size_t K, unsigned int N, const double p[], unsigned int n[]);
+void ssm_ran_multinomial_hybrid (const gsl_rng * r, const size_t K, unsigned int N, const double p[], unsigned int n[]);
+unsigned int ssm_ran_poisson_hybrid(const gsl_rng *r, double mu);
 double ssm_correct_rate(double rate, double dt);
 ssm_err_code_t ssm_check_no_neg_sv_or_remainder(ssm_X_t *p_X, ssm_par_t *par, ssm_nav_t *nav, ssm_calc_t *calc, double t);
 ssm_f_pred_t ssm_get_f_pred(ssm_nav_t *nav);
+ssm_err_code_t ssm_f_prediction_ekf                           (ssm_X_t *p_X, double t0, double t1, ssm_par_t *par, ssm_nav_t *nav, ssm_calc_t *calc);
 ssm_err_code_t ssm_f_prediction_ode                           (ssm_X_t *p_X, double t0, double t1, ssm_par_t *par, ssm_nav_t *nav, ssm_calc_t *calc);
 ssm_err_code_t ssm_f_prediction_sde_no_dem_sto_no_white_noise (ssm_X_t *p_X, double t0, double t1, ssm_par_t *par, ssm_nav_t *nav, ssm_calc_t *calc);
 ssm_err_code_t ssm_f_prediction_sde_no_dem_sto_no_diff        (ssm_X_t *p_X, double t0, double t1, ssm_par_t *par, ssm_nav_t *nav, ssm_calc_t *calc);
@@ -681,12 +1043,25 @@ ssm_err_code_t ssm_f_prediction_sde_no_diff                   (ssm_X_t *p_X, dou
 ssm_err_code_t ssm_f_prediction_sde_full                      (ssm_X_t *p_X, double t0, double t1, ssm_par_t *par, ssm_nav_t *nav, ssm_calc_t *calc);
 ssm_err_code_t ssm_f_prediction_psr                           (ssm_X_t *p_X, double t0, double t1, ssm_par_t *par, ssm_nav_t *nav, ssm_calc_t *calc);
 ssm_err_code_t ssm_f_prediction_psr_no_diff                   (ssm_X_t *p_X, double t0, double t1, ssm_par_t *par, ssm_nav_t *nav, ssm_calc_t *calc);
+ssm_err_code_t ssm_f_prediction_sde_adapt                     (ssm_X_t *p_X, double t0, double t1, ssm_par_t *par, ssm_nav_t *nav, ssm_calc_t *calc);
+ssm_err_code_t ssm_f_prediction_psr_adapt                     (ssm_X_t *p_X, double t0, double t1, ssm_par_t *par, ssm_nav_t *nav, ssm_calc_t *calc);
+ssm_err_code_t ssm_f_prediction_sde_milstein                  (ssm_X_t *p_X, double t0, double t1, ssm_par_t *par, ssm_nav_t *nav, ssm_calc_t *calc);
+ssm_err_code_t ssm_f_prediction_sde_srk15                     (ssm_X_t *p_X, double t0, double t1, ssm_par_t *par, ssm_nav_t *nav, ssm_calc_t *calc);
+
+/* gillespie.c */
+ssm_err_code_t ssm_f_prediction_gillespie                     (ssm_X_t *p_X, double t0, double t1, ssm_par_t *par, ssm_nav_t *nav, ssm_calc_t *calc);
+ssm_err_code_t ssm_f_prediction_gillespie_no_diff             (ssm_X_t *p_X, double t0, double t1, ssm_par_t *par, ssm_nav_t *nav, ssm_calc_t *calc);
+ssm_err_code_t ssm_f_prediction_ode_dense(ssm_X_t *p_X, ssm_dense_t *dense, double t0, double t1, double t_end, ssm_row_t *row, ssm_par_t *par, ssm_nav_t *nav, ssm_calc_t *calc);
+void ssm_f_prediction_ode_batch(ssm_X_t **J_X, ssm_par_t **J_par, int B, double t0, double t1, ssm_nav_t *nav, ssm_calc_t *calc, ssm_err_code_t *status);
+void ssm_f_prediction_sto_batch(ssm_X_t **J_X, ssm_par_t **J_par, int B, double t0, double t1, ssm_step_batch_t step_batch, int is_diff, ssm_nav_t *nav, ssm_calc_t *calc, ssm_err_code_t *status);
+void ssm_f_prediction_J(ssm_X_t **J_X, int J_start, int J_end, ssm_par_t **J_par, int flag_J_par, ssm_row_t *row, double t0, double t1, ssm_f_pred_t f_pred, ssm_nav_t *nav, ssm_calc_t *calc, ssm_err_code_t *cum_status);
 
 /* smc.c */
 int ssm_weight(ssm_fitness_t *fitness, ssm_row_t *row, ssm_nav_t *nav, int n);
 void ssm_systematic_sampling(ssm_fitness_t *fitness, ssm_calc_t *calc, int n);
 void ssm_resample_X(ssm_fitness_t *fitness, ssm_X_t ***J_p_X, ssm_X_t ***J_p_X_tmp, int n);
 void ssm_swap_X(ssm_X_t ***X, ssm_X_t ***tmp_X);
+ssm_err_code_t ssm_run_smc(ssm_f_pred_t f_pred, ssm_X_t ***D_J_X, ssm_X_t ***D_J_X_tmp, ssm_par_t *par, ssm_calc_t **calc, ssm_data_t *data, ssm_fitness_t *fitness, ssm_nav_t *nav, ssm_workers_t *workers);
 
 /* transform.c */
 double ssm_f_id(double x);
@@ -714,6 +1089,7 @@ double ssm_f_2prior_id(double x, ssm_hat_t *hat, ssm_par_t *par, ssm_calc_t *cal
 int ssm_in_par(ssm_it_parameters_t *it, const char *name);
 int ssm_in_jarray(json_t *array, const char *name);
 const gsl_interp_type *ssm_str_to_interp_type(const char *optarg);
+const gsl_odeiv2_step_type *ssm_str_to_stepper_type(const char *optarg, int *is_implicit);
 int ssm_sanitize_n_threads(int n_threads, ssm_fitness_t *fitness);
 
 /* print.c */
@@ -741,12 +1117,12 @@ void ssm_hat_eval(ssm_hat_t *hat, ssm_X_t **J_X, ssm_par_t **J_par, ssm_nav_t *n
 
 
 /* bayes.c */
-ssm_err_code_t ssm_log_prob_proposal(double *log_proposal, ssm_theta_t *proposed, ssm_theta_t *theta, ssm_var_t *var, double sd_fac, ssm_nav_t *nav, int is_mvn);
+ssm_err_code_t ssm_log_prob_proposal(double *log_proposal, ssm_theta_t *proposed, ssm_theta_t *theta, ssm_var_t *var, double sd_fac, ssm_nav_t *nav, ssm_proposal_t *proposal);
 ssm_err_code_t ssm_log_prob_prior(double *log_prior, ssm_theta_t *theta, ssm_nav_t *nav, ssm_fitness_t *fitness);
-ssm_err_code_t ssm_metropolis_hastings(ssm_fitness_t *fitness, double *alpha, ssm_theta_t *proposed, ssm_theta_t *theta, gsl_matrix *var, double sd_fac , ssm_nav_t *nav, ssm_calc_t *calc, int is_mvn);
+ssm_err_code_t ssm_metropolis_hastings(ssm_fitness_t *fitness, double *alpha, ssm_theta_t *proposed, ssm_theta_t *theta, gsl_matrix *var, double sd_fac , ssm_nav_t *nav, ssm_calc_t *calc, ssm_proposal_t *proposal);
 ssm_var_t *ssm_adapt_eps_var_sd_fac(double *sd_fac, ssm_adapt_t *a, ssm_var_t *var, ssm_nav_t *nav, int m);
 void ssm_adapt_ar(ssm_adapt_t *a, int is_accepted, int m);
-void ssm_theta_ran(ssm_theta_t *proposed, ssm_theta_t *theta, ssm_var_t *var, double sd_fac, ssm_calc_t *calc, ssm_nav_t *nav, int is_mvn);
+void ssm_theta_ran(ssm_theta_t *proposed, ssm_theta_t *theta, ssm_var_t *var, double sd_fac, ssm_calc_t *calc, ssm_nav_t *nav, ssm_proposal_t *proposal);
 int ssm_theta_copy(ssm_theta_t *dest, ssm_theta_t *src);
 int ssm_par_copy(ssm_par_t *dest, ssm_par_t *src);
 void ssm_sample_traj(ssm_X_t **D_X, ssm_X_t ***D_J_X, ssm_calc_t *calc, ssm_data_t *data, ssm_fitness_t *fitness);
@@ -754,9 +1130,29 @@ void ssm_sample_traj(ssm_X_t **D_X, ssm_X_t ***D_J_X, ssm_calc_t *calc, ssm_data
 /* simplex.c */
 double ssm_simplex(ssm_theta_t *theta, ssm_var_t *var, void *params, double (*f_simplex)(const gsl_vector *x, void *params), ssm_nav_t *nav, ssm_options_t *opts);
 
+/* manifest.c */
+void ssm_hash_model(char *dest, ssm_nav_t *nav);
+void ssm_hash_data(char *dest, json_t *jdata);
+void ssm_hash_options(char *dest, ssm_options_t *opts);
+ssm_manifest_t *ssm_manifest_new(json_t *jdata, ssm_nav_t *nav, ssm_options_t *opts);
+void ssm_manifest_free(ssm_manifest_t *manifest);
+char *ssm_manifest_dumps(ssm_manifest_t *manifest);
+ssm_manifest_t *ssm_manifest_loads(const char *str);
+void ssm_manifest2options(ssm_options_t *opts, ssm_manifest_t *manifest);
+
+/* shm.c */
+void ssm_shm_init(ssm_options_t *opts);
+void ssm_shm_forked(void);
+int ssm_shm_active(void);
+void *ssm_shm_malloc(size_t size);
+void ssm_shm_free(void *ptr);
+
 /* workers.c */
 void *ssm_worker_inproc(void *params);
-ssm_workers_t *ssm_workers_start(ssm_X_t ***D_J_X, ssm_par_t **J_par, ssm_data_t *data, ssm_calc_t **calc, ssm_fitness_t *fitness, ssm_f_pred_t f_pred, ssm_nav_t *nav, ssm_options_t *opts, ssm_worker_opt_t wopts);
+void *ssm_workers_handshake(void *params);
+ssm_workers_t *ssm_workers_start(json_t *jparameters, json_t *jdata, ssm_X_t ***D_J_X, ssm_par_t **J_par, ssm_data_t *data, ssm_calc_t **calc, ssm_fitness_t *fitness, ssm_f_pred_t f_pred, ssm_nav_t *nav, ssm_options_t *opts, ssm_worker_opt_t wopts);
+void ssm_workers_integrate(ssm_workers_t *workers, int n);
+void ssm_workers_eval(ssm_workers_t *workers, ssm_par_t **N_par, int N, ssm_X_t ***N_D_X, double *log_like, ssm_err_code_t *status, ssm_data_t *data);
 void ssm_workers_stop(ssm_workers_t *workers);
 
 /* special functions */
@@ -769,11 +1165,23 @@ double slowstep(double x, double d);
 /******************************/
 
 /* kalman/ekf.c */
-ssm_err_code_t _ssm_check_and_correct_Ct(ssm_X_t *X, ssm_calc_t *calc, ssm_nav_t *nav);
-ssm_err_code_t ssm_kalman_gain_computation(ssm_row_t *row, double t, ssm_X_t *X, ssm_par_t *par, ssm_calc_t *calc, ssm_nav_t *nav);
+int ssm_kalman_Ct_index(int m, int i, int j);
+double ssm_kalman_Ct_get(const double *Ct, int m, int i, int j);
+void ssm_kalman_Ct_unpack(gsl_matrix *dest, const double *Ct);
+void ssm_kalman_Ct_pack(double *Ct, const gsl_matrix *src);
+ssm_err_code_t _ssm_check_and_correct_Ct(gsl_matrix *Ct, ssm_calc_t *calc);
+ssm_err_code_t _ssm_cholesky(gsl_matrix *A, int flag_psd);
+void _ssm_kalman_eval_Rt(ssm_row_t *row, double t, ssm_X_t *X, ssm_par_t *par, ssm_calc_t *calc, ssm_nav_t *nav);
+double _ssm_kalman_log_like(const gsl_matrix *L, int upper, const gsl_vector *pred_error, gsl_vector *std_error);
 ssm_err_code_t ssm_kalman_update(ssm_fitness_t *fitness, ssm_X_t *X, ssm_row_t *row, double t, ssm_par_t *par, ssm_calc_t *calc, ssm_nav_t *nav);
 double ssm_diff_derivative(double jac_tpl, const double X[], ssm_state_t *state);
 void ssm_kalman_reset_Ct(ssm_X_t *X, ssm_nav_t *nav);
+void ssm_kalman_steady_reset(ssm_calc_t *calc);
+void ssm_kalman_steady_check(ssm_row_t *row, double t0, double t1, ssm_calc_t *calc);
+
+/* kalman/ukf.c */
+ssm_err_code_t ssm_f_prediction_ukf(ssm_X_t *p_X, double t0, double t1, ssm_par_t *par, ssm_nav_t *nav, ssm_calc_t *calc);
+ssm_err_code_t ssm_ukf_update(ssm_fitness_t *fitness, ssm_X_t *X, ssm_row_t *row, double t, ssm_par_t *par, ssm_calc_t *calc, ssm_nav_t *nav);
 
 /******************************/
 /* mif function signatures */
@@ -791,6 +1199,16 @@ void ssm_mif_update_ionides(ssm_theta_t *mle, ssm_var_t *var, double **D_theta_b
 void ssm_mif_print_header_mean_var_theoretical_ess(FILE *stream, ssm_nav_t *nav);
 void ssm_mif_print_mean_var_theoretical_ess(FILE *stream, double *theta_bart, double *theta_Vt, ssm_fitness_t *fitness, ssm_nav_t *nav , ssm_row_t *row, int m);
 
+/******************************/
+/* pmcmc function signatures */
+/******************************/
+
+/* pmcmc/pmcmc_util.c */
+ssm_prefetch_t *ssm_prefetch_new(int length, ssm_input_t *input, ssm_calc_t *calc, ssm_data_t *data, ssm_nav_t *nav, ssm_options_t *opts);
+void ssm_prefetch_free(ssm_prefetch_t *prefetch, ssm_data_t *data);
+void ssm_prefetch_tree(ssm_prefetch_t *prefetch, ssm_theta_t *theta, ssm_var_t *var, ssm_proposal_t *proposal, double sd_fac, double ar, ssm_input_t *input, ssm_calc_t *calc, ssm_nav_t *nav);
+void ssm_prefetch_eval(ssm_prefetch_t *prefetch, ssm_workers_t *workers, ssm_data_t *data);
+
 /******************************/
 /* worker function signatures */
 /******************************/
@@ -800,6 +1218,24 @@ void ssm_zmq_send_par(void *socket, ssm_par_t *par, int zmq_options);
 void ssm_zmq_recv_par(ssm_par_t *par, void *socket);
 void ssm_zmq_send_X(void *socket, ssm_X_t *X, int zmq_options);
 void ssm_zmq_recv_X(ssm_X_t *X, void *socket);
+void ssm_zmq_send_str(void *socket, const char *str, int zmq_options);
+char *ssm_zmq_recv_str(void *socket);
+void ssm_zmq_identity(char *dest, int id);
+ssm_job_t *ssm_job_new(json_t *jparameters, json_t *jdata, ssm_worker_opt_t wopts, ssm_options_t *opts);
+void ssm_job_free(ssm_job_t *job);
+void ssm_job_integrate(ssm_job_t *job, void *receiver, void *sender);
+ssm_chain_job_t *ssm_chain_job_new(json_t *jparameters, json_t *jdata, ssm_options_t *opts);
+void ssm_chain_job_free(ssm_chain_job_t *job);
+void ssm_chain_job_eval(ssm_chain_job_t *job, void *receiver, void *sender);
+
+/******************************/
+/* broker function signatures */
+/******************************/
+
+/* broker/broker.c */
+ssm_broker_t *ssm_broker_new(ssm_options_t *opts);
+void ssm_broker_free(ssm_broker_t *broker);
+void ssm_broker_run(ssm_broker_t *broker);
 
 /*********************************/
 /* templated function signatures */
@@ -833,21 +1269,41 @@ ssm_observed_t **_ssm_observed_new(int *observed_length);
 
 /* diff_template.c */
 void ssm_compute_diff(ssm_X_t *p_X, ssm_par_t *par, ssm_nav_t *nav, ssm_calc_t *calc);
+void ssm_compute_diff_batch(double *Y, double dt, int B, const double *P, ssm_nav_t *nav, ssm_calc_t *calc);
 
 /* ode_sde_template.c */
 int ssm_step_ode(double t, const double X[], double f[], void *params);
+void ssm_step_ode_batch(double t, const double *Y, double *F, int B, const double *P, ssm_nav_t *nav, ssm_calc_t *calc);
 void ssm_step_sde_no_dem_sto(ssm_X_t *p_X, double t, ssm_par_t *par, ssm_nav_t *nav, ssm_calc_t *calc);
 void ssm_step_sde_no_white_noise(ssm_X_t *p_X, double t, ssm_par_t *par, ssm_nav_t *nav, ssm_calc_t *calc);
 void ssm_step_sde_full(ssm_X_t *p_X, double t, ssm_par_t *par, ssm_nav_t *nav, ssm_calc_t *calc);
 void ssm_step_sde_no_dem_sto_no_white_noise(ssm_X_t *p_X, double t, ssm_par_t *par, ssm_nav_t *nav, ssm_calc_t *calc);
+void ssm_step_sde_batch_no_dem_sto(double *Y, double t, double dt, int B, const double *P, ssm_nav_t *nav, ssm_calc_t *calc);
+void ssm_step_sde_batch_no_white_noise(double *Y, double t, double dt, int B, const double *P, ssm_nav_t *nav, ssm_calc_t *calc);
+void ssm_step_sde_batch_full(double *Y, double t, double dt, int B, const double *P, ssm_nav_t *nav, ssm_calc_t *calc);
+void ssm_step_sde_batch_no_dem_sto_no_white_noise(double *Y, double t, double dt, int B, const double *P, ssm_nav_t *nav, ssm_calc_t *calc);
+int ssm_sde_dw_length(void);
+int ssm_sde_dw_on(int j, ssm_nav_t *nav);
+void ssm_sde_drift_diffusion(const double *X, double t, double *a, double *g, ssm_par_t *par, ssm_nav_t *nav, ssm_calc_t *calc);
+void ssm_sde_milstein(const double *X, double t, const double *dd, double *m, ssm_par_t *par, ssm_nav_t *nav, ssm_calc_t *calc);
+double ssm_psr_leap(ssm_X_t *p_X, double t, double eps, ssm_par_t *par, ssm_nav_t *nav, ssm_calc_t *calc);
 
 /* psr_template.c */
 void ssm_psr_new(ssm_calc_t *calc);
 void ssm_psr_free(ssm_calc_t *calc);
 void ssm_step_psr(ssm_X_t *p_X, double t, ssm_par_t *par, ssm_nav_t *nav, ssm_calc_t *calc);
+void ssm_step_psr_batch(double *Y, double t, double dt, int B, const double *P, ssm_nav_t *nav, ssm_calc_t *calc);
+
+/* gillespie_template.c */
+void ssm_gillespie_new(ssm_calc_t *calc, ssm_nav_t *nav);
+void ssm_gillespie_free(ssm_calc_t *calc);
+void ssm_gillespie_freeze(ssm_X_t *p_X, double t, ssm_par_t *par, ssm_nav_t *nav, ssm_calc_t *calc);
+double ssm_gillespie_propensity(int r, const double *X, ssm_par_t *par, ssm_nav_t *nav, ssm_calc_t *calc);
+void ssm_gillespie_fire(int r, double *X, ssm_nav_t *nav);
 
 /* jac_template */
 void ssm_eval_jac(const double X[], double t, ssm_par_t *par, ssm_nav_t *nav, ssm_calc_t *calc);
+int ssm_jac_ode(double t, const double X[], double *dfdy, double dfdt[], void *params);
 
 /* Ht_template.c */
 void ssm_eval_Ht(ssm_X_t *p_X, ssm_row_t *row, double t, ssm_par_t *par, ssm_nav_t *nav, ssm_calc_t *calc);
@@ -860,6 +1316,7 @@ void ssm_eval_Q_no_dem_sto_no_env_sto(const double X[], double t, ssm_par_t *par
 
 /* step_ekf_template.c */
 int ssm_step_ekf(double t, const double X[], double f[], void *params);
+int ssm_step_ukf(double t, const double X[], double f[], void *params);
 
 
 
@@ -77,6 +77,38 @@ const gsl_interp_type *ssm_str_to_interp_type(const char *optarg)
 }
 
 
+/**
+ * tranform --stepper argument into gsl_odeiv2_step_type *.
+ * is_implicit is set to 1 for the steppers requiring the jacobian.
+ * "auto" starts with rkf45 (see ssm_f_prediction_ode()).
+ */
+const gsl_odeiv2_step_type *ssm_str_to_stepper_type(const char *optarg, int *is_implicit)
+{
+    *is_implicit = 0;
+
+    if (strcmp(optarg, "rkf45") == 0 || strcmp(optarg, "auto") == 0) {
+        return gsl_odeiv2_step_rkf45;
+    } else if (strcmp(optarg, "rkck") == 0){
+        return gsl_odeiv2_step_rkck;
+    } else if (strcmp(optarg, "rk8pd") == 0){
+        return gsl_odeiv2_step_rk8pd;
+    }
+
+    *is_implicit = 1;
+    if (strcmp(optarg, "rk4imp") == 0){
+        return gsl_odeiv2_step_rk4imp;
+    } else if (strcmp(optarg, "bsimp") == 0){
+        return gsl_odeiv2_step_bsimp;
+    } else if (strcmp(optarg, "msbdf") == 0){
+        return gsl_odeiv2_step_msbdf;
+    }
+
+    *is_implicit = 0;
+    ssm_print_warning("Unknown gsl_odeiv2 stepper. rkf45 will be used instead.");
+    return gsl_odeiv2_step_rkf45;
+}
+
+
 
 /**
  * make sure that n_threads <= J and return safe n_threads
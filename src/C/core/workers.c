@@ -18,6 +18,14 @@
 
 #include "ssm.h"
 
+/**
+ * Integrate a chunk of particles. The worker is a thread or, with
+ * --shm, a forked process sharing the particles with the server (see
+ * core/shm.c). In both cases the server sends the id of the chunk, the
+ * index of the data and the address of the particles array to
+ * integrate (the arrays are swapped by the resampling, their content
+ * is not).
+ */
 void *ssm_worker_inproc(void *params)
 {
     char str[SSM_STR_BUFFSIZE];
@@ -29,7 +37,6 @@ void *ssm_worker_inproc(void *params)
     int J_chunk = p->J_chunk;   
     ssm_data_t *data = p->data;
     ssm_par_t **J_par = p->J_par;
-    ssm_X_t ***D_J_X = p->D_J_X;
     ssm_calc_t **calc = p->calc;
     ssm_nav_t *nav = p->nav;
     ssm_fitness_t *fitness = p->fitness;
@@ -37,18 +44,18 @@ void *ssm_worker_inproc(void *params)
 
     // Socket to server controller
     void *controller = zmq_socket (context, ZMQ_SUB);
-    snprintf(str, SSM_STR_BUFFSIZE, "inproc://ssm_server_controller_%d", id);
+    snprintf(str, SSM_STR_BUFFSIZE, "%s_controller_%d", p->endpoint, id);
     zmq_connect (controller, str);
     zmq_setsockopt (controller, ZMQ_SUBSCRIBE, "", 0);
 
     //  Socket to receive messages (particles) from the server
     void *receiver = zmq_socket (context, ZMQ_PULL);
-    snprintf(str, SSM_STR_BUFFSIZE, "inproc://ssm_server_sender_%d", id);
+    snprintf(str, SSM_STR_BUFFSIZE, "%s_sender_%d", p->endpoint, id);
     zmq_connect (receiver, str);
 
     //  Socket to send messages (results) to the server
     void *sender = zmq_socket (context, ZMQ_PUSH);
-    snprintf(str, SSM_STR_BUFFSIZE, "inproc://ssm_server_receiver_%d", id);
+    snprintf(str, SSM_STR_BUFFSIZE, "%s_receiver_%d", p->endpoint, id);
     zmq_connect (sender, str);
 
     // ready !
@@ -61,33 +68,34 @@ void *ssm_worker_inproc(void *params)
 
     int j, n, t0, t1;
     int the_id;
+    ssm_X_t **J_X;
+    ssm_calc_t *the_calc;
 
     int _zero = 0;
     int *j_par = (SSM_WORKER_J_PAR & wopts) ? &j: &_zero;
-    int np1;
-    int *n_X = (SSM_WORKER_D_X & wopts) ? &np1 : &_zero;
 
     while (1) {
         zmq_poll (items, 2, -1);
         if (items [0].revents & ZMQ_POLLIN) {
 
             zmq_recv(receiver, &the_id, sizeof (int), 0);
-            zmq_recv(receiver, &n, sizeof (int), 0);	    
+            zmq_recv(receiver, &n, sizeof (int), 0);
+            zmq_recv(receiver, &J_X, sizeof (ssm_X_t **), 0);
 
-	    np1 = n + 1;
             t0 = (n) ? data->rows[n-1]->time: 0;
             t1 = data->rows[n]->time;
 
+            //a forked worker always use its own calc so that the processes do not draw the same random numbers
+            the_calc = (p->flag_process) ? calc[p->index] : calc[the_id];
+
             int J_start = the_id * J_chunk;
-            int J_end = (the_id+1 == calc[the_id]->threads_length) ? fitness->J : (the_id+1)*J_chunk;
+            int J_end = (the_id+1 == the_calc->threads_length) ? fitness->J : (the_id+1)*J_chunk;
 
-            for(j=J_start; j<J_end; j++ ){
+            ssm_f_prediction_J(J_X, J_start, J_end, J_par, (SSM_WORKER_J_PAR & wopts), data->rows[n], t0, t1, f_pred, nav, the_calc, fitness->cum_status);
 
-                ssm_X_reset_inc(D_J_X[*n_X][j], data->rows[n], nav);
-		fitness->cum_status[j] |= (*f_pred)(D_J_X[*n_X][j], t0, t1, J_par[*j_par], nav, calc[the_id]);
-		
+            for(j=J_start; j<J_end; j++ ){
                 if((SSM_WORKER_FITNESS & wopts) && data->rows[n]->ts_nonan_length) {
-                    fitness->weights[j] = (fitness->cum_status[j] == SSM_SUCCESS) ?  exp(ssm_log_likelihood(data->rows[n], D_J_X[*n_X][j], J_par[*j_par], calc[the_id], nav, fitness)) : 0.0;
+                    fitness->weights[j] = (fitness->cum_status[j] == SSM_SUCCESS) ?  exp(ssm_log_likelihood(data->rows[n], J_X[j], J_par[*j_par], the_calc, nav, fitness)) : 0.0;
                     fitness->cum_status[j] = SSM_SUCCESS;
                 }
             }
@@ -115,7 +123,54 @@ void *ssm_worker_inproc(void *params)
 }
 
 
-ssm_workers_t *ssm_workers_start(ssm_X_t ***D_J_X, ssm_par_t **J_par, ssm_data_t *data, ssm_calc_t **calc, ssm_fitness_t *fitness, ssm_f_pred_t f_pred, ssm_nav_t *nav, ssm_options_t *opts, ssm_worker_opt_t wopts)
+/**
+ * Answer the handshake of the tcp workers (see worker/main_worker.c)
+ * on a REQ/REP socket. A worker asks for the manifest, the parameters
+ * and (if it doesn't have the same locally) the data and covariates.
+ * WOPTS tells it the kind of work (particles or, with
+ * SSM_WORKER_CHAIN, whole likelihood evaluations of J particles).
+ * It then sends "READY <hash>" with the hash it computed on its side
+ * and only connects to the particle sockets if the hash matches.
+ *
+ * The thread terminates when the zmq context is destroyed by
+ * ssm_workers_stop().
+ */
+void *ssm_workers_handshake(void *params)
+{
+    ssm_workers_t *w = (ssm_workers_t *) params;
+
+    void *handshake = zmq_socket(w->context, ZMQ_REP);
+    zmq_bind(handshake, "tcp://*:5560");
+
+    char *req;
+    char str[SSM_STR_BUFFSIZE];
+    while ( (req = ssm_zmq_recv_str(handshake)) ) {
+
+        if(strcmp(req, "MANIFEST") == 0) {
+            ssm_zmq_send_str(handshake, w->str_manifest, 0);
+        } else if (strcmp(req, "PARAMETERS") == 0) {
+            ssm_zmq_send_str(handshake, w->str_parameters, 0);
+        } else if (strcmp(req, "DATA") == 0) {
+            ssm_zmq_send_str(handshake, w->str_data, 0);
+        } else if (strcmp(req, "WOPTS") == 0) {
+            snprintf(str, SSM_STR_BUFFSIZE, "%d %d", (int) w->wopts, w->J);
+            ssm_zmq_send_str(handshake, str, 0);
+        } else if (strncmp(req, "READY ", 6) == 0) {
+            ssm_zmq_send_str(handshake, (strcmp(req + 6, w->manifest->hash) == 0) ? "OK": "MISMATCH", 0);
+        } else {
+            ssm_zmq_send_str(handshake, "UNKNOWN", 0);
+        }
+
+        free(req);
+    }
+
+    zmq_close(handshake);
+
+    return NULL;
+}
+
+
+ssm_workers_t *ssm_workers_start(json_t *jparameters, json_t *jdata, ssm_X_t ***D_J_X, ssm_par_t **J_par, ssm_data_t *data, ssm_calc_t **calc, ssm_fitness_t *fitness, ssm_f_pred_t f_pred, ssm_nav_t *nav, ssm_options_t *opts, ssm_worker_opt_t wopts)
 {
     int i, id;
     char str[SSM_STR_BUFFSIZE];
@@ -129,25 +184,88 @@ ssm_workers_t *ssm_workers_start(ssm_X_t ***D_J_X, ssm_par_t **J_par, ssm_data_t
     w->flag_tcp = opts->flag_tcp;
     w->inproc_length = calc[0]->threads_length;
     w->wopts = wopts;
+    w->J = fitness->J;
+    w->flag_broker = 0;
+    w->flag_shm = 0;
+    w->endpoint[0] = '\0';
+    w->D_J_X = D_J_X;
+    w->workers = NULL;
+    w->pids = NULL;
+
+    w->manifest = NULL;
+    w->str_manifest = NULL;
+    w->str_parameters = NULL;
+    w->str_data = NULL;
 
     if(opts->flag_tcp){
 	w->context = zmq_ctx_new();;
 
-        //  Socket to send messages on
-        w->sender = zmq_socket(w->context, ZMQ_PUSH);
-        zmq_bind(w->sender, "tcp://*:5557");
-
-        //  Socket to receive messages on
-        w->receiver = zmq_socket(w->context, ZMQ_PULL);
-        zmq_bind(w->receiver, "tcp://*:5558");
-
-        //  Socket for worker control
-        w->controller = zmq_socket(w->context, ZMQ_PUB);
-        zmq_bind(w->controller, "tcp://*:5559");
+	w->manifest = ssm_manifest_new(jdata, nav, opts);
+	w->str_manifest = ssm_manifest_dumps(w->manifest);
+	w->str_parameters = json_dumps(jparameters, JSON_COMPACT);
+	w->str_data = json_dumps(jdata, JSON_COMPACT | JSON_SORT_KEYS);
+	if(w->str_parameters == NULL || w->str_data == NULL){
+	    ssm_print_err("could not serialize the parameters or the data for the workers");
+	    exit(EXIT_FAILURE);
+	}
 
 	w->params = NULL;
 	w->workers = NULL;
 
+	if(strlen(opts->broker)){
+	    if(wopts & SSM_WORKER_CHAIN){
+		ssm_print_err("whole likelihood evaluations (--chain) cannot be dispatched through a broker");
+		exit(EXIT_FAILURE);
+	    }
+	    w->flag_broker = 1;
+
+	    char identity[SSM_STR_BUFFSIZE];
+	    ssm_zmq_identity(identity, opts->id);
+
+	    //particles are sent and received on the same socket
+	    w->sender = zmq_socket(w->context, ZMQ_DEALER);
+	    zmq_setsockopt(w->sender, ZMQ_IDENTITY, identity, strlen(identity));
+	    snprintf(str, SSM_STR_BUFFSIZE, "tcp://%s:%d", opts->broker, SSM_BROKER_PORT_FRONTEND);
+	    zmq_connect(w->sender, str);
+	    w->receiver = w->sender;
+
+	    //register the job (same identity so that the broker can route the particles)
+	    w->controller = zmq_socket(w->context, ZMQ_REQ);
+	    zmq_setsockopt(w->controller, ZMQ_IDENTITY, identity, strlen(identity));
+	    snprintf(str, SSM_STR_BUFFSIZE, "tcp://%s:%d", opts->broker, SSM_BROKER_PORT_CONTROL);
+	    zmq_connect(w->controller, str);
+
+	    ssm_zmq_send_str(w->controller, "JOB", ZMQ_SNDMORE);
+	    ssm_zmq_send_str(w->controller, w->manifest->hash, ZMQ_SNDMORE);
+	    ssm_zmq_send_str(w->controller, w->str_manifest, ZMQ_SNDMORE);
+	    ssm_zmq_send_str(w->controller, w->str_parameters, ZMQ_SNDMORE);
+	    ssm_zmq_send_str(w->controller, w->str_data, ZMQ_SNDMORE);
+	    zmq_send(w->controller, &wopts, sizeof (int), 0);
+
+	    char *reply = ssm_zmq_recv_str(w->controller);
+	    if(strcmp(reply, "OK") != 0){
+		ssm_print_err("the broker refused the job");
+		exit(EXIT_FAILURE);
+	    }
+	    free(reply);
+
+	} else {
+	    //  Socket to send messages on
+	    w->sender = zmq_socket(w->context, ZMQ_PUSH);
+	    zmq_bind(w->sender, "tcp://*:5557");
+
+	    //  Socket to receive messages on
+	    w->receiver = zmq_socket(w->context, ZMQ_PULL);
+	    zmq_bind(w->receiver, "tcp://*:5558");
+
+	    //  Socket for worker control
+	    w->controller = zmq_socket(w->context, ZMQ_PUB);
+	    zmq_bind(w->controller, "tcp://*:5559");
+
+	    //workers only connect to the sockets above once their handshake has been verified
+	    pthread_create(&(w->handshake), NULL, ssm_workers_handshake, (void*) w);
+	}
+
     } else if (w->inproc_length == 1){
 	w->context = NULL;
 	w->sender = NULL;
@@ -157,24 +275,11 @@ ssm_workers_t *ssm_workers_start(ssm_X_t ***D_J_X, ssm_par_t **J_par, ssm_data_t
 	w->workers = NULL;       
 
     } else {
-	w->context = zmq_ctx_new();
-
-	w->sender = zmq_socket (w->context, ZMQ_PUSH);
-	snprintf(str, SSM_STR_BUFFSIZE, "inproc://ssm_server_sender_%d", opts->id);
-	zmq_bind (w->sender, str);
-
-	w->receiver = zmq_socket (w->context, ZMQ_PULL);
-	snprintf(str, SSM_STR_BUFFSIZE, "inproc://ssm_server_receiver_%d", opts->id);
-	zmq_bind (w->receiver, str);
-
-	w->controller = zmq_socket (w->context, ZMQ_PUB);
-	snprintf(str, SSM_STR_BUFFSIZE, "inproc://ssm_server_controller_%d", opts->id);
-	zmq_bind (w->controller, str);
-
-	w->workers = malloc(w->inproc_length * sizeof (pthread_t));
-	if(w->workers == NULL){
-	    ssm_print_err("allocation impossible for pthread_t");
-	    exit(EXIT_FAILURE);
+	w->flag_shm = (opts->flag_shm && ssm_shm_active());
+	if(w->flag_shm){
+	    snprintf(w->endpoint, SSM_STR_BUFFSIZE, "ipc:///tmp/ssm_server_%d", (int) getpid());
+	} else {
+	    snprintf(w->endpoint, SSM_STR_BUFFSIZE, "inproc://ssm_server");
 	}
 
 	w->params =  malloc(w->inproc_length * sizeof (ssm_params_worker_inproc_t));
@@ -186,18 +291,70 @@ ssm_workers_t *ssm_workers_start(ssm_X_t ***D_J_X, ssm_par_t **J_par, ssm_data_t
 	int J_chunk = fitness->J / w->inproc_length;
 	for(i=0; i<w->inproc_length; i++){
 	    w->params[i].id = opts->id;
-	    w->params[i].context = w->context;
+	    w->params[i].index = i;
+	    w->params[i].flag_process = w->flag_shm;
+	    w->params[i].endpoint = w->endpoint;
+	    w->params[i].context = NULL;
 	    w->params[i].wopts = wopts;
 	    w->params[i].J_chunk = J_chunk;
 	    w->params[i].data = data;
 	    w->params[i].J_par = J_par;
-	    w->params[i].D_J_X = D_J_X;
 	    w->params[i].calc = calc;
 	    w->params[i].nav = nav;
 	    w->params[i].fitness = fitness;
 	    w->params[i].f_pred = f_pred;
+	}
+
+	if(w->flag_shm){
+	    //fork before any zmq context exists: each process has its own
+	    w->pids = malloc(w->inproc_length * sizeof (pid_t));
+	    if(w->pids == NULL){
+		ssm_print_err("allocation impossible for pid_t");
+		exit(EXIT_FAILURE);
+	    }
+
+	    fflush(NULL);
+	    for(i=0; i<w->inproc_length; i++){
+		w->pids[i] = fork();
+		if(w->pids[i] == -1){
+		    ssm_print_err("could not fork the workers");
+		    exit(EXIT_FAILURE);
+		} else if(w->pids[i] == 0){
+		    ssm_shm_forked();
+		    w->params[i].context = zmq_ctx_new();
+		    ssm_worker_inproc((void*) &(w->params[i]));
+		    zmq_ctx_destroy(w->params[i].context);
+		    _exit(EXIT_SUCCESS);
+		}
+	    }
+	}
+
+	w->context = zmq_ctx_new();
+
+	w->sender = zmq_socket (w->context, ZMQ_PUSH);
+	snprintf(str, SSM_STR_BUFFSIZE, "%s_sender_%d", w->endpoint, opts->id);
+	zmq_bind (w->sender, str);
+
+	w->receiver = zmq_socket (w->context, ZMQ_PULL);
+	snprintf(str, SSM_STR_BUFFSIZE, "%s_receiver_%d", w->endpoint, opts->id);
+	zmq_bind (w->receiver, str);
+
+	w->controller = zmq_socket (w->context, ZMQ_PUB);
+	snprintf(str, SSM_STR_BUFFSIZE, "%s_controller_%d", w->endpoint, opts->id);
+	zmq_bind (w->controller, str);
+
+	if(!w->flag_shm){
+	    //inproc:// endpoints have to be bound before the threads connect
+	    w->workers = malloc(w->inproc_length * sizeof (pthread_t));
+	    if(w->workers == NULL){
+		ssm_print_err("allocation impossible for pthread_t");
+		exit(EXIT_FAILURE);
+	    }
 
-	    pthread_create(&(w->workers[i]), NULL, ssm_worker_inproc, (void*) &(w->params[i]));
+	    for(i=0; i<w->inproc_length; i++){
+		w->params[i].context = w->context;
+		pthread_create(&(w->workers[i]), NULL, ssm_worker_inproc, (void*) &(w->params[i]));
+	    }
 	}
 
 	//wait that all worker are connected
@@ -210,25 +367,110 @@ ssm_workers_t *ssm_workers_start(ssm_X_t ***D_J_X, ssm_par_t **J_par, ssm_data_t
 }
 
 
+/**
+ * Integrate the particles between data n-1 and n with the inproc
+ * workers (threads or, with --shm, processes): one chunk of particles
+ * per worker.
+ */
+void ssm_workers_integrate(ssm_workers_t *workers, int n)
+{
+    int i, id;
+    ssm_X_t **J_X = workers->D_J_X[(SSM_WORKER_D_X & workers->wopts) ? n+1 : 0];
+
+    //send work
+    for (i=0; i<workers->inproc_length; i++) {
+        zmq_send(workers->sender, &i, sizeof (int), ZMQ_SNDMORE);
+        zmq_send(workers->sender, &n, sizeof (int), ZMQ_SNDMORE);
+        zmq_send(workers->sender, &J_X, sizeof (ssm_X_t **), 0);
+    }
+
+    //get results from the workers
+    for (i=0; i<workers->inproc_length; i++) {
+        zmq_recv(workers->receiver, &id, sizeof (int), 0);
+    }
+}
+
+
+/**
+ * Compute the log likelihood of the N parameters N_par with the tcp
+ * workers (SSM_WORKER_CHAIN): each worker runs a whole particle
+ * filter so that only the parameters, the log likelihood and, if
+ * N_D_X is not NULL, a sampled trajectory (stored in N_D_X[i]) are
+ * exchanged. The N evaluations run in parallel on the available
+ * workers.
+ */
+void ssm_workers_eval(ssm_workers_t *workers, ssm_par_t **N_par, int N, ssm_X_t ***N_D_X, double *log_like, ssm_err_code_t *status, ssm_data_t *data)
+{
+    int i, n, the_i;
+    int flag_traj = (N_D_X != NULL);
+
+    //send work
+    for(i=0; i<N; i++){
+        zmq_send(workers->sender, &i, sizeof (int), ZMQ_SNDMORE);
+        ssm_zmq_send_par(workers->sender, N_par[i], ZMQ_SNDMORE);
+        zmq_send(workers->sender, &flag_traj, sizeof (int), 0);
+    }
+
+    //get results from the workers
+    for(i=0; i<N; i++){
+        zmq_recv(workers->receiver, &the_i, sizeof (int), 0);
+        zmq_recv(workers->receiver, &(status[the_i]), sizeof (ssm_err_code_t), 0);
+        zmq_recv(workers->receiver, &(log_like[the_i]), sizeof (double), 0);
+        if(flag_traj){
+            for(n=0; n<data->n_obs; n++){
+                ssm_zmq_recv_X(N_D_X[the_i][n+1], workers->receiver);
+            }
+        }
+    }
+}
+
+
 void ssm_workers_stop(ssm_workers_t *workers)
 {
     int i;
 
     if(workers->flag_tcp || workers->inproc_length >1){
-        zmq_send (workers->controller, "KILL", 5, 0);
-        zmq_close (workers->sender);
-        zmq_close (workers->receiver);
-        zmq_close (workers->controller);
 
-	if(!workers->flag_tcp){
+	if(workers->flag_broker){
+	    //the workers belong to the broker: only unregister the job
+	    ssm_zmq_send_str(workers->controller, "BYE", 0);
+	    char *reply = ssm_zmq_recv_str(workers->controller);
+	    free(reply);
+
+	    zmq_close (workers->sender);
+	    zmq_close (workers->controller);
+	} else {
+	    zmq_send (workers->controller, "KILL", 5, 0);
+	    zmq_close (workers->sender);
+	    zmq_close (workers->receiver);
+	    zmq_close (workers->controller);
+	}
+
+	if(workers->flag_shm){
+	    for(i = 0; i < workers->inproc_length; i++){
+		waitpid(workers->pids[i], NULL, 0);
+	    }
+	} else if(!workers->flag_tcp){
 	    for(i = 0; i < workers->inproc_length; i++){
 		pthread_join(workers->workers[i], NULL);
 	    }
 	}
 
         free(workers->workers);
+        free(workers->pids);
         free(workers->params);
         zmq_ctx_destroy (workers->context);
+
+	if(workers->flag_tcp){
+	    if(!workers->flag_broker){
+		//the context termination unblocks the handshake thread
+		pthread_join(workers->handshake, NULL);
+	    }
+	    ssm_manifest_free(workers->manifest);
+	    free(workers->str_manifest);
+	    free(workers->str_parameters);
+	    free(workers->str_data);
+	}
     }
 
     free(workers);
@@ -19,6 +19,63 @@
 #include "ssm.h"
 
 
+/**
+ * Ct is stored packed after the m states of X: only its upper
+ * triangle, row by row (m(m+1)/2 terms). The linear algebra is done
+ * on calc->_Ct, unpacked by ssm_kalman_update().
+ *
+ * Index of the term (i, j) of Ct in the packed storage
+ */
+int ssm_kalman_Ct_index(int m, int i, int j)
+{
+    if(i > j){
+        int tmp = i;
+        i = j;
+        j = tmp;
+    }
+
+    return i*m - (i*(i-1))/2 + (j-i);
+}
+
+double ssm_kalman_Ct_get(const double *Ct, int m, int i, int j)
+{
+    return Ct[ssm_kalman_Ct_index(m, i, j)];
+}
+
+/**
+ * unpack Ct (packed) into the symmetric matrix dest
+ */
+void ssm_kalman_Ct_unpack(gsl_matrix *dest, const double *Ct)
+{
+    int i, j;
+    int m = dest->size1;
+    double x;
+
+    for(i=0; i<m; i++){
+        for(j=i; j<m; j++){
+            x = *Ct++;
+            gsl_matrix_set(dest, i, j, x);
+            gsl_matrix_set(dest, j, i, x);
+        }
+    }
+}
+
+/**
+ * pack the upper triangle of src into Ct
+ */
+void ssm_kalman_Ct_pack(double *Ct, const gsl_matrix *src)
+{
+    int i, j;
+    int m = src->size1;
+
+    for(i=0; i<m; i++){
+        for(j=i; j<m; j++){
+            *Ct++ = gsl_matrix_get(src, i, j);
+        }
+    }
+}
+
+
 /**
  * Brings Ct back to being symetric and semi-definite positive,
  * in case numerical instabilities made it lose these properties.
@@ -28,7 +85,7 @@
  * but this is the most natural way to go as far as I know.
  * We shouldn't need this anymore with the Square-Root Unscented Kalman Filter.
  */
-ssm_err_code_t _ssm_check_and_correct_Ct(ssm_X_t *X, ssm_calc_t *calc, ssm_nav_t *nav)
+ssm_err_code_t _ssm_check_and_correct_Ct(gsl_matrix *Ct, ssm_calc_t *calc)
 {
 
     int i,j;
@@ -42,13 +99,12 @@ ssm_err_code_t _ssm_check_and_correct_Ct(ssm_X_t *X, ssm_calc_t *calc, ssm_nav_t
 
 
     gsl_matrix *Temp = calc->_Ft; // temporary matrix
-    int m = nav->states_sv_inc->length + nav->states_diff->length;
-    gsl_matrix_view Ct =  gsl_matrix_view_array(&X->proj[m], m, m);
-    gsl_matrix_memcpy(Temp, &Ct.matrix);	// temp = Ct
+    int m = Ct->size1;
+    gsl_matrix_memcpy(Temp, Ct);	// temp = Ct
 
     for(i=0; i< m; i++){
         for(j=0; j< m; j++){
-            gsl_matrix_set(&Ct.matrix, i, j, ((gsl_matrix_get(Temp, i, j) + gsl_matrix_get(Temp, j, i)) / 2.0) );
+            gsl_matrix_set(Ct, i, j, ((gsl_matrix_get(Temp, i, j) + gsl_matrix_get(Temp, j, i)) / 2.0) );
         }
     }
 
@@ -94,7 +150,7 @@ ssm_err_code_t _ssm_check_and_correct_Ct(ssm_X_t *X, ssm_calc_t *calc, ssm_nav_t
         cum_status |=  (status != GSL_SUCCESS) ? SSM_ERR_KAL : SSM_SUCCESS;
 
         // Ct = 1.0*evec*Temp2 + 0.0*Temp2;
-        status = gsl_blas_dgemm(CblasNoTrans, CblasNoTrans, 1.0, evec, Temp2, 0.0, &Ct.matrix);
+        status = gsl_blas_dgemm(CblasNoTrans, CblasNoTrans, 1.0, evec, Temp2, 0.0, Ct);
         cum_status |=  (status != GSL_SUCCESS) ? SSM_ERR_KAL : SSM_SUCCESS;
     }
 
@@ -103,31 +159,74 @@ ssm_err_code_t _ssm_check_and_correct_Ct(ssm_X_t *X, ssm_calc_t *calc, ssm_nav_t
 
 
 /**
- * Computation of the EKF gain kt for observation data_t_ts and obs
- * jacobian ht, given estimate xk_t_ts and current covariance Ct
+ * In place Cholesky factorization A = L L' (L is stored in the lower
+ * triangle, the upper triangle is set to 0). Unlike gsl_linalg_cholesky_decomp(), a matrix that is
+ * not positive definite is reported through the returned status
+ * instead of the gsl error handler.
+ *
+ * With flag_psd, A only has to be positive semi-definite: pivots
+ * that are null up to rounding errors are taken as 0 (the
+ * corresponding column of L is 0).
  */
-ssm_err_code_t ssm_kalman_gain_computation(ssm_row_t *row, double t, ssm_X_t *X, ssm_par_t *par, ssm_calc_t *calc, ssm_nav_t *nav)
+ssm_err_code_t _ssm_cholesky(gsl_matrix *A, int flag_psd)
 {
+    int i, j, k;
+    double sum;
+    double tol = 0.0;
+    int n = A->size1;
+
+    if(flag_psd){
+        for(j=0; j<n; j++){
+            tol = GSL_MAX(tol, gsl_matrix_get(A, j, j));
+        }
+        tol *= n*GSL_DBL_EPSILON;
+    }
 
-    int i, j, status;
-    double tmp;
-    ssm_err_code_t cum_status = SSM_SUCCESS;
-    int m = nav->states_sv->length + nav->states_inc->length + nav->states_diff->length;
+    for(j=0; j<n; j++){
+        sum = gsl_matrix_get(A, j, j);
+        for(k=0; k<j; k++){
+            sum -= gsl_matrix_get(A, j, k) * gsl_matrix_get(A, j, k);
+        }
+        if(sum <= tol){
+            if(!flag_psd || sum < -tol){
+                return SSM_ERR_KAL;
+            }
+            for(i=j; i<n; i++){
+                gsl_matrix_set(A, i, j, 0.0);
+            }
+            continue;
+        }
+        gsl_matrix_set(A, j, j, sqrt(sum));
 
+        for(i=j+1; i<n; i++){
+            sum = gsl_matrix_get(A, i, j);
+            for(k=0; k<j; k++){
+                sum -= gsl_matrix_get(A, i, k) * gsl_matrix_get(A, j, k);
+            }
+            gsl_matrix_set(A, i, j, sum / gsl_matrix_get(A, j, j));
+        }
+    }
+
+    for(i=0; i<n; i++){
+        for(j=i+1; j<n; j++){
+            gsl_matrix_set(A, i, j, 0.0);
+        }
+    }
+
+    return SSM_SUCCESS;
+}
+
+
+/**
+ * fill Rt with the observation variances of row
+ */
+void _ssm_kalman_eval_Rt(ssm_row_t *row, double t, ssm_X_t *X, ssm_par_t *par, ssm_calc_t *calc, ssm_nav_t *nav)
+{
+    int i, j;
+    double tmp;
 
-    // sub-matrices and sub-vectors of working variables are extracted as not all tseries are observed
-    gsl_vector_view pred_error = gsl_vector_subvector(calc->_pred_error,0,row->ts_nonan_length);
-    gsl_matrix_view St = gsl_matrix_submatrix(calc->_St,0,0,row->ts_nonan_length,row->ts_nonan_length);
-    gsl_matrix_view Stm1 = gsl_matrix_submatrix(calc->_Stm1,0,0,row->ts_nonan_length,row->ts_nonan_length);
     gsl_matrix_view Rt = gsl_matrix_submatrix(calc->_Rt,0,0,row->ts_nonan_length,row->ts_nonan_length);
-    gsl_matrix_view Tmp = gsl_matrix_submatrix(calc->_Tmp_N_SV_N_TS,0,0,m,row->ts_nonan_length);
-    gsl_matrix_view Ht = gsl_matrix_submatrix(calc->_Ht,0,0,m,row->ts_nonan_length);
-    gsl_matrix_view Kt = gsl_matrix_submatrix(calc->_Kt,0,0,m,row->ts_nonan_length);
-    gsl_matrix_view Ct =  gsl_matrix_view_array(&X->proj[m], m, m);
-    gsl_permutation *p  = gsl_permutation_alloc(row->ts_nonan_length);
 
-    // fill Ht and Rt
-    ssm_eval_Ht(X, row, t, par, nav, calc);
     for(i=0; i< row->ts_nonan_length; i++){
         for(j=0; j< row->ts_nonan_length; j++){
             if (i==j){
@@ -145,103 +244,516 @@ ssm_err_code_t ssm_kalman_gain_computation(ssm_row_t *row, double t, ssm_X_t *X,
             }
         }
     }
+}
+
+
+/**
+ * fill Ht, Rt and the prediction error of the observations of row
+ */
+static void _ssm_kalman_eval_Ht_Rt_pred_error(ssm_row_t *row, double t, ssm_X_t *X, ssm_par_t *par, ssm_calc_t *calc, ssm_nav_t *nav)
+{
+    int i;
+
+    gsl_vector_view pred_error = gsl_vector_subvector(calc->_pred_error,0,row->ts_nonan_length);
+
+    // fill Ht and Rt
+    ssm_eval_Ht(X, row, t, par, nav, calc);
+    _ssm_kalman_eval_Rt(row, t, X, par, calc, nav);
 
     // pred_error = double data_t_ts - xk_t_ts
     for(i=0; i< row->ts_nonan_length; i++){
         gsl_vector_set(&pred_error.vector,i,row->values[i] - row->observed[i]->f_obs_mean(X, par, calc, t));
     }
+}
+
+
+/**
+ * log likelihood of the prediction error given the Cholesky factor L
+ * of its covariance St (upper is 1 if L' is stored in the upper
+ * triangle instead): with L std_error = pred_error,
+ * pred_error' St^-1 pred_error = std_error' std_error and
+ * log|St| = 2 sum log|L_ii|
+ */
+double _ssm_kalman_log_like(const gsl_matrix *L, int upper, const gsl_vector *pred_error, gsl_vector *std_error)
+{
+    int i;
+    double log_like;
+    int n = pred_error->size;
+
+    gsl_vector_memcpy(std_error, pred_error);
+    if(upper){
+        gsl_blas_dtrsv(CblasUpper, CblasTrans, CblasNonUnit, L, std_error);
+    } else {
+        gsl_blas_dtrsv(CblasLower, CblasNoTrans, CblasNonUnit, L, std_error);
+    }
+    gsl_blas_ddot(std_error, std_error, &log_like);
 
-    // positivity and symetry could have been lost when propagating Ct
-    cum_status |= _ssm_check_and_correct_Ct(X, calc, nav);
+    log_like = -0.5*log_like - 0.5*n*log(2*M_PI);
+    for(i=0; i< n; i++){
+        log_like -= log(fabs(gsl_matrix_get(L, i, i)));
+    }
 
-    // sc_st = Ht' * Ct * Ht + sc_rt
-    /*
-     * here ht is a column vector to fit gsl standards,
-     * rather than a row vector as it should be in theory,
-     * which explains the slightly different formula we use
-     */
+    return log_like;
+}
 
-    // workn = Ct*Ht
-    status = gsl_blas_dgemm(CblasNoTrans, CblasNoTrans, 1.0, &Ct.matrix, &Ht.matrix, 0.0, &Tmp.matrix);
-    cum_status |=  (status != GSL_SUCCESS) ? SSM_ERR_KAL : SSM_SUCCESS;
 
-    // sc_st = Ht' * workn;
-    status = gsl_blas_dgemm(CblasTrans, CblasNoTrans, 1.0, &Ht.matrix, &Tmp.matrix, 0.0, &St.matrix);
+/**
+ * Square-root (array) form of the update: with Ct = S S' and
+ * Rt = Rt^1/2 Rt^1/2', an orthogonal transformation (QR decomposition)
+ * of the pre-array A brings it to the lower triangular post-array B:
+ *
+ *     A = [ Rt^1/2  Ht' S ]      B = [ St^1/2   0  ]
+ *         [   0       S   ]          [  Kbar   S+  ]
+ *
+ * As A A' = B B', St^1/2 is a square root of St, Kt = Kbar St^-1/2 and
+ * S+ S+' is the updated covariance, positive semi-definite by
+ * construction: Ct doesn't have to be corrected after the update.
+ *
+ * The QR decomposition is done on A' (A' = Q R so that B = R').
+ *
+ * This is an update-only square-root filter: the prediction still
+ * integrates the full covariance Ct (ssm_step_ekf()) and S is
+ * obtained at each update by a Cholesky factorization (O(m^3)) of the
+ * propagated Ct, tolerating singular Ct (some states can have a null
+ * variance). The eigen value correction of
+ * _ssm_check_and_correct_Ct() is only used when this factorization
+ * fails. Positivity is therefore guaranteed by construction for the
+ * updated covariance only.
+ */
+static ssm_err_code_t _ssm_kalman_sqrt_update(ssm_fitness_t *fitness, ssm_X_t *X, ssm_row_t *row, double t, ssm_par_t *par, ssm_calc_t *calc, ssm_nav_t *nav)
+{
+    int i, j, status;
+    ssm_err_code_t cum_status = SSM_SUCCESS;
+    int m = nav->states_sv_inc->length + nav->states_diff->length;
+    int p = row->ts_nonan_length;
+
+    gsl_vector_view pred_error = gsl_vector_subvector(calc->_pred_error,0,p);
+    gsl_vector_view std_error = gsl_vector_subvector(calc->_std_error,0,p);
+    gsl_matrix_view Kt = gsl_matrix_submatrix(calc->_Kt,0,0,m,p);
+    gsl_vector_view X_sv = gsl_vector_view_array(X->proj,m);
+    gsl_matrix_view Ht = gsl_matrix_submatrix(calc->_Ht,0,0,m,p);
+    gsl_matrix_view Rt = gsl_matrix_submatrix(calc->_Rt,0,0,p,p);
+    gsl_matrix *Ct = calc->_Ct;
+    gsl_matrix *S = calc->_Ft; //not used outside of the integration of Ct
+
+    // A' and the blocks of R (A' is overwritten by R)
+    gsl_matrix_view At = gsl_matrix_submatrix(calc->_sqrt_pre,0,0,p+m,p+m);
+    gsl_vector_view tau = gsl_vector_subvector(calc->_sqrt_tau,0,p+m);
+    gsl_matrix_view At_21 = gsl_matrix_submatrix(&At.matrix,p,0,m,p);
+    gsl_matrix_view R_11 = gsl_matrix_submatrix(&At.matrix,0,0,p,p);
+    gsl_matrix_view R_22 = gsl_matrix_submatrix(&At.matrix,p,p,m,m);
+
+    _ssm_kalman_eval_Ht_Rt_pred_error(row, t, X, par, calc, nav);
+
+    // S = chol(Ct)
+    gsl_matrix_memcpy(S, Ct);
+    if(_ssm_cholesky(S, 1) != SSM_SUCCESS){
+        // positivity could have been lost when propagating Ct
+        cum_status |= _ssm_check_and_correct_Ct(Ct, calc);
+        gsl_matrix_memcpy(S, Ct);
+        status = _ssm_cholesky(S, 1);
+        cum_status |= status;
+        if(status != SSM_SUCCESS){
+            return cum_status;
+        }
+    }
+
+    // A' = [ Rt^1/2   0  ]
+    //      [ S' Ht    S' ]
+    gsl_matrix_set_zero(&At.matrix);
+    for(i=0; i<p; i++){
+        gsl_matrix_set(&At.matrix, i, i, sqrt(gsl_matrix_get(&Rt.matrix, i, i)));
+    }
+    status = gsl_blas_dgemm(CblasTrans, CblasNoTrans, 1.0, S, &Ht.matrix, 0.0, &At_21.matrix);
     cum_status |=  (status != GSL_SUCCESS) ? SSM_ERR_KAL : SSM_SUCCESS;
+    for(i=0; i<m; i++){
+        for(j=0; j<=i; j++){
+            gsl_matrix_set(&At.matrix, p+j, p+i, gsl_matrix_get(S, i, j));
+        }
+    }
 
-    // sc_st = sc_st + sc_rt ;
-    status  =  gsl_matrix_add(&St.matrix,&Rt.matrix);
+    status = gsl_linalg_QR_decomp(&At.matrix, &tau.vector);
     cum_status |=  (status != GSL_SUCCESS) ? SSM_ERR_KAL : SSM_SUCCESS;
 
-    for(i=0; i< row->ts_nonan_length; i++){
-	if (gsl_matrix_get(&St.matrix,i,i)<SSM_ZERO_LOG){
-	    gsl_matrix_set(&St.matrix,i,i,SSM_ZERO_LOG);
+    // R_11' is a square root of St
+    for(i=0; i<p; i++){
+        if(gsl_matrix_get(&R_11.matrix, i, i) == 0.0){
+            return cum_status | SSM_ERR_KAL;
         }
     }
 
-    // Kt = Ct * Ht * sc_st^-1
-    status = gsl_linalg_LU_decomp(&St.matrix, p, &i); // inversion requires LU decomposition
+    // Kt = R_12' R_11'^-1
+    for(i=0; i<m; i++){
+        for(j=0; j<p; j++){
+            gsl_matrix_set(&Kt.matrix, i, j, gsl_matrix_get(&At.matrix, j, p+i));
+        }
+    }
+    status = gsl_blas_dtrsm(CblasRight, CblasUpper, CblasTrans, CblasNonUnit, 1.0, &R_11.matrix, &Kt.matrix);
     cum_status |=  (status != GSL_SUCCESS) ? SSM_ERR_KAL : SSM_SUCCESS;
 
-    status = gsl_linalg_LU_invert(&St.matrix,p,&Stm1.matrix);
+    //////////////////
+    // state update //
+    //////////////////
+    // X_sv += Kt * pred_error
+    status = gsl_blas_dgemv(CblasNoTrans,1.0,&Kt.matrix,&pred_error.vector,1.0,&X_sv.vector);
     cum_status |=  (status != GSL_SUCCESS) ? SSM_ERR_KAL : SSM_SUCCESS;
 
-    status = gsl_blas_dgemm(CblasNoTrans, CblasNoTrans, 1.0, &Ht.matrix, &Stm1.matrix, 0.0, &Tmp.matrix);
+    ///////////////////////
+    // covariance update //
+    ///////////////////////
+    // Ct = R_22' R_22 (the lower triangle of R holds the householder vectors)
+    for(i=1; i<m; i++){
+        for(j=0; j<i; j++){
+            gsl_matrix_set(&R_22.matrix, i, j, 0.0);
+        }
+    }
+    status = gsl_blas_dsyrk(CblasUpper, CblasTrans, 1.0, &R_22.matrix, 0.0, Ct);
     cum_status |=  (status != GSL_SUCCESS) ? SSM_ERR_KAL : SSM_SUCCESS;
+    for(i=1; i<m; i++){
+        for(j=0; j<i; j++){
+            gsl_matrix_set(Ct, i, j, gsl_matrix_get(Ct, j, i));
+        }
+    }
 
-    status = gsl_blas_dgemm(CblasNoTrans, CblasNoTrans, 1.0, &Ct.matrix, &Tmp.matrix, 0.0, &Kt.matrix);
-    cum_status |=  (status != GSL_SUCCESS) ? SSM_ERR_KAL : SSM_SUCCESS;
+    // positivity of state variables and remainder could have been lost when updating X_sv
+    cum_status |= ssm_check_no_neg_sv_or_remainder(X, par, nav, calc, t);
+
+    // log_like
+    fitness->log_like += ssm_sanitize_log_likelihood(_ssm_kalman_log_like(&R_11.matrix, 1, &pred_error.vector, &std_error.vector), row, fitness, nav);
+    return cum_status;
+}
+
+
+/**
+ * Rt being diagonal, the observations of row are processed one at a
+ * time: each of them is a scalar update (no matrix inversion) with
+ * ht the i-th column of Ht, rt = Rt(i,i) and
+ *
+ *     ct = Ct ht,  st = ht' ct + rt,  kt = ct / st
+ *     Ct = (I - kt ht') Ct (I - kt ht')' + rt kt kt'
+ *
+ * (Joseph form, computed as a product and not simplified into
+ * Ct - ct ct'/st: it is a sum of positive semi-definite terms and
+ * much less sensitive to rounding errors, O(m^2) per observation).
+ * The prediction errors of the next observations are corrected by the
+ * linearized effect of the update (ht' kt e) so that the result is
+ * the one of the joint update of all the observations (Ht being
+ * evaluated once). The log likelihood is the sum of the ones of the
+ * scalar innovations.
+ *
+ * The positivity of Ct is checked (Cholesky factorization of a copy)
+ * before and after the update, the eigen value correction is only
+ * used when it fails.
+ */
+static ssm_err_code_t _ssm_kalman_sequential_update(ssm_fitness_t *fitness, ssm_X_t *X, ssm_row_t *row, double t, ssm_par_t *par, ssm_calc_t *calc, ssm_nav_t *nav)
+{
+    int i, j, l, status;
+    double st, rt, e, he, x;
+    double log_like = 0.0;
+    ssm_err_code_t cum_status = SSM_SUCCESS;
+    int m = nav->states_sv_inc->length + nav->states_diff->length;
+    int p = row->ts_nonan_length;
+
+    gsl_vector_view X_sv = gsl_vector_view_array(X->proj,m);
+    gsl_matrix *Ct = calc->_Ct;
+    gsl_matrix *A = calc->_FtCt;
+
+    _ssm_kalman_eval_Ht_Rt_pred_error(row, t, X, par, calc, nav);
+
+    // positivity could have been lost when propagating Ct: a Cholesky
+    // factorization (on a copy) is enough to check it, the eigen value
+    // correction is only used when it fails
+    gsl_matrix_memcpy(calc->_Ft, Ct);
+    if(_ssm_cholesky(calc->_Ft, 1) != SSM_SUCCESS){
+        cum_status |= _ssm_check_and_correct_Ct(Ct, calc);
+    }
 
+    for(i=0; i<p; i++){
+        gsl_vector_view ht = gsl_matrix_column(calc->_Ht, i);
+        gsl_vector_view ct = gsl_matrix_column(calc->_Tmp_N_SV_N_TS, i);
+        gsl_vector_view kt = gsl_matrix_column(calc->_Kt, i);
+        gsl_vector_view ht_m = gsl_vector_subvector(&ht.vector, 0, m);
+        gsl_vector_view ct_m = gsl_vector_subvector(&ct.vector, 0, m);
+        gsl_vector_view kt_m = gsl_vector_subvector(&kt.vector, 0, m);
+        gsl_vector_view at = gsl_matrix_row(calc->_Tmp_N_TS_N_SV, i);
+        gsl_vector_view at_m = gsl_vector_subvector(&at.vector, 0, m);
+
+        // ct = Ct * ht
+        status = gsl_blas_dsymv(CblasUpper, 1.0, Ct, &ht_m.vector, 0.0, &ct_m.vector);
+        cum_status |=  (status != GSL_SUCCESS) ? SSM_ERR_KAL : SSM_SUCCESS;
+
+        // st = ht' * ct + rt
+        status = gsl_blas_ddot(&ht_m.vector, &ct_m.vector, &st);
+        cum_status |=  (status != GSL_SUCCESS) ? SSM_ERR_KAL : SSM_SUCCESS;
+        rt = gsl_matrix_get(calc->_Rt, i, i);
+        st += rt;
+        if(st < SSM_ZERO_LOG){
+            st = SSM_ZERO_LOG;
+        }
+        if(calc->steady_tol > 0.0){
+            gsl_vector_set(calc->_steady_st, i, st);
+        }
+
+        // kt = ct / st
+        gsl_vector_memcpy(&kt_m.vector, &ct_m.vector);
+        gsl_vector_scale(&kt_m.vector, 1.0/st);
+
+        // X_sv += kt * e
+        e = gsl_vector_get(calc->_pred_error, i);
+        status = gsl_blas_daxpy(e, &kt_m.vector, &X_sv.vector);
+        cum_status |=  (status != GSL_SUCCESS) ? SSM_ERR_KAL : SSM_SUCCESS;
+
+        // A = (I - kt ht') Ct = Ct - kt ct'
+        gsl_matrix_memcpy(A, Ct);
+        status = gsl_blas_dger(-1.0, &kt_m.vector, &ct_m.vector, A);
+        cum_status |=  (status != GSL_SUCCESS) ? SSM_ERR_KAL : SSM_SUCCESS;
+
+        // at = A ht
+        status = gsl_blas_dgemv(CblasNoTrans, 1.0, A, &ht_m.vector, 0.0, &at_m.vector);
+        cum_status |=  (status != GSL_SUCCESS) ? SSM_ERR_KAL : SSM_SUCCESS;
+
+        // Ct = A (I - kt ht')' + rt kt kt' = A - at kt' + rt kt kt'
+        gsl_matrix_memcpy(Ct, A);
+        status = gsl_blas_dger(-1.0, &at_m.vector, &kt_m.vector, Ct);
+        cum_status |=  (status != GSL_SUCCESS) ? SSM_ERR_KAL : SSM_SUCCESS;
+        status = gsl_blas_dger(rt, &kt_m.vector, &kt_m.vector, Ct);
+        cum_status |=  (status != GSL_SUCCESS) ? SSM_ERR_KAL : SSM_SUCCESS;
+
+        // symmetry is only lost by rounding errors
+        for(j=1; j<m; j++){
+            for(l=0; l<j; l++){
+                x = 0.5*(gsl_matrix_get(Ct, j, l) + gsl_matrix_get(Ct, l, j));
+                gsl_matrix_set(Ct, j, l, x);
+                gsl_matrix_set(Ct, l, j, x);
+            }
+        }
+
+        // prediction error of the next observations given the update
+        for(j=i+1; j<p; j++){
+            gsl_vector_view hj = gsl_matrix_column(calc->_Ht, j);
+            gsl_vector_view hj_m = gsl_vector_subvector(&hj.vector, 0, m);
+            gsl_blas_ddot(&hj_m.vector, &kt_m.vector, &he);
+            gsl_vector_set(calc->_pred_error, j, gsl_vector_get(calc->_pred_error, j) - he*e);
+            if(calc->steady_tol > 0.0){
+                gsl_matrix_set(calc->_steady_G, j, i, he);
+            }
+        }
+
+        log_like += -0.5*(log(2*M_PI*st) + e*e/st);
+    }
+
+    // positivity could have been lost (rounding errors) when updating Ct
+    gsl_matrix_memcpy(calc->_Ft, Ct);
+    if(_ssm_cholesky(calc->_Ft, 1) != SSM_SUCCESS){
+        cum_status |= _ssm_check_and_correct_Ct(Ct, calc);
+    }
+
+    // positivity of state variables and remainder could have been lost when updating X_sv
+    cum_status |= ssm_check_no_neg_sv_or_remainder(X, par, nav, calc, t);
+
+    fitness->log_like += ssm_sanitize_log_likelihood(log_like, row, fitness, nav);
     return cum_status;
+}
+
 
+/**
+ * Steady-state Kalman filter (--steady).
+ *
+ * For a time invariant model observed at regular intervals, Kt and
+ * Ct converge. Once their relative change has been smaller than
+ * calc->steady_tol for SSM_KALMAN_STEADY_N consecutive updates with
+ * the same pattern (time step, observed time series and reset
+ * incidences), they are frozen: only the states are integrated (see
+ * ssm_f_prediction_ekf()) and updated with the frozen gain (see
+ * _ssm_kalman_steady_update()). The covariance equations are
+ * integrated again as soon as the pattern changes.
+ *
+ * ssm_kalman_steady_reset() has to be called before every run of
+ * the filter and ssm_kalman_steady_check() before every prediction.
+ */
+void ssm_kalman_steady_reset(ssm_calc_t *calc)
+{
+    calc->is_steady = 0;
+    calc->steady_count = -1;
+    calc->steady_row = NULL;
+    calc->steady_dt = -1.0;
 }
 
 
+static int _ssm_kalman_same_pattern(ssm_row_t *row, ssm_row_t *other)
+{
+    int i;
+
+    if(!other || row->ts_nonan_length != other->ts_nonan_length || row->states_reset_length != other->states_reset_length){
+        return 0;
+    }
+
+    for(i=0; i<row->ts_nonan_length; i++){
+        if(row->observed[i] != other->observed[i]){
+            return 0;
+        }
+    }
 
+    for(i=0; i<row->states_reset_length; i++){
+        if(row->states_reset[i] != other->states_reset[i]){
+            return 0;
+        }
+    }
 
-ssm_err_code_t ssm_kalman_update(ssm_fitness_t *fitness, ssm_X_t *X, ssm_row_t *row, double t, ssm_par_t *par, ssm_calc_t *calc, ssm_nav_t *nav)
+    return 1;
+}
+
+
+/**
+ * Leave the steady state if the prediction/update cycle leading to
+ * row (from t0 to t1) differs from the previous one. The frozen
+ * updated Ct is then propagated as usual.
+ */
+void ssm_kalman_steady_check(ssm_row_t *row, double t0, double t1, ssm_calc_t *calc)
 {
+    if(calc->steady_tol <= 0.0){
+        return;
+    }
 
-    int status;
+    if((t1 - t0) != calc->steady_dt || !_ssm_kalman_same_pattern(row, calc->steady_row)){
+        calc->is_steady = 0;
+        calc->steady_count = -1;
+    }
+
+    calc->steady_row = row;
+    calc->steady_dt = t1 - t0;
+}
+
+
+/**
+ * After a sequential update: compare Kt and Ct (unpacked in
+ * calc->_Ct) with the ones of the previous update and keep them.
+ */
+static void _ssm_kalman_steady_track(ssm_row_t *row, ssm_calc_t *calc, int m)
+{
+    int i, j;
+    double x;
+    double diff_Kt = 0.0, norm_Kt = 0.0, diff_Ct = 0.0, norm_Ct = 0.0;
+    double *Ct = calc->_steady_Ct;
+
+    for(i=0; i<m; i++){
+        for(j=0; j<row->ts_nonan_length; j++){
+            x = gsl_matrix_get(calc->_Kt, i, j);
+            diff_Kt = GSL_MAX(diff_Kt, fabs(x - gsl_matrix_get(calc->_steady_Kt, i, j)));
+            norm_Kt = GSL_MAX(norm_Kt, fabs(x));
+            gsl_matrix_set(calc->_steady_Kt, i, j, x);
+        }
+
+        for(j=i; j<m; j++){
+            x = gsl_matrix_get(calc->_Ct, i, j);
+            diff_Ct = GSL_MAX(diff_Ct, fabs(x - *Ct));
+            norm_Ct = GSL_MAX(norm_Ct, fabs(x));
+            *Ct++ = x;
+        }
+    }
+
+    if(calc->steady_count >= 0 && diff_Kt <= calc->steady_tol * norm_Kt && diff_Ct <= calc->steady_tol * norm_Ct){
+        calc->steady_count++;
+    } else {
+        calc->steady_count = 0;
+    }
+
+    calc->is_steady = (calc->steady_count >= SSM_KALMAN_STEADY_N);
+}
+
+
+/**
+ * Sequential update (see _ssm_kalman_sequential_update()) with the
+ * frozen gains, innovation variances and corrections of the
+ * prediction errors: O(m p) instead of O(p m^2) and no covariance
+ * correction. Ct is set to its frozen updated value.
+ */
+static ssm_err_code_t _ssm_kalman_steady_update(ssm_fitness_t *fitness, ssm_X_t *X, ssm_row_t *row, double t, ssm_par_t *par, ssm_calc_t *calc, ssm_nav_t *nav)
+{
+    int i, j;
+    double st, e;
+    double log_like = 0.0;
+    ssm_err_code_t cum_status;
     int m = nav->states_sv_inc->length + nav->states_diff->length;
-    gsl_vector_view pred_error = gsl_vector_subvector(calc->_pred_error,0,row->ts_nonan_length);
-    gsl_vector_view zero = gsl_vector_subvector(calc->_zero,0,row->ts_nonan_length);
-    gsl_matrix_view Kt = gsl_matrix_submatrix(calc->_Kt,0,0,m,row->ts_nonan_length);
-    gsl_matrix_view Tmp = gsl_matrix_submatrix(calc->_Tmp_N_TS_N_SV,0,0,row->ts_nonan_length,m);
+    int p = row->ts_nonan_length;
+
     gsl_vector_view X_sv = gsl_vector_view_array(X->proj,m);
-    gsl_matrix_view Ht = gsl_matrix_submatrix(calc->_Ht,0,0,m,row->ts_nonan_length);
-    gsl_matrix_view Ct =  gsl_matrix_view_array(&X->proj[m], m, m);
-    gsl_matrix_view St = gsl_matrix_submatrix(calc->_St,0,0,row->ts_nonan_length,row->ts_nonan_length);
 
-    ssm_err_code_t cum_status = ssm_kalman_gain_computation(row, t, X, par, calc, nav);
+    for(i=0; i<p; i++){
+        gsl_vector_set(calc->_pred_error, i, row->values[i] - row->observed[i]->f_obs_mean(X, par, calc, t));
+    }
 
-    //////////////////
-    // state update //
-    //////////////////
-    // X_sv += Kt * pred_error
-    status = gsl_blas_dgemv(CblasNoTrans,1.0,&Kt.matrix,&pred_error.vector,1.0,&X_sv.vector);
-    cum_status |=  (status != GSL_SUCCESS) ? SSM_ERR_KAL : SSM_SUCCESS;
-    
+    for(i=0; i<p; i++){
+        gsl_vector_view kt = gsl_matrix_column(calc->_steady_Kt, i);
+        gsl_vector_view kt_m = gsl_vector_subvector(&kt.vector, 0, m);
 
-    ///////////////////////
-    // covariance update //
-    ///////////////////////
+        e = gsl_vector_get(calc->_pred_error, i);
+        st = gsl_vector_get(calc->_steady_st, i);
 
-    // Ct = Ct - Kt * Ht' * Ct
-    status = gsl_blas_dgemm(CblasTrans, CblasNoTrans, 1.0, &Ht.matrix, &Ct.matrix, 0.0, &Tmp.matrix);
-    cum_status |=  (status != GSL_SUCCESS) ? SSM_ERR_KAL : SSM_SUCCESS;
+        gsl_blas_daxpy(e, &kt_m.vector, &X_sv.vector);
 
-    status = gsl_blas_dgemm(CblasNoTrans, CblasNoTrans, -1.0, &Kt.matrix, &Tmp.matrix, 1.0, &Ct.matrix);
-    cum_status |=  (status != GSL_SUCCESS) ? SSM_ERR_KAL : SSM_SUCCESS;
+        for(j=i+1; j<p; j++){
+            gsl_vector_set(calc->_pred_error, j, gsl_vector_get(calc->_pred_error, j) - gsl_matrix_get(calc->_steady_G, j, i)*e);
+        }
 
-    // positivity and symmetry could have been lost when updating Ct
-    cum_status |= _ssm_check_and_correct_Ct(X, calc, nav);
+        log_like += -0.5*(log(2*M_PI*st) + e*e/st);
+    }
+
+    memcpy(&X->proj[m], calc->_steady_Ct, (m*(m+1))/2 * sizeof (double));
 
     // positivity of state variables and remainder could have been lost when updating X_sv
-    cum_status |= ssm_check_no_neg_sv_or_remainder(X, par, nav, calc, t);
+    cum_status = ssm_check_no_neg_sv_or_remainder(X, par, nav, calc, t);
+
+    fitness->log_like += ssm_sanitize_log_likelihood(log_like, row, fitness, nav);
+    return cum_status;
+}
+
+
+/**
+ * Update X and Ct with the observations of row and add their log
+ * likelihood to fitness->log_like.
+ *
+ * Ct is unpacked in calc->_Ct for the update and packed back in X.
+ * The observations are processed sequentially (see
+ * _ssm_kalman_sequential_update()) or, with calc->flag_sqrt, the
+ * update works on a square root of Ct (see _ssm_kalman_sqrt_update()).
+ * The unscented Kalman filter has its own update (see
+ * ssm_ukf_update()). Once Kt and Ct are frozen (--steady), the
+ * update only involves the states (see ssm_kalman_steady_check()).
+ */
+ssm_err_code_t ssm_kalman_update(ssm_fitness_t *fitness, ssm_X_t *X, ssm_row_t *row, double t, ssm_par_t *par, ssm_calc_t *calc, ssm_nav_t *nav)
+{
+    ssm_err_code_t cum_status;
+    int m = nav->states_sv_inc->length + nav->states_diff->length;
+
+    if(calc->is_steady){
+        return _ssm_kalman_steady_update(fitness, X, row, t, par, calc, nav);
+    }
+
+    if(calc->steady_tol > 0.0){
+        memcpy(calc->_steady_Ct_pred, &X->proj[m], (m*(m+1))/2 * sizeof (double));
+    }
+
+    ssm_kalman_Ct_unpack(calc->_Ct, &X->proj[m]);
+
+    if(nav->implementation == SSM_UKF){
+        cum_status = ssm_ukf_update(fitness, X, row, t, par, calc, nav);
+    } else if(calc->flag_sqrt){
+        cum_status = _ssm_kalman_sqrt_update(fitness, X, row, t, par, calc, nav);
+    } else {
+        cum_status = _ssm_kalman_sequential_update(fitness, X, row, t, par, calc, nav);
+
+        if(calc->steady_tol > 0.0){
+            if(cum_status == SSM_SUCCESS){
+                _ssm_kalman_steady_track(row, calc, m);
+            } else {
+                calc->steady_count = -1;
+            }
+        }
+    }
+
+    ssm_kalman_Ct_pack(&X->proj[m], calc->_Ct);
 
-    // log_like   
-    fitness->log_like += ssm_sanitize_log_likelihood(log(ssm_dmvnorm(row->ts_nonan_length, &pred_error.vector, &zero.vector, &St.matrix, 1.0)), row, fitness, nav);
     return cum_status;
 }
 
@@ -276,6 +788,5 @@ double ssm_diff_derivative(double jac_tpl, const double X[], ssm_state_t *state)
 void ssm_kalman_reset_Ct(ssm_X_t *X, ssm_nav_t *nav)
 {
     int dim = nav->states_sv_inc->length + nav->states_diff->length;
-    gsl_matrix_view Ct = gsl_matrix_view_array(&X->proj[dim], dim, dim);
-    gsl_matrix_set_zero(&Ct.matrix);
+    memset(&X->proj[dim], 0, (dim*(dim+1))/2 * sizeof (double));
 }
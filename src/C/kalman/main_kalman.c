@@ -49,12 +49,16 @@ int main(int argc, char *argv[])
     fitness->cum_status[0] = SSM_SUCCESS;
 
     ssm_par2X(X, par, calc, nav);
+    ssm_kalman_steady_reset(calc);
 
     for(n=0; n<data->n_obs; n++) {
         t0 = (n) ? data->rows[n-1]->time: 0;
+        ssm_X_reset_inc(X, data->rows[n], nav);
+
+        n = ssm_row_span_end(data, n, nav, calc);
         t1 = data->rows[n]->time;
 
-        ssm_X_reset_inc(X, data->rows[n], nav);
+        ssm_kalman_steady_check(data->rows[n], t0, t1, calc);
         fitness->cum_status[0] |= (*f_pred)(X, t0, t1, par, nav, calc);
 
         if (nav->print & SSM_PRINT_DIAG) {
@@ -23,20 +23,22 @@ static ssm_err_code_t run_kalman_and_store_traj(ssm_X_t **D_X, ssm_par_t *par, s
     int n, np1;
     double t0, t1;
     ssm_err_code_t rc;
+    ssm_f_pred_t f_pred = ssm_get_f_pred(nav);
 
     fitness->log_like = 0.0;
     fitness->log_prior = 0.0;    
-    
+    ssm_kalman_steady_reset(calc);
 
     for(n=0; n<data->n_obs; n++) {
         t0 = (n) ? data->rows[n-1]->time: 0;
         t1 = data->rows[n]->time;
         np1 = n+1;
 
+        ssm_kalman_steady_check(data->rows[n], t0, t1, calc);
         ssm_X_copy(D_X[np1], D_X[n]);
         ssm_X_reset_inc(D_X[np1], data->rows[n], nav);
 
-        rc = ssm_f_prediction_ode(D_X[np1], t0, t1, par, nav, calc);
+        rc = (*f_pred)(D_X[np1], t0, t1, par, nav, calc);
         if(rc != SSM_SUCCESS){
             return rc;
         }
@@ -133,7 +135,7 @@ int main(int argc, char *argv[])
 
         var = ssm_adapt_eps_var_sd_fac(&sd_fac, adapt, var_input, nav, m);
 
-        ssm_theta_ran(proposed, theta, var, sd_fac, calc, nav, 1);
+        ssm_theta_ran(proposed, theta, var, sd_fac, calc, nav, adapt->proposal);
 
         ssm_theta2input(input, proposed, nav);
         ssm_input2par(par_proposed, input, calc, nav);
@@ -146,7 +148,7 @@ int main(int argc, char *argv[])
             ssm_kalman_reset_Ct(D_X[0], nav);
 
             success |= run_kalman_and_store_traj(D_X, par_proposed, fitness, data, calc, nav);
-            success |= ssm_metropolis_hastings(fitness, &ratio, proposed, theta, var, sd_fac, nav, calc, 1);
+            success |= ssm_metropolis_hastings(fitness, &ratio, proposed, theta, var, sd_fac, nav, calc, adapt->proposal);
         }
 
         if(success == SSM_SUCCESS){ //everything went well and the proposed theta was accepted
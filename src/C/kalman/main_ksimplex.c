@@ -47,6 +47,7 @@ static double f_ksimplex(const gsl_vector *theta, void *params)
     ssm_X_t *X = p->X;
     ssm_fitness_t *fitness = p->fitness;
     int flag_prior = p->flag_prior;
+    ssm_f_pred_t f_pred = ssm_get_f_pred(nav);
 
     if(ssm_check_ic(par, calc) != SSM_SUCCESS){
         if (nav->print & SSM_PRINT_WARNING) {
@@ -64,14 +65,17 @@ static double f_ksimplex(const gsl_vector *theta, void *params)
     fitness->cum_status[0] = SSM_SUCCESS;
 
     ssm_kalman_reset_Ct(X, nav);
+    ssm_kalman_steady_reset(calc);
 
     for(n=0; n<data->n_obs; n++) {
         t0 = (n) ? data->rows[n-1]->time: 0;
-        t1 = data->rows[n]->time;
-
         ssm_X_reset_inc(X, data->rows[n], nav);
 
-        fitness->cum_status[0] |= ssm_f_prediction_ode(X, t0, t1, par, nav, calc);
+        n = ssm_row_span_end(data, n, nav, calc);
+        t1 = data->rows[n]->time;
+
+        ssm_kalman_steady_check(data->rows[n], t0, t1, calc);
+        fitness->cum_status[0] |= (*f_pred)(X, t0, t1, par, nav, calc);
 	
         if(data->rows[n]->ts_nonan_length && (fitness->cum_status[0] == SSM_SUCCESS)) {
             fitness->cum_status[0] |= ssm_kalman_update(fitness, X, data->rows[n], t1, par, calc, nav);
@@ -0,0 +1,335 @@
+/**************************************************************************
+ *    This file is part of ssm.
+ *
+ *    ssm is free software: you can redistribute it and/or modify it
+ *    under the terms of the GNU General Public License as published
+ *    by the Free Software Foundation, either version 3 of the
+ *    License, or (at your option) any later version.
+ *
+ *    ssm is distributed in the hope that it will be useful, but
+ *    WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public
+ *    License along with ssm.  If not, see
+ *    <http://www.gnu.org/licenses/>.
+ *************************************************************************/
+
+#include "ssm.h"
+
+/**
+ * Unscented Kalman Filter (UKF).
+ *
+ * X has the same layout as with the EKF (the states followed by their
+ * covariance Ct) but Ct is not integrated: the 2m+1 sigma points
+ * x, x +/- sqrt(m+lambda) S_i (S S' = Ct) are propagated through the
+ * deterministic skeleton (ssm_step_ukf) and the observation
+ * functions, so that no jacobian is needed.
+ *
+ * The scaling parameters are alpha = 1, kappa = 0 (lambda = 0) and
+ * beta = 2 (optimal for gaussian distributions): all the weights are
+ * positive.
+ */
+#define SSM_UKF_BETA 2.0
+
+/**
+ * the process noise (Q) being state dependent, the sigma points are
+ * regenerated every SSM_UKF_DT (at most) between two data points
+ */
+#define SSM_UKF_DT 1.0
+
+
+static void _ssm_ukf_weights(int m, double *wm0, double *wc0, double *wi, double *gamma)
+{
+    double lambda = 0.0;
+
+    *wm0 = lambda / (m + lambda);
+    *wc0 = *wm0 + SSM_UKF_BETA;
+    *wi = 1.0 / (2.0*(m + lambda));
+    *gamma = sqrt(m + lambda);
+}
+
+
+/**
+ * fill the rows of calc->_ukf_sigma with the sigma points of the
+ * states of X and their covariance Ct (unpacked in calc->_Ct)
+ */
+static ssm_err_code_t _ssm_ukf_sigma_points(ssm_X_t *X, ssm_calc_t *calc, ssm_nav_t *nav)
+{
+    int i, j;
+    double wm0, wc0, wi, gamma, x, s;
+    ssm_err_code_t cum_status = SSM_SUCCESS;
+    int m = nav->states_sv_inc->length + nav->states_diff->length;
+    gsl_matrix *Ct = calc->_Ct;
+    gsl_matrix *S = calc->_Ft; //not used by the UKF otherwise
+
+    _ssm_ukf_weights(m, &wm0, &wc0, &wi, &gamma);
+
+    gsl_matrix_memcpy(S, Ct);
+    if(_ssm_cholesky(S, 1) != SSM_SUCCESS){
+        // positivity could have been lost during the update
+        cum_status |= _ssm_check_and_correct_Ct(Ct, calc);
+        gsl_matrix_memcpy(S, Ct);
+        if(_ssm_cholesky(S, 1) != SSM_SUCCESS){
+            return cum_status | SSM_ERR_KAL;
+        }
+    }
+
+    for(j=0; j<m; j++){
+        x = X->proj[j];
+        gsl_matrix_set(calc->_ukf_sigma, 0, j, x);
+        for(i=0; i<m; i++){
+            s = gamma * gsl_matrix_get(S, j, i);
+            gsl_matrix_set(calc->_ukf_sigma, 1+i, j, x + s);
+            gsl_matrix_set(calc->_ukf_sigma, 1+m+i, j, x - s);
+        }
+    }
+
+    return cum_status;
+}
+
+
+/**
+ * integrate the states y from t0 to t1 (h is the adaptive step size)
+ */
+static ssm_err_code_t _ssm_ukf_integrate(double *y, double *h, double t0, double t1, ssm_nav_t *nav, ssm_calc_t *calc)
+{
+    double t = t0;
+
+    gsl_odeiv2_evolve_reset(calc->evolve);
+    gsl_odeiv2_step_reset(calc->step);
+
+    while (t < t1) {
+        int status = gsl_odeiv2_evolve_apply(calc->evolve, calc->control, calc->step, &(calc->sys), &t, t1, h, y);
+        if (status != GSL_SUCCESS) {
+            if (nav->print & SSM_PRINT_WARNING) {
+                ssm_print_warning("gsl_odeiv2 error");
+            }
+            return SSM_ERR_PRED;
+        }
+    }
+
+    return SSM_SUCCESS;
+}
+
+
+/**
+ * Prediction: on each sub-interval [t, t+dt] the sigma points are
+ * propagated, the mean and covariance are recomputed from them and
+ * the process noise is added with the trapezoidal rule
+ * Ct += dt (Q(t) + Q(t+dt)) / 2
+ */
+ssm_err_code_t ssm_f_prediction_ukf(ssm_X_t *p_X, double t0, double t1, ssm_par_t *par, ssm_nav_t *nav, ssm_calc_t *calc)
+{
+    int i, j, k;
+    double t = t0;
+    double dt, h, h0, x, cov;
+    double wm0, wc0, wi, gamma;
+    ssm_err_code_t cum_status = SSM_SUCCESS;
+    int m = nav->states_sv_inc->length + nav->states_diff->length;
+    double *Ct = &p_X->proj[m]; //packed
+    gsl_matrix *Q0 = calc->_FtCt; //Q at the beginning of the sub-interval
+    gsl_matrix *sigma = calc->_ukf_sigma;
+
+    calc->_par = par; //pass the ref to par so that it is available wihtin the function to integrate
+    _ssm_ukf_weights(m, &wm0, &wc0, &wi, &gamma);
+
+    while (t < t1) {
+        dt = GSL_MIN(SSM_UKF_DT, t1 - t);
+
+        ssm_kalman_Ct_unpack(calc->_Ct, Ct);
+        cum_status |= _ssm_ukf_sigma_points(p_X, calc, nav);
+        if(cum_status != SSM_SUCCESS){
+            return cum_status;
+        }
+
+        calc->eval_Q(p_X->proj, t, par, nav, calc);
+        gsl_matrix_memcpy(Q0, calc->_Q);
+
+        // propagate the sigma points (they all start with the step size of X)
+        h0 = p_X->dt;
+        for(i=0; i<2*m+1; i++){
+            gsl_vector_view chi = gsl_matrix_row(sigma, i);
+            h = h0;
+            cum_status |= _ssm_ukf_integrate(chi.vector.data, &h, t, t+dt, nav, calc);
+            if(cum_status != SSM_SUCCESS){
+                return cum_status;
+            }
+            if(i == 0){
+                p_X->dt = h;
+            }
+        }
+
+        // mean
+        for(j=0; j<m; j++){
+            x = wm0 * gsl_matrix_get(sigma, 0, j);
+            for(i=1; i<2*m+1; i++){
+                x += wi * gsl_matrix_get(sigma, i, j);
+            }
+            p_X->proj[j] = x;
+        }
+
+        // covariance (the sigma points are centered in place)
+        for(i=0; i<2*m+1; i++){
+            for(j=0; j<m; j++){
+                gsl_matrix_set(sigma, i, j, gsl_matrix_get(sigma, i, j) - p_X->proj[j]);
+            }
+        }
+
+        t += dt;
+        calc->eval_Q(p_X->proj, t, par, nav, calc);
+
+        for(j=0; j<m; j++){
+            for(k=j; k<m; k++){
+                cov = wc0 * gsl_matrix_get(sigma, 0, j) * gsl_matrix_get(sigma, 0, k);
+                for(i=1; i<2*m+1; i++){
+                    cov += wi * gsl_matrix_get(sigma, i, j) * gsl_matrix_get(sigma, i, k);
+                }
+                cov += 0.5 * dt * (gsl_matrix_get(Q0, j, k) + gsl_matrix_get(calc->_Q, j, k));
+                Ct[ssm_kalman_Ct_index(m, j, k)] = cov;
+            }
+        }
+    }
+
+    return ssm_check_no_neg_sv_or_remainder(p_X, par, nav, calc, t1);
+}
+
+
+/**
+ * Update X and Ct with the observations of row and add their log
+ * likelihood to fitness->log_like.
+ *
+ * With yi the observations of the sigma points (observed[]->f_obs_mean),
+ * y their weighted mean, St = sum wc (yi-y)(yi-y)' + Rt and
+ * Pxy = sum wc (xi-x)(yi-y)': Kt = Pxy St^-1 and Ct = Ct - Kt St Kt'.
+ * St is factorized as in the EKF (St = L L').
+ *
+ * Called by ssm_kalman_update() (Ct is unpacked in calc->_Ct).
+ */
+ssm_err_code_t ssm_ukf_update(ssm_fitness_t *fitness, ssm_X_t *X, ssm_row_t *row, double t, ssm_par_t *par, ssm_calc_t *calc, ssm_nav_t *nav)
+{
+    int i, j, k, status;
+    double y, cov;
+    double wm0, wc0, wi, gamma;
+    ssm_err_code_t cum_status = SSM_SUCCESS;
+    int m = nav->states_sv_inc->length + nav->states_diff->length;
+    int p = row->ts_nonan_length;
+
+    gsl_vector_view pred_error = gsl_vector_subvector(calc->_pred_error,0,p);
+    gsl_vector_view std_error = gsl_vector_subvector(calc->_std_error,0,p);
+    gsl_matrix_view St = gsl_matrix_submatrix(calc->_St,0,0,p,p);
+    gsl_matrix_view Rt = gsl_matrix_submatrix(calc->_Rt,0,0,p,p);
+    gsl_matrix_view Kt = gsl_matrix_submatrix(calc->_Kt,0,0,m,p);
+    gsl_matrix_view KtL = gsl_matrix_submatrix(calc->_Tmp_N_SV_N_TS,0,0,m,p);
+    gsl_vector_view X_sv = gsl_vector_view_array(X->proj,m);
+    gsl_matrix *Ct = calc->_Ct;
+    gsl_matrix *sigma = calc->_ukf_sigma;
+    gsl_matrix *obs = calc->_ukf_obs;
+
+    // a sigma point seen as a ssm_X_t (for the observation functions)
+    ssm_X_t X_sigma = *X;
+    X_sigma.proj = calc->_ukf_proj;
+    memcpy(X_sigma.proj, X->proj, X->length * sizeof (double));
+
+    _ssm_ukf_weights(m, &wm0, &wc0, &wi, &gamma);
+
+    _ssm_kalman_eval_Rt(row, t, X, par, calc, nav);
+
+    cum_status |= _ssm_ukf_sigma_points(X, calc, nav);
+    if(cum_status != SSM_SUCCESS){
+        return cum_status;
+    }
+
+    // observations of the sigma points
+    for(i=0; i<2*m+1; i++){
+        for(j=0; j<m; j++){
+            X_sigma.proj[j] = gsl_matrix_get(sigma, i, j);
+        }
+        for(k=0; k<p; k++){
+            gsl_matrix_set(obs, i, k, row->observed[k]->f_obs_mean(&X_sigma, par, calc, t));
+        }
+    }
+
+    // pred_error = data - weighted mean of the observations, sigma points and observations are centered in place
+    for(k=0; k<p; k++){
+        y = wm0 * gsl_matrix_get(obs, 0, k);
+        for(i=1; i<2*m+1; i++){
+            y += wi * gsl_matrix_get(obs, i, k);
+        }
+        gsl_vector_set(&pred_error.vector, k, row->values[k] - y);
+        for(i=0; i<2*m+1; i++){
+            gsl_matrix_set(obs, i, k, gsl_matrix_get(obs, i, k) - y);
+        }
+    }
+    for(i=0; i<2*m+1; i++){
+        for(j=0; j<m; j++){
+            gsl_matrix_set(sigma, i, j, gsl_matrix_get(sigma, i, j) - X->proj[j]);
+        }
+    }
+
+    // St = sum wc (yi-y)(yi-y)' + Rt
+    for(j=0; j<p; j++){
+        for(k=j; k<p; k++){
+            cov = wc0 * gsl_matrix_get(obs, 0, j) * gsl_matrix_get(obs, 0, k);
+            for(i=1; i<2*m+1; i++){
+                cov += wi * gsl_matrix_get(obs, i, j) * gsl_matrix_get(obs, i, k);
+            }
+            cov += gsl_matrix_get(&Rt.matrix, j, k);
+            gsl_matrix_set(&St.matrix, j, k, cov);
+            gsl_matrix_set(&St.matrix, k, j, cov);
+        }
+    }
+
+    // Kt = Pxy = sum wc (xi-x)(yi-y)'
+    for(j=0; j<m; j++){
+        for(k=0; k<p; k++){
+            cov = wc0 * gsl_matrix_get(sigma, 0, j) * gsl_matrix_get(obs, 0, k);
+            for(i=1; i<2*m+1; i++){
+                cov += wi * gsl_matrix_get(sigma, i, j) * gsl_matrix_get(obs, i, k);
+            }
+            gsl_matrix_set(&Kt.matrix, j, k, cov);
+        }
+    }
+
+    // St = L * L'
+    status = _ssm_cholesky(&St.matrix, 0);
+    cum_status |= status;
+    if(status != SSM_SUCCESS){
+        return cum_status;
+    }
+
+    // Kt = Pxy * L'^-1 * L^-1, Kt L (= Pxy L'^-1) is kept for the covariance update
+    status = gsl_blas_dtrsm(CblasRight, CblasLower, CblasTrans, CblasNonUnit, 1.0, &St.matrix, &Kt.matrix);
+    cum_status |=  (status != GSL_SUCCESS) ? SSM_ERR_KAL : SSM_SUCCESS;
+    gsl_matrix_memcpy(&KtL.matrix, &Kt.matrix);
+
+    status = gsl_blas_dtrsm(CblasRight, CblasLower, CblasNoTrans, CblasNonUnit, 1.0, &St.matrix, &Kt.matrix);
+    cum_status |=  (status != GSL_SUCCESS) ? SSM_ERR_KAL : SSM_SUCCESS;
+
+    //////////////////
+    // state update //
+    //////////////////
+    // X_sv += Kt * pred_error
+    status = gsl_blas_dgemv(CblasNoTrans,1.0,&Kt.matrix,&pred_error.vector,1.0,&X_sv.vector);
+    cum_status |=  (status != GSL_SUCCESS) ? SSM_ERR_KAL : SSM_SUCCESS;
+
+    ///////////////////////
+    // covariance update //
+    ///////////////////////
+    // Ct = Ct - Kt St Kt' = Ct - (Kt L) (Kt L)'
+    status = gsl_blas_dsyrk(CblasUpper, CblasNoTrans, -1.0, &KtL.matrix, 1.0, Ct);
+    cum_status |=  (status != GSL_SUCCESS) ? SSM_ERR_KAL : SSM_SUCCESS;
+    for(i=1; i<m; i++){
+        for(j=0; j<i; j++){
+            gsl_matrix_set(Ct, i, j, gsl_matrix_get(Ct, j, i));
+        }
+    }
+
+    // positivity of state variables and remainder could have been lost when updating X_sv
+    cum_status |= ssm_check_no_neg_sv_or_remainder(X, par, nav, calc, t);
+
+    // log_like
+    fitness->log_like += ssm_sanitize_log_likelihood(_ssm_kalman_log_like(&St.matrix, 0, &pred_error.vector, &std_error.vector), row, fitness, nav);
+    return cum_status;
+}
@@ -36,8 +36,6 @@ int main(int argc, char *argv[])
     ssm_X_t **J_X = ssm_J_X_new(fitness, nav, opts);
     ssm_X_t **J_X_tmp = ssm_J_X_new(fitness, nav, opts);
     
-    json_decref(jdata);
-
     ssm_input_t *input = ssm_input_new(jparameters, nav);
     ssm_theta_t *mle = ssm_theta_new(input, nav);
     ssm_var_t *var = ssm_var_new(jparameters, nav);
@@ -68,7 +66,7 @@ int main(int argc, char *argv[])
     double **D_theta_bart = ssm_d2_new(data->length+1, nav->theta_all->length); //mean of theta at each time step, +1 because we keep values for every data point + initial condition
     double **D_theta_Vt = ssm_d2_new(data->length+1, nav->theta_all->length); //variance of theta at each time step
 
-    int m, i, id;
+    int m, i;
     int n_iter = opts->n_iter;
     int flag_prior = opts->flag_prior;
     int L = (int) floor(opts->L*data->length);
@@ -77,7 +75,8 @@ int main(int argc, char *argv[])
 
     ssm_f_pred_t f_pred = ssm_get_f_pred(nav);
 
-    ssm_workers_t *workers = ssm_workers_start(&J_X, J_par, data, calc, fitness, f_pred, nav, opts, SSM_WORKER_J_PAR | SSM_WORKER_FITNESS);
+    ssm_workers_t *workers = ssm_workers_start(jparameters, jdata, &J_X, J_par, data, calc, fitness, f_pred, nav, opts, SSM_WORKER_J_PAR | SSM_WORKER_FITNESS);
+    json_decref(jdata);
 
     for(m=1; m <= n_iter; m++){
 
@@ -93,7 +92,7 @@ int main(int argc, char *argv[])
 
         for(j=0; j<fitness->J; j++) {
             do{
-                ssm_theta_ran(J_theta[j], mle, var, opts->b * cooling, calc[0], nav, 0);
+                ssm_theta_ran(J_theta[j], mle, var, opts->b * cooling, calc[0], nav, NULL);
                 ssm_theta2input(input, J_theta[j], nav);
                 ssm_input2par(J_par[j], input, calc[0], nav);
             } while(ssm_check_ic(J_par[j], calc[0]) != SSM_SUCCESS);
@@ -132,25 +131,13 @@ int main(int argc, char *argv[])
 		}
 
 	    } else if(calc[0]->threads_length > 1){
-
-		//send work
-		for (i=0; i<calc[0]->threads_length; i++) {
-		    zmq_send(workers->sender, &i, sizeof (int), ZMQ_SNDMORE);
-		    zmq_send(workers->sender, &n, sizeof (int), 0);
-		}
-
-		//get results from the workers
-		for (i=0; i<calc[0]->threads_length; i++) {
-		    zmq_recv(workers->receiver, &id, sizeof (int), 0);
-		}
+		ssm_workers_integrate(workers, n);
 
 	    } else {
 
-		for(j=0;j<fitness->J;j++) {
-
-		    ssm_X_reset_inc(J_X[j], data->rows[n], nav);
-		    fitness->cum_status[j] |= (*f_pred)(J_X[j], t0, t1, J_par[j], nav, calc[0]);
+		ssm_f_prediction_J(J_X, 0, fitness->J, J_par, 1, data->rows[n], t0, t1, f_pred, nav, calc[0], fitness->cum_status);
 
+		for(j=0;j<fitness->J;j++) {
 		    if(data->rows[n]->ts_nonan_length) {
 			fitness->weights[j] = (fitness->cum_status[j] == SSM_SUCCESS) ?  exp(ssm_log_likelihood(data->rows[n], J_X[j], J_par[j], calc[0], nav, fitness)) : 0.0;
 			fitness->cum_status[j] = SSM_SUCCESS;
@@ -18,80 +18,23 @@
 
 #include "ssm.h"
 
-static ssm_err_code_t run_smc(ssm_err_code_t (*f_pred) (ssm_X_t *, double, double, ssm_par_t *, ssm_nav_t *, ssm_calc_t *), ssm_X_t ***D_J_X, ssm_X_t ***D_J_X_tmp, ssm_par_t *par, ssm_calc_t **calc, ssm_data_t *data, ssm_fitness_t *fitness, ssm_nav_t *nav, ssm_workers_t *workers)
+/**
+ * compute the log likelihood of par (in fitness->log_like). The
+ * initial conditions are in D_J_X[0]. With --chain, the particle
+ * filter is run by a tcp worker which also sends back a sampled
+ * trajectory (in D_X) if flag_traj. Otherwise the trajectory is
+ * sampled from D_J_X once the proposal is accepted.
+ */
+static ssm_err_code_t run_pmcmc_smc(ssm_f_pred_t f_pred, ssm_X_t ***D_J_X, ssm_X_t ***D_J_X_tmp, ssm_X_t **D_X, int flag_traj, ssm_par_t *par, ssm_calc_t **calc, ssm_data_t *data, ssm_fitness_t *fitness, ssm_nav_t *nav, ssm_workers_t *workers)
 {
-    int i, j, n, np1, id, the_j;
-    double t0, t1;
+    ssm_err_code_t status;
 
-    fitness->log_like = 0.0;
-    fitness->log_prior = 0.0;
-    fitness->n_all_fail = 0;
-
-    for(j=0; j<fitness->J; j++){
-	fitness->cum_status[j] = SSM_SUCCESS;
+    if(workers->wopts & SSM_WORKER_CHAIN){
+        ssm_workers_eval(workers, &par, 1, (flag_traj) ? &D_X : NULL, &(fitness->log_like), &status, data);
+        return status;
     }
 
-    for(n=0; n<data->n_obs; n++) {
-        np1 = n+1;
-        t0 = (n) ? data->rows[n-1]->time: 0;
-        t1 = data->rows[n]->time;
-
-	if(!workers->flag_tcp){
-	    for(j=0; j<fitness->J; j++){
-		ssm_X_copy(D_J_X[np1][j], D_J_X[n][j]);
-	    }
-	}
-
-	if(workers->flag_tcp){
-	    //send work
-	    for (j=0;j<fitness->J;j++) {
-		zmq_send(workers->sender, &n, sizeof (int), ZMQ_SNDMORE);
-		ssm_zmq_send_par(workers->sender, par, ZMQ_SNDMORE);
-
-		zmq_send(workers->sender, &j, sizeof (int), ZMQ_SNDMORE);                   	       	       
-		ssm_zmq_send_X(workers->sender, D_J_X[n][j], ZMQ_SNDMORE);
-		zmq_send(workers->sender, &(fitness->cum_status[j]), sizeof (ssm_err_code_t), 0);
-	    }
-
-	    //get results from the workers
-	    for (j=0; j<fitness->J; j++) {
-		zmq_recv(workers->receiver, &the_j, sizeof (int), 0);
-		ssm_zmq_recv_X(D_J_X[ np1 ][ the_j ], workers->receiver);
-		zmq_recv(workers->receiver, &(fitness->weights[the_j]), sizeof (double), 0);
-		zmq_recv(workers->receiver, &(fitness->cum_status[the_j]), sizeof (ssm_err_code_t), 0);
-	    }
-
-	} else if(calc[0]->threads_length > 1){
-	    //send work
-            for (i=0; i<calc[0]->threads_length; i++) {
-                zmq_send(workers->sender, &i, sizeof (int), ZMQ_SNDMORE);
-                zmq_send(workers->sender, &n, sizeof (int), 0);
-            }
-
-            //get results from the workers
-            for (i=0; i<calc[0]->threads_length; i++) {
-                zmq_recv(workers->receiver, &id, sizeof (int), 0);
-            }
-        } else {
-
-	    for(j=0;j<fitness->J;j++) {
-		ssm_X_reset_inc(D_J_X[np1][j], data->rows[n], nav);
-		fitness->cum_status[j] |= (*f_pred)(D_J_X[np1][j], t0, t1, par, nav, calc[0]);
-		if(data->rows[n]->ts_nonan_length) {
-		    fitness->weights[j] = (fitness->cum_status[j] == SSM_SUCCESS) ?  exp(ssm_log_likelihood(data->rows[n], D_J_X[np1][j], par, calc[0], nav, fitness)) : 0.0;
-		    fitness->cum_status[j] = SSM_SUCCESS;
-		}
-	    }
-	}
-	
-        if(data->rows[n]->ts_nonan_length) {
-            if(ssm_weight(fitness, data->rows[n], nav, n)) {
-                ssm_systematic_sampling(fitness, calc[0], n);
-            }
-            ssm_resample_X(fitness, &D_J_X[np1], &D_J_X_tmp[np1], n);
-        }
-    }
-    return ( (data->n_obs != 0) && (fitness->n_all_fail == data->n_obs) ) ? SSM_ERR_PRED: SSM_SUCCESS;
+    return ssm_run_smc(f_pred, D_J_X, D_J_X_tmp, par, calc, data, fitness, nav, workers);
 }
 
 int main(int argc, char *argv[])
@@ -113,8 +56,6 @@ int main(int argc, char *argv[])
     ssm_X_t **D_X = ssm_D_X_new(data, nav, opts); //to store sampled trajectories
     ssm_X_t **D_X_prev = ssm_D_X_new(data, nav, opts);
 
-    json_decref(jdata);
-
     ssm_input_t *input = ssm_input_new(jparameters, nav);
     ssm_par_t *par = ssm_par_new(input, calc[0], nav);
     ssm_par_t *par_proposed = ssm_par_new(input, calc[0], nav);
@@ -124,6 +65,7 @@ int main(int argc, char *argv[])
     ssm_var_t *var_input = ssm_var_new(jparameters, nav);
     ssm_var_t *var; //the covariance matrix used;
     ssm_adapt_t *adapt = ssm_adapt_new(nav, opts);
+    ssm_prefetch_t *prefetch = (opts->prefetch > 0) ? ssm_prefetch_new(opts->prefetch, input, calc[0], data, nav, opts) : NULL;
 
     int n_iter = opts->n_iter;
     int n_traj = GSL_MIN(n_iter, opts->n_traj);
@@ -131,20 +73,23 @@ int main(int argc, char *argv[])
 
     ssm_f_pred_t f_pred = ssm_get_f_pred(nav);
 
-    ssm_workers_t *workers = ssm_workers_start(D_J_X, &par, data, calc, fitness, f_pred, nav, opts, SSM_WORKER_D_X | SSM_WORKER_FITNESS);
+    //the likelihood is always evaluated for par_proposed
+    ssm_workers_t *workers = ssm_workers_start(jparameters, jdata, D_J_X, &par_proposed, data, calc, fitness, f_pred, nav, opts, (opts->flag_chain) ? SSM_WORKER_CHAIN : SSM_WORKER_D_X | SSM_WORKER_FITNESS);
+    json_decref(jdata);
 
     /////////////////////////
     // initialization step //
     /////////////////////////
     int j, n;
     int m = 0;
+    int flag_traj = ( (nav->print & SSM_PRINT_X) && data->n_obs );
 
     ssm_par2X(D_J_X[0][0], par, calc[0], nav);
     for(j=1; j<fitness->J; j++){
         ssm_X_copy(D_J_X[0][j], D_J_X[0][0]);
     }
 
-    ssm_err_code_t success = run_smc(f_pred, D_J_X, D_J_X_tmp, par_proposed, calc, data, fitness, nav, workers);
+    ssm_err_code_t success = run_pmcmc_smc(f_pred, D_J_X, D_J_X_tmp, D_X, flag_traj, par_proposed, calc, data, fitness, nav, workers);
     success |= ssm_log_prob_prior(&fitness->log_prior, proposed, nav, fitness);
 
     if(success != SSM_SUCCESS){
@@ -156,8 +101,10 @@ int main(int argc, char *argv[])
     fitness->log_like_prev = fitness->log_like;
     fitness->log_prior_prev = fitness->log_prior;
 
-    if ( ( nav->print & SSM_PRINT_X ) && data->n_obs ) {
-        ssm_sample_traj(D_X, D_J_X, calc[0], data, fitness);
+    if ( flag_traj ) {
+        if(!opts->flag_chain){
+            ssm_sample_traj(D_X, D_J_X, calc[0], data, fitness);
+        }
         for(n=0; n<data->n_obs; n++){
             ssm_X_copy(D_X_prev[n+1], D_X[n+1]);
             ssm_print_X(nav->X, D_X_prev[n+1], par, nav, calc[0], data->rows[n], m);
@@ -180,23 +127,50 @@ int main(int argc, char *argv[])
     ////////////////
     double sd_fac;
     double ratio;
+    int node = -1; //current node of the tree of prefetched proposals (-1: the tree has to be grown)
     for(m=1; m<n_iter; m++) {
         var = ssm_adapt_eps_var_sd_fac(&sd_fac, adapt, var_input, nav, m);
-        ssm_theta_ran(proposed, theta, var, sd_fac, calc[0], nav, 1);
-        ssm_theta2input(input, proposed, nav);
-        ssm_input2par(par_proposed, input, calc[0], nav);
 
-        success = ssm_check_ic(par_proposed, calc[0]);
+        if(prefetch){
+            if(node == -1){
+                ssm_prefetch_tree(prefetch, theta, var, adapt->proposal, sd_fac, (adapt->flag_smooth) ? adapt->ar_smoothed : adapt->ar, input, calc[0], nav);
+                ssm_prefetch_eval(prefetch, workers, data);
+                node = 0;
+            }
 
-        if(success == SSM_SUCCESS){
-            ssm_par2X(D_J_X[0][0], par_proposed, calc[0], nav);
-            D_J_X[0][0]->dt = D_J_X[0][0]->dt0;
-            for(j=1; j<fitness->J; j++){
-                ssm_X_copy(D_J_X[0][j], D_J_X[0][0]);
+            ssm_theta_copy(proposed, prefetch->proposed[node]);
+            ssm_par_copy(par_proposed, prefetch->par[node]);
+            success = prefetch->status[node];
+
+            if(success == SSM_SUCCESS){
+                fitness->log_like = prefetch->log_like[node];
+                success |= ssm_metropolis_hastings(fitness, &ratio, proposed, theta, var, sd_fac, nav, calc[0], adapt->proposal);
+                if(success == SSM_SUCCESS && flag_traj){
+                    for(n=0; n<data->n_obs; n++){
+                        ssm_X_copy(D_X[n+1], prefetch->D_X[node][n+1]);
+                    }
+                }
             }
 
-	    success |= run_smc(f_pred, D_J_X, D_J_X_tmp, par_proposed, calc, data, fitness, nav, workers);
-            success |= ssm_metropolis_hastings(fitness, &ratio, proposed, theta, var, sd_fac, nav, calc[0], 1);
+            node = prefetch->child[node][(success == SSM_SUCCESS) ? 1 : 0];
+
+        } else {
+            ssm_theta_ran(proposed, theta, var, sd_fac, calc[0], nav, adapt->proposal);
+            ssm_theta2input(input, proposed, nav);
+            ssm_input2par(par_proposed, input, calc[0], nav);
+
+            success = ssm_check_ic(par_proposed, calc[0]);
+
+            if(success == SSM_SUCCESS){
+                ssm_par2X(D_J_X[0][0], par_proposed, calc[0], nav);
+                D_J_X[0][0]->dt = D_J_X[0][0]->dt0;
+                for(j=1; j<fitness->J; j++){
+                    ssm_X_copy(D_J_X[0][j], D_J_X[0][0]);
+                }
+
+                success |= run_pmcmc_smc(f_pred, D_J_X, D_J_X_tmp, D_X, flag_traj, par_proposed, calc, data, fitness, nav, workers);
+                success |= ssm_metropolis_hastings(fitness, &ratio, proposed, theta, var, sd_fac, nav, calc[0], adapt->proposal);
+            }
         }
 
         if(success == SSM_SUCCESS){ //everything went well and the proposed theta was accepted
@@ -205,8 +179,10 @@ int main(int argc, char *argv[])
             ssm_theta_copy(theta, proposed);
             ssm_par_copy(par, par_proposed);
 
-            if ( (nav->print & SSM_PRINT_X) && data->n_obs ) {
-                ssm_sample_traj(D_X, D_J_X, calc[0], data, fitness);
+            if ( flag_traj ) {
+                if(!opts->flag_chain){
+                    ssm_sample_traj(D_X, D_J_X, calc[0], data, fitness);
+                }
                 for(n=0; n<data->n_obs; n++){
                     ssm_X_copy(D_X_prev[n+1], D_X[n+1]);
                 }
@@ -251,6 +227,9 @@ int main(int argc, char *argv[])
     ssm_D_J_X_free(D_J_X_tmp, data, fitness);
     ssm_D_X_free(D_X, data);
     ssm_D_X_free(D_X_prev, data);
+    if(prefetch){
+        ssm_prefetch_free(prefetch, data);
+    }
 
     ssm_N_calc_free(calc, nav);
 
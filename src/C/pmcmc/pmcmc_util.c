@@ -0,0 +1,194 @@
+/**************************************************************************
+ *    This file is part of ssm.
+ *
+ *    ssm is free software: you can redistribute it and/or modify it
+ *    under the terms of the GNU General Public License as published
+ *    by the Free Software Foundation, either version 3 of the
+ *    License, or (at your option) any later version.
+ *
+ *    ssm is distributed in the hope that it will be useful, but
+ *    WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public
+ *    License along with ssm.  If not, see
+ *    <http://www.gnu.org/licenses/>.
+ *************************************************************************/
+
+#include "ssm.h"
+
+ssm_prefetch_t *ssm_prefetch_new(int length, ssm_input_t *input, ssm_calc_t *calc, ssm_data_t *data, ssm_nav_t *nav, ssm_options_t *opts)
+{
+    int i;
+
+    ssm_prefetch_t *prefetch = malloc(sizeof (ssm_prefetch_t));
+    if (prefetch == NULL) {
+        ssm_print_err("Allocation impossible for ssm_prefetch_t *");
+        exit(EXIT_FAILURE);
+    }
+
+    prefetch->length = length;
+    prefetch->n_nodes = 0;
+
+    prefetch->parent = ssm_i1_new(length);
+    prefetch->prob = ssm_d1_new(length);
+    prefetch->log_like = ssm_d1_new(length);
+    prefetch->index = ssm_i1_new(length);
+    prefetch->N_log_like = ssm_d1_new(length);
+
+    prefetch->child = malloc(length * sizeof (int *));
+    prefetch->base = malloc(length * sizeof (ssm_theta_t *));
+    prefetch->proposed = malloc(length * sizeof (ssm_theta_t *));
+    prefetch->par = malloc(length * sizeof (ssm_par_t *));
+    prefetch->status = malloc(length * sizeof (ssm_err_code_t));
+    prefetch->N_par = malloc(length * sizeof (ssm_par_t *));
+    prefetch->N_D_X = malloc(length * sizeof (ssm_X_t **));
+    prefetch->N_status = malloc(length * sizeof (ssm_err_code_t));
+    prefetch->D_X = malloc(length * sizeof (ssm_X_t **));
+
+    if (prefetch->child == NULL || prefetch->base == NULL || prefetch->proposed == NULL || prefetch->par == NULL || prefetch->status == NULL ||
+        prefetch->N_par == NULL || prefetch->N_D_X == NULL || prefetch->N_status == NULL || prefetch->D_X == NULL) {
+        ssm_print_err("Allocation impossible for ssm_prefetch_t *");
+        exit(EXIT_FAILURE);
+    }
+
+    for(i=0; i<length; i++){
+        prefetch->child[i] = ssm_i1_new(2);
+        prefetch->proposed[i] = ssm_theta_new(input, nav);
+        prefetch->par[i] = ssm_par_new(input, calc, nav);
+        prefetch->D_X[i] = (nav->print & SSM_PRINT_X) ? ssm_D_X_new(data, nav, opts) : NULL;
+    }
+
+    return prefetch;
+}
+
+
+void ssm_prefetch_free(ssm_prefetch_t *prefetch, ssm_data_t *data)
+{
+    int i;
+
+    for(i=0; i<prefetch->length; i++){
+        free(prefetch->child[i]);
+        ssm_theta_free(prefetch->proposed[i]);
+        ssm_par_free(prefetch->par[i]);
+        if(prefetch->D_X[i]){
+            ssm_D_X_free(prefetch->D_X[i], data);
+        }
+    }
+
+    free(prefetch->child);
+    free(prefetch->base);
+    free(prefetch->proposed);
+    free(prefetch->par);
+    free(prefetch->status);
+    free(prefetch->N_par);
+    free(prefetch->N_D_X);
+    free(prefetch->N_status);
+    free(prefetch->D_X);
+
+    free(prefetch->parent);
+    free(prefetch->prob);
+    free(prefetch->log_like);
+    free(prefetch->index);
+    free(prefetch->N_log_like);
+
+    free(prefetch);
+}
+
+
+/**
+ * Grow the tree of the next proposals from theta: starting from the
+ * root, the node the most likely to be reached is added until the
+ * tree has prefetch->length nodes. A child is reached with
+ * probability ar (acceptance of its parent) or 1-ar (rejection). At
+ * low acceptance rates the tree is therefore mostly a chain of
+ * rejections.
+ *
+ * The proposals are drawn with the covariance and the tuning factor
+ * of the first iteration of the tree (proposal must have been set to
+ * var).
+ */
+void ssm_prefetch_tree(ssm_prefetch_t *prefetch, ssm_theta_t *theta, ssm_var_t *var, ssm_proposal_t *proposal, double sd_fac, double ar, ssm_input_t *input, ssm_calc_t *calc, ssm_nav_t *nav)
+{
+    int i, k, c;
+    int best_node, best_c;
+    double p, best;
+
+    //keep both branches possible
+    ar = GSL_MIN(GSL_MAX(ar, 0.01), 0.99);
+
+    prefetch->n_nodes = 0;
+    for(k=0; k<prefetch->length; k++){
+
+        if(k == 0){
+            best_node = -1;
+            best_c = 0;
+            best = 1.0;
+        } else {
+            best_node = -1;
+            best_c = 0;
+            best = -1.0;
+            for(i=0; i<prefetch->n_nodes; i++){
+                for(c=0; c<2; c++){
+                    p = prefetch->prob[i] * ((c) ? ar : 1.0-ar);
+                    if(prefetch->child[i][c] == -1 && p > best){
+                        best = p;
+                        best_node = i;
+                        best_c = c;
+                    }
+                }
+            }
+            prefetch->child[best_node][best_c] = k;
+        }
+
+        prefetch->parent[k] = best_node;
+        prefetch->child[k][0] = -1;
+        prefetch->child[k][1] = -1;
+        prefetch->prob[k] = best;
+
+        if(best_node == -1){
+            prefetch->base[k] = theta;
+        } else {
+            prefetch->base[k] = (best_c) ? prefetch->proposed[best_node] : prefetch->base[best_node];
+        }
+
+        ssm_theta_ran(prefetch->proposed[k], prefetch->base[k], var, sd_fac, calc, nav, proposal);
+        ssm_theta2input(input, prefetch->proposed[k], nav);
+        ssm_input2par(prefetch->par[k], input, calc, nav);
+        prefetch->status[k] = ssm_check_ic(prefetch->par[k], calc);
+        prefetch->log_like[k] = 0.0;
+
+        prefetch->n_nodes++;
+    }
+}
+
+
+/**
+ * evaluate the likelihood of all the nodes of the tree (with valid
+ * initial conditions) in parallel on the tcp workers (--chain)
+ */
+void ssm_prefetch_eval(ssm_prefetch_t *prefetch, ssm_workers_t *workers, ssm_data_t *data)
+{
+    int i, k;
+    int N = 0;
+
+    for(k=0; k<prefetch->n_nodes; k++){
+        if(prefetch->status[k] == SSM_SUCCESS){
+            prefetch->index[N] = k;
+            prefetch->N_par[N] = prefetch->par[k];
+            prefetch->N_D_X[N] = prefetch->D_X[k];
+            N++;
+        }
+    }
+
+    if(N){
+        ssm_workers_eval(workers, prefetch->N_par, N, (prefetch->D_X[0]) ? prefetch->N_D_X : NULL, prefetch->N_log_like, prefetch->N_status, data);
+    }
+
+    for(i=0; i<N; i++){
+        k = prefetch->index[i];
+        prefetch->status[k] = prefetch->N_status[i];
+        prefetch->log_like[k] = prefetch->N_log_like[i];
+    }
+}
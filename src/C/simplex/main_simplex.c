@@ -71,9 +71,11 @@ static double f_simplex(const gsl_vector *theta, void *params)
 
     for(n=0; n<data->n_obs; n++) {
         t0 = (n) ? data->rows[n-1]->time: 0;
+        ssm_X_reset_inc(X, data->rows[n], nav);
+
+        n = ssm_row_span_end(data, n, nav, calc);
         t1 = data->rows[n]->time;
 
-        ssm_X_reset_inc(X, data->rows[n], nav);
         status |= ssm_f_prediction_ode(X, t0, t1, par, nav, calc);
 
         if( status != SSM_SUCCESS ){
@@ -21,7 +21,7 @@
 
 int main(int argc, char *argv[])
 {
-    int i, j, n, t0, t1, id, the_j;
+    int i, j, n, t0, t1, the_j;
 
     ssm_options_t *opts = ssm_options_new();
     ssm_options_load(opts, SSM_SIMUL, argc, argv);
@@ -51,8 +51,6 @@ int main(int argc, char *argv[])
     ssm_X_t **J_X = ssm_J_X_new(fitness, nav, opts);
     ssm_hat_t *hat = ssm_hat_new(nav);
 
-    json_decref(jdata);
-
     ssm_input_t *input = ssm_input_new(jparameters, nav);
     ssm_par_t **J_par = malloc(fitness->J * sizeof (ssm_par_t *));
     if(J_par == NULL) {
@@ -78,7 +76,8 @@ int main(int argc, char *argv[])
    
     ssm_f_pred_t f_pred = ssm_get_f_pred(nav);
 
-    ssm_workers_t *workers = ssm_workers_start(&J_X, J_par, data, calc, fitness, f_pred, nav, opts, SSM_WORKER_J_PAR);
+    ssm_workers_t *workers = ssm_workers_start(jparameters, jdata, &J_X, J_par, data, calc, fitness, f_pred, nav, opts, SSM_WORKER_J_PAR);
+    json_decref(jdata);
     
     for(j=0; j<fitness->J; j++) {
         fitness->cum_status[j] = SSM_SUCCESS;
@@ -98,6 +97,20 @@ int main(int argc, char *argv[])
 	}
     }
 
+    //ode integrated by a single thread with an explicit stepper: the particles are integrated across the rows with dense output (see ssm_f_prediction_ode_dense())
+    ssm_dense_t **J_dense = NULL;
+    double t_end = (data->n_obs) ? data->rows[data->n_obs-1]->time : 0;
+    if(nav->implementation == SSM_ODE && !workers->flag_tcp && calc[0]->threads_length == 1 && !calc[0]->_driver_stiff && calc[0]->T != gsl_odeiv2_step_msbdf){
+        J_dense = malloc(fitness->J * sizeof (ssm_dense_t *));
+        if(J_dense == NULL) {
+            ssm_print_err("Allocation impossible for ssm_dense_t *");
+            exit(EXIT_FAILURE);
+        }
+        for(j=0; j<fitness->J; j++) {
+            J_dense[j] = ssm_dense_new(nav);
+        }
+    }
+
     for(n=(n_start+1); n < data->n_obs; n++) {
 	t0 = (n) ? data->rows[n-1]->time: 0;
 	t1 = data->rows[n]->time;
@@ -123,24 +136,17 @@ int main(int argc, char *argv[])
 	    }
 
 	} else if(calc[0]->threads_length > 1){
+            ssm_workers_integrate(workers, n);
 
-            //send work
-            for (i=0; i<calc[0]->threads_length; i++) {
-                zmq_send(workers->sender, &i, sizeof (int), ZMQ_SNDMORE);
-                zmq_send(workers->sender, &n, sizeof (int), 0);
-            }
+        } else if(J_dense) {
 
-            //get results from the workers
-            for (i=0; i<calc[0]->threads_length; i++) {
-                zmq_recv(workers->receiver, &id, sizeof (int), 0);
-            }
+	    for(j=0;j<fitness->J;j++) {
+		fitness->cum_status[j] |= ssm_f_prediction_ode_dense(J_X[j], J_dense[j], t0, t1, t_end, data->rows[n], J_par[j], nav, calc[0]);
+	    }
 
         } else {
 
-	    for(j=0;j<fitness->J;j++) {
-		ssm_X_reset_inc(J_X[j], data->rows[n], nav);
-		fitness->cum_status[j] |= f_pred(J_X[j], t0, t1, J_par[j], nav, calc[0]);
-	    }
+	    ssm_f_prediction_J(J_X, 0, fitness->J, J_par, 1, data->rows[n], t0, t1, f_pred, nav, calc[0], fitness->cum_status);
 
 	}
 
@@ -167,6 +173,13 @@ int main(int argc, char *argv[])
 
     ssm_workers_stop(workers);
 
+    if(J_dense){
+        for(j=0; j<fitness->J; j++) {
+            ssm_dense_free(J_dense[j]);
+        }
+        free(J_dense);
+    }
+
     for(j=0; j<fitness->J; j++) {
         ssm_par_free(J_par[j]);
     }
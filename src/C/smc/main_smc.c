@@ -20,7 +20,7 @@
 
 int main(int argc, char *argv[])
 {
-    int i, j, n, t0, t1, id, the_j;
+    int j, n, t0, t1, the_j;
 
     ssm_options_t *opts = ssm_options_new();
     ssm_options_load(opts, SSM_SMC, argc, argv);
@@ -37,8 +37,6 @@ int main(int argc, char *argv[])
     ssm_X_t **J_X_tmp = ssm_J_X_new(fitness, nav, opts);
     ssm_hat_t *hat = ssm_hat_new(nav);
 
-    json_decref(jdata);
-
     ssm_input_t *input = ssm_input_new(jparameters, nav);
     ssm_par_t *par = ssm_par_new(input, calc[0], nav);
     ssm_theta_t *theta = ssm_theta_new(input, nav);
@@ -57,7 +55,8 @@ int main(int argc, char *argv[])
 
     ssm_f_pred_t f_pred = ssm_get_f_pred(nav);
 
-    ssm_workers_t *workers = ssm_workers_start(&J_X, &par, data, calc, fitness, f_pred, nav, opts, SSM_WORKER_FITNESS);
+    ssm_workers_t *workers = ssm_workers_start(jparameters, jdata, &J_X, &par, data, calc, fitness, f_pred, nav, opts, SSM_WORKER_FITNESS);
+    json_decref(jdata);
 
     for(n=0; n<data->n_obs; n++) {
         t0 = (n) ? data->rows[n-1]->time: 0;
@@ -85,21 +84,11 @@ int main(int argc, char *argv[])
 	    }
 
 	} else if(calc[0]->threads_length > 1){
-	    //send work
-            for (i=0; i<calc[0]->threads_length; i++) {
-                zmq_send(workers->sender, &i, sizeof (int), ZMQ_SNDMORE);
-                zmq_send(workers->sender, &n, sizeof (int), 0);
-            }
-
-            //get results from the workers
-            for (i=0; i<calc[0]->threads_length; i++) {
-                zmq_recv(workers->receiver, &id, sizeof (int), 0);
-            }
+	    ssm_workers_integrate(workers, n);
 
         } else {
+	    ssm_f_prediction_J(J_X, 0, fitness->J, &par, 0, data->rows[n], t0, t1, f_pred, nav, calc[0], fitness->cum_status);
 	    for(j=0;j<fitness->J;j++) {
-                ssm_X_reset_inc(J_X[j], data->rows[n], nav);
-                fitness->cum_status[j] |= (*f_pred)(J_X[j], t0, t1, par, nav, calc[0]);
 		if(data->rows[n]->ts_nonan_length) {
                     fitness->weights[j] = (fitness->cum_status[j] == SSM_SUCCESS) ?  exp(ssm_log_likelihood(data->rows[n], J_X[j], par, calc[0], nav, fitness)) : 0.0;
 		    fitness->cum_status[j] = SSM_SUCCESS;
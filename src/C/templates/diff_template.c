@@ -26,5 +26,37 @@ void ssm_compute_diff(ssm_X_t *p_X, ssm_par_t *par, ssm_nav_t *nav, ssm_calc_t *
 }
 
 
-{% endblock %}
+/**
+ * ssm_compute_diff() for the B lanes of ssm_f_prediction_sto_batch()
+ * (states Y and parameters P stored lane-wise: [n][B])
+ */
+void ssm_compute_diff_batch(double *Y, double dt, int B, const double *P, ssm_nav_t *nav, ssm_calc_t *calc)
+{
+    {% if batch.terms|length %}
+
+    int i, b;
+    int n_browns = {{ batch.n_browns }};
+    ssm_it_states_t *it = nav->states_diff;
 
+    double (*X)[B] = (double (*)[B]) Y;
+    const double (*par)[B] = (const double (*)[B]) P;
+
+    double sqrt_dt = sqrt(dt);
+
+    double _w[n_browns][B];
+    for(b=0; b<B; b++){
+        for(i=0; i<n_browns; i++){
+            _w[i][b] = gsl_ran_ugaussian(calc->randgsl);
+        }
+    }
+
+    {% for eq in batch.terms %}
+    i = it->p[{{ loop.index0 }}]->offset;
+    for(b=0; b<B; b++){
+        X[i][b] += sqrt_dt*({{ eq }});
+    }{% endfor %}
+
+    {% endif %}
+}
+
+{% endblock %}
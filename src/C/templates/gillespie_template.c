@@ -0,0 +1,146 @@
+{% extends "ordered.tpl" %}
+
+{% block code %}
+
+/**
+ * Alloc memory for the gillespie implementation (including the
+ * dependency graph of the reactions)
+ */
+void ssm_gillespie_new(ssm_calc_t *calc, ssm_nav_t *nav)
+{
+    int n_reactions = {{ reactions|length }};
+
+    ssm_gillespie_t *gil = malloc(sizeof (ssm_gillespie_t));
+    if (gil == NULL) {
+        char str[SSM_STR_BUFFSIZE];
+        snprintf(str, SSM_STR_BUFFSIZE, "Allocation impossible in file :%s line : %d",__FILE__,__LINE__);
+        ssm_print_err(str);
+        exit(EXIT_FAILURE);
+    }
+
+    gil->n_reactions = n_reactions;
+
+    /*automaticaly generated code: reactions whose propensity depends on the states changed by each reaction*/
+    gil->dep_length = ssm_u1_new(n_reactions);
+    {% for r in reactions %}
+    gil->dep_length[{{ loop.index0 }}] = {{ r.dep|length }};{% endfor %}
+
+    gil->dep = ssm_u2_var_new(n_reactions, gil->dep_length);
+    {% for r in reactions %}{% set i = loop.index0 %}{% for j in r.dep %}
+    gil->dep[{{ i }}][{{ loop.index0 }}] = {{ j }};{% endfor %}{% endfor %}
+
+    gil->a = ssm_d1_new(n_reactions);
+    gil->tau = ssm_d1_new(n_reactions);
+    gil->heap = ssm_i1_new(n_reactions);
+    gil->node = ssm_i1_new(n_reactions);
+
+    gil->diffed = (nav->states_diff->length) ? ssm_d1_new(nav->states_diff->length) : NULL;
+    gil->noise = {% if white_noise %}ssm_d1_new({{ white_noise|length }}){% else %}NULL{% endif %};
+    gil->cov = (calc->covariates_length) ? ssm_d1_new(calc->covariates_length) : NULL;
+
+    calc->gillespie = gil;
+}
+
+void ssm_gillespie_free(ssm_calc_t *calc)
+{
+    ssm_gillespie_t *gil = calc->gillespie;
+
+    free(gil->dep_length);
+    ssm_u2_free(gil->dep, gil->n_reactions);
+    free(gil->a);
+    free(gil->tau);
+    free(gil->heap);
+    free(gil->node);
+    if(gil->diffed){
+        free(gil->diffed);
+    }
+    if(gil->noise){
+        free(gil->noise);
+    }
+    if(gil->cov){
+        free(gil->cov);
+    }
+
+    free(gil);
+}
+
+
+/**
+ * Freeze the time dependent terms of the propensities (covariates,
+ * diffusions and white noises) over the time step [t, t+dt]
+ */
+void ssm_gillespie_freeze(ssm_X_t *p_X, double t, ssm_par_t *par, ssm_nav_t *nav, ssm_calc_t *calc)
+{
+    int i;
+    ssm_gillespie_t *gil = calc->gillespie;
+
+    for(i=0; i<calc->covariates_length; i++){
+        gil->cov[i] = gsl_spline_eval(calc->spline[i], t, calc->acc[i]);
+    }
+
+    {% if is_diff %}
+    ssm_it_states_t *states_diff = nav->states_diff;
+    int is_diff = ! (nav->noises_off & SSM_NO_DIFF);
+
+    for(i=0; i<states_diff->length; i++){
+        ssm_state_t *p = states_diff->p[i];
+        if(is_diff){
+            gil->diffed[i] = p->f_inv(p_X->proj[p->offset]);
+        } else {
+            gil->diffed[i] = gsl_vector_get(par, p->ic->offset);
+        }
+    }
+    {% endif %}
+
+    {% if white_noise %}
+    double dt = p_X->dt;
+
+    if(nav->noises_off & SSM_NO_WHITE_NOISE){
+        {% for n in white_noise %}
+        gil->noise[{{ loop.index0 }}] = 1.0;{% endfor %}
+    } else {
+        {% for n in white_noise %}
+        gil->noise[{{ loop.index0 }}] = gsl_ran_gamma(calc->randgsl, (dt)/ pow(gsl_vector_get(par, ORDER_{{ n.sd }}), 2), pow(gsl_vector_get(par, ORDER_{{ n.sd }}), 2))/dt;{% endfor %}
+    }
+    {% endif %}
+}
+
+
+/**
+ * Propensity of the reaction r (the terms frozen by
+ * ssm_gillespie_freeze() are read from calc->gillespie)
+ */
+double ssm_gillespie_propensity(int r, const double *X, ssm_par_t *par, ssm_nav_t *nav, ssm_calc_t *calc)
+{
+    ssm_gillespie_t *gil = calc->gillespie;
+
+    switch(r){
+    {% for r in reactions %}
+    case {{ loop.index0 }}:
+        return {{ r.propensity }};
+    {% endfor %}
+    }
+
+    return 0.0;
+}
+
+
+/**
+ * Update the states and the incidences after one firing of the
+ * reaction r
+ */
+void ssm_gillespie_fire(int r, double *X, ssm_nav_t *nav)
+{
+    ssm_it_states_t *states_inc = nav->states_inc;
+
+    switch(r){
+    {% for r in reactions %}
+    case {{ loop.index0 }}:
+        {% for u in r.update %}
+        {{ u }};{% endfor %}
+        break;
+    {% endfor %}
+    }
+}
+
+{% endblock %}
@@ -2,11 +2,14 @@
 
 {% block code %}
 
-void ssm_eval_jac(const double X[], double t, ssm_par_t *par, ssm_nav_t *nav, ssm_calc_t *calc)
+/**
+ * jacobian matrix of the states (Ft), shared by the EKF (see
+ * ssm_eval_jac()) and the implicit ODE steppers (see ssm_jac_ode())
+ */
+static void _ssm_eval_jac(const double X[], double t, ssm_par_t *par, ssm_nav_t *nav, ssm_calc_t *calc, gsl_matrix *Ft)
 {
 
     int i;
-    gsl_matrix *Ft = calc->_Ft;
 
     ssm_it_states_t *states_diff = nav->states_diff;
     ssm_it_states_t *states_inc = nav->states_inc;
@@ -21,6 +24,7 @@ void ssm_eval_jac(const double X[], double t, ssm_par_t *par, ssm_nav_t *nav, ss
     {% endif %}
 
     //some terms are always 0: derivative of the ODE (excluding the observed variable) against the observed variable, derivative of the dynamic of the observed variable against the observed variables, derivative of the drift eq.
+    //Ft is also used as a workspace by the Kalman update so it is reset here, only its (structurally) non null terms are set below.
     gsl_matrix_set_zero(Ft);
 
     double _r[{{ jac.caches|length }}];
@@ -54,24 +58,24 @@ void ssm_eval_jac(const double X[], double t, ssm_par_t *par, ssm_nav_t *nav, ss
     //first non null part of the jacobian matrix: derivative of the ODE (excluding the observed variable) against the state variable only ( automaticaly generated code )
     {% for jac_i in jac.jac %}
     {% set outer_loop = loop %}
-    {% for jac_ii in jac_i %}
+    {% for jac_ii in jac_i %}{% if jac.caches[jac_ii] != '0' %}
     gsl_matrix_set(Ft,
                    states_sv->p[{{ outer_loop.index0 }}]->offset,
                    states_sv->p[{{ loop.index0 }}]->offset,
                    _r[{{ jac_ii }}]);
-    {% endfor %}
+    {% endif %}{% endfor %}
     {% endfor %}
 
 
     //second non null part of the jacobian matrix: derivative of the dynamic of the observed variable against the state variable only ( automaticaly generated code )
     {% for jac_i in jac.jac_obs %}
     {% set outer_loop = loop %}
-    {% for jac_ii in jac_i %}
+    {% for jac_ii in jac_i %}{% if jac.caches[jac_ii] != '0' %}
     gsl_matrix_set(Ft,
                    states_inc->p[{{ outer_loop.index0 }}]->offset,
                    states_sv->p[{{ loop.index0 }}]->offset,
                    _r[{{ jac_ii }}]);
-    {% endfor %}
+    {% endif %}{% endfor %}
     {% endfor %}
 
 
@@ -82,23 +86,23 @@ void ssm_eval_jac(const double X[], double t, ssm_par_t *par, ssm_nav_t *nav, ss
         //third non null part of the jacobian matrix: derivative of the ODE (excluding the observed variable) against the diff variable (automaticaly generated code)
         {% for jac_i in jac.jac_diff %}
         {% set outer_loop = loop %}
-        {% for jac_ii in jac_i %}
+        {% for jac_ii in jac_i %}{% if jac.caches[jac_ii.value] != '0' %}
         gsl_matrix_set(Ft,
                        states_sv->p[{{ outer_loop.index0 }}]->offset,
                        states_diff->p[{{ loop.index0 }}]->offset,
                        ssm_diff_derivative(_r[{{ jac_ii.value }}], X, states_diff->p[{{ loop.index0 }}]));
-        {% endfor %}
+        {% endif %}{% endfor %}
         {% endfor %}
 
         //fourth non null part of the jacobian matrix: derivative of obs variable against diff (automaticaly generated code)
         {% for jac_i in jac.jac_obs_diff %}
         {% set outer_loop = loop %}
-        {% for jac_ii in jac_i %}
+        {% for jac_ii in jac_i %}{% if jac.caches[jac_ii.value] != '0' %}
         gsl_matrix_set(Ft,
                        states_inc->p[{{ outer_loop.index0 }}]->offset,
                        nav->states_diff->p[{{ loop.index0 }}]->offset,
                        ssm_diff_derivative(_r[{{ jac_ii.value }}], X, states_diff->p[{{ loop.index0 }}]));
-        {% endfor %}
+        {% endif %}{% endfor %}
         {% endfor %}
 
     }
@@ -107,4 +111,38 @@ void ssm_eval_jac(const double X[], double t, ssm_par_t *par, ssm_nav_t *nav, ss
 }
 
 
+void ssm_eval_jac(const double X[], double t, ssm_par_t *par, ssm_nav_t *nav, ssm_calc_t *calc)
+{
+    _ssm_eval_jac(X, t, par, nav, calc, calc->_Ft);
+}
+
+
+/**
+ * Jacobian of ssm_step_ode in the format of gsl_odeiv2_system (used
+ * by the implicit steppers, see --stepper). The system is not
+ * autonomous (covariates, time dependent rates) so dfdt is
+ * approximated by a forward difference.
+ */
+int ssm_jac_ode(double t, const double X[], double *dfdy, double dfdt[], void *params)
+{
+    int i;
+    ssm_calc_t *calc = (ssm_calc_t *) params;
+    ssm_nav_t *nav = calc->_nav;
+    int m = nav->states_sv_inc->length + nav->states_diff->length;
+
+    gsl_matrix_view Ft = gsl_matrix_view_array(dfdy, m, m);
+    _ssm_eval_jac(X, t, calc->_par, nav, calc, &Ft.matrix);
+
+    double f0[m], f1[m];
+    double delta = GSL_SQRT_DBL_EPSILON * GSL_MAX(1.0, fabs(t));
+    ssm_step_ode(t, X, f0, params);
+    ssm_step_ode(t + delta, X, f1, params);
+    for(i=0; i<m; i++){
+        dfdt[i] = (f1[i] - f0[i]) / delta;
+    }
+
+    return GSL_SUCCESS;
+}
+
+
 {% endblock %}
@@ -59,12 +59,12 @@ static double f_var_pred_tpl_{{ y.name }}(ssm_X_t *p_X, ssm_par_t *par, ssm_calc
 {
     double res = 0;
     int m = nav->states_sv->length + nav->states_inc->length + nav->states_diff->length;
-    gsl_matrix_const_view Ct   = gsl_matrix_const_view_array(&p_X->proj[m], m, m);
+    const double *Ct = &p_X->proj[m];
 
     {% for grad_i in y.grads %}
     {% set outer_loop = loop %}
     {% for grad_ii in y.grads %}
-    res += {{ grad_i.Cterm }}*{{ grad_ii.Cterm }}*gsl_matrix_get(&Ct.matrix, {{ grad_i.ind }}, {{ grad_ii.ind }});
+    res += {{ grad_i.Cterm }}*{{ grad_ii.Cterm }}*ssm_kalman_Ct_get(Ct, m, {{ grad_i.ind }}, {{ grad_ii.ind }});
     {% endfor %}
     {% endfor %}
     
@@ -65,9 +65,9 @@ void ssm_step_sde_{{ noises_off }}(ssm_X_t *p_X, double t, ssm_par_t *par, ssm_n
     {% for cache in step.caches %}
     _r[{{ loop.index0 }}] = {{ cache }};{% endfor %}
 
-    /* noises */
+    /* noises (Brownian increments, given in calc->_dw by ssm_f_prediction_sde_adapt()) */
     {% for noise in func.proc.noises %}
-    {{ noise }} = sqrt(dt)*gsl_ran_ugaussian(calc->randgsl);{% endfor %}
+    {{ noise }} = (calc->_dw) ? calc->_dw[{{ step.dw.index(noise) }}] : sqrt(dt)*gsl_ran_ugaussian(calc->randgsl);{% endfor %}
 
     /*ODE system*/
     {% for eq in func.proc.system %}
@@ -100,5 +100,358 @@ void ssm_step_sde_{{ noises_off }}(ssm_X_t *p_X, double t, ssm_par_t *par, ssm_n
 }
 {% endfor %}
 
-{% endblock %}
 
+/**
+ * ssm_step_ode() for the B lanes of ssm_f_prediction_ode_batch(): the
+ * states (Y, F) and the parameters (P) are stored lane-wise ([n][B])
+ * and every statement is a loop over the lanes.
+ */
+void ssm_step_ode_batch(double t, const double *Y, double *F, int B, const double *P, ssm_nav_t *nav, ssm_calc_t *calc)
+{
+    int i, b;
+
+    const double (*X)[B] = (const double (*)[B]) Y;
+    double (*f)[B] = (double (*)[B]) F;
+    const double (*par)[B] = (const double (*)[B]) P;
+
+    ssm_it_states_t *states_inc = nav->states_inc;
+
+    double _r[{{ batch.caches|length }}][B];
+
+    {% if batch.sf %}
+    double _sf[{{ batch.sf|length }}][B];{% endif %}
+
+    {% if is_cov %}
+    //the covariates are the same for every lane
+    double _cov[calc->covariates_length];
+    for(i=0; i<calc->covariates_length; i++){
+        _cov[i] = gsl_spline_eval(calc->spline[i], t, calc->acc[i]);
+    }
+    {% endif %}
+
+    {% if is_diff %}
+    ssm_it_states_t *states_diff = nav->states_diff;
+    double diffed[states_diff->length][B];
+    for(i=0; i<states_diff->length; i++){
+        ssm_state_t *p = states_diff->p[i];
+        for(b=0; b<B; b++){
+            diffed[i][b] = par[p->ic->offset][b];
+            f[p->offset][b] = 0.0;
+        }
+    }
+    {% endif %}
+
+    /* caches */
+    {% for sf in batch.sf %}
+    for(b=0; b<B; b++){
+        _sf[{{ loop.index0 }}][b] = {{ sf }};
+    }{% endfor %}
+
+    {% for cache in batch.caches %}
+    for(b=0; b<B; b++){
+        _r[{{ loop.index0 }}][b] = {{ cache }};
+    }{% endfor %}
+
+    /*ODE system*/
+    {% for eq in batch.system %}
+    for(b=0; b<B; b++){
+        f[{{eq.index}}][b] = {{ eq.eq }};
+    }{% endfor %}
+
+    /*compute incidence:integral between t and t+1*/
+    {% for eq in batch.obs %}
+    i = states_inc->p[{{ eq.index }}]->offset;
+    for(b=0; b<B; b++){
+        f[i][b] = {{ eq.eq }};
+    }{% endfor %}
+}
+
+
+{% for noises_off, func in batch_sde.func.items() %}
+/**
+ * ssm_step_sde_{{ noises_off }}() for the B lanes of
+ * ssm_f_prediction_sto_batch(): the states (Y) and the parameters
+ * (P) are stored lane-wise ([n][B]) and every statement is a loop
+ * over the lanes. Only the noises are drawn lane after lane.
+ */
+void ssm_step_sde_batch_{{ noises_off }}(double *Y, double t, double dt, int B, const double *P, ssm_nav_t *nav, ssm_calc_t *calc)
+{
+    int i, b;
+
+    double (*X)[B] = (double (*)[B]) Y;
+    const double (*par)[B] = (const double (*)[B]) P;
+
+    ssm_it_states_t *states_sv = nav->states_sv;
+    ssm_it_states_t *states_inc = nav->states_inc;
+
+    double f[nav->states_sv_inc->length + nav->states_diff->length][B];
+
+    double _r[{{ batch_sde.caches|length }}][B];
+
+    {% if batch_sde.sf %}
+    double _sf[{{ batch_sde.sf|length }}][B];{% endif %}
+
+    {% for noise in func.noises %}
+    double {{ noise }}[B];{% endfor %}
+
+    {% if is_cov %}
+    //the covariates are the same for every lane
+    double _cov[calc->covariates_length];
+    for(i=0; i<calc->covariates_length; i++){
+        _cov[i] = gsl_spline_eval(calc->spline[i], t, calc->acc[i]);
+    }
+    {% endif %}
+
+    {% if is_diff %}
+    ssm_it_states_t *states_diff = nav->states_diff;
+    double diffed[states_diff->length][B];
+    int is_diff = ! (nav->noises_off & SSM_NO_DIFF);
+    for(i=0; i<states_diff->length; i++){
+        ssm_state_t *p = states_diff->p[i];
+        for(b=0; b<B; b++){
+            diffed[i][b] = (is_diff) ? p->f_inv(X[p->offset][b]) : par[p->ic->offset][b];
+            f[p->offset][b] = 0.0;
+        }
+    }
+    {% endif %}
+
+    /* caches */
+    {% for sf in batch_sde.sf %}
+    for(b=0; b<B; b++){
+        _sf[{{ loop.index0 }}][b] = {{ sf }};
+    }{% endfor %}
+
+    {% for cache in batch_sde.caches %}
+    for(b=0; b<B; b++){
+        _r[{{ loop.index0 }}][b] = {{ cache }};
+    }{% endfor %}
+
+    {% if func.noises %}
+    /* noises */
+    double sqrt_dt = sqrt(dt);
+    for(b=0; b<B; b++){
+        {% for noise in func.noises %}
+        {{ noise }}[b] = sqrt_dt*gsl_ran_ugaussian(calc->randgsl);{% endfor %}
+    }
+    {% endif %}
+
+    /*SDE system*/
+    {% for eq in func.system %}
+    for(b=0; b<B; b++){
+        f[{{eq.index}}][b] = X[{{eq.index}}][b] + {{ eq.eq }};
+    }{% endfor %}
+
+    /*compute incidence:integral between t and t+1*/
+    {% for eq in func.obs %}
+    i = states_inc->p[{{ eq.index }}]->offset;
+    for(b=0; b<B; b++){
+        f[i][b] = X[i][b] + {{ eq.eq }};
+    }{% endfor %}
+
+    //y_pred (f) -> X (and we ensure that X is > 0.0)
+    for(i=0; i<states_sv->length; i++){
+        int o = states_sv->p[i]->offset;
+        for(b=0; b<B; b++){
+            X[o][b] = (f[o][b] < 0.0) ? 0.0 : f[o][b];
+        }
+    }
+
+    for(i=0; i<states_inc->length; i++){
+        int o = states_inc->p[i]->offset;
+        for(b=0; b<B; b++){
+            X[o][b] = (f[o][b] < 0.0) ? 0.0 : f[o][b];
+        }
+    }
+}
+{% endfor %}
+
+
+/**
+ * Number of Brownian increments (calc->_dw) of the SDEs (see
+ * ssm_f_prediction_sde_adapt())
+ */
+int ssm_sde_dw_length(void)
+{
+    return {{ step.dw|length }};
+}
+
+
+
+/**
+ * Is the Brownian increment j of calc->_dw switched on (the
+ * demographic stochasticity of each reaction comes first, then the
+ * white noises)?
+ */
+int ssm_sde_dw_on(int j, ssm_nav_t *nav)
+{
+    if (j < {{ sde.n_dem }}) {
+        return !(nav->noises_off & SSM_NO_DEM_STO);
+    }
+
+    return !(nav->noises_off & SSM_NO_WHITE_NOISE);
+}
+
+
+/**
+ * Drift (a, [n_X]) and diffusion matrix (g, [n_X][n_dw], one column
+ * per Brownian increment of calc->_dw) of the SDEs at (X, t) used by
+ * ssm_f_prediction_sde_milstein() and ssm_f_prediction_sde_srk15().
+ * The columns of the noises switched off are null, as are the rows of
+ * the diffusions (stepped by ssm_compute_diff()).
+ */
+void ssm_sde_drift_diffusion(const double *X, double t, double *a, double *g, ssm_par_t *par, ssm_nav_t *nav, ssm_calc_t *calc)
+{
+    int n_X = nav->states_sv_inc->length + nav->states_diff->length;
+    int dem = !(nav->noises_off & SSM_NO_DEM_STO);
+    int env = !(nav->noises_off & SSM_NO_WHITE_NOISE);
+
+    ssm_it_states_t *states_inc = nav->states_inc;
+
+    double _r[{{ step.caches|length }}];
+
+    {% if step.sf %}
+    double _sf[{{ step.sf|length }}];{% endif %}
+
+    {% if is_diff %}
+    int i;
+    ssm_it_states_t *states_diff = nav->states_diff;
+    double diffed[states_diff->length];
+    int is_diff = ! (nav->noises_off & SSM_NO_DIFF);
+
+    for(i=0; i<states_diff->length; i++){
+        ssm_state_t *p = states_diff->p[i];
+        if(is_diff){
+            diffed[i] = p->f_inv(X[p->offset]);
+        } else {
+            diffed[i] = gsl_vector_get(par, p->ic->offset);
+        }
+    }
+    {% endif %}
+
+    memset(a, 0, n_X * sizeof (double));
+    memset(g, 0, n_X * {{ sde.dw|length }} * sizeof (double));
+
+    /* caches */
+    {% for sf in step.sf %}
+    _sf[{{ loop.index0 }}] = {{ sf }};{% endfor %}
+
+    {% for cache in step.caches %}
+    _r[{{ loop.index0 }}] = {{ cache }};{% endfor %}
+
+    /* drift */
+    {% for eq in step.func.ode.proc.system %}
+    a[{{ eq.index }}] = {{ eq.eq }};{% endfor %}
+
+    {% for eq in step.func.ode.obs %}
+    a[states_inc->p[{{ eq.index }}]->offset] = {{ eq.eq }};{% endfor %}
+
+    /* diffusion */
+    {% for d in sde.diffusion %}
+    if ({% if d.j < sde.n_dem %}dem{% else %}env{% endif %}) {
+        g[({{ d.target }})*{{ sde.dw|length }} + {{ d.j }}] = {{ d.term }};
+    }{% endfor %}
+}
+
+
+/**
+ * Milstein correction (m, [n_X]) of the SDEs at (X, t):
+ * m_x = 0.5 * sum_{j,l} (L^j g_{x,l}) dd[j][l] where L^j is the
+ * derivative along the column j of the diffusion matrix (see
+ * ssm_sde_drift_diffusion()) and dd[j][l] = dW_j dW_l - delta_{j,l} dt
+ * ([n_dw][n_dw], null for the noises switched off). The coefficients
+ * that are not finite (the demographic stochasticity is the square
+ * root of a flux that can be 0) are skipped.
+ */
+void ssm_sde_milstein(const double *X, double t, const double *dd, double *m, ssm_par_t *par, ssm_nav_t *nav, ssm_calc_t *calc)
+{
+    int n_X = nav->states_sv_inc->length + nav->states_diff->length;
+
+    ssm_it_states_t *states_inc = nav->states_inc;
+
+    {% if sde.milstein %}
+    double c;
+    {% endif %}
+
+    {% if is_diff %}
+    int i;
+    ssm_it_states_t *states_diff = nav->states_diff;
+    double diffed[states_diff->length];
+    int is_diff = ! (nav->noises_off & SSM_NO_DIFF);
+
+    for(i=0; i<states_diff->length; i++){
+        ssm_state_t *p = states_diff->p[i];
+        if(is_diff){
+            diffed[i] = p->f_inv(X[p->offset]);
+        } else {
+            diffed[i] = gsl_vector_get(par, p->ic->offset);
+        }
+    }
+    {% endif %}
+
+    memset(m, 0, n_X * sizeof (double));
+
+    {% for coef in sde.milstein %}
+    c = {{ coef.term }};
+    if (gsl_finite(c)) {
+        m[{{ coef.target }}] += 0.5 * c * dd[{{ coef.j * (sde.dw|length) + coef.l }}];
+    }{% endfor %}
+}
+
+/**
+ * Largest time step satisfying the leap condition of Cao, Gillespie
+ * and Petzold (2006) at time t: the expected change (mu*tau) and the
+ * standard deviation of the change (sqrt(sigma2*tau)) of every state
+ * variable x must stay below max(eps*x/g, 1) where g is the highest
+ * order of the reactions x is a reactant of. mu and sigma2 are
+ * computed from the rates of the ODE skeleton.
+ */
+double ssm_psr_leap(ssm_X_t *p_X, double t, double eps, ssm_par_t *par, ssm_nav_t *nav, ssm_calc_t *calc)
+{
+    double *X = p_X->proj;
+    double tau = GSL_POSINF;
+    double mu, sigma2, bound;
+
+    double _r[{{ step.caches|length }}];
+
+    {% if step.sf %}
+    double _sf[{{ step.sf|length }}];{% endif %}
+
+    {% if is_diff %}
+    int i;
+    ssm_it_states_t *states_diff = nav->states_diff;
+    double diffed[states_diff->length];
+    int is_diff = ! (nav->noises_off & SSM_NO_DIFF);
+
+    for(i=0; i<states_diff->length; i++){
+        ssm_state_t *p = states_diff->p[i];
+        if(is_diff){
+            diffed[i] = p->f_inv(X[p->offset]);
+        } else {
+            diffed[i] = gsl_vector_get(par, p->ic->offset);
+        }
+    }
+    {% endif %}
+
+    /* caches */
+    {% for sf in step.sf %}
+    _sf[{{ loop.index0 }}] = {{ sf }};{% endfor %}
+
+    {% for cache in step.caches %}
+    _r[{{ loop.index0 }}] = {{ cache }};{% endfor %}
+
+    {% for s in step.leap %}
+    mu = {{ s.mu }};
+    sigma2 = {{ s.sigma2 }};
+    bound = GSL_MAX(eps*X[ORDER_{{ s.state }}]/{{ s.g }}.0, 1.0);
+    if(mu != 0.0){
+        tau = GSL_MIN(tau, bound/fabs(mu));
+    }
+    if(sigma2 > 0.0){
+        tau = GSL_MIN(tau, bound*bound/sigma2);
+    }
+    {% endfor %}
+
+    return tau;
+}
+
+{% endblock %}
@@ -29,6 +29,8 @@ void ssm_psr_free(ssm_calc_t *calc)
 
 /**
  * stepping functions for Poisson System with stochastic rates (psr)
+ * and for the hybrid implementation (the multinomial and Poisson
+ * draws are made by the samplers of calc)
  */
 void ssm_step_psr(ssm_X_t *p_X, double t, ssm_par_t *par, ssm_nav_t *nav, ssm_calc_t *calc)
 {
@@ -87,7 +89,7 @@ void ssm_step_psr(ssm_X_t *p_X, double t, ssm_par_t *par, ssm_nav_t *nav, ssm_ca
 
     /*3-multinomial drawn (automaticaly generated code)*/
     {% for draw in psr_multinomial %}
-    ssm_ran_multinomial(calc->randgsl, {{ draw.nb_exit }}, (unsigned int) X[ORDER_{{ draw.state }}], calc->prob[ORDER_{{ draw.state }}], calc->inc[ORDER_{{ draw.state }}]);{% endfor %}
+    calc->ran_multinomial(calc->randgsl, {{ draw.nb_exit }}, (unsigned int) X[ORDER_{{ draw.state }}], calc->prob[ORDER_{{ draw.state }}], calc->inc[ORDER_{{ draw.state }}]);{% endfor %}
 
     /*4-update state variables (automaticaly generated code)*/
     //use inc to cache the Poisson draw as thew might be re-used for the incidence computation
@@ -102,4 +104,100 @@ void ssm_step_psr(ssm_X_t *p_X, double t, ssm_par_t *par, ssm_nav_t *nav, ssm_ca
     X[states_inc->p[{{ eq.index }}]->offset] += {{ eq.right_hand_side }};{% endfor %}
 }
 
+
+/**
+ * ssm_step_psr() for the B lanes of ssm_f_prediction_sto_batch():
+ * the states (Y) and the parameters (P) are stored lane-wise ([n][B]).
+ * The caches are loops over the lanes, the probabilities and the
+ * multinomial and Poisson draws are computed lane after lane (in
+ * calc->prob and calc->inc).
+ */
+void ssm_step_psr_batch(double *Y, double t, double dt, int B, const double *P, ssm_nav_t *nav, ssm_calc_t *calc)
+{
+    int b;
+
+    double (*X)[B] = (double (*)[B]) Y;
+    const double (*par)[B] = (const double (*)[B]) P;
+
+    double sum, one_minus_exp_sum;
+
+    ssm_it_states_t *states_inc = nav->states_inc;
+
+    /*0-declaration of noise terms (if any)*/
+    {% for n in white_noise %}
+    double {{ n.name }}[B];{% endfor %}
+
+    double _r[{{ batch.caches|length }}][B];
+    {% if batch.sf %}
+    double _sf[{{ batch.sf|length }}][B];{% endif %}
+
+    {% if is_cov %}
+    //the covariates are the same for every lane
+    int k;
+    double _cov[calc->covariates_length];
+    for(k=0; k<calc->covariates_length; k++){
+        _cov[k] = gsl_spline_eval(calc->spline[k], t, calc->acc[k]);
+    }
+    {% endif %}
+
+    {% if is_diff %}
+    int i;
+    ssm_it_states_t *states_diff = nav->states_diff;
+    double diffed[states_diff->length][B];
+    int is_diff = ! (nav->noises_off & SSM_NO_DIFF);
+
+    for(i=0; i<states_diff->length; i++){
+        ssm_state_t *p = states_diff->p[i];
+        for(b=0; b<B; b++){
+            diffed[i][b] = (is_diff) ? p->f_inv(X[p->offset][b]) : par[p->ic->offset][b];
+        }
+    }
+    {% endif %}
+
+    /*1-generate noise increments (if any) (automaticaly generated code)*/
+    {% if white_noise %}
+    if(nav->noises_off & SSM_NO_WHITE_NOISE){
+        for(b=0; b<B; b++){
+            {% for n in white_noise %}
+            {{ n.name }}[b] = 1.0;{% endfor %}
+        }
+    } else {
+        for(b=0; b<B; b++){
+            {% for n in white_noise %}
+            {{ n.name }}[b] = gsl_ran_gamma(calc->randgsl, (dt)/ pow(par[ORDER_{{ n.sd }}][b], 2), pow(par[ORDER_{{ n.sd }}][b], 2))/dt;{% endfor %}
+        }
+    }
+    {% endif %}
+
+    /*2-generate process increments (automaticaly generated code)*/
+    {% for sf in batch.sf %}
+    for(b=0; b<B; b++){
+        _sf[{{ loop.index0 }}][b] = {{ sf }};
+    }{% endfor %}
+
+    {% for cache in batch.caches %}
+    for(b=0; b<B; b++){
+        _r[{{ loop.index0 }}][b] = {{ cache }};
+    }{% endfor %}
+
+    for(b=0; b<B; b++){
+
+        {{ batch.code }}
+
+        /*3-multinomial drawn (automaticaly generated code)*/
+        {% for draw in psr_multinomial %}
+        calc->ran_multinomial(calc->randgsl, {{ draw.nb_exit }}, (unsigned int) X[ORDER_{{ draw.state }}][b], calc->prob[ORDER_{{ draw.state }}], calc->inc[ORDER_{{ draw.state }}]);{% endfor %}
+
+        /*4-update state variables (automaticaly generated code)*/
+        {% for draw in batch.poisson %}
+        {{ draw }};{% endfor %}
+
+        {{ batch.update_code }}
+
+        /*compute incidence:integral between t and t+1 (automaticaly generated code)*/
+        {% for eq in batch.inc %}
+        X[states_inc->p[{{ eq.index }}]->offset][b] += {{ eq.right_hand_side }};{% endfor %}
+    }
+}
+
 {% endblock %}
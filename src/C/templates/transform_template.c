@@ -117,7 +117,7 @@ static double f_remainder_var_tpl_{{ rem }}(ssm_X_t *p_X, ssm_calc_t *calc, ssm_
 {
     double *X = p_X->proj;
     int m = nav->states_sv_inc->length + nav->states_diff->length;
-    gsl_matrix_const_view Ct = gsl_matrix_const_view_array(&X[m], m, m);
+    const double *Ct = &X[m];
     return {{ var }};
 }
 {% endfor %}
@@ -18,30 +18,109 @@
 
 #include "ssm.h"
 
-int main(int argc, char *argv[])
+static json_t *load_json_str(char *str)
+{
+    json_error_t error;
+    if(str == NULL){
+        ssm_print_err("nothing received from the server");
+        exit(EXIT_FAILURE);
+    }
+
+    json_t *json = json_loads(str, 0, &error);
+    if(!json) {
+        ssm_print_err(error.text);
+        exit(EXIT_FAILURE);
+    }
+    free(str);
+
+    return json;
+}
+
+
+/**
+ * work for a single server (--server): handshake then integrate
+ * the particles (or run whole particle filters if the server
+ * dispatches likelihood evaluations) until the server sends KILL
+ */
+static void run_server(void *context, ssm_options_t *opts)
 {
-    int j, n, t0, t1;
     char str[SSM_STR_BUFFSIZE];
+    int wopts, J;
+    ssm_job_t *job = NULL;
+    ssm_chain_job_t *chain_job = NULL;
 
-    ssm_options_t *opts = ssm_options_new();
-    ssm_options_load(opts, SSM_WORKER, argc, argv);
+    ////////////////////////////////////////////////////////////////
+    // handshake: get everything we need from the server and make //
+    // sure that we integrate the particles the same way it does  //
+    ////////////////////////////////////////////////////////////////
+    void *server_handshake = zmq_socket (context, ZMQ_REQ);
+    snprintf(str, SSM_STR_BUFFSIZE, "tcp://%s:%d", opts->server, 5560);
+    zmq_connect (server_handshake, str);
 
-    json_t *jparameters = ssm_load_json_stream(stdin);
-    json_t *jdata = ssm_load_data(opts);
-    opts->J = 1;
+    ssm_zmq_send_str(server_handshake, "MANIFEST", 0);
+    char *str_manifest = ssm_zmq_recv_str(server_handshake);
+    ssm_manifest_t *manifest = ssm_manifest_loads(str_manifest);
+    free(str_manifest);
+    if(!manifest){
+        ssm_print_err("handshake with the server failed (invalid manifest)");
+        exit(EXIT_FAILURE);
+    }
+    ssm_manifest2options(opts, manifest);
 
-    ssm_nav_t *nav = ssm_nav_new(jparameters, opts);
-    ssm_data_t *data = ssm_data_new(jdata, nav, opts);
-    ssm_fitness_t *fitness = ssm_fitness_new(data, opts);
-    ssm_calc_t *calc = ssm_calc_new(jdata, nav, data, fitness, opts, 0);
-    ssm_X_t *X = ssm_X_new(nav, opts);
+    ssm_zmq_send_str(server_handshake, "PARAMETERS", 0);
+    json_t *jparameters = load_json_str(ssm_zmq_recv_str(server_handshake));
 
+    ssm_zmq_send_str(server_handshake, "WOPTS", 0);
+    char *str_wopts = ssm_zmq_recv_str(server_handshake);
+    if(!str_wopts || sscanf(str_wopts, "%d %d", &wopts, &J) != 2){
+        ssm_print_err("invalid work options sent by the server");
+        exit(EXIT_FAILURE);
+    }
+    free(str_wopts);
+
+    //use the local data only if they are the same as the one of the server
+    json_t *jdata = NULL;
+    char hash[SSM_HASH_BUFFSIZE];
+    if(access(".data.json", R_OK) == 0){
+        jdata = ssm_load_data(opts);
+        ssm_hash_data(hash, jdata);
+        if(strcmp(hash, manifest->data) != 0){
+            json_decref(jdata);
+            jdata = NULL;
+        }
+    }
+
+    if(!jdata){
+        ssm_zmq_send_str(server_handshake, "DATA", 0);
+        jdata = load_json_str(ssm_zmq_recv_str(server_handshake));
+    }
+
+    ssm_manifest_t *local;
+    if(wopts & SSM_WORKER_CHAIN){
+        opts->J = J;
+        chain_job = ssm_chain_job_new(jparameters, jdata, opts);
+        local = chain_job->manifest;
+    } else {
+        job = ssm_job_new(jparameters, jdata, (ssm_worker_opt_t) wopts, opts);
+        local = job->manifest;
+    }
     json_decref(jdata);
 
-    ssm_input_t *input = ssm_input_new(jparameters, nav);
-    ssm_par_t *par = ssm_par_new(input, calc, nav);
+    if(strcmp(local->model, manifest->model) != 0){
+        ssm_print_err("the model of the worker differs from the one of the server");
+        exit(EXIT_FAILURE);
+    }
 
-    void *context = zmq_ctx_new();
+    snprintf(str, SSM_STR_BUFFSIZE, "READY %s", local->hash);
+    ssm_zmq_send_str(server_handshake, str, 0);
+    char *str_ready = ssm_zmq_recv_str(server_handshake);
+    if(!str_ready || strcmp(str_ready, "OK") != 0){
+        ssm_print_err("handshake with the server failed (manifest mismatch)");
+        exit(EXIT_FAILURE);
+    }
+    free(str_ready);
+    ssm_manifest_free(manifest);
+    zmq_close (server_handshake);
 
     // Socket to server controller
     void *server_controller = zmq_socket (context, ZMQ_SUB);
@@ -58,8 +137,6 @@ int main(int argc, char *argv[])
     void *server_sender = zmq_socket (context, ZMQ_PUSH);
     snprintf(str, SSM_STR_BUFFSIZE, "tcp://%s:%d", opts->server, 5558);
     zmq_connect (server_sender, str);
-   
-    ssm_f_pred_t f_pred = ssm_get_f_pred(nav);
 
     zmq_pollitem_t items [] = {
         { server_receiver, 0, ZMQ_POLLIN, 0 },
@@ -69,34 +146,11 @@ int main(int argc, char *argv[])
     while (1) {
         zmq_poll (items, 2, -1);
         if (items [0].revents & ZMQ_POLLIN) {
-	    
-            //get a particle from the server
-	    zmq_recv(server_receiver, &n, sizeof (int), 0);
-	    ssm_zmq_recv_par(par, server_receiver);
-	    zmq_recv(server_receiver, &j, sizeof (int), 0);
-	    //printf("j: %d j %d\n", j, j);
-	    ssm_zmq_recv_X(X, server_receiver);
-	    zmq_recv(server_receiver, &(fitness->cum_status[0]), sizeof (ssm_err_code_t), 0);
-
-	    //do the computations..
-            t0 = (n) ? data->rows[n-1]->time: 0;
-            t1 = data->rows[n]->time;
-	    ssm_X_reset_inc(X, data->rows[n], nav);
-	    fitness->cum_status[0] |= (*f_pred)(X, t0, t1, par, nav, calc);
-	    if((opts->worker_algo != SSM_SIMUL) && data->rows[n]->ts_nonan_length) {
-		fitness->weights[0] = (fitness->cum_status[0] == SSM_SUCCESS) ?  exp(ssm_log_likelihood(data->rows[n], X, par, calc, nav, fitness)) : 0.0;
-		fitness->cum_status[0] = SSM_SUCCESS;
-	    }
-
-	    //send results
-	    zmq_send(server_sender, &j, sizeof (int), ZMQ_SNDMORE);    
-	    ssm_zmq_send_X(server_sender, X, ZMQ_SNDMORE);
-	    if(opts->worker_algo != SSM_SIMUL){
-		zmq_send(server_sender, &(fitness->weights[0]), sizeof (double), ZMQ_SNDMORE);
-	    }
-	    zmq_send(server_sender, &(fitness->cum_status[0]), sizeof (ssm_err_code_t), 0);
-	    //printf("j: %d j %d sent back\n", j, j);
-
+            if(chain_job){
+                ssm_chain_job_eval(chain_job, server_receiver, server_sender);
+            } else {
+                ssm_job_integrate(job, server_receiver, server_sender);
+            }
         }
 
         //controller commands:
@@ -114,16 +168,178 @@ int main(int argc, char *argv[])
     zmq_close (server_sender);
     zmq_close (server_controller);
 
-    ssm_X_free(X);
-    ssm_calc_free(calc, nav);
-    ssm_data_free(data);
-    ssm_fitness_free(fitness);
+    if(chain_job){
+        ssm_chain_job_free(chain_job);
+    } else {
+        ssm_job_free(job);
+    }
+}
+
+
+/**
+ * does the job described by manifest and jparameters use the model
+ * compiled in this binary? (checked before building the job:
+ * the data and the calc of another model can't be loaded)
+ */
+static int _ssm_worker_same_model(json_t *jparameters, ssm_manifest_t *manifest, ssm_options_t *opts)
+{
+    char hash[SSM_HASH_BUFFSIZE];
+
+    if(manifest->implementation != opts->implementation){
+        return 0;
+    }
 
+    ssm_nav_t *nav = ssm_nav_new(jparameters, opts);
+    ssm_hash_model(hash, nav);
     ssm_nav_free(nav);
-    ssm_input_free(input);
-    ssm_par_free(par);
+
+    return (strcmp(hash, manifest->model) == 0);
+}
+
+
+/**
+ * work for the pool of a broker (--broker): the broker sends the
+ * jobs (manifest, parameters, data) of the servers it dispatches
+ * the particles of, followed by their particles. A heartbeat is sent
+ * every SSM_BROKER_HEARTBEAT ms while idle so that the broker can
+ * detect the workers that died.
+ */
+static void run_broker(void *context, ssm_options_t *opts)
+{
+    int i;
+    char str[SSM_STR_BUFFSIZE];
+    char identity[SSM_STR_BUFFSIZE];
+    ssm_job_t *job = NULL;
+
+    void *broker = zmq_socket (context, ZMQ_DEALER);
+    ssm_zmq_identity(identity, opts->id);
+    zmq_setsockopt (broker, ZMQ_IDENTITY, identity, strlen(identity));
+    snprintf(str, SSM_STR_BUFFSIZE, "tcp://%s:%d", opts->broker, SSM_BROKER_PORT_BACKEND);
+    zmq_connect (broker, str);
+
+    for(i=0; i<SSM_BROKER_PREFETCH; i++){
+        ssm_zmq_send_str(broker, "READY", 0);
+    }
+
+    zmq_pollitem_t items [] = {
+        { broker, 0, ZMQ_POLLIN, 0 }
+    };
+
+    while (1) {
+        zmq_poll (items, 1, SSM_BROKER_HEARTBEAT);
+        if (!(items [0].revents & ZMQ_POLLIN)) {
+            ssm_zmq_send_str(broker, "HEARTBEAT", 0);
+            continue;
+        }
+
+        char *cmd = ssm_zmq_recv_str(broker);
+        if(!cmd){ //context terminated
+            break;
+        }
+
+        if(strcmp(cmd, "WORK") == 0) {
+            char *master = ssm_zmq_recv_str(broker);
+            if(!master || !job){ //context terminated or no job loaded: leave, the broker resends the particles of the workers it lost
+                if(master){
+                    ssm_print_warning("particle sent by the broker without a job loaded");
+                }
+                free(master);
+                free(cmd);
+                break;
+            }
+            ssm_zmq_send_str(broker, "DONE", ZMQ_SNDMORE);
+            zmq_send(broker, master, strlen(master), ZMQ_SNDMORE);
+            ssm_job_integrate(job, broker, broker);
+            free(master);
+
+        } else if(strcmp(cmd, "JOB") == 0) {
+            int wopts;
+            char *str_manifest = ssm_zmq_recv_str(broker);
+            char *str_parameters = ssm_zmq_recv_str(broker);
+            char *str_data = ssm_zmq_recv_str(broker);
+            zmq_recv(broker, &wopts, sizeof (int), 0);
+
+            ssm_manifest_t *manifest = ssm_manifest_loads(str_manifest);
+            free(str_manifest);
+
+            if(job){
+                ssm_job_free(job);
+                job = NULL;
+            }
+
+            if(!manifest || !str_parameters || !str_data){ //the broker uses the hash of the job it sent
+                ssm_zmq_send_str(broker, "MISMATCH", 0);
+                if(opts->print & SSM_PRINT_WARNING){
+                    ssm_print_warning("invalid job sent by the broker");
+                }
+                if(manifest){
+                    ssm_manifest_free(manifest);
+                }
+                free(str_parameters);
+                free(str_data);
+                free(cmd);
+                continue;
+            }
+
+            json_t *jparameters = load_json_str(str_parameters);
+
+            if(manifest->implementation == opts->implementation){
+                ssm_manifest2options(opts, manifest);
+            }
+
+            if(_ssm_worker_same_model(jparameters, manifest, opts)){
+                json_t *jdata = load_json_str(str_data);
+                job = ssm_job_new(jparameters, jdata, (ssm_worker_opt_t) wopts, opts);
+                json_decref(jdata);
+
+                if(strcmp(job->manifest->hash, manifest->hash) != 0){
+                    ssm_job_free(job);
+                    job = NULL;
+                }
+            } else {
+                json_decref(jparameters);
+                free(str_data);
+            }
+
+            snprintf(str, SSM_STR_BUFFSIZE, "%s %s", (job) ? "LOADED": "MISMATCH", manifest->hash);
+            ssm_zmq_send_str(broker, str, 0);
+            if(!job && (opts->print & SSM_PRINT_WARNING)){
+                ssm_print_warning("could not load a job sent by the broker (different model or implementation)");
+            }
+            ssm_manifest_free(manifest);
+
+        } else if(strcmp(cmd, "KILL") == 0) {
+            free(cmd);
+            break;
+        }
+
+        free(cmd);
+    }
+
+    zmq_close (broker);
+
+    if(job){
+        ssm_job_free(job);
+    }
+}
+
+
+int main(int argc, char *argv[])
+{
+    ssm_options_t *opts = ssm_options_new();
+    ssm_options_load(opts, SSM_WORKER, argc, argv);
+    opts->J = 1;
+
+    void *context = zmq_ctx_new();
+
+    if(strlen(opts->broker)){
+        run_broker(context, opts);
+    } else {
+        run_server(context, opts);
+    }
 
     zmq_ctx_destroy(context);
+    ssm_options_free(opts);
 
     return 0;
 }
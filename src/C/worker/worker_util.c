@@ -45,3 +45,237 @@ void ssm_zmq_recv_X(ssm_X_t *X, void *socket)
     //proj
     zmq_recv(socket, X->proj, X->length * sizeof (double), 0);
 }
+
+/**
+ * send a '\0' terminated string
+ */
+void ssm_zmq_send_str(void *socket, const char *str, int zmq_options)
+{
+    zmq_send(socket, str, strlen(str) + 1, zmq_options);
+}
+
+/**
+ * receive a string of arbitrary length (to be freed by the
+ * caller). Returns NULL if the zmq context has been terminated.
+ */
+char *ssm_zmq_recv_str(void *socket)
+{
+    zmq_msg_t msg;
+    zmq_msg_init(&msg);
+
+    if(zmq_msg_recv(&msg, socket, 0) == -1){
+        zmq_msg_close(&msg);
+        return NULL;
+    }
+
+    size_t size = zmq_msg_size(&msg);
+    char *str = malloc((size + 1) * sizeof (char));
+    if(str == NULL){
+        ssm_print_err("allocation impossible for zmq string");
+        exit(EXIT_FAILURE);
+    }
+
+    memcpy(str, zmq_msg_data(&msg), size);
+    str[size] = '\0';
+    zmq_msg_close(&msg);
+
+    return str;
+}
+
+/**
+ * identity used to address a socket through a broker: <hostname>:<pid>:<id>
+ */
+void ssm_zmq_identity(char *dest, int id)
+{
+    char hostname[SSM_STR_BUFFSIZE];
+    if(gethostname(hostname, SSM_STR_BUFFSIZE) != 0){
+        strncpy(hostname, "localhost", SSM_STR_BUFFSIZE);
+    }
+    hostname[SSM_STR_BUFFSIZE-1] = '\0';
+
+    snprintf(dest, SSM_STR_BUFFSIZE, "%s:%d:%d", hostname, (int) getpid(), id);
+}
+
+
+/**
+ * build everything needed to integrate the particles of a server.
+ * opts must already be set to the server values (see
+ * ssm_manifest2options()). The job steals the reference to
+ * jparameters.
+ */
+ssm_job_t *ssm_job_new(json_t *jparameters, json_t *jdata, ssm_worker_opt_t wopts, ssm_options_t *opts)
+{
+    ssm_job_t *job = malloc(sizeof (ssm_job_t));
+    if (job == NULL) {
+        ssm_print_err("Allocation impossible for ssm_job_t *");
+        exit(EXIT_FAILURE);
+    }
+
+    job->wopts = wopts;
+    job->jparameters = jparameters;
+
+    job->nav = ssm_nav_new(jparameters, opts);
+    job->data = ssm_data_new(jdata, job->nav, opts);
+    job->fitness = ssm_fitness_new(job->data, opts);
+    job->calc = ssm_calc_new(jdata, job->nav, job->data, job->fitness, opts, 0);
+    job->X = ssm_X_new(job->nav, opts);
+
+    job->input = ssm_input_new(jparameters, job->nav);
+    job->par = ssm_par_new(job->input, job->calc, job->nav);
+
+    job->f_pred = ssm_get_f_pred(job->nav);
+    job->manifest = ssm_manifest_new(jdata, job->nav, opts);
+
+    return job;
+}
+
+
+void ssm_job_free(ssm_job_t *job)
+{
+    ssm_manifest_free(job->manifest);
+    ssm_par_free(job->par);
+    ssm_input_free(job->input);
+    ssm_X_free(job->X);
+    ssm_calc_free(job->calc, job->nav);
+    ssm_fitness_free(job->fitness);
+    ssm_data_free(job->data);
+    ssm_nav_free(job->nav);
+    json_decref(job->jparameters);
+
+    free(job);
+}
+
+
+/**
+ * receive a particle, integrate it to the next data point and send
+ * the results back. With a broker, the caller has already sent the
+ * routing frames on the sender socket.
+ */
+void ssm_job_integrate(ssm_job_t *job, void *receiver, void *sender)
+{
+    int j, n, t0, t1;
+
+    ssm_data_t *data = job->data;
+    ssm_fitness_t *fitness = job->fitness;
+
+    //get a particle from the server
+    zmq_recv(receiver, &n, sizeof (int), 0);
+    ssm_zmq_recv_par(job->par, receiver);
+    zmq_recv(receiver, &j, sizeof (int), 0);
+    ssm_zmq_recv_X(job->X, receiver);
+    zmq_recv(receiver, &(fitness->cum_status[0]), sizeof (ssm_err_code_t), 0);
+
+    //do the computations..
+    t0 = (n) ? data->rows[n-1]->time: 0;
+    t1 = data->rows[n]->time;
+    ssm_X_reset_inc(job->X, data->rows[n], job->nav);
+    fitness->cum_status[0] |= (*job->f_pred)(job->X, t0, t1, job->par, job->nav, job->calc);
+    if((job->wopts & SSM_WORKER_FITNESS) && data->rows[n]->ts_nonan_length) {
+        fitness->weights[0] = (fitness->cum_status[0] == SSM_SUCCESS) ?  exp(ssm_log_likelihood(data->rows[n], job->X, job->par, job->calc, job->nav, fitness)) : 0.0;
+        fitness->cum_status[0] = SSM_SUCCESS;
+    }
+
+    //send results
+    zmq_send(sender, &j, sizeof (int), ZMQ_SNDMORE);
+    ssm_zmq_send_X(sender, job->X, ZMQ_SNDMORE);
+    if(job->wopts & SSM_WORKER_FITNESS){
+        zmq_send(sender, &(fitness->weights[0]), sizeof (double), ZMQ_SNDMORE);
+    }
+    zmq_send(sender, &(fitness->cum_status[0]), sizeof (ssm_err_code_t), 0);
+}
+
+
+/**
+ * build everything needed to run whole particle filters (of opts->J
+ * particles) for a server (SSM_WORKER_CHAIN). opts must already be
+ * set to the server values. The job steals the reference to
+ * jparameters.
+ */
+ssm_chain_job_t *ssm_chain_job_new(json_t *jparameters, json_t *jdata, ssm_options_t *opts)
+{
+    ssm_chain_job_t *job = malloc(sizeof (ssm_chain_job_t));
+    if (job == NULL) {
+        ssm_print_err("Allocation impossible for ssm_chain_job_t *");
+        exit(EXIT_FAILURE);
+    }
+
+    job->jparameters = jparameters;
+
+    job->nav = ssm_nav_new(jparameters, opts);
+    job->data = ssm_data_new(jdata, job->nav, opts);
+    job->fitness = ssm_fitness_new(job->data, opts);
+    job->calc = ssm_N_calc_new(jdata, job->nav, job->data, job->fitness, opts);
+    job->D_J_X = ssm_D_J_X_new(job->data, job->fitness, job->nav, opts);
+    job->D_J_X_tmp = ssm_D_J_X_new(job->data, job->fitness, job->nav, opts);
+    job->D_X = ssm_D_X_new(job->data, job->nav, opts);
+
+    job->input = ssm_input_new(jparameters, job->nav);
+    job->par = ssm_par_new(job->input, job->calc[0], job->nav);
+
+    job->f_pred = ssm_get_f_pred(job->nav);
+    job->manifest = ssm_manifest_new(jdata, job->nav, opts);
+
+    //the particles of each filter can still be dispatched across the threads of the worker
+    job->workers = ssm_workers_start(jparameters, jdata, job->D_J_X, &job->par, job->data, job->calc, job->fitness, job->f_pred, job->nav, opts, SSM_WORKER_D_X | SSM_WORKER_FITNESS);
+
+    return job;
+}
+
+
+void ssm_chain_job_free(ssm_chain_job_t *job)
+{
+    ssm_workers_stop(job->workers);
+
+    ssm_manifest_free(job->manifest);
+    ssm_par_free(job->par);
+    ssm_input_free(job->input);
+    ssm_D_X_free(job->D_X, job->data);
+    ssm_D_J_X_free(job->D_J_X_tmp, job->data, job->fitness);
+    ssm_D_J_X_free(job->D_J_X, job->data, job->fitness);
+    ssm_N_calc_free(job->calc, job->nav);
+    ssm_fitness_free(job->fitness);
+    ssm_data_free(job->data);
+    ssm_nav_free(job->nav);
+    json_decref(job->jparameters);
+
+    free(job);
+}
+
+
+/**
+ * receive parameters, run a particle filter and send back the log
+ * likelihood (and a sampled trajectory if requested). See
+ * ssm_workers_eval() for the server side.
+ */
+void ssm_chain_job_eval(ssm_chain_job_t *job, void *receiver, void *sender)
+{
+    int i, j, n, flag_traj;
+    ssm_err_code_t status;
+
+    ssm_data_t *data = job->data;
+    ssm_fitness_t *fitness = job->fitness;
+    ssm_X_t ***D_J_X = job->D_J_X;
+
+    zmq_recv(receiver, &i, sizeof (int), 0);
+    ssm_zmq_recv_par(job->par, receiver);
+    zmq_recv(receiver, &flag_traj, sizeof (int), 0);
+
+    ssm_par2X(D_J_X[0][0], job->par, job->calc[0], job->nav);
+    D_J_X[0][0]->dt = D_J_X[0][0]->dt0;
+    for(j=1; j<fitness->J; j++){
+        ssm_X_copy(D_J_X[0][j], D_J_X[0][0]);
+    }
+
+    status = ssm_run_smc(job->f_pred, D_J_X, job->D_J_X_tmp, job->par, job->calc, data, fitness, job->nav, job->workers);
+
+    zmq_send(sender, &i, sizeof (int), ZMQ_SNDMORE);
+    zmq_send(sender, &status, sizeof (ssm_err_code_t), ZMQ_SNDMORE);
+    zmq_send(sender, &(fitness->log_like), sizeof (double), (flag_traj && data->n_obs) ? ZMQ_SNDMORE: 0);
+
+    if(flag_traj && data->n_obs){
+        ssm_sample_traj(job->D_X, D_J_X, job->calc[0], data, fitness);
+        for(n=0; n<data->n_obs; n++){
+            ssm_zmq_send_X(sender, job->D_X[n+1], (n+1 < data->n_obs) ? ZMQ_SNDMORE: 0);
+        }
+    }
+}
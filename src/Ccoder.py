@@ -17,6 +17,9 @@
 #########################################################################
 
 import copy
+import re
+from sympy import diff, Symbol, sympify
+from sympy.printing import ccode
 from Cmodel import Cmodel
 
 class SsmError(Exception):
@@ -110,7 +113,7 @@ class Ccoder(Cmodel):
                         if x_i != rem and x_j != rem :
                             if eq != '':
                                 eq += ' + '
-                            eq += 'gsl_matrix_get(&Ct.matrix,' + str(self.order_states[x_i]) +','  + str(self.order_states[x_j]) + ')';
+                            eq += 'ssm_kalman_Ct_get(Ct, m, ' + str(self.order_states[x_i]) +', '  + str(self.order_states[x_j]) + ')';
                 f_remainders_var[rem] = eq;
 
         # Initial compartment sizes in cases of no remainder
@@ -350,7 +353,7 @@ class Ccoder(Cmodel):
                 if 'white_noise' in reac_from_univ[nbreac]:
                     myrate = '({0})*{1}'.format(myrate, reac_from_univ[nbreac]['white_noise']['name'])
 
-                poisson.append('calc->inc[ORDER_{0}][{1}] = gsl_ran_poisson(calc->randgsl, ({2})*dt)'.format(s, nbreac, myrate))
+                poisson.append('calc->inc[ORDER_{0}][{1}] = calc->ran_poisson(calc->randgsl, ({2})*dt)'.format(s, nbreac, myrate))
                 incDict[reac_from_univ[nbreac]['to']] += ' + calc->inc[ORDER_{0}][{1}]'.format(s, nbreac)
 
         Cstring=''
@@ -396,6 +399,62 @@ class Ccoder(Cmodel):
 
 
 
+    def gillespie(self):
+        """
+        Reactions of the exact (next reaction method) implementation:
+        propensity, state and incidence updates of each reaction and
+        dependency graph (the reactions whose propensity has to be
+        recomputed after each firing).
+
+        The terms that depend on time (covariates, diffusions and
+        white noises) are frozen over each time step by
+        ssm_gillespie_freeze() so that they are read from the
+        ssm_gillespie_t workspace (gil).
+        """
+
+        univ = ['U'] + self.remainder
+        noises = [x['name'] for x in self.white_noise]
+
+        def freeze(term):
+            term = re.sub(r'gsl_spline_eval\(calc->spline\[(\w+)\],t,calc->acc\[\w+\]\)', r'gil->cov[\1]', term)
+            term = re.sub(r'\bdiffed\[', 'gil->diffed[', term)
+            for i, noise in enumerate(noises):
+                term = re.sub(r'\b{0}\b'.format(noise), 'gil->noise[{0}]'.format(i), term)
+            return term
+
+        reactions = []
+        depends = [] #states of the propensity of each reaction
+        for r in self.proc_model:
+            rate = self.make_C_term(r['rate'], True)
+            if 'white_noise' in r:
+                rate = '({0})*{1}'.format(rate, r['white_noise']['name'])
+
+            if r['from'] in univ:
+                propensity = freeze(rate)
+            else:
+                propensity = '({0})*X[ORDER_{1}]'.format(freeze(rate), r['from'])
+
+            update = []
+            if r['from'] not in univ:
+                update.append('X[ORDER_{0}] -= 1.0'.format(r['from']))
+            if r['to'] not in univ:
+                update.append('X[ORDER_{0}] += 1.0'.format(r['to']))
+
+            #incidences tracking the reaction (same matching as in self.step_psr_inc())
+            for i, inc in enumerate(self.par_inc_def):
+                if isinstance(inc[0], dict) and any([(x['from'] == r['from'] and x['to'] == r['to'] and x['rate'] == r['rate']) for x in inc]):
+                    update.append('X[states_inc->p[{0}]->offset] += 1.0'.format(i))
+
+            reactions.append({'propensity': propensity, 'update': update})
+            depends.append(set([x for x in self.change_user_input(r['rate']) if x in self.par_sv] + ([r['from']] if r['from'] not in univ else [])))
+
+        for i, r in enumerate(self.proc_model):
+            changed = set([x for x in [r['from'], r['to']] if x not in univ])
+            reactions[i]['dep'] = [j for j in range(len(self.proc_model)) if j == i or (depends[j] & changed)]
+
+        return {'reactions': reactions, 'white_noise': self.white_noise}
+
+
     def step_ode_sde(self):
         """
         Generates ODE and SDEs
@@ -537,7 +596,209 @@ class Ccoder(Cmodel):
             func['full']['obs'].append({'index': myobs['index'], 'eq': '({0})*dt + {1} {2}'.format(eq, dem, env)})
 
 
-        return {'func': func, 'caches': caches, 'sf': sf}
+        ##########################################################################
+        ##mean (mu) and variance (sigma2) of the change of each state variable per
+        ##unit of time and highest order (g) of the reactions it is a reactant of:
+        ##leap condition of Cao, Gillespie and Petzold (2006) (see ssm_psr_leap())
+        ##########################################################################
+        univ = ['U'] + self.remainder
+        leap = []
+        for s in self.par_sv:
+            eq, dem, env = eq_dem_env(odeDict[s])
+
+            g = 1
+            for r in proc_model:
+                reactants = set([x for x in self.change_user_input(r['rate']) if x in self.par_sv] + ([r['from']] if r['from'] not in univ else []))
+                if s in reactants:
+                    g = max(g, len(reactants))
+
+            leap.append({'state': s,
+                         'mu': eq or '0.0',
+                         'sigma2': ' + '.join(['({0})'.format(x['term']) for x in odeDict[s]]) or '0.0',
+                         'g': g})
+
+        ##all the noises of the SDEs (Brownian increments) in the order of calc->_dw (see ssm_f_prediction_sde_adapt())
+        dw = dem_sto_id + unique_noises_id
+
+        return {'func': func, 'caches': caches, 'sf': sf, 'leap': leap, 'dw': dw}
+
+
+    def make_C_directional_derivative(self, term, direction):
+        """
+        ssm C expression of the derivative of term along the vector
+        field direction (dict state variable: term), that is
+        sum_x direction[x] * d(term)/dx (None if it is null)
+        """
+
+        def safe(t):
+            return ''.join([('ssm___' + r if r in self.all_par else r) for r in self.change_user_input(t)])
+
+        pterm = sympify(safe(term))
+        dterm = 0
+        for x in direction:
+            dterm += sympify(safe(direction[x])) * diff(pterm, Symbol(str('ssm___' + x)))
+
+        if dterm == 0:
+            return None
+
+        return self.generator_C(ccode(dterm).replace('ssm___', ''), True)
+
+
+    def sde_diffusion(self, step):
+        """
+        Diffusion matrix of the SDEs (one column per Brownian increment
+        of calc->_dw, see self.step_ode_sde()) and coefficients of the
+        Milstein correction for ssm_f_prediction_sde_milstein() and
+        ssm_f_prediction_sde_srk15(). The drift is the ODE of step
+        (output of self.step_ode_sde()).
+
+        The rows are the state variables and the incidences. The
+        Milstein correction of row x is
+        0.5*sum_{j,l} (L^j g_{x,l}) (dW_j dW_l - delta_{j,l} dt) where
+        L^j g_{x,l} is the derivative of g_{x,l} along the column j
+        (the Levy areas are neglected: strong order 1 for commutative
+        noises only).
+        """
+
+        univ = ['U'] + self.remainder
+        dw = step['dw']
+        n_dem = len(self.proc_model)
+
+        rows = [{'state': s, 'target': 'ORDER_{0}'.format(s), 'g': {}} for s in self.par_sv]
+        rows += [{'state': None, 'target': 'states_inc->p[{0}]->offset'.format(i), 'g': {}} for i in range(len(self.par_inc_def))]
+
+        def add(row, j, term):
+            row['g'][j] = row['g'].get(j, '') + term
+
+        for i, r in enumerate(self.proc_model):
+            flux = '({0})*{1}'.format(r['rate'], r['from']) if r['from'] not in univ else '({0})'.format(r['rate'])
+
+            cols = [(i, 'sqrt({0})'.format(flux))]
+            if 'white_noise' in r:
+                cols.append((n_dem + [x['name'] for x in self.white_noise].index(r['white_noise']['name']), '({0})*({1})'.format(flux, r['white_noise']['sd'])))
+
+            for j, term in cols:
+                if r['from'] not in univ:
+                    add(rows[self.par_sv.index(r['from'])], j, ' - ' + term)
+                if r['to'] not in univ:
+                    add(rows[self.par_sv.index(r['to'])], j, ' + ' + term)
+
+                #incidences tracking the reaction (same matching as in self.step_ode_sde())
+                for k, inc in enumerate(self.par_inc_def):
+                    if isinstance(inc[0], dict):
+                        for x in inc:
+                            if x['from'] == r['from'] and x['to'] == r['to'] and x['rate'] == r['rate']:
+                                add(rows[len(self.par_sv) + k], j, ' + ' + term)
+
+        diffusion = []
+        milstein = []
+        for row in rows:
+            for j in sorted(row['g']):
+                diffusion.append({'target': row['target'], 'j': j, 'term': self.make_C_term(row['g'][j], True)})
+
+            for j in range(len(dw)):
+                direction = dict([(x['state'], x['g'][j]) for x in rows if x['state'] and j in x['g']])
+                if not direction:
+                    continue
+                for l in sorted(row['g']):
+                    term = self.make_C_directional_derivative(row['g'][l], direction)
+                    if term:
+                        milstein.append({'target': row['target'], 'j': j, 'l': l, 'term': term})
+
+        return {'dw': dw, 'n_dem': n_dem, 'diffusion': diffusion, 'milstein': milstein}
+
+
+    def lane(self, term, noises=[]):
+        """
+        Lane-wise version of the C expression term for the batch
+        (B particles per call) stepping functions: states, parameters,
+        caches and noises become [n][B] (or [B]) arrays indexed by the
+        lane b and the covariates (identical for every lane) are
+        interpolated once in _cov
+        """
+
+        term = re.sub(r'gsl_spline_eval\(calc->spline\[(\w+)\],t,calc->acc\[\w+\]\)', r'_cov[\1]', term)
+        term = re.sub(r'gsl_vector_get\(par,(\w+)\)', r'par[\1][b]', term)
+        term = re.sub(r'\b(X|diffed|_r|_sf)\[(\w+)\]', r'\1[\2][b]', term)
+        for noise in noises:
+            term = re.sub(r'\b{0}\b'.format(noise), noise + '[b]', term)
+
+        return term
+
+
+    def step_ode_batch(self, step):
+        """
+        Lane-wise version of the ODE of step (output of
+        self.step_ode_sde()) for ssm_step_ode_batch()
+        """
+
+        ode = step['func']['ode']
+
+        return {
+            'sf': [self.lane(x) for x in step['sf']],
+            'caches': [self.lane(x) for x in step['caches']],
+            'system': [{'index': x['index'], 'eq': self.lane(x['eq'])} for x in ode['proc']['system']],
+            'obs': [{'index': x['index'], 'eq': self.lane(x['eq'])} for x in ode['obs']]
+        }
+
+
+    def step_sde_batch(self, step):
+        """
+        Lane-wise version of the SDEs of step (output of
+        self.step_ode_sde()) for ssm_step_sde_batch_*()
+        """
+
+        func = {}
+        for noises_off, f in step['func'].items():
+            if noises_off != 'ode':
+                noises = f['proc']['noises']
+                func[noises_off] = {
+                    'noises': noises,
+                    'system': [{'index': x['index'], 'eq': self.lane(x['eq'], noises)} for x in f['proc']['system']],
+                    'obs': [{'index': x['index'], 'eq': self.lane(x['eq'], noises)} for x in f['obs']]
+                }
+
+        return {
+            'sf': [self.lane(x) for x in step['sf']],
+            'caches': [self.lane(x) for x in step['caches']],
+            'func': func
+        }
+
+
+    def step_psr_batch(self, step, step_inc):
+        """
+        Lane-wise version of the psr step (output of self.step_psr()
+        and self.step_psr_inc()) for ssm_step_psr_batch(). Only the
+        caches and the noises are lane-wise arrays: the probabilities
+        and the multinomial and Poisson draws (calc->prob and
+        calc->inc) are computed lane after lane.
+        """
+
+        noises = [x['name'] for x in self.white_noise]
+
+        return {
+            'sf': [self.lane(x, noises) for x in step['sf']],
+            'caches': [self.lane(x, noises) for x in step['caches']],
+            'code': self.lane(step['code'], noises),
+            'poisson': [self.lane(x, noises) for x in step['poisson']],
+            'update_code': self.lane(step['update_code'], noises),
+            'inc': [{'index': x['index'], 'right_hand_side': self.lane(x['right_hand_side'], noises)} for x in step_inc]
+        }
+
+
+    def compute_diff_batch(self, diff):
+        """
+        Lane-wise version of the diffusions (output of
+        self.compute_diff()) for ssm_compute_diff_batch()
+        """
+
+        if not diff:
+            return []
+
+        return {
+            'n_browns': diff['n_browns'],
+            'terms': [re.sub(r'\b_w\[(\w+)\]', r'_w[\1][b]', self.lane(x)) for x in diff['terms']]
+        }
 
 
     def compute_diff(self):
@@ -708,6 +969,63 @@ class Ccoder(Cmodel):
                 'caches_jac_only': caches_jac_only}
 
 
+    def ekf_sparsity(self, jac, Q):
+        """structure of the non null terms of the jacobian matrix (Ft)
+        and of the diffusion matrix (Q) of the EKF, using the
+        offsets of the states in X (see self.order_states). It is
+        used by ssm_step_ekf to compute Ft*Ct and add Q without
+        going through the (structural) zeros.
+
+        jac: output of self.jac()
+        Q: output of self.eval_Q()
+        """
+
+        m = len(self.par_sv) + len(self.par_inc) + len(self.par_diff)
+        sv = [self.order_states[x] for x in self.par_sv]
+        inc = [self.order_states[x] for x in self.par_inc]
+        diff = [self.order_states[x] for x in self.par_diff]
+
+        def is_null(ind):
+            return jac['caches'][ind] == '0'
+
+        ##non null columns of every row of Ft
+        Ft = [[] for x in range(m)]
+
+        for s, row in enumerate(jac['jac']):
+            Ft[sv[s]] += [sv[i] for i, ind in enumerate(row) if not is_null(ind)]
+
+        for o, row in enumerate(jac['jac_obs']):
+            Ft[inc[o]] += [sv[i] for i, ind in enumerate(row) if not is_null(ind)]
+
+        for s, row in enumerate(jac['jac_diff']):
+            Ft[sv[s]] += [diff[i] for i, x in enumerate(row) if not is_null(x['value'])]
+
+        for o, row in enumerate(jac['jac_obs_diff']):
+            Ft[inc[o]] += [diff[i] for i, x in enumerate(row) if not is_null(x['value'])]
+
+        ##non null terms of the upper triangle of Q (union of the noises_off versions)
+        Q_ij = set()
+        for tpl in Q.values():
+            for x in tpl['Q_proc']:
+                Q_ij.add((sv[x['i']], sv[x['j']]))
+
+            for x in tpl['Q_inc']:
+                i = inc[x['i']['ind']] if x['i']['is_inc'] else sv[x['i']['ind']]
+                j = inc[x['j']['ind']] if x['j']['is_inc'] else sv[x['j']['ind']]
+                Q_ij.add((i, j))
+
+            for x in tpl['Q_sde']:
+                Q_ij.add((diff[x['i']], diff[x['j']]))
+
+        ##k is the index in the packed upper triangle of Ct (see ssm_kalman_Ct_index())
+        Q_packed = []
+        for i, j in sorted(set([(min(x), max(x)) for x in Q_ij])):
+            Q_packed.append({'i': i, 'j': j, 'k': i*m - (i*(i-1))/2 + (j-i)})
+
+        return {'Ft': [{'i': i, 'cols': sorted(cols)} for i, cols in enumerate(Ft)],
+                'Q': Q_packed}
+
+
     def Ht(self):
         """compute jacobian matrix of the mean of the obs process (assumed to be Gaussian) using Sympy"""
 
@@ -1014,17 +1332,23 @@ class Ccoder(Cmodel):
                 for i  in range(len(tpl['Q_cm'])):
                     for j in range(i+1):
                         if tpl['Q_cm'][i][j]:
+                            term = self.make_C_term(tpl['Q_cm'][i][j], True)
+                            if term == '0': ##terms can cancel out (e.g. flows in and out of the same compartment)
+                                continue
+
                             if i< N_PAR_SV and j < N_PAR_SV:
-                                tpl['Q_proc'].append({'i': i, 'j': j, 'term': self.make_C_term(tpl['Q_cm'][i][j], True)})
+                                tpl['Q_proc'].append({'i': i, 'j': j, 'term': term})
                             else:
                                 tpl['Q_inc'].append({'i': {'is_inc': False, 'ind': i} if i < N_PAR_SV else {'is_inc': True, 'ind': i - N_PAR_SV},
                                                      'j': {'is_inc': False, 'ind': j} if j < N_PAR_SV else {'is_inc': True, 'ind': j - N_PAR_SV},
-                                                     'term': self.make_C_term(tpl['Q_cm'][i][j], True)})
+                                                     'term': term})
             if sde:
                 for i in range(len(Q_sde)):
                     for j in range(i+1):
                         if Q_sde[i][j]:
-                            tpl['Q_sde'].append({'i': i, 'j': j, 'term': self.make_C_term(Q_sde[i][j], True)})
+                            term = self.make_C_term(Q_sde[i][j], True)
+                            if term != '0':
+                                tpl['Q_sde'].append({'i': i, 'j': j, 'term': term})
 
 
         ##cache special functions
@@ -0,0 +1,139 @@
+#include "clar.h"
+#include <ssm.h>
+
+/**
+ * is the block [data, data + size) zeroed?
+ */
+static int _is_zero(const char *data, size_t size)
+{
+    size_t i;
+    for(i=0; i<size; i++){
+        if(data[i]){
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+void test_alloc__arena(void)
+{
+    size_t size_ptr[] = {0, 8, 24, 64, 100};
+    size_t size_data[] = {0, 8, 1000};
+    int i, j;
+    char *data;
+
+    for(i=0; i<5; i++){
+        for(j=0; j<3; j++){
+            char *block = ssm_arena_new(size_ptr[i], size_data[j], (void **) &data);
+
+            cl_assert(((uintptr_t) block) % SSM_ALLOC_ALIGN == 0);
+            cl_assert(((uintptr_t) data) % SSM_ALLOC_ALIGN == 0);
+
+            //the values follow the row pointers, with less than SSM_ALLOC_ALIGN bytes of padding
+            cl_assert(data >= block + size_ptr[i]);
+            cl_assert(data < block + size_ptr[i] + SSM_ALLOC_ALIGN);
+
+            cl_assert(_is_zero(block, (data - block) + size_data[j]));
+
+            ssm_arena_free(block);
+        }
+    }
+}
+
+void test_alloc__arena_huge(void)
+{
+    char *data;
+    size_t size = SSM_ALLOC_HUGE + 100;
+    char *block = ssm_arena_new(16, size, (void **) &data);
+
+    cl_assert(((uintptr_t) block) % SSM_ALLOC_HUGE == 0);
+    cl_assert(((uintptr_t) data) % SSM_ALLOC_ALIGN == 0);
+    cl_assert(_is_zero(data, size));
+
+    data[size-1] = 1;
+    ssm_arena_free(block);
+}
+
+void test_alloc__arena_reuse(void)
+{
+    int k;
+    char *data;
+    size_t size = 4096;
+
+    //a block given back and allocated again (likely at the same address) is zeroed again
+    for(k=0; k<3; k++){
+        char *block = ssm_arena_new(64, size, (void **) &data);
+        cl_assert(_is_zero(block, 64 + size));
+        memset(block, 0xff, 64 + size);
+        ssm_arena_free(block);
+    }
+}
+
+void test_alloc__arena_exhausted(void)
+{
+    int status;
+    char *data;
+
+    //an impossible allocation terminates the process with EXIT_FAILURE
+    fflush(NULL);
+    pid_t pid = fork();
+    cl_assert(pid != -1);
+    if(pid == 0){
+        ssm_arena_new(64, SIZE_MAX/2, (void **) &data);
+        _exit(EXIT_SUCCESS);
+    }
+
+    cl_assert(waitpid(pid, &status, 0) == pid);
+    cl_assert(WIFEXITED(status));
+    cl_assert_equal_i(WEXITSTATUS(status), EXIT_FAILURE);
+}
+
+void test_alloc__d2(void)
+{
+    int i, j;
+    int n = 5, p = 7;
+    double **tab = ssm_d2_new(n, p);
+
+    //a single block: the rows are views on contiguous (aligned) values
+    cl_assert(((uintptr_t) tab[0]) % SSM_ALLOC_ALIGN == 0);
+    for(i=0; i<n; i++){
+        cl_assert(tab[i] == tab[0] + i*p);
+        for(j=0; j<p; j++){
+            cl_assert(tab[i][j] == 0.0);
+            tab[i][j] = i*p + j;
+        }
+    }
+
+    for(i=0; i<n*p; i++){
+        cl_assert(tab[0][i] == i);
+    }
+
+    ssm_d2_free(tab, n);
+}
+
+void test_alloc__d3_var(void)
+{
+    int i, j, k;
+    int n = 3;
+    unsigned int p1[] = {2, 0, 3};
+    unsigned int p2_0[] = {4, 1}, p2_2[] = {0, 2, 5};
+    unsigned int *p2[] = {p2_0, NULL, p2_2};
+    double ***tab = ssm_d3_var_new(n, p1, p2);
+    double *next = tab[0][0];
+
+    //ragged rows, still contiguous in the order of the indices
+    cl_assert(((uintptr_t) next) % SSM_ALLOC_ALIGN == 0);
+    for(i=0; i<n; i++){
+        for(j=0; j<p1[i]; j++){
+            cl_assert(tab[i][j] == next);
+            for(k=0; k<p2[i][j]; k++){
+                cl_assert(tab[i][j][k] == 0.0);
+                tab[i][j][k] = 1.0;
+            }
+            next += p2[i][j];
+        }
+    }
+
+    ssm_d3_var_free(tab, n, p1);
+}
@@ -0,0 +1,88 @@
+/**
+ * Micro-benchmark of the Euler multinomial draws of the psr
+ * implementation: ssm_ran_multinomial() against the sequential
+ * gsl_ran_binomial() version it replaces, for typical compartment
+ * sizes and exit probabilities.
+ *
+ * make bench
+ */
+
+#include <time.h>
+#include <ssm.h>
+
+#define N_DRAWS 2000000
+
+static void gsl_multinomial(const gsl_rng * r, const size_t K, unsigned int N, const double p[], unsigned int n[])
+{
+    size_t k;
+    double sum_p = 0.0;
+
+    unsigned int sum_n = 0;
+
+    for (k = 0; k < K; k++) {
+        if (p[k] > 0.0) {
+            n[k] = gsl_ran_binomial (r, p[k] / (1.0 - sum_p), N - sum_n);
+        }
+        else {
+            n[k] = 0;
+        }
+
+        sum_p += p[k];
+        sum_n += n[k];
+    }
+}
+
+static double elapsed(struct timespec *start)
+{
+    struct timespec end;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    return (end.tv_sec - start->tv_sec) + 1e-9*(end.tv_nsec - start->tv_nsec);
+}
+
+int main(void)
+{
+    unsigned int N[] = {0, 10, 1000, 100000, 10000000};
+    double rate[] = {1e-5, 1e-3, 0.1}; //sum of the exit rates * dt
+    int i, j, k;
+    unsigned int n[3];
+    unsigned long check = 0;
+
+    gsl_rng *r = gsl_rng_alloc(gsl_rng_mt19937);
+
+    printf("%10s %8s %12s %12s %8s\n", "N", "rate*dt", "gsl (ns)", "ssm (ns)", "speedup");
+
+    for(i=0; i<5; i++){
+        for(j=0; j<3; j++){
+            double p[3];
+            double one_minus_exp_sum = 1.0 - exp(-rate[j]);
+            p[0] = one_minus_exp_sum*0.7;
+            p[1] = one_minus_exp_sum*0.3;
+            p[2] = 1.0 - p[0] - p[1];
+
+            struct timespec start;
+            double t_gsl, t_ssm;
+
+            gsl_rng_set(r, 1);
+            clock_gettime(CLOCK_MONOTONIC, &start);
+            for(k=0; k<N_DRAWS; k++){
+                gsl_multinomial(r, 3, N[i], p, n);
+                check += n[0];
+            }
+            t_gsl = elapsed(&start);
+
+            gsl_rng_set(r, 1);
+            clock_gettime(CLOCK_MONOTONIC, &start);
+            for(k=0; k<N_DRAWS; k++){
+                ssm_ran_multinomial(r, 3, N[i], p, n);
+                check += n[0];
+            }
+            t_ssm = elapsed(&start);
+
+            printf("%10u %8g %12.1f %12.1f %8.2f\n", N[i], rate[j], 1e9*t_gsl/N_DRAWS, 1e9*t_ssm/N_DRAWS, t_gsl/t_ssm);
+        }
+    }
+
+    gsl_rng_free(r);
+
+    return (check == 0); //keep the draws
+}
@@ -0,0 +1,151 @@
+/**
+ * Benchmark of the hybrid implementation against the psr one it
+ * derives from (exact binomial and Poisson draws).
+ *
+ * The first table times the samplers: ssm_ran_multinomial_hybrid()
+ * against ssm_ran_multinomial() and ssm_ran_poisson_hybrid() against
+ * gsl_ran_poisson(), around the SSM_HYBRID_VAR threshold where the
+ * hybrid draws switch to their normal approximation.
+ *
+ * The second table integrates the fixture model of the test suite
+ * (1e6 inhabitants per city) with the psr and hybrid predictors and
+ * reports the cost per step and the mean and standard deviation of
+ * the infected in nyc at the 4th data point, which should agree.
+ *
+ * make bench
+ */
+
+#include <time.h>
+#include <ssm.h>
+#include "fixture.h"
+
+#define N_DRAWS 1000000
+#define N_FIXTURE_PATHS 500
+
+static double elapsed(struct timespec *start)
+{
+    struct timespec end;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    return (end.tv_sec - start->tv_sec) + 1e-9*(end.tv_nsec - start->tv_nsec);
+}
+
+/**
+ * fixture_load() without clar
+ */
+const char *cl_fixture(const char *fixture_name)
+{
+    static char path[1024];
+    snprintf(path, sizeof (path), "%s%s", CLAR_FIXTURE_PATH, fixture_name);
+    return path;
+}
+
+int main(void)
+{
+    unsigned int N[] = {10, 100, 1000, 100000, 10000000};
+    double mu[] = {1.0, 10.0, 25.0, 1000.0, 100000.0};
+    double rate = 0.1; //sum of the exit rates * dt
+    ssm_implementations_t implementation[] = {SSM_PSR, SSM_HYBRID};
+    const char *name[] = {"psr", "hybrid"};
+    double t_psr = 0.0;
+    int i, k;
+    unsigned int n[3];
+    unsigned long check = 0;
+    fixture_t fx;
+
+    gsl_rng *r = gsl_rng_alloc(gsl_rng_mt19937);
+
+    double p[3];
+    double one_minus_exp_sum = 1.0 - exp(-rate);
+    p[0] = one_minus_exp_sum*0.7;
+    p[1] = one_minus_exp_sum*0.3;
+    p[2] = 1.0 - p[0] - p[1];
+
+    printf("%12s %10s %12s %12s %8s\n", "multinomial", "N", "exact (ns)", "hybrid (ns)", "speedup");
+    for(i=0; i<5; i++){
+        struct timespec start;
+        double t_exact, t_hybrid;
+
+        gsl_rng_set(r, 1);
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for(k=0; k<N_DRAWS; k++){
+            ssm_ran_multinomial(r, 3, N[i], p, n);
+            check += n[0];
+        }
+        t_exact = elapsed(&start);
+
+        gsl_rng_set(r, 1);
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for(k=0; k<N_DRAWS; k++){
+            ssm_ran_multinomial_hybrid(r, 3, N[i], p, n);
+            check += n[0];
+        }
+        t_hybrid = elapsed(&start);
+
+        printf("%12s %10u %12.1f %12.1f %8.2f\n", "", N[i], 1e9*t_exact/N_DRAWS, 1e9*t_hybrid/N_DRAWS, t_exact/t_hybrid);
+    }
+
+    printf("\n%12s %10s %12s %12s %8s\n", "poisson", "mu", "exact (ns)", "hybrid (ns)", "speedup");
+    for(i=0; i<5; i++){
+        struct timespec start;
+        double t_exact, t_hybrid;
+
+        gsl_rng_set(r, 1);
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for(k=0; k<N_DRAWS; k++){
+            check += gsl_ran_poisson(r, mu[i]);
+        }
+        t_exact = elapsed(&start);
+
+        gsl_rng_set(r, 1);
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for(k=0; k<N_DRAWS; k++){
+            check += ssm_ran_poisson_hybrid(r, mu[i]);
+        }
+        t_hybrid = elapsed(&start);
+
+        printf("%12s %10g %12.1f %12.1f %8.2f\n", "", mu[i], 1e9*t_exact/N_DRAWS, 1e9*t_hybrid/N_DRAWS, t_exact/t_hybrid);
+    }
+
+    gsl_rng_free(r);
+
+    //the psr and hybrid predictors on the fixture model, from the initial conditions to the 4th data point
+    fixture_load(&fx);
+
+    printf("\n%12s %12s %8s %12s %12s\n", "predictor", "step (ns)", "speedup", "mean I_nyc", "sd I_nyc");
+    for(i=0; i<2; i++){
+        fx.opts->implementation = implementation[i];
+        fixture_new(&fx);
+
+        ssm_f_pred_t f_pred = ssm_get_f_pred(fx.nav);
+        double t1 = fx.data->rows[3]->time;
+        double dt = 0.25;
+        int o = fixture_offset(fx.nav->states_sv, "I_nyc");
+        double sum = 0.0, sum2 = 0.0;
+        struct timespec start;
+
+        gsl_rng_set(fx.calc->randgsl, 1);
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for(k=0; k<N_FIXTURE_PATHS; k++){
+            ssm_par2X(fx.X, fx.par, fx.calc, fx.nav);
+            fx.X->dt = dt;
+            if((*f_pred)(fx.X, 0.0, t1, fx.par, fx.nav, fx.calc) != SSM_SUCCESS){
+                fprintf(stderr, "%s failed\n", name[i]);
+            }
+            sum += fx.X->proj[o];
+            sum2 += fx.X->proj[o]*fx.X->proj[o];
+        }
+        double t_step = 1e9*elapsed(&start)/(N_FIXTURE_PATHS*ceil(t1/dt));
+        if(i == 0){
+            t_psr = t_step;
+        }
+
+        double mean = sum/N_FIXTURE_PATHS;
+        printf("%12s %12.1f %8.2f %12.1f %12.1f\n", name[i], t_step, t_psr/t_step, mean, sqrt((sum2 - N_FIXTURE_PATHS*mean*mean)/(N_FIXTURE_PATHS - 1)));
+
+        fixture_free(&fx);
+    }
+
+    fixture_unload(&fx);
+
+    return (check == 0); //keep the draws
+}
@@ -0,0 +1,181 @@
+/**
+ * Convergence benchmark of the integration schemes of the sde
+ * implementation (--scheme): strong error at T = 1 of Euler
+ * Maruyama, Milstein and the order 1.5 stochastic Runge Kutta
+ * scheme against the exact solution of a geometric Brownian motion
+ * dX = mu X dt + sigma X dW (the generated models have no closed
+ * form solution), and cost of the steps.
+ *
+ * The steps of the first table are the formulas of
+ * ssm_f_prediction_sde_full(), ssm_f_prediction_sde_milstein() and
+ * ssm_f_prediction_sde_srk15() written for a(x) = mu x and
+ * b(x) = sigma x. The errors should decrease with dt as dt^0.5, dt
+ * and dt^1.5.
+ *
+ * The second table times the real predictors (as returned by
+ * ssm_get_f_pred() for each --scheme) on the fixture model of the
+ * test suite (white noise on the infection in nyc) at the same dt.
+ *
+ * make bench
+ */
+
+#include <time.h>
+#include <ssm.h>
+#include "fixture.h"
+
+#define N_PATHS 20000
+#define N_FIXTURE_PATHS 200
+
+#define MU 1.5
+#define SIGMA 1.0
+
+typedef double (*step_t)(double x, double dt, double dW, double dZ);
+
+static double a(double x)
+{
+    return MU*x;
+}
+
+static double b(double x)
+{
+    return SIGMA*x;
+}
+
+static double euler(double x, double dt, double dW, double dZ)
+{
+    return x + a(x)*dt + b(x)*dW;
+}
+
+static double milstein(double x, double dt, double dW, double dZ)
+{
+    //L^1 b = b b'
+    return x + a(x)*dt + b(x)*dW + 0.5*b(x)*SIGMA*(dW*dW - dt);
+}
+
+static double srk15(double x, double dt, double dW, double dZ)
+{
+    double sqrt_dt = sqrt(dt);
+    double y_p = x + a(x)*dt + b(x)*sqrt_dt;
+    double y_m = x + a(x)*dt - b(x)*sqrt_dt;
+    double p_p = y_p + b(y_p)*sqrt_dt;
+    double p_m = y_p - b(y_p)*sqrt_dt;
+
+    return x + b(x)*dW
+        + (a(y_p) - a(y_m))*dZ/(2.0*sqrt_dt)
+        + 0.25*(a(y_p) + 2.0*a(x) + a(y_m))*dt
+        + (b(y_p) - b(y_m))*(dW*dW - dt)/(4.0*sqrt_dt)
+        + (b(y_p) - 2.0*b(x) + b(y_m))*(dW*dt - dZ)/(2.0*dt)
+        + (b(p_p) - b(p_m) - b(y_p) + b(y_m))*(dW*dW/3.0 - dt)*dW/(4.0*dt);
+}
+
+static double elapsed(struct timespec *start)
+{
+    struct timespec end;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    return (end.tv_sec - start->tv_sec) + 1e-9*(end.tv_nsec - start->tv_nsec);
+}
+
+/**
+ * fixture_load() without clar
+ */
+const char *cl_fixture(const char *fixture_name)
+{
+    static char path[1024];
+    snprintf(path, sizeof (path), "%s%s", CLAR_FIXTURE_PATH, fixture_name);
+    return path;
+}
+
+int main(void)
+{
+    step_t step[] = {&euler, &milstein, &srk15};
+    const char *name[] = {"euler", "milstein", "srk15"};
+    int n_steps[] = {4, 8, 16, 32, 64, 128, 256};
+    ssm_schemes_t scheme[] = {SSM_EULER, SSM_MILSTEIN, SSM_SRK15};
+    int i, j, k, n;
+    fixture_t fx;
+
+    gsl_rng *r = gsl_rng_alloc(gsl_rng_mt19937);
+
+    printf("%10s %8s %12s %8s %12s\n", "scheme", "1/dt", "error", "order", "step (ns)");
+
+    for(i=0; i<3; i++){
+        double err_prev = 0.0;
+
+        for(j=0; j<7; j++){
+            double dt = 1.0/n_steps[j];
+            double sqrt_dt = sqrt(dt);
+            double err = 0.0;
+            struct timespec start;
+
+            gsl_rng_set(r, 1);
+            clock_gettime(CLOCK_MONOTONIC, &start);
+            for(k=0; k<N_PATHS; k++){
+                double x = 1.0;
+                double W = 0.0;
+                for(n=0; n<n_steps[j]; n++){
+                    //the same Brownian increments and integrals of W for all the schemes
+                    double dW = sqrt_dt*gsl_ran_ugaussian(r);
+                    double dZ = 0.5*dt*(dW + sqrt_dt*gsl_ran_ugaussian(r)/M_SQRT3);
+                    x = (*step[i])(x, dt, dW, dZ);
+                    W += dW;
+                }
+                err += fabs(x - exp((MU - 0.5*SIGMA*SIGMA) + SIGMA*W));
+            }
+            double t_step = elapsed(&start);
+            err /= N_PATHS;
+
+            if(j){
+                printf("%10s %8d %12.3e %8.2f %12.1f\n", name[i], n_steps[j], err, log(err_prev/err)/log(2.0), 1e9*t_step/(N_PATHS*n_steps[j]));
+            } else {
+                printf("%10s %8d %12.3e %8s %12.1f\n", name[i], n_steps[j], err, "", 1e9*t_step/(N_PATHS*n_steps[j]));
+            }
+            err_prev = err;
+        }
+    }
+
+    gsl_rng_free(r);
+
+    //the real predictors on the fixture model, from the initial conditions to the 4th data point
+    fixture_load(&fx);
+    fx.opts->implementation = SSM_SDE;
+    fx.opts->noises_off = SSM_NO_DEM_STO | SSM_NO_DIFF; //a single noise, as required by srk15
+
+    printf("\n%10s %8s %12s %8s\n", "predictor", "1/dt", "step (ns)", "/euler");
+
+    double t_euler[7];
+    for(i=0; i<3; i++){
+        fx.opts->scheme = scheme[i];
+        fixture_new(&fx);
+        fixture_set_par(fx.par, fx.nav, "sto", 0.5);
+        fixture_set_par(fx.par, fx.nav, "I_nyc", 1000.0);
+
+        ssm_f_pred_t f_pred = ssm_get_f_pred(fx.nav);
+        double t1 = fx.data->rows[3]->time;
+
+        for(j=0; j<7; j++){
+            double dt = 1.0/n_steps[j];
+            struct timespec start;
+
+            clock_gettime(CLOCK_MONOTONIC, &start);
+            for(k=0; k<N_FIXTURE_PATHS; k++){
+                ssm_par2X(fx.X, fx.par, fx.calc, fx.nav);
+                fx.X->dt = dt;
+                if((*f_pred)(fx.X, 0.0, t1, fx.par, fx.nav, fx.calc) != SSM_SUCCESS){
+                    fprintf(stderr, "%s failed at 1/dt = %d\n", name[i], n_steps[j]);
+                }
+            }
+            double t_step = 1e9*elapsed(&start)/(N_FIXTURE_PATHS*ceil(t1/dt));
+            if(i == 0){
+                t_euler[j] = t_step;
+            }
+
+            printf("%10s %8d %12.1f %8.2f\n", name[i], n_steps[j], t_step, t_step/t_euler[j]);
+        }
+
+        fixture_free(&fx);
+    }
+
+    fixture_unload(&fx);
+
+    return 0;
+}
@@ -0,0 +1,118 @@
+#include "clar.h"
+#include <ssm.h>
+
+static gsl_rng *randgsl;
+
+void test_binomial__initialize(void)
+{
+    randgsl = gsl_rng_alloc(gsl_rng_mt19937);
+    gsl_rng_set(randgsl, 2);
+}
+
+void test_binomial__cleanup(void)
+{
+    gsl_rng_free(randgsl);
+}
+
+void test_binomial__limits(void)
+{
+    cl_assert_equal_i(ssm_ran_binomial(randgsl, 0.3, 0), 0);
+    cl_assert_equal_i(ssm_ran_binomial(randgsl, 0.0, 100), 0);
+    cl_assert_equal_i(ssm_ran_binomial(randgsl, -1e-17, 100), 0);
+    cl_assert_equal_i(ssm_ran_binomial(randgsl, 1.0, 100), 100);
+    cl_assert_equal_i(ssm_ran_binomial(randgsl, 1.0 + 1e-16, 100), 100);
+}
+
+void test_binomial__moments(void)
+{
+    //inversion (small mean) and BTPE regimes, on both sides of p = 0.5
+    double p[] = {1e-4, 0.01, 0.3, 0.7, 0.999};
+    unsigned int n[] = {1, 5, 40, 1000, 100000};
+    int M = 20000;
+    int i, j, k;
+
+    for(i=0; i<5; i++){
+        for(j=0; j<5; j++){
+            double mean = 0.0, var = 0.0;
+            for(k=0; k<M; k++){
+                double x = ssm_ran_binomial(randgsl, p[i], n[j]);
+                cl_assert(x <= n[j]);
+                mean += x;
+                var += x*x;
+            }
+            mean /= M;
+            var = var/M - mean*mean;
+
+            double sd = sqrt(n[j]*p[i]*(1.0-p[i]));
+            cl_assert_(fabs(mean - n[j]*p[i]) < 5.0*sd/sqrt(M) + 1e-12, "binomial mean");
+            cl_assert_(fabs(var - sd*sd) < 0.1*sd*sd + 1e-3, "binomial variance");
+        }
+    }
+}
+
+void test_binomial__multinomial(void)
+{
+    double p[4] = {0.2, 0.0, 0.1, 0.7};
+    unsigned int n[4];
+    double sum[4] = {0.0, 0.0, 0.0, 0.0};
+    int M = 20000;
+    int k, i;
+
+    for(k=0; k<M; k++){
+        ssm_ran_multinomial(randgsl, 4, 50, p, n);
+        cl_assert_equal_i(n[0] + n[1] + n[2] + n[3], 50);
+        cl_assert_equal_i(n[1], 0);
+        for(i=0; i<4; i++){
+            sum[i] += n[i];
+        }
+    }
+
+    for(i=0; i<4; i++){
+        cl_assert_(fabs(sum[i]/M - 50*p[i]) < 0.05, "multinomial mean");
+    }
+
+    //empty compartment
+    ssm_ran_multinomial(randgsl, 4, 0, p, n);
+    for(i=0; i<4; i++){
+        cl_assert_equal_i(n[i], 0);
+    }
+}
+
+void test_binomial__multinomial_hybrid(void)
+{
+    //exits of a large compartment (normal approximation) and a rare one (exact draw)
+    double p[4] = {0.2, 1e-6, 0.1, 0.7};
+    unsigned int N = 1000000;
+    unsigned int n[4];
+    double sum[4] = {0.0, 0.0, 0.0, 0.0};
+    double sum2 = 0.0;
+    int M = 20000;
+    int k, i;
+
+    for(k=0; k<M; k++){
+        ssm_ran_multinomial_hybrid(randgsl, 4, N, p, n);
+        cl_assert_equal_i(n[0] + n[1] + n[2] + n[3], N);
+        for(i=0; i<4; i++){
+            sum[i] += n[i];
+        }
+        sum2 += (double) n[0] * n[0];
+    }
+
+    for(i=0; i<4; i++){
+        double sd = sqrt(N*p[i]*(1.0-p[i]));
+        cl_assert_(fabs(sum[i]/M - N*p[i]) < 5.0*sd/sqrt(M), "hybrid multinomial mean");
+    }
+    double var = sum2/M - (sum[0]/M)*(sum[0]/M);
+    cl_assert_(fabs(var - N*p[0]*(1.0-p[0])) < 0.1*N*p[0]*(1.0-p[0]), "hybrid multinomial variance");
+
+    //small compartment: exact draws
+    ssm_ran_multinomial_hybrid(randgsl, 4, 3, p, n);
+    cl_assert_equal_i(n[0] + n[1] + n[2] + n[3], 3);
+
+    //Poisson
+    double mean = 0.0;
+    for(k=0; k<M; k++){
+        mean += ssm_ran_poisson_hybrid(randgsl, 1000.0);
+    }
+    cl_assert_(fabs(mean/M - 1000.0) < 5.0*sqrt(1000.0/M), "hybrid poisson mean");
+}
@@ -1,5 +1,5 @@
 #include "clar.h"
-#include <ssm.h>
+#include "fixture.h"
 
 static json_t *jparameters;
 static json_t *jdata;
@@ -68,3 +68,74 @@ void test_calc__covariates(void)
         cl_check(gsl_spline_eval(calc->spline[9], data->rows[3]->time, calc->acc[9]) == 1.0);
     }
 }
+
+void test_calc__ode_batch(void)
+{
+    int b, k, n;
+    double t0, t1, dt_min;
+    int B = SSM_ODE_BATCH;
+    ssm_X_t *X[SSM_ODE_BATCH], *J_X[SSM_ODE_BATCH];
+    ssm_par_t *J_par[SSM_ODE_BATCH];
+    ssm_err_code_t status[SSM_ODE_BATCH];
+
+    //ode implementation with a tight tolerance so that the shared step size of the lanes doesn't matter
+    ssm_calc_free(calc, nav);
+    ssm_fitness_free(fitness);
+    ssm_data_free(data);
+    ssm_nav_free(nav);
+    opts->implementation = SSM_ODE;
+    opts->noises_off = SSM_NO_DEM_STO | SSM_NO_WHITE_NOISE | SSM_NO_DIFF;
+    opts->eps_abs = 1e-10;
+    opts->eps_rel = 1e-10;
+    nav = ssm_nav_new(jparameters, opts);
+    data = ssm_data_new(jdata, nav, opts);
+    fitness = ssm_fitness_new(data, opts);
+    calc = ssm_calc_new(jdata, nav, data, fitness, opts, 0);
+    cl_assert(calc->_batch != NULL);
+
+    ssm_input_t *input = ssm_input_new(jparameters, nav);
+    int m = nav->states_sv_inc->length + nav->states_diff->length;
+
+    //a different recovery rate in each lane
+    for(b=0; b<B; b++){
+        J_par[b] = ssm_par_new(input, calc, nav);
+        fixture_set_par(J_par[b], nav, "v", fixture_get_par(J_par[b], nav, "v") * (1.0 + 0.05*b));
+        X[b] = ssm_X_new(nav, opts);
+        J_X[b] = ssm_X_new(nav, opts);
+        ssm_par2X(X[b], J_par[b], calc, nav);
+        ssm_X_copy(J_X[b], X[b]);
+    }
+
+    //a few rows, the step size being propagated from one to the next
+    for(n=0; n<4; n++){
+        t0 = (n) ? data->rows[n-1]->time: 0;
+        t1 = data->rows[n]->time;
+
+        dt_min = GSL_POSINF;
+        for(b=0; b<B; b++){
+            ssm_X_reset_inc(X[b], data->rows[n], nav);
+            ssm_X_reset_inc(J_X[b], data->rows[n], nav);
+            cl_assert(ssm_f_prediction_ode(X[b], t0, t1, J_par[b], nav, calc) == SSM_SUCCESS);
+            dt_min = GSL_MIN(dt_min, X[b]->dt);
+            status[b] = SSM_SUCCESS;
+        }
+
+        ssm_f_prediction_ode_batch(J_X, J_par, B, t0, t1, nav, calc, status);
+
+        for(b=0; b<B; b++){
+            cl_assert(status[b] == SSM_SUCCESS);
+            for(k=0; k<m; k++){
+                cl_assert(fabs(J_X[b]->proj[k] - X[b]->proj[k]) < 1e-6*(1.0 + fabs(X[b]->proj[k])));
+            }
+            //the shortened final step doesn't shrink the step size of the next row
+            cl_assert(J_X[b]->dt > 0.2*dt_min);
+        }
+    }
+
+    for(b=0; b<B; b++){
+        ssm_X_free(J_X[b]);
+        ssm_X_free(X[b]);
+        ssm_par_free(J_par[b]);
+    }
+    ssm_input_free(input);
+}
@@ -0,0 +1,85 @@
+#include "clar.h"
+#include "fixture.h"
+
+/**
+ * load the parameters and the data of the fixture, the options are
+ * the default ones
+ */
+void fixture_load(fixture_t *fx)
+{
+    fx->jparameters = ssm_load_json_file(cl_fixture("package.json"));
+    fx->jdata = ssm_load_json_file(cl_fixture(".data.json"));
+    fx->opts = ssm_options_new();
+}
+
+void fixture_unload(fixture_t *fx)
+{
+    ssm_options_free(fx->opts);
+    json_decref(fx->jdata);
+    json_decref(fx->jparameters);
+}
+
+/**
+ * build the model with fx->opts
+ */
+void fixture_new(fixture_t *fx)
+{
+    fx->nav = ssm_nav_new(fx->jparameters, fx->opts);
+    fx->data = ssm_data_new(fx->jdata, fx->nav, fx->opts);
+    fx->fitness = ssm_fitness_new(fx->data, fx->opts);
+    fx->calc = ssm_calc_new(fx->jdata, fx->nav, fx->data, fx->fitness, fx->opts, 0);
+    fx->input = ssm_input_new(fx->jparameters, fx->nav);
+    fx->par = ssm_par_new(fx->input, fx->calc, fx->nav);
+    fx->X = ssm_X_new(fx->nav, fx->opts);
+}
+
+void fixture_free(fixture_t *fx)
+{
+    ssm_X_free(fx->X);
+    ssm_par_free(fx->par);
+    ssm_input_free(fx->input);
+    ssm_calc_free(fx->calc, fx->nav);
+    ssm_fitness_free(fx->fitness);
+    ssm_data_free(fx->data);
+    ssm_nav_free(fx->nav);
+}
+
+/**
+ * set the parameter name (natural scale) in par
+ */
+void fixture_set_par(ssm_par_t *par, ssm_nav_t *nav, const char *name, double value)
+{
+    int i;
+    for(i=0; i<nav->par_all->length; i++){
+        if(strcmp(nav->par_all->p[i]->name, name) == 0){
+            gsl_vector_set(par, nav->par_all->p[i]->offset, value);
+        }
+    }
+}
+
+double fixture_get_par(ssm_par_t *par, ssm_nav_t *nav, const char *name)
+{
+    int i;
+    for(i=0; i<nav->par_all->length; i++){
+        if(strcmp(nav->par_all->p[i]->name, name) == 0){
+            return gsl_vector_get(par, nav->par_all->p[i]->offset);
+        }
+    }
+
+    return GSL_NAN;
+}
+
+/**
+ * offset of the state name of it (-1 if none)
+ */
+int fixture_offset(ssm_it_states_t *it, const char *name)
+{
+    int i;
+    for(i=0; i<it->length; i++){
+        if(strcmp(it->p[i]->name, name) == 0){
+            return it->p[i]->offset;
+        }
+    }
+
+    return -1;
+}
@@ -0,0 +1,34 @@
+#ifndef SSM_TEST_FIXTURE_H
+#define SSM_TEST_FIXTURE_H
+
+#include <ssm.h>
+
+/**
+ * model of the fixture (examples/foo) built with opts. The suites
+ * changing the options call fixture_free() and fixture_new() again.
+ */
+typedef struct
+{
+    json_t *jparameters;
+    json_t *jdata;
+    ssm_options_t *opts;
+
+    ssm_nav_t *nav;
+    ssm_data_t *data;
+    ssm_fitness_t *fitness;
+    ssm_calc_t *calc;
+    ssm_input_t *input;
+    ssm_par_t *par;
+    ssm_X_t *X;
+} fixture_t;
+
+void fixture_load(fixture_t *fx);
+void fixture_unload(fixture_t *fx);
+void fixture_new(fixture_t *fx);
+void fixture_free(fixture_t *fx);
+
+void fixture_set_par(ssm_par_t *par, ssm_nav_t *nav, const char *name, double value);
+double fixture_get_par(ssm_par_t *par, ssm_nav_t *nav, const char *name);
+int fixture_offset(ssm_it_states_t *it, const char *name);
+
+#endif
@@ -0,0 +1,65 @@
+#include "clar.h"
+#include "fixture.h"
+
+static fixture_t fx;
+
+void test_gillespie__initialize(void)
+{
+    fixture_load(&fx);
+    fx.opts->implementation = SSM_GILLESPIE;
+    fx.opts->noises_off = SSM_NO_WHITE_NOISE | SSM_NO_DIFF;
+    fixture_new(&fx);
+}
+
+void test_gillespie__cleanup(void)
+{
+    fixture_free(&fx);
+    fixture_unload(&fx);
+}
+
+void test_gillespie__death(void)
+{
+    int k;
+    int M = 4000;
+    double I0 = 1000.0;
+    double v = 1.0/11.0, mu_d = 0.00027;
+    double t1 = fx.data->rows[0]->time;
+    double p = exp(-(v + mu_d)*t1);
+    double x, I0_nyc, sum = 0.0, sum2 = 0.0, mean, var;
+
+    int o_I_paris = fixture_offset(fx.nav->states_sv, "I_paris");
+    int o_I_nyc = fixture_offset(fx.nav->states_sv, "I_nyc");
+    int o_Inc_out = fixture_offset(fx.nav->states_inc, "Inc_out");
+    int o_Inc_in_nyc = fixture_offset(fx.nav->states_inc, "Inc_in_nyc");
+    ssm_f_pred_t f_pred = ssm_get_f_pred(fx.nav);
+
+    cl_assert(o_I_paris >= 0 && o_I_nyc >= 0 && o_Inc_out >= 0 && o_Inc_in_nyc >= 0);
+    cl_assert(f_pred == &ssm_f_prediction_gillespie_no_diff);
+
+    //no transmission: the infectious die (recovery and death) independently at rate v + mu_d
+    fixture_set_par(fx.par, fx.nav, "r0_paris", 0.0);
+    fixture_set_par(fx.par, fx.nav, "r0_nyc", 0.0);
+    fixture_set_par(fx.par, fx.nav, "I_paris", I0);
+
+    for(k=0; k<M; k++){
+        ssm_par2X(fx.X, fx.par, fx.calc, fx.nav);
+        I0_nyc = fx.X->proj[o_I_nyc];
+        fx.X->dt = 0.3; //t1 is not a multiple of dt
+
+        cl_assert(ssm_f_prediction_gillespie_no_diff(fx.X, 0.0, t1, fx.par, fx.nav, fx.calc) == SSM_SUCCESS);
+
+        //every firing is tracked: the exits of the infectious compartments are the incidence
+        cl_assert(fx.X->proj[o_Inc_out] == (I0 - fx.X->proj[o_I_paris]) + (I0_nyc - fx.X->proj[o_I_nyc]));
+        cl_assert(fx.X->proj[o_Inc_in_nyc] == 0.0);
+
+        x = fx.X->proj[o_I_paris];
+        sum += x;
+        sum2 += x*x;
+    }
+
+    //I_paris(t1) ~ Binomial(I0, exp(-(v + mu_d) t1))
+    mean = sum/M;
+    var = (sum2 - M*mean*mean)/(M - 1);
+    cl_assert_(fabs(mean - I0*p) < 4.0*sqrt(I0*p*(1.0-p)/M), "the mean of the survivors is not the one of the binomial law");
+    cl_assert_(fabs(var/(I0*p*(1.0-p)) - 1.0) < 0.15, "the variance of the survivors is not the one of the binomial law");
+}
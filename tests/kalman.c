@@ -0,0 +1,321 @@
+#include "clar.h"
+#include "fixture.h"
+
+static fixture_t fx;
+
+static int n_steady; //number of updates done with the frozen Kt and Ct
+static int n_steady_exits; //number of rows that took the filter out of the steady state
+static int steady_exit_row; //last of these rows
+
+/**
+ * run the filter on all the data (as in main_kalman.c) and return the
+ * log likelihood. With flag_var0, the initial variance of the state
+ * variables is their initial value (instead of 0.0). With
+ * flag_mean_data, the data are replaced by the predicted observations
+ * (the states then follow the deterministic skeleton).
+ */
+static double _kalman_run(int flag_var0, int flag_mean_data)
+{
+    int i, n, offset, was_steady;
+    double t0, t1;
+    ssm_err_code_t cum_status = SSM_SUCCESS;
+    ssm_f_pred_t f_pred = ssm_get_f_pred(fx.nav);
+    int m = fx.nav->states_sv_inc->length + fx.nav->states_diff->length;
+
+    fx.fitness->log_like = 0.0;
+    ssm_par2X(fx.X, fx.par, fx.calc, fx.nav);
+    ssm_kalman_reset_Ct(fx.X, fx.nav);
+    if(flag_var0){
+        for(i=0; i<fx.nav->states_sv->length; i++){
+            offset = fx.nav->states_sv->p[i]->offset;
+            fx.X->proj[m + ssm_kalman_Ct_index(m, offset, offset)] = fx.X->proj[offset];
+        }
+    }
+    ssm_kalman_steady_reset(fx.calc);
+    n_steady = 0;
+    n_steady_exits = 0;
+    steady_exit_row = -1;
+
+    for(n=0; n<fx.data->n_obs; n++){
+        t0 = (n) ? fx.data->rows[n-1]->time: 0;
+        ssm_X_reset_inc(fx.X, fx.data->rows[n], fx.nav);
+
+        n = ssm_row_span_end(fx.data, n, fx.nav, fx.calc);
+        t1 = fx.data->rows[n]->time;
+
+        was_steady = fx.calc->is_steady;
+        ssm_kalman_steady_check(fx.data->rows[n], t0, t1, fx.calc);
+        if(was_steady && !fx.calc->is_steady){
+            n_steady_exits++;
+            steady_exit_row = n;
+        }
+
+        cum_status |= (*f_pred)(fx.X, t0, t1, fx.par, fx.nav, fx.calc);
+
+        if(fx.data->rows[n]->ts_nonan_length){
+            if(flag_mean_data){
+                for(i=0; i<fx.data->rows[n]->ts_nonan_length; i++){
+                    fx.data->rows[n]->values[i] = fx.data->rows[n]->observed[i]->f_obs_mean(fx.X, fx.par, fx.calc, t1);
+                }
+            }
+            n_steady += fx.calc->is_steady;
+            cum_status |= ssm_kalman_update(fx.fitness, fx.X, fx.data->rows[n], t1, fx.par, fx.calc, fx.nav);
+        }
+    }
+
+    cl_assert(cum_status == SSM_SUCCESS);
+
+    return fx.fitness->log_like;
+}
+
+void test_kalman__initialize(void)
+{
+    fixture_load(&fx);
+    fx.opts->implementation = SSM_EKF;
+    fixture_new(&fx);
+}
+
+void test_kalman__cleanup(void)
+{
+    fixture_free(&fx);
+    fixture_unload(&fx);
+}
+
+void test_kalman__Ct_packed(void)
+{
+    int i, j;
+    double cov[3][3] = {{2.0, 0.3, 0.1}, {0.3, 1.0, -0.2}, {0.1, -0.2, 0.5}};
+    double Ct[6];
+    gsl_matrix *var = gsl_matrix_alloc(3, 3);
+    gsl_matrix *unpacked = gsl_matrix_alloc(3, 3);
+
+    for(i=0; i<3; i++){
+        for(j=0; j<3; j++){
+            gsl_matrix_set(var, i, j, cov[i][j]);
+        }
+    }
+
+    ssm_kalman_Ct_pack(Ct, var);
+    for(i=0; i<3; i++){
+        for(j=0; j<3; j++){
+            cl_check(ssm_kalman_Ct_get(Ct, 3, i, j) == gsl_matrix_get(var, i, j));
+        }
+    }
+
+    ssm_kalman_Ct_unpack(unpacked, Ct);
+    cl_check(gsl_matrix_equal(unpacked, var));
+
+    gsl_matrix_free(unpacked);
+    gsl_matrix_free(var);
+}
+
+void test_kalman__Ct_packed_update(void)
+{
+    int i, j;
+    int m = fx.nav->states_sv_inc->length + fx.nav->states_diff->length;
+    ssm_row_t *row = fx.data->rows[0];
+    ssm_f_pred_t f_pred = ssm_get_f_pred(fx.nav);
+
+    ssm_par2X(fx.X, fx.par, fx.calc, fx.nav);
+    ssm_kalman_reset_Ct(fx.X, fx.nav);
+    ssm_X_reset_inc(fx.X, row, fx.nav);
+    cl_assert((*f_pred)(fx.X, 0, row->time, fx.par, fx.nav, fx.calc) == SSM_SUCCESS);
+
+    //the predicted Ct is read from X and the updated one written back (packed)
+    cl_assert(ssm_kalman_update(fx.fitness, fx.X, row, row->time, fx.par, fx.calc, fx.nav) == SSM_SUCCESS);
+    for(i=0; i<m; i++){
+        for(j=0; j<m; j++){
+            cl_check(ssm_kalman_Ct_get(&fx.X->proj[m], m, i, j) == gsl_matrix_get(fx.calc->_Ct, i, j));
+        }
+    }
+}
+
+void test_kalman__sqrt(void)
+{
+    double log_like, log_like_sqrt;
+
+    log_like = _kalman_run(0, 0);
+    cl_assert(gsl_finite(log_like));
+
+    //the square-root update is algebraically the same as the sequential one
+    fixture_free(&fx);
+    fx.opts->flag_sqrt = 1;
+    fixture_new(&fx);
+    cl_assert(fx.calc->flag_sqrt);
+
+    log_like_sqrt = _kalman_run(0, 0);
+    cl_assert_(fabs(log_like_sqrt - log_like) < 1e-6*fabs(log_like), "--sqrt and the sequential update give different log likelihoods");
+}
+
+void test_kalman__ukf(void)
+{
+    double log_like_ekf, log_like_ukf;
+
+    //no transmission: the model is linear in the states and there is
+    //no process noise (the white noise is on the transmission), the
+    //EKF and the UKF are then both exact
+    fixture_free(&fx);
+    fx.opts->noises_off = SSM_NO_DEM_STO | SSM_NO_DIFF;
+    fx.opts->eps_abs = 1e-10;
+    fx.opts->eps_rel = 1e-10;
+    fx.opts->eps_cov = 1.0;
+    fixture_new(&fx);
+    fixture_set_par(fx.par, fx.nav, "r0_paris", 1e-6);
+    fixture_set_par(fx.par, fx.nav, "r0_nyc", 1e-6);
+
+    log_like_ekf = _kalman_run(1, 0);
+    cl_assert(gsl_finite(log_like_ekf));
+
+    fixture_free(&fx);
+    fx.opts->implementation = SSM_UKF;
+    fixture_new(&fx);
+    fixture_set_par(fx.par, fx.nav, "r0_paris", 1e-6);
+    fixture_set_par(fx.par, fx.nav, "r0_nyc", 1e-6);
+
+    log_like_ukf = _kalman_run(1, 0);
+    cl_assert_(fabs(log_like_ukf - log_like_ekf) < 1e-6*fabs(log_like_ekf), "the UKF and the EKF give different log likelihoods on a linear model");
+}
+
+void test_kalman__sequential_update(void)
+{
+    int i, j;
+    int m = fx.nav->states_sv_inc->length + fx.nav->states_diff->length;
+    ssm_row_t *row = fx.data->rows[0];
+    int p = row->ts_nonan_length;
+    double t = row->time;
+    double log_like, quad, norm_Ct = 0.0;
+    ssm_f_pred_t f_pred = ssm_get_f_pred(fx.nav);
+    ssm_X_t *X_joint = ssm_X_new(fx.nav, fx.opts);
+
+    gsl_matrix *Ct = gsl_matrix_alloc(m, m);
+    gsl_matrix *Ht = gsl_matrix_alloc(m, p);
+    gsl_matrix *CtHt = gsl_matrix_alloc(m, p);
+    gsl_matrix *St = gsl_matrix_alloc(p, p);
+    gsl_matrix *Kt = gsl_matrix_alloc(m, p);
+    gsl_vector *e = gsl_vector_alloc(p);
+    gsl_vector *Se = gsl_vector_alloc(p);
+    gsl_vector_view x = gsl_vector_view_array(X_joint->proj, m);
+
+    cl_assert(p > 1);
+
+    ssm_par2X(fx.X, fx.par, fx.calc, fx.nav);
+    ssm_kalman_reset_Ct(fx.X, fx.nav);
+    ssm_X_reset_inc(fx.X, row, fx.nav);
+    cl_assert((*f_pred)(fx.X, 0, t, fx.par, fx.nav, fx.calc) == SSM_SUCCESS);
+    ssm_X_copy(X_joint, fx.X);
+
+    //joint update of all the observations: St = Ht' Ct Ht + Rt, Kt = Ct Ht St^-1
+    ssm_kalman_Ct_unpack(Ct, &X_joint->proj[m]);
+    ssm_eval_Ht(X_joint, row, t, fx.par, fx.nav, fx.calc);
+    _ssm_kalman_eval_Rt(row, t, X_joint, fx.par, fx.calc, fx.nav);
+    for(i=0; i<p; i++){
+        gsl_vector_set(e, i, row->values[i] - row->observed[i]->f_obs_mean(X_joint, fx.par, fx.calc, t));
+        for(j=0; j<m; j++){
+            gsl_matrix_set(Ht, j, i, gsl_matrix_get(fx.calc->_Ht, j, i));
+        }
+        for(j=0; j<p; j++){
+            gsl_matrix_set(St, i, j, gsl_matrix_get(fx.calc->_Rt, i, j));
+        }
+    }
+    gsl_blas_dgemm(CblasNoTrans, CblasNoTrans, 1.0, Ct, Ht, 0.0, CtHt);
+    gsl_blas_dgemm(CblasTrans, CblasNoTrans, 1.0, Ht, CtHt, 1.0, St);
+
+    cl_assert(gsl_linalg_cholesky_decomp(St) == GSL_SUCCESS);
+    log_like = -0.5*p*log(2*M_PI);
+    for(i=0; i<p; i++){
+        log_like -= log(gsl_matrix_get(St, i, i));
+    }
+    gsl_linalg_cholesky_invert(St);
+    gsl_blas_dgemv(CblasNoTrans, 1.0, St, e, 0.0, Se);
+    gsl_blas_ddot(e, Se, &quad);
+    log_like -= 0.5*quad;
+
+    gsl_blas_dgemm(CblasNoTrans, CblasNoTrans, 1.0, CtHt, St, 0.0, Kt);
+    gsl_blas_dgemv(CblasNoTrans, 1.0, Kt, e, 1.0, &x.vector);
+    gsl_blas_dgemm(CblasNoTrans, CblasTrans, -1.0, Kt, CtHt, 1.0, Ct);
+
+    //sequential update
+    fx.fitness->log_like = 0.0;
+    cl_assert(ssm_kalman_update(fx.fitness, fx.X, row, t, fx.par, fx.calc, fx.nav) == SSM_SUCCESS);
+
+    cl_assert_(fabs(fx.fitness->log_like - log_like) < 1e-8*fabs(log_like), "the sequential and the joint updates give different log likelihoods");
+    for(i=0; i<m; i++){
+        cl_assert(fabs(fx.X->proj[i] - X_joint->proj[i]) < 1e-8*(1.0 + fabs(X_joint->proj[i])));
+        for(j=0; j<m; j++){
+            norm_Ct = GSL_MAX(norm_Ct, fabs(gsl_matrix_get(Ct, i, j)));
+        }
+    }
+    for(i=0; i<m; i++){
+        for(j=0; j<m; j++){
+            cl_assert(fabs(ssm_kalman_Ct_get(&fx.X->proj[m], m, i, j) - gsl_matrix_get(Ct, i, j)) < 1e-8*norm_Ct);
+        }
+    }
+
+    gsl_vector_free(Se);
+    gsl_vector_free(e);
+    gsl_matrix_free(Kt);
+    gsl_matrix_free(St);
+    gsl_matrix_free(CtHt);
+    gsl_matrix_free(Ht);
+    gsl_matrix_free(Ct);
+    ssm_X_free(X_joint);
+}
+
+/**
+ * time invariant setting for --steady: no diffusions, frozen
+ * covariates (they are constant: N = 1e6, mu_b = mu_d = 0.00027) and
+ * states at the endemic equilibrium (data at the predicted
+ * observations). r0 is large so that the equilibrium is quickly
+ * reached by Kt and Ct.
+ */
+static void _kalman_steady_new(double steady_tol)
+{
+    double N = 1e6, mu = 0.00027, v = 1.0/11.0, r0 = 1000.0;
+    double S = N*(v + mu)/(r0*v);
+    double I = mu*(N - S)/(v + mu);
+
+    fixture_free(&fx);
+    fx.opts->noises_off = SSM_NO_DIFF;
+    fx.opts->eps_abs = 1e-8;
+    fx.opts->eps_rel = 1e-8;
+    fx.opts->eps_cov = 1.0;
+    fx.opts->steady_tol = steady_tol;
+    strncpy(fx.opts->freeze_forcing, "2012-07-26", SSM_STR_BUFFSIZE);
+    fixture_new(&fx);
+
+    fixture_set_par(fx.par, fx.nav, "r0_paris", r0);
+    fixture_set_par(fx.par, fx.nav, "r0_nyc", r0);
+    fixture_set_par(fx.par, fx.nav, "S_paris", S);
+    fixture_set_par(fx.par, fx.nav, "S_nyc", S);
+    fixture_set_par(fx.par, fx.nav, "I_paris", I);
+    fixture_set_par(fx.par, fx.nav, "I_nyc", I);
+}
+
+void test_kalman__steady(void)
+{
+    double log_like, log_like_steady;
+
+    _kalman_steady_new(0.0);
+    cl_assert(fx.calc->steady_tol == 0.0);
+    log_like = _kalman_run(0, 1);
+    cl_assert(gsl_finite(log_like));
+    cl_assert_equal_i(n_steady, 0);
+
+    _kalman_steady_new(1e-4);
+    cl_assert(fx.calc->steady_tol == 1e-4);
+    log_like_steady = _kalman_run(0, 1);
+    cl_assert(n_steady > 0);
+    cl_assert_(fabs(log_like_steady - log_like) < 1e-5*fabs(log_like), "--steady changes the log likelihood");
+}
+
+void test_kalman__steady_missing_data(void)
+{
+    _kalman_steady_new(1e-4);
+    _kalman_run(0, 1);
+
+    //the regular series is interrupted by rows with missing data: the filter leaves the steady state
+    cl_assert(n_steady > 0);
+    cl_assert(n_steady_exits > 0);
+    cl_assert(fx.data->rows[steady_exit_row]->ts_nonan_length > 0);
+    cl_assert(fx.data->rows[steady_exit_row]->ts_nonan_length < fx.nav->observed_length);
+}
@@ -0,0 +1,76 @@
+#include "clar.h"
+#include <ssm.h>
+
+static json_t *jparameters;
+static json_t *jdata;
+static ssm_nav_t *nav;
+static ssm_options_t *opts;
+
+void test_manifest__initialize(void)
+{
+    jparameters = ssm_load_json_file(cl_fixture("package.json"));
+    jdata = ssm_load_json_file(cl_fixture(".data.json"));
+    opts = ssm_options_new();
+    nav = ssm_nav_new(jparameters, opts);
+}
+
+void test_manifest__cleanup(void)
+{
+    json_decref(jdata);
+    json_decref(jparameters);
+    ssm_options_free(opts);
+    ssm_nav_free(nav);
+}
+
+void test_manifest__hash(void)
+{
+    ssm_manifest_t *manifest = ssm_manifest_new(jdata, nav, opts);
+    ssm_manifest_t *manifest2 = ssm_manifest_new(jdata, nav, opts);
+
+    cl_assert_equal_i(strlen(manifest->hash), SSM_HASH_BUFFSIZE-1);
+    cl_assert_equal_s(manifest->hash, manifest2->hash);
+    ssm_manifest_free(manifest2);
+
+    //the hash of the options depends on dt
+    opts->dt /= 2.0;
+    manifest2 = ssm_manifest_new(jdata, nav, opts);
+    cl_assert_equal_s(manifest->model, manifest2->model);
+    cl_assert_equal_s(manifest->data, manifest2->data);
+    cl_assert(strcmp(manifest->options, manifest2->options) != 0);
+    cl_assert(strcmp(manifest->hash, manifest2->hash) != 0);
+
+    ssm_manifest_free(manifest);
+    ssm_manifest_free(manifest2);
+}
+
+void test_manifest__dumps_loads(void)
+{
+    ssm_manifest_t *manifest = ssm_manifest_new(jdata, nav, opts);
+    char *str = ssm_manifest_dumps(manifest);
+    ssm_manifest_t *manifest2 = ssm_manifest_loads(str);
+
+    cl_assert_equal_s(manifest->model, manifest2->model);
+    cl_assert_equal_s(manifest->data, manifest2->data);
+    cl_assert_equal_s(manifest->options, manifest2->options);
+    cl_assert_equal_s(manifest->hash, manifest2->hash);
+    cl_assert_equal_s(manifest->interpolator, manifest2->interpolator);
+    cl_assert_equal_s(manifest->stepper, manifest2->stepper);
+    cl_check(manifest2->dt == opts->dt);
+    cl_check(manifest2->eps_abs == opts->eps_abs);
+    cl_check(manifest2->eps_rel == opts->eps_rel);
+    cl_check(manifest2->adapt_dt == opts->adapt_dt);
+    cl_check(manifest2->scheme == opts->scheme);
+    cl_check(manifest2->noises_off == opts->noises_off);
+    cl_check(manifest2->implementation == opts->implementation);
+
+    free(str);
+    ssm_manifest_free(manifest);
+    ssm_manifest_free(manifest2);
+}
+
+void test_manifest__loads_invalid(void)
+{
+    cl_assert(ssm_manifest_loads(NULL) == NULL);
+    cl_assert(ssm_manifest_loads("not a manifest") == NULL);
+    cl_assert(ssm_manifest_loads("{\"model\": \"0\"}") == NULL);
+}
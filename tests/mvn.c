@@ -0,0 +1,63 @@
+#include "clar.h"
+#include <ssm.h>
+
+static gsl_matrix *var;
+static gsl_vector *x;
+static gsl_vector *mean;
+static ssm_proposal_t *proposal;
+
+void test_mvn__initialize(void)
+{
+    int i, j;
+    double cov[3][3] = {{2.0, 0.3, 0.1}, {0.3, 1.0, -0.2}, {0.1, -0.2, 0.5}};
+
+    var = gsl_matrix_alloc(3, 3);
+    for(i=0; i<3; i++){
+        for(j=0; j<3; j++){
+            gsl_matrix_set(var, i, j, cov[i][j]);
+        }
+    }
+
+    x = gsl_vector_alloc(3);
+    mean = gsl_vector_alloc(3);
+    for(i=0; i<3; i++){
+        gsl_vector_set(x, i, 0.5*i - 0.2);
+        gsl_vector_set(mean, i, 0.1*i);
+    }
+
+    proposal = ssm_proposal_new(3);
+    ssm_proposal_set(proposal, var);
+}
+
+void test_mvn__cleanup(void)
+{
+    ssm_proposal_free(proposal);
+    gsl_vector_free(mean);
+    gsl_vector_free(x);
+    gsl_matrix_free(var);
+}
+
+void test_mvn__log_dmvnorm(void)
+{
+    double sd_fac;
+
+    for(sd_fac = 0.5; sd_fac < 3.0; sd_fac += 1.0){
+        cl_assert_(fabs(ssm_proposal_log_dmvnorm(proposal, x, mean, sd_fac) - log(ssm_dmvnorm(3, x, mean, var, sd_fac))) < 1e-12, "log density differs from ssm_dmvnorm");
+    }
+}
+
+void test_mvn__refactorize(void)
+{
+    double log_det = proposal->log_det;
+
+    //same covariance: the factor is reused
+    ssm_proposal_set(proposal, var);
+    cl_assert(proposal->log_det == log_det);
+
+    //modified in place: the factor is recomputed once marked as dirty
+    gsl_matrix_scale(var, 2.0);
+    proposal->is_dirty = 1;
+    ssm_proposal_set(proposal, var);
+    cl_assert(fabs(proposal->log_det - (log_det + 3*log(2.0))) < 1e-12);
+    cl_assert(fabs(ssm_proposal_log_dmvnorm(proposal, x, mean, 1.0) - log(ssm_dmvnorm(3, x, mean, var, 1.0))) < 1e-12);
+}
@@ -0,0 +1,77 @@
+#include "clar.h"
+#include <ssm.h>
+
+static json_t *jparameters;
+static json_t *jdata;
+static ssm_nav_t *nav;
+static ssm_options_t *opts;
+static ssm_data_t *data;
+static ssm_fitness_t *fitness;
+static ssm_calc_t *calc;
+static ssm_input_t *input;
+static ssm_theta_t *theta;
+static ssm_var_t *var;
+static ssm_proposal_t *proposal;
+static ssm_prefetch_t *prefetch;
+
+void test_prefetch__initialize(void)
+{
+    jparameters = ssm_load_json_file(cl_fixture("package.json"));
+    jdata = ssm_load_json_file(cl_fixture(".data.json"));
+    opts = ssm_options_new();
+    nav = ssm_nav_new(jparameters, opts);
+    data = ssm_data_new(jdata, nav, opts);
+    fitness = ssm_fitness_new(data, opts);
+    calc = ssm_calc_new(jdata, nav, data, fitness, opts, 0);
+    input = ssm_input_new(jparameters, nav);
+    theta = ssm_theta_new(input, nav);
+    var = ssm_var_new(jparameters, nav);
+    proposal = ssm_proposal_new(nav->theta_all->length);
+    ssm_proposal_set(proposal, var);
+    prefetch = ssm_prefetch_new(4, input, calc, data, nav, opts);
+}
+
+void test_prefetch__cleanup(void)
+{
+    ssm_prefetch_free(prefetch, data);
+    ssm_proposal_free(proposal);
+    ssm_var_free(var);
+    ssm_theta_free(theta);
+    ssm_input_free(input);
+    ssm_calc_free(calc, nav);
+    json_decref(jdata);
+    json_decref(jparameters);
+    ssm_options_free(opts);
+    ssm_nav_free(nav);
+    ssm_data_free(data);
+    ssm_fitness_free(fitness);
+}
+
+void test_prefetch__low_acceptance(void)
+{
+    int k;
+
+    ssm_prefetch_tree(prefetch, theta, var, proposal, 1.0, 0.2, input, calc, nav);
+    cl_assert_equal_i(prefetch->n_nodes, 4);
+
+    //a chain of rejections: every node is proposed from theta
+    for(k=0; k<3; k++){
+        cl_assert_equal_i(prefetch->child[k][0], k+1);
+        cl_assert_equal_i(prefetch->child[k][1], -1);
+        cl_assert(prefetch->base[k+1] == theta);
+    }
+    cl_assert_equal_i(prefetch->parent[0], -1);
+    cl_assert(prefetch->prob[3] < prefetch->prob[2]);
+}
+
+void test_prefetch__balanced_acceptance(void)
+{
+    ssm_prefetch_tree(prefetch, theta, var, proposal, 1.0, 0.5, input, calc, nav);
+
+    //both children of the root before any grandchild
+    cl_assert_equal_i(prefetch->child[0][0], 1);
+    cl_assert_equal_i(prefetch->child[0][1], 2);
+    cl_assert(prefetch->base[1] == theta);
+    cl_assert(prefetch->base[2] == prefetch->proposed[0]);
+    cl_assert_equal_i(prefetch->parent[3], 1);
+}
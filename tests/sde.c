@@ -0,0 +1,218 @@
+#include "clar.h"
+#include "fixture.h"
+
+static fixture_t fx;
+
+/**
+ * integrate M paths from the initial conditions to t1 with f_pred and
+ * a time step dt and return the mean and the variance of the states
+ * of offsets o[n]
+ */
+static void _sde_moments(ssm_f_pred_t f_pred, double dt, double t1, int M, const int *o, int n, double *mean, double *var)
+{
+    int i, k;
+    double sum2[n];
+
+    for(i=0; i<n; i++){
+        mean[i] = 0.0;
+        sum2[i] = 0.0;
+    }
+
+    for(k=0; k<M; k++){
+        ssm_par2X(fx.X, fx.par, fx.calc, fx.nav);
+        fx.X->dt = dt;
+        cl_assert((*f_pred)(fx.X, 0.0, t1, fx.par, fx.nav, fx.calc) == SSM_SUCCESS);
+        for(i=0; i<n; i++){
+            mean[i] += fx.X->proj[o[i]];
+            sum2[i] += fx.X->proj[o[i]]*fx.X->proj[o[i]];
+        }
+    }
+
+    for(i=0; i<n; i++){
+        mean[i] /= M;
+        var[i] = (sum2[i] - M*mean[i]*mean[i])/(M - 1);
+    }
+}
+
+void test_sde__initialize(void)
+{
+    fixture_load(&fx);
+    fx.opts->implementation = SSM_SDE;
+    fx.opts->noises_off = SSM_NO_DIFF;
+    fx.opts->scheme = SSM_MILSTEIN;
+    fixture_new(&fx);
+}
+
+void test_sde__cleanup(void)
+{
+    fixture_free(&fx);
+    fixture_unload(&fx);
+}
+
+void test_sde__drift_diffusion(void)
+{
+    int i, j, o;
+    int n_X = fx.nav->states_sv_inc->length + fx.nav->states_diff->length;
+    int n_dw = ssm_sde_dw_length();
+    double dt = 0.01, h = 0.1;
+    double a[n_X], g[n_X*n_dw], X0[n_X], dw[n_dw], expected;
+    double *dw_calc = fx.calc->_dw;
+
+    ssm_par2X(fx.X, fx.par, fx.calc, fx.nav);
+    memcpy(X0, fx.X->proj, n_X * sizeof (double));
+    ssm_sde_drift_diffusion(X0, 0.0, a, g, fx.par, fx.nav, fx.calc);
+
+    //the diffusions are stepped by ssm_compute_diff(): null rows
+    for(i=0; i<fx.nav->states_diff->length; i++){
+        o = fx.nav->states_diff->p[i]->offset;
+        cl_assert(a[o] == 0.0);
+        for(j=0; j<n_dw; j++){
+            cl_assert(g[o*n_dw + j] == 0.0);
+        }
+    }
+
+    //the Euler Maruyama step with the Brownian increments dw (one column at a time, none for j = -1) is X0 + a dt + g dw
+    for(j=-1; j<n_dw; j++){
+        memset(dw, 0, n_dw * sizeof (double));
+        if(j >= 0){
+            dw[j] = h;
+        }
+
+        memcpy(fx.X->proj, X0, n_X * sizeof (double));
+        fx.X->dt = dt;
+        fx.calc->_dw = dw;
+        ssm_step_sde_full(fx.X, 0.0, fx.par, fx.nav, fx.calc);
+        fx.calc->_dw = dw_calc;
+
+        for(i=0; i<fx.nav->states_sv_inc->length; i++){
+            o = fx.nav->states_sv_inc->p[i]->offset;
+            expected = X0[o] + a[o]*dt + ((j >= 0) ? g[o*n_dw + j]*h : 0.0);
+            cl_assert_(fabs(fx.X->proj[o] - expected) < 1e-9*(1.0 + fabs(X0[o])), fx.nav->states_sv_inc->p[i]->name);
+        }
+    }
+}
+
+void test_sde__milstein_correction(void)
+{
+    int i, j, l, o;
+    int n_X = fx.nav->states_sv_inc->length + fx.nav->states_diff->length;
+    int n_dw = ssm_sde_dw_length();
+    double eps = 1e-3;
+    double a[n_X], g[n_X*n_dw], g_p[n_X*n_dw], g_m[n_X*n_dw];
+    double X0[n_X], X_p[n_X], X_m[n_X], dd[n_dw*n_dw], m[n_X], Lg;
+
+    ssm_par2X(fx.X, fx.par, fx.calc, fx.nav);
+    memcpy(X0, fx.X->proj, n_X * sizeof (double));
+    ssm_sde_drift_diffusion(X0, 0.0, a, g, fx.par, fx.nav, fx.calc);
+
+    //0.5 L^j g_{x,l} (coefficient of dd[j][l]) against central differences of g along the column j
+    for(j=0; j<n_dw; j++){
+        memcpy(X_p, X0, n_X * sizeof (double));
+        memcpy(X_m, X0, n_X * sizeof (double));
+        for(i=0; i<fx.nav->states_sv->length; i++){
+            o = fx.nav->states_sv->p[i]->offset;
+            X_p[o] += eps*g[o*n_dw + j];
+            X_m[o] -= eps*g[o*n_dw + j];
+        }
+        ssm_sde_drift_diffusion(X_p, 0.0, a, g_p, fx.par, fx.nav, fx.calc);
+        ssm_sde_drift_diffusion(X_m, 0.0, a, g_m, fx.par, fx.nav, fx.calc);
+
+        for(l=0; l<n_dw; l++){
+            memset(dd, 0, n_dw*n_dw * sizeof (double));
+            dd[j*n_dw + l] = 1.0;
+            ssm_sde_milstein(X0, 0.0, dd, m, fx.par, fx.nav, fx.calc);
+
+            for(i=0; i<fx.nav->states_sv_inc->length; i++){
+                o = fx.nav->states_sv_inc->p[i]->offset;
+                Lg = (g_p[o*n_dw + l] - g_m[o*n_dw + l])/(2.0*eps);
+                cl_assert_(fabs(m[o] - 0.5*Lg) < 1e-6*(1.0 + fabs(Lg)), fx.nav->states_sv_inc->p[i]->name);
+            }
+        }
+    }
+}
+
+void test_sde__skeleton(void)
+{
+    int i;
+    int n_X = fx.nav->states_sv_inc->length + fx.nav->states_diff->length;
+    double t1 = fx.data->rows[3]->time;
+    double x_ref[n_X], x_euler[n_X], err_euler, err_srk15;
+    ssm_it_states_t *states_sv_inc;
+
+    //without noise (sto = 0 and no demographic stochasticity) Milstein is Euler and srk15 is Heun (order 2)
+    fixture_free(&fx);
+    fx.opts->noises_off = SSM_NO_DEM_STO | SSM_NO_DIFF;
+    fx.opts->scheme = SSM_SRK15;
+    fixture_new(&fx);
+    fixture_set_par(fx.par, fx.nav, "sto", 0.0);
+    fixture_set_par(fx.par, fx.nav, "I_nyc", 1000.0);
+    states_sv_inc = fx.nav->states_sv_inc;
+
+    cl_assert(ssm_get_f_pred(fx.nav) == &ssm_f_prediction_sde_srk15);
+
+    ssm_par2X(fx.X, fx.par, fx.calc, fx.nav);
+    fx.X->dt = 1.0/1024.0;
+    cl_assert(ssm_f_prediction_sde_no_dem_sto_no_diff(fx.X, 0.0, t1, fx.par, fx.nav, fx.calc) == SSM_SUCCESS);
+    memcpy(x_ref, fx.X->proj, n_X * sizeof (double));
+
+    ssm_par2X(fx.X, fx.par, fx.calc, fx.nav);
+    fx.X->dt = 0.25;
+    cl_assert(ssm_f_prediction_sde_no_dem_sto_no_diff(fx.X, 0.0, t1, fx.par, fx.nav, fx.calc) == SSM_SUCCESS);
+    memcpy(x_euler, fx.X->proj, n_X * sizeof (double));
+
+    ssm_par2X(fx.X, fx.par, fx.calc, fx.nav);
+    fx.X->dt = 0.25;
+    cl_assert(ssm_f_prediction_sde_milstein(fx.X, 0.0, t1, fx.par, fx.nav, fx.calc) == SSM_SUCCESS);
+    for(i=0; i<states_sv_inc->length; i++){
+        int o = states_sv_inc->p[i]->offset;
+        cl_assert_(fabs(fx.X->proj[o] - x_euler[o]) < 1e-9*(1.0 + fabs(x_euler[o])), states_sv_inc->p[i]->name);
+    }
+
+    ssm_par2X(fx.X, fx.par, fx.calc, fx.nav);
+    fx.X->dt = 0.25;
+    cl_assert(ssm_f_prediction_sde_srk15(fx.X, 0.0, t1, fx.par, fx.nav, fx.calc) == SSM_SUCCESS);
+    for(i=0; i<states_sv_inc->length; i++){
+        int o = states_sv_inc->p[i]->offset;
+        err_euler = fabs(x_euler[o] - x_ref[o]);
+        err_srk15 = fabs(fx.X->proj[o] - x_ref[o]);
+        cl_assert_(err_srk15 <= GSL_MAX(err_euler/10.0, 1e-6*(1.0 + fabs(x_ref[o]))), states_sv_inc->p[i]->name);
+    }
+}
+
+void test_sde__weak(void)
+{
+    int i, s;
+    int M = 2000;
+    double t1 = fx.data->rows[3]->time;
+    double mean_ref[3], var_ref[3], mean[3], var[3];
+    const char *name[] = {"S_nyc", "I_nyc", "Inc_in_nyc"};
+    int o[3];
+    ssm_f_pred_t f_pred[] = {&ssm_f_prediction_sde_milstein, &ssm_f_prediction_sde_srk15};
+
+    //a single noise (white noise on the infection in nyc), as required by srk15
+    fixture_free(&fx);
+    fx.opts->noises_off = SSM_NO_DEM_STO | SSM_NO_DIFF;
+    fx.opts->scheme = SSM_SRK15;
+    fixture_new(&fx);
+    fixture_set_par(fx.par, fx.nav, "sto", 0.5);
+    fixture_set_par(fx.par, fx.nav, "I_nyc", 1000.0);
+
+    o[0] = fixture_offset(fx.nav->states_sv, "S_nyc");
+    o[1] = fixture_offset(fx.nav->states_sv, "I_nyc");
+    o[2] = fixture_offset(fx.nav->states_inc, "Inc_in_nyc");
+    cl_assert(o[0] >= 0 && o[1] >= 0 && o[2] >= 0);
+
+    //reference: Euler Maruyama with a tiny time step
+    _sde_moments(&ssm_f_prediction_sde_no_dem_sto_no_diff, 1.0/64.0, t1, M, o, 3, mean_ref, var_ref);
+    for(i=0; i<3; i++){
+        cl_assert_(var_ref[i] > 0.0, name[i]);
+    }
+
+    for(s=0; s<2; s++){
+        _sde_moments(f_pred[s], 0.25, t1, M, o, 3, mean, var);
+        for(i=0; i<3; i++){
+            cl_assert_(fabs(mean[i] - mean_ref[i]) < 4.0*sqrt((var[i] + var_ref[i])/M), name[i]);
+            cl_assert_(fabs(var[i]/var_ref[i] - 1.0) < 0.2, name[i]);
+        }
+    }
+}
@@ -0,0 +1,156 @@
+#include "clar.h"
+#include "fixture.h"
+
+/**
+ * As with --shm, the segment is mapped once per process and lives
+ * until the end of it: the suites run after this one allocate their
+ * particles and parameters in it.
+ */
+
+static fixture_t fx;
+
+void test_shm__initialize(void)
+{
+    fixture_load(&fx);
+    fx.opts->flag_shm = 1;
+    fx.opts->n_thread = 2;
+    fx.opts->J = 4;
+    ssm_shm_init(fx.opts);
+}
+
+void test_shm__cleanup(void)
+{
+    fixture_unload(&fx);
+}
+
+void test_shm__malloc(void)
+{
+    cl_assert(ssm_shm_active());
+
+    char *a = ssm_shm_malloc(1);
+    char *b = ssm_shm_malloc(100);
+    char *c = ssm_shm_malloc(SSM_SHM_ALIGN);
+
+    //bump allocation of blocks rounded up to SSM_SHM_ALIGN
+    cl_assert(((uintptr_t) a) % SSM_SHM_ALIGN == 0);
+    cl_assert(b == a + SSM_SHM_ALIGN);
+    cl_assert(c == b + 2*SSM_SHM_ALIGN);
+
+    memset(a, 1, 1);
+    memset(b, 2, 100);
+    memset(c, 3, SSM_SHM_ALIGN);
+    cl_assert(a[0] == 1 && b[99] == 2 && c[0] == 3);
+
+    //freeing is a no-op in the segment: the next block does not reuse b
+    ssm_shm_free(b);
+    char *d = ssm_shm_malloc(8);
+    cl_assert(d == c + SSM_SHM_ALIGN);
+}
+
+void test_shm__forked(void)
+{
+    int status;
+    int *shared = ssm_shm_malloc(sizeof (int));
+    int *private = malloc(sizeof (int));
+
+    *shared = 0;
+    *private = 0;
+
+    //the writes of a forked process are only seen through the segment, where it can no longer allocate
+    fflush(NULL);
+    pid_t pid = fork();
+    cl_assert(pid != -1);
+    if(pid == 0){
+        *shared = 42;
+        *private = 42;
+        ssm_shm_forked();
+        _exit(ssm_shm_active() ? EXIT_FAILURE : EXIT_SUCCESS);
+    }
+
+    cl_assert(waitpid(pid, &status, 0) == pid);
+    cl_assert(WIFEXITED(status));
+    cl_assert_equal_i(WEXITSTATUS(status), EXIT_SUCCESS);
+
+    cl_assert_equal_i(*shared, 42);
+    cl_assert_equal_i(*private, 0);
+    cl_assert(ssm_shm_active());
+
+    ssm_shm_free(shared);
+    ssm_shm_free(private);
+}
+
+void test_shm__exhausted(void)
+{
+    int status;
+
+    fflush(NULL);
+    pid_t pid = fork();
+    cl_assert(pid != -1);
+    if(pid == 0){
+        ssm_shm_malloc(SSM_SHM_SIZE);
+        _exit(EXIT_SUCCESS);
+    }
+
+    cl_assert(waitpid(pid, &status, 0) == pid);
+    cl_assert(WIFEXITED(status));
+    cl_assert_equal_i(WEXITSTATUS(status), EXIT_FAILURE);
+}
+
+void test_shm__workers(void)
+{
+    int i, j;
+    ssm_workers_t *workers;
+
+    //the deterministic skeleton: the forked workers have to give the particles of the sequential integration
+    fx.opts->implementation = SSM_ODE;
+
+    ssm_nav_t *nav = ssm_nav_new(fx.jparameters, fx.opts);
+    ssm_data_t *data = ssm_data_new(fx.jdata, nav, fx.opts);
+    ssm_fitness_t *fitness = ssm_fitness_new(data, fx.opts);
+    ssm_calc_t **calc = ssm_N_calc_new(fx.jdata, nav, data, fitness, fx.opts);
+    ssm_input_t *input = ssm_input_new(fx.jparameters, nav);
+    ssm_par_t *par = ssm_par_new(input, calc[0], nav);
+    ssm_X_t **J_X = ssm_J_X_new(fitness, nav, fx.opts);
+    ssm_X_t **J_X_ref = ssm_J_X_new(fitness, nav, fx.opts);
+    ssm_err_code_t cum_status[fitness->J];
+    ssm_f_pred_t f_pred = ssm_get_f_pred(nav);
+    ssm_row_t *row = data->rows[0];
+
+    cl_assert(calc[0]->threads_length == 2);
+
+    for(j=0; j<fitness->J; j++){
+        ssm_par2X(J_X[j], par, calc[0], nav);
+        ssm_par2X(J_X_ref[j], par, calc[0], nav);
+        fitness->weights[j] = 0.0;
+        fitness->cum_status[j] = SSM_SUCCESS;
+        cum_status[j] = SSM_SUCCESS;
+    }
+
+    workers = ssm_workers_start(fx.jparameters, fx.jdata, &J_X, &par, data, calc, fitness, f_pred, nav, fx.opts, SSM_WORKER_FITNESS);
+    cl_assert(workers->flag_shm);
+    ssm_workers_integrate(workers, 0);
+    ssm_workers_stop(workers);
+
+    ssm_f_prediction_J(J_X_ref, 0, fitness->J, &par, 0, row, 0.0, row->time, f_pred, nav, calc[0], cum_status);
+
+    for(j=0; j<fitness->J; j++){
+        cl_assert(cum_status[j] == SSM_SUCCESS);
+        for(i=0; i<J_X[j]->length; i++){
+            cl_assert(fabs(J_X[j]->proj[i] - J_X_ref[j]->proj[i]) <= 1e-9*(1.0 + fabs(J_X_ref[j]->proj[i])));
+        }
+
+        if(row->ts_nonan_length){
+            double weight = exp(ssm_log_likelihood(row, J_X_ref[j], par, calc[0], nav, fitness));
+            cl_assert(fabs(fitness->weights[j] - weight) <= 1e-9*weight);
+        }
+    }
+
+    ssm_J_X_free(J_X_ref, fitness);
+    ssm_J_X_free(J_X, fitness);
+    ssm_par_free(par);
+    ssm_input_free(input);
+    ssm_N_calc_free(calc, nav);
+    ssm_fitness_free(fitness);
+    ssm_data_free(data);
+    ssm_nav_free(nav);
+}